@@ -1,13 +1,22 @@
 #include "Stretch.h"
+#include "StretchCore.h"
+#include "StretchArena.h"
+#include "StretchResultCache.h"
+#include "AE_EffectSuites.h"
 #include "AE_EffectCBSuites.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <limits>
-#include <vector>
-#include <thread>
+#include <memory>
+#include <mutex>
 #include <cstring>
-#include <atomic>
+#include <new>
+#include <random>
+#include <vector>
 
 // -----------------------------------------------------------------------------
 // UI / boilerplate
@@ -50,21 +59,112 @@ GlobalSetup(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* params[], PF_
     
     out_data->out_flags = PF_OutFlag_DEEP_COLOR_AWARE | 
                           PF_OutFlag_PIX_INDEPENDENT |
-                          PF_OutFlag_I_EXPAND_BUFFER;
+                          PF_OutFlag_I_EXPAND_BUFFER |
+                          PF_OutFlag_SEQUENCE_DATA_NEEDS_FLATTENING;
     
     out_data->out_flags2 = PF_OutFlag2_SUPPORTS_THREADED_RENDERING |
-                           PF_OutFlag2_REVEALS_ZERO_ALPHA;
+                           PF_OutFlag2_REVEALS_ZERO_ALPHA |
+                           PF_OutFlag2_SUPPORTS_SMART_RENDER |
+                           PF_OutFlag2_FLOAT_COLOR_AWARE |
+                           PF_OutFlag2_SUPPORTS_GET_FLATTENED_SEQUENCE_DATA;
     
     return PF_Err_NONE;
 }
 
+// -----------------------------------------------------------------------------
+// Parameter helpers
+// -----------------------------------------------------------------------------
+
+// Downsample factor (den / num) with division by zero protection
+static float DownsampleFactor(const PF_RationalScale& scale)
+{
+    return (scale.num > 0 && scale.den != 0)
+        ? static_cast<float>(scale.den) / static_cast<float>(scale.num)
+        : 1.0f;
+}
+
+// Collects the stretch parameters; the anchor is supplied separately because
+// it must be checked out during render
+static StretchParams GetStretchParams(const PF_InData* in_data, PF_ParamDef* params[], float anchor_x, float anchor_y)
+{
+    StretchParams sp;
+    sp.shift_amount = static_cast<float>(params[STRETCH_SHIFT_AMOUNT]->u.fs_d.value);
+    sp.angle_deg = static_cast<float>(params[STRETCH_ANGLE]->u.ad.value >> 16);
+    sp.anchor_x = anchor_x;
+    sp.anchor_y = anchor_y;
+    sp.direction = params[STRETCH_DIRECTION]->u.pd.value;
+    sp.quality = params[STRETCH_QUALITY]->u.pd.value;
+    sp.draft = in_data->quality == PF_Quality_LO;
+    sp.downsample_x = DownsampleFactor(in_data->downsample_x);
+    sp.downsample_y = DownsampleFactor(in_data->downsample_y);
+    return sp;
+}
+
+// Checks out one parameter at the current time and checks it back in after
+// copying it. SmartFX selectors get no params[] array, so every value has to
+// come through here.
+static PF_Err CheckoutParam(PF_InData* in_data, int index, PF_ParamDef& value)
+{
+    PF_ParamDef param;
+    AEFX_CLR_STRUCT(param);
+
+    PF_Err err = PF_CHECKOUT_PARAM(in_data,
+                                   index,
+                                   in_data->current_time,
+                                   in_data->time_step,
+                                   in_data->time_scale,
+                                   &param);
+    if (err != PF_Err_NONE) {
+        return err;
+    }
+
+    value = param;
+    return PF_CHECKIN_PARAM(in_data, &param);
+}
+
+// SmartFX counterpart of GetStretchParams
+static PF_Err CheckoutStretchParams(PF_InData* in_data, StretchParams& sp)
+{
+    PF_ParamDef shift_amount;
+    PF_ParamDef anchor;
+    PF_ParamDef angle;
+    PF_ParamDef direction;
+    PF_ParamDef quality;
+
+    PF_Err err = CheckoutParam(in_data, STRETCH_SHIFT_AMOUNT, shift_amount);
+    if (err == PF_Err_NONE) {
+        err = CheckoutParam(in_data, STRETCH_ANCHOR_POINT, anchor);
+    }
+    if (err == PF_Err_NONE) {
+        err = CheckoutParam(in_data, STRETCH_ANGLE, angle);
+    }
+    if (err == PF_Err_NONE) {
+        err = CheckoutParam(in_data, STRETCH_DIRECTION, direction);
+    }
+    if (err == PF_Err_NONE) {
+        err = CheckoutParam(in_data, STRETCH_QUALITY, quality);
+    }
+    if (err != PF_Err_NONE) {
+        return err;
+    }
+
+    PF_ParamDef* params[STRETCH_NUM_PARAMS] = {};
+    params[STRETCH_SHIFT_AMOUNT] = &shift_amount;
+    params[STRETCH_ANGLE] = &angle;
+    params[STRETCH_DIRECTION] = &direction;
+    params[STRETCH_QUALITY] = &quality;
+
+    sp = GetStretchParams(in_data, params,
+                          static_cast<float>(anchor.u.td.x_value >> 16),
+                          static_cast<float>(anchor.u.td.y_value >> 16));
+    return PF_Err_NONE;
+}
+
 static PF_Err
 FrameSetup(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* params[], PF_LayerDef* output)
 {
     (void)output;
 
-    PF_Err err = PF_Err_NONE;
-
     // Null pointer checks
     if (!in_data || !params || !params[STRETCH_INPUT]) {
         return PF_Err_BAD_CALLBACK_PARAM;
@@ -79,123 +179,28 @@ FrameSetup(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* params[], PF_L
         return PF_Err_NONE;
     }
 
-    // Get parameters
-    const float shift_amount = static_cast<float>(params[STRETCH_SHIFT_AMOUNT]->u.fs_d.value);
-    float angle_deg = static_cast<float>(params[STRETCH_ANGLE]->u.ad.value >> 16);
-    const int direction = params[STRETCH_DIRECTION]->u.pd.value;
+    // The anchor does not affect the expansion
+    const StretchGeometry geometry = StretchComputeGeometry(GetStretchParams(in_data, params, 0.0f, 0.0f));
 
-    // Downsample adjustment with division by zero protection (check both num > 0 and den != 0)
-    const float downsample_x = (in_data->downsample_x.num > 0 && in_data->downsample_x.den != 0)
-        ? static_cast<float>(in_data->downsample_x.den) / static_cast<float>(in_data->downsample_x.num)
-        : 1.0f;
-    const float downsample_y = (in_data->downsample_y.num > 0 && in_data->downsample_y.den != 0)
-        ? static_cast<float>(in_data->downsample_y.den) / static_cast<float>(in_data->downsample_y.num)
-        : 1.0f;
-    const float downsample = std::min(downsample_x, downsample_y);
-    
-    // Effective shift in pixels
-    float effective_shift = (downsample > 0.0f) ? (shift_amount / downsample) : shift_amount;
-    
     // If no shift, no expansion needed
-    if (std::abs(effective_shift) < 0.01f) {
+    if (!geometry.active) {
         return PF_Err_NONE;
     }
-    
-    // Direction adjustment (Both mode splits the shift)
-    if (direction == 1) { // Both
-        effective_shift *= 0.5f;
-    }
-    
-    // Calculate shift vector from angle
-    const float angle_rad = angle_deg * (static_cast<float>(M_PI) / 180.0f);
-    const float sn = std::sin(angle_rad);
-    const float cs = std::cos(angle_rad);
-    
-    // Perpendicular vector (direction of shift)
-    const float perp_x = -sn;
-    const float perp_y = cs;
-    
-    // Calculate maximum shift vector
-    const float shift_vec_x = perp_x * effective_shift;
-    const float shift_vec_y = perp_y * effective_shift;
-    
-    // Calculate bounding box
-    float min_x = 0.0f;
-    float max_x = static_cast<float>(input_width);
-    float min_y = 0.0f;
-    float max_y = static_cast<float>(input_height);
-    
-    const float corners[4][2] = {
-        {0.0f, 0.0f},
-        {static_cast<float>(input_width), 0.0f},
-        {0.0f, static_cast<float>(input_height)},
-        {static_cast<float>(input_width), static_cast<float>(input_height)}
-    };
-    
-    for (int i = 0; i < 4; i++) {
-        const float x = corners[i][0];
-        const float y = corners[i][1];
-        
-        if (direction == 1) { // Both
-            float x_pos = x + shift_vec_x;
-            float y_pos = y + shift_vec_y;
-            float x_neg = x - shift_vec_x;
-            float y_neg = y - shift_vec_y;
-            
-            min_x = std::min({min_x, x_pos, x_neg});
-            max_x = std::max({max_x, x_pos, x_neg});
-            min_y = std::min({min_y, y_pos, y_neg});
-            max_y = std::max({max_y, y_pos, y_neg});
-        }
-        else if (direction == 2) { // Forward
-            // Forward: pixels shift in -shift_vec direction (sampling from -shift_vec)
-            // So the image appears to move in +shift_vec direction
-            // We need to expand buffer in +shift_vec direction
-            float x_shifted = x + shift_vec_x;
-            float y_shifted = y + shift_vec_y;
-            
-            min_x = std::min(min_x, x_shifted);
-            max_x = std::max(max_x, x_shifted);
-            min_y = std::min(min_y, y_shifted);
-            max_y = std::max(max_y, y_shifted);
-        }
-        else { // Backward (direction == 3)
-            // Backward: pixels shift in +shift_vec direction (sampling from +shift_vec)
-            // So the image appears to move in -shift_vec direction
-            // We need to expand buffer in -shift_vec direction
-            float x_shifted = x - shift_vec_x;
-            float y_shifted = y - shift_vec_y;
-            
-            min_x = std::min(min_x, x_shifted);
-            max_x = std::max(max_x, x_shifted);
-            min_y = std::min(min_y, y_shifted);
-            max_y = std::max(max_y, y_shifted);
-        }
-    }
-    
-    // Calculate required expansion
-    int expand_left = static_cast<int>(std::ceil(-min_x));
-    int expand_top = static_cast<int>(std::ceil(-min_y));
-    int expand_right = static_cast<int>(std::ceil(max_x - input_width));
-    int expand_bottom = static_cast<int>(std::ceil(max_y - input_height));
 
-    if (expand_left < 0) expand_left = 0;
-    if (expand_top < 0) expand_top = 0;
-    if (expand_right < 0) expand_right = 0;
-    if (expand_bottom < 0) expand_bottom = 0;
+    const StretchExpansion expansion = StretchComputeExpansion(geometry, input_width, input_height);
 
     // Set output dimensions and origin with integer overflow protection
     // Clamp to short range (-32768 to 32767) to prevent overflow when casting to short
     constexpr int short_max = 32767;
-    const int clamped_expand_left = std::min(expand_left, short_max);
-    const int clamped_expand_top = std::min(expand_top, short_max);
+    const int clamped_expand_left = std::min(expansion.left, short_max);
+    const int clamped_expand_top = std::min(expansion.top, short_max);
 
-    out_data->width = input_width + expand_left + expand_right;
-    out_data->height = input_height + expand_top + expand_bottom;
+    out_data->width = input_width + expansion.left + expansion.right;
+    out_data->height = input_height + expansion.top + expansion.bottom;
     out_data->origin.h = static_cast<short>(clamped_expand_left);
     out_data->origin.v = static_cast<short>(clamped_expand_top);
-    
-    return err;
+
+    return PF_Err_NONE;
 }
 
 
@@ -213,8 +218,8 @@ static PF_Err ParamsSetup(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef*
 
     PF_ADD_FLOAT_SLIDERX(
         "Shift Amount",
-        0,
-        10000,
+        STRETCH_SHIFT_MIN,
+        STRETCH_SHIFT_MAX,
         0,
         500,
         0,
@@ -243,832 +248,454 @@ static PF_Err ParamsSetup(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef*
         "Both|Forward|Backward",
         DIRECTION_DISK_ID);
 
+    AEFX_CLR_STRUCT(def);
+
+    PF_ADD_POPUP(
+        "Quality",
+        4,
+        2,
+        "Nearest|Bilinear|Bicubic|Lanczos3",
+        QUALITY_DISK_ID);
+
+    AEFX_CLR_STRUCT(def);
+
+    // Supervised so turning it off can drop the instance's frames
+    PF_ADD_CHECKBOXX("Cache Results",
+        FALSE,
+        PF_ParamFlag_SUPERVISE,
+        CACHE_RESULTS_DISK_ID);
+
     out_data->num_params = STRETCH_NUM_PARAMS;
     return err;
 }
 
 
+// -----------------------------------------------------------------------------
+// Sequence data
+// -----------------------------------------------------------------------------
+//
+// Cached frames of every effect instance live in one process-wide result
+// cache under a single budget. Sequence data holds the instance's owner ID in
+// that cache and, flattened, its hit/miss counters. Unflattened sequence data
+// holds a reference on the owner, so the instance and the render clones of
+// multi-frame rendering (which get a flat copy, unflattened or not) find the
+// same frames and count into the same counters. A duplicated effect keeps its
+// source's ID and shares its frames, which are keyed by content anyway.
+
+constexpr A_u_long STRETCH_SEQUENCE_MAGIC = 0x53745263; // 'StRc'
+
+struct StretchSequenceData
+{
+    A_u_long magic;
+    A_u_long flat;               // TRUE: holds no reference on cache_owner
+    std::uint64_t cache_hits;
+    std::uint64_t cache_misses;
+    std::uint64_t cache_owner;   // owner ID in SharedResultCache()
+};
 
-template <typename T>
-static inline T ClampScalar(T value, T min_value, T max_value)
+static StretchResultCache& SharedResultCache()
 {
-    if (value < min_value) return min_value;
-    if (value > max_value) return max_value;
-    return value;
+    static StretchResultCache cache;
+    return cache;
 }
 
-// -----------------------------------------------------------------------------
-// Pixel Traits
-// -----------------------------------------------------------------------------
-
-template <typename PixelT>
-struct PixelTraits;
+// Owner IDs carry a per-process nonce in their high half, so an ID saved
+// with a project by another session is never taken for a live one
+static std::uint32_t ProcessNonce()
+{
+    static const std::uint32_t nonce = []() {
+        std::random_device device;
+        const std::uint32_t value = device();
+        return value != 0 ? value : 1u;
+    }();
+    return nonce;
+}
 
-template <>
-struct PixelTraits<PF_Pixel>
+static std::uint64_t NewCacheOwner()
 {
-    using ChannelType = A_u_char;
-    static constexpr float MAX_VAL = 255.0f;
-    static inline float ToFloat(ChannelType v) { return static_cast<float>(v); }
-    static inline ChannelType FromFloat(float v)
-    {
-        return static_cast<ChannelType>(ClampScalar(v, 0.0f, MAX_VAL) + 0.5f);
-    }
-};
+    static std::atomic<std::uint32_t> next{1};
+    return (static_cast<std::uint64_t>(ProcessNonce()) << 32) | next.fetch_add(1, std::memory_order_relaxed);
+}
 
-template <>
-struct PixelTraits<PF_Pixel16>
+// Takes a reference on the instance's owner in the shared cache, seeded with
+// the saved counters
+static void UnflattenSequenceData(StretchSequenceData& seq)
 {
-    using ChannelType = A_u_short;
-    static constexpr float MAX_VAL = 32768.0f;
-    static inline float ToFloat(ChannelType v) { return static_cast<float>(v); }
-    static inline ChannelType FromFloat(float v)
-    {
-        return static_cast<ChannelType>(ClampScalar(v, 0.0f, MAX_VAL) + 0.5f);
+    if (seq.magic != STRETCH_SEQUENCE_MAGIC) {
+        seq = StretchSequenceData{ STRETCH_SEQUENCE_MAGIC, TRUE, 0, 0, 0 };
     }
-};
+    if (seq.flat) {
+        if ((seq.cache_owner >> 32) != ProcessNonce()) {
+            seq.cache_owner = NewCacheOwner();
+        }
+        SharedResultCache().Attach(seq.cache_owner, seq.cache_hits, seq.cache_misses);
+        seq.flat = FALSE;
+    }
+}
 
-template <>
-struct PixelTraits<PF_PixelFloat>
+// Flat copy of seq's state
+static StretchSequenceData FlatSequenceData(const StretchSequenceData& seq)
 {
-    using ChannelType = PF_FpShort;
-    static inline float ToFloat(ChannelType v) { return static_cast<float>(v); }
-    static inline ChannelType FromFloat(float v) { return static_cast<ChannelType>(v); }
-};
-
-// -----------------------------------------------------------------------------
-// Sampling
-// -----------------------------------------------------------------------------
+    StretchSequenceData flat{ STRETCH_SEQUENCE_MAGIC, TRUE, seq.cache_hits, seq.cache_misses, seq.cache_owner };
+    if (SharedResultCache().IsAttached(seq.cache_owner)) {
+        const StretchResultCache::Stats stats = SharedResultCache().GetStats(seq.cache_owner);
+        flat.cache_hits = stats.hits;
+        flat.cache_misses = stats.misses;
+    }
+    return flat;
+}
 
-// Nearest Neighbor sampling to avoid black fringe artifacts
-// This method prevents blending with transparent (alpha=0) black pixels,
-// which is the recommended approach per Adobe's documentation:
-// https://ae-plugins.docsforadobe.dev/effect-details/pixel-aspect-ratio/?h=anti+aliasing#dont-assume-pixels-are-square-or-1-to-1
-template <typename Pixel>
-static inline Pixel SampleNearestNeighbor(const A_u_char* base_ptr,
-    A_long rowbytes,
-    float xf,
-    float yf,
-    int width,
-    int height)
+static PF_Err SequenceSetup(PF_InData* in_data, PF_OutData* out_data)
 {
-    // Round to nearest integer (same method as MultiSlicer)
-    A_long x = static_cast<A_long>(xf + 0.5f);
-    A_long y = static_cast<A_long>(yf + 0.5f);
+    AEGP_SuiteHandler suites(in_data->pica_basicP);
+    PF_HandleSuite1* handle_suite = suites.HandleSuite1();
 
-    // Bounds check
-    if (x < 0 || x >= width || y < 0 || y >= height) {
-        Pixel result;
-        std::memset(&result, 0, sizeof(Pixel));
-        return result;
+    PF_Handle handle = handle_suite->host_new_handle(sizeof(StretchSequenceData));
+    if (!handle) {
+        return PF_Err_OUT_OF_MEMORY;
+    }
+    auto* seq = static_cast<StretchSequenceData*>(handle_suite->host_lock_handle(handle));
+    if (!seq) {
+        handle_suite->host_dispose_handle(handle);
+        return PF_Err_OUT_OF_MEMORY;
     }
+    seq->magic = 0;
+    UnflattenSequenceData(*seq);
+    handle_suite->host_unlock_handle(handle);
 
-    const Pixel* row = reinterpret_cast<const Pixel*>(base_ptr + y * rowbytes);
-    return row[x];
+    out_data->sequence_data = handle;
+    return PF_Err_NONE;
 }
 
-// Alpha-weighted bilinear sampling for proper anti-aliasing with transparency
-// This avoids black fringing by excluding transparent pixels from interpolation
-template <typename Pixel>
-static inline Pixel SampleBilinear(const A_u_char* base_ptr,
-    A_long rowbytes,
-    float xf,
-    float yf,
-    int width,
-    int height)
+static PF_Err SequenceResetup(PF_InData* in_data, PF_OutData* out_data)
 {
-    using Traits = PixelTraits<Pixel>;
-    
-    // Get integer and fractional parts
-    const int x0 = static_cast<int>(floorf(xf));
-    const int y0 = static_cast<int>(floorf(yf));
-    const float fx = xf - static_cast<float>(x0);
-    const float fy = yf - static_cast<float>(y0);
-    
-    // Fast path: if coordinate is (nearly) integer, skip bilinear interpolation
-    if (fx < EPSILON && fy < EPSILON) {
-        // Check bounds
-        if (x0 >= 0 && x0 < width && y0 >= 0 && y0 < height) {
-            const Pixel* row = reinterpret_cast<const Pixel*>(base_ptr + y0 * rowbytes);
-            return row[x0];
-        }
-        // Out of bounds - return transparent
-        Pixel result;
-        std::memset(&result, 0, sizeof(Pixel));
-        return result;
-    }
-    
-    const int x1 = x0 + 1;
-    const int y1 = y0 + 1;
-    
-    // Check if all four pixels are within bounds
-    const bool in_bounds_00 = (x0 >= 0 && x0 < width && y0 >= 0 && y0 < height);
-    const bool in_bounds_10 = (x1 >= 0 && x1 < width && y0 >= 0 && y0 < height);
-    const bool in_bounds_01 = (x0 >= 0 && x0 < width && y1 >= 0 && y1 < height);
-    const bool in_bounds_11 = (x1 >= 0 && x1 < width && y1 >= 0 && y1 < height);
-    
-    // If all pixels are out of bounds, return transparent
-    if (!in_bounds_00 && !in_bounds_10 && !in_bounds_01 && !in_bounds_11) {
-        Pixel result;
-        std::memset(&result, 0, sizeof(Pixel));
-        return result;
-    }
-    
-    // Get pixels (use transparent for out-of-bounds)
-    Pixel p00, p10, p01, p11;
-    std::memset(&p00, 0, sizeof(Pixel));
-    std::memset(&p10, 0, sizeof(Pixel));
-    std::memset(&p01, 0, sizeof(Pixel));
-    std::memset(&p11, 0, sizeof(Pixel));
-    
-    if (in_bounds_00) {
-        const Pixel* row0 = reinterpret_cast<const Pixel*>(base_ptr + y0 * rowbytes);
-        p00 = row0[x0];
+    PF_Handle handle = in_data->sequence_data;
+    if (!handle) {
+        return SequenceSetup(in_data, out_data);
     }
-    if (in_bounds_10) {
-        const Pixel* row0 = reinterpret_cast<const Pixel*>(base_ptr + y0 * rowbytes);
-        p10 = row0[x1];
+
+    AEGP_SuiteHandler suites(in_data->pica_basicP);
+    PF_HandleSuite1* handle_suite = suites.HandleSuite1();
+    if (handle_suite->host_get_handle_size(handle) < sizeof(StretchSequenceData)) {
+        handle_suite->host_dispose_handle(handle);
+        return SequenceSetup(in_data, out_data);
     }
-    if (in_bounds_01) {
-        const Pixel* row1 = reinterpret_cast<const Pixel*>(base_ptr + y1 * rowbytes);
-        p01 = row1[x0];
+
+    auto* seq = static_cast<StretchSequenceData*>(handle_suite->host_lock_handle(handle));
+    if (seq) {
+        UnflattenSequenceData(*seq);
+        handle_suite->host_unlock_handle(handle);
     }
-    if (in_bounds_11) {
-        const Pixel* row1 = reinterpret_cast<const Pixel*>(base_ptr + y1 * rowbytes);
-        p11 = row1[x1];
+    out_data->sequence_data = handle;
+    return PF_Err_NONE;
+}
+
+static PF_Err SequenceFlatten(PF_InData* in_data, PF_OutData* out_data)
+{
+    PF_Handle handle = in_data->sequence_data;
+    if (!handle) {
+        return PF_Err_NONE;
     }
-    
-    // Bilinear weights - pre-compute (1-fx) and (1-fy) to avoid redundant subtraction
-    const float inv_fx = 1.0f - fx;
-    const float inv_fy = 1.0f - fy;
-    const float w00 = inv_fx * inv_fy;
-    const float w10 = fx * inv_fy;
-    const float w01 = inv_fx * fy;
-    const float w11 = fx * fy;
-    
-    // Get alpha values for weighting - convert once and reuse
-    const float a00 = Traits::ToFloat(p00.alpha);
-    const float a10 = Traits::ToFloat(p10.alpha);
-    const float a01 = Traits::ToFloat(p01.alpha);
-    const float a11 = Traits::ToFloat(p11.alpha);
-    
-    // Alpha-weighted interpolation
-    // Pixels with zero or near-zero alpha don't contribute to color
-    
-    float total_weight = 0.0f;
-    float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
-    
-    // Process each pixel - convert RGB values only when alpha is significant
-    if (a00 > ALPHA_THRESHOLD) {
-        const float weight = w00 * a00;
-        total_weight += weight;
-        r += Traits::ToFloat(p00.red) * weight;
-        g += Traits::ToFloat(p00.green) * weight;
-        b += Traits::ToFloat(p00.blue) * weight;
-        a += a00 * w00;
+
+    AEGP_SuiteHandler suites(in_data->pica_basicP);
+    PF_HandleSuite1* handle_suite = suites.HandleSuite1();
+    auto* seq = static_cast<StretchSequenceData*>(handle_suite->host_lock_handle(handle));
+    if (seq && seq->magic == STRETCH_SEQUENCE_MAGIC) {
+        const StretchSequenceData flat = FlatSequenceData(*seq);
+        if (!seq->flat) {
+            SharedResultCache().Detach(seq->cache_owner);
+        }
+        *seq = flat;
     }
-    
-    if (a10 > ALPHA_THRESHOLD) {
-        const float weight = w10 * a10;
-        total_weight += weight;
-        r += Traits::ToFloat(p10.red) * weight;
-        g += Traits::ToFloat(p10.green) * weight;
-        b += Traits::ToFloat(p10.blue) * weight;
-        a += a10 * w10;
+    if (seq) {
+        handle_suite->host_unlock_handle(handle);
     }
-    
-    if (a01 > ALPHA_THRESHOLD) {
-        const float weight = w01 * a01;
-        total_weight += weight;
-        r += Traits::ToFloat(p01.red) * weight;
-        g += Traits::ToFloat(p01.green) * weight;
-        b += Traits::ToFloat(p01.blue) * weight;
-        a += a01 * w01;
+    out_data->sequence_data = handle;
+    return PF_Err_NONE;
+}
+
+// Multi-frame rendering asks for a flat copy without tearing down the
+// instance's live data. The copy keeps the owner ID, so render clones share
+// the instance's frames and counters
+static PF_Err GetFlattenedSequenceData(PF_InData* in_data, PF_OutData* out_data)
+{
+    AEGP_SuiteHandler suites(in_data->pica_basicP);
+    PF_HandleSuite1* handle_suite = suites.HandleSuite1();
+
+    StretchSequenceData flat{ STRETCH_SEQUENCE_MAGIC, TRUE, 0, 0, 0 };
+    if (in_data->sequence_data) {
+        const auto* seq = static_cast<const StretchSequenceData*>(*in_data->sequence_data);
+        if (seq && seq->magic == STRETCH_SEQUENCE_MAGIC) {
+            flat = FlatSequenceData(*seq);
+        }
     }
-    
-    if (a11 > ALPHA_THRESHOLD) {
-        const float weight = w11 * a11;
-        total_weight += weight;
-        r += Traits::ToFloat(p11.red) * weight;
-        g += Traits::ToFloat(p11.green) * weight;
-        b += Traits::ToFloat(p11.blue) * weight;
-        a += a11 * w11;
+
+    PF_Handle handle = handle_suite->host_new_handle(sizeof(StretchSequenceData));
+    if (!handle) {
+        return PF_Err_OUT_OF_MEMORY;
     }
-    
-    Pixel result;
-    
-    if (total_weight > ALPHA_THRESHOLD) {
-        // Normalize by total weight - use multiplication by inverse instead of division
-        const float inv_weight = 1.0f / total_weight;
-        result.red = Traits::FromFloat(r * inv_weight);
-        result.green = Traits::FromFloat(g * inv_weight);
-        result.blue = Traits::FromFloat(b * inv_weight);
-        result.alpha = Traits::FromFloat(a);
-    } else {
-        // All pixels were transparent
-        std::memset(&result, 0, sizeof(Pixel));
+    auto* copy = static_cast<StretchSequenceData*>(handle_suite->host_lock_handle(handle));
+    if (!copy) {
+        handle_suite->host_dispose_handle(handle);
+        return PF_Err_OUT_OF_MEMORY;
     }
-    
-    return result;
+    *copy = flat;
+    handle_suite->host_unlock_handle(handle);
+
+    out_data->sequence_data = handle;
+    return PF_Err_NONE;
 }
 
-// Fast row sampler for cases where Y coordinate is constant across the row
-// This avoids repeated Y-coordinate calculations (floor, clamp, row pointer lookup)
-// Uses alpha-weighted interpolation to avoid black fringing with transparent pixels
-template <typename Pixel>
-class FastRowSampler {
-public:
-    const Pixel* row0;
-    const Pixel* row1;
-    float w0_y; // Weight for row0 (1 - fy)
-    float w1_y; // Weight for row1 (fy)
-    int width;
-    int height;
-    
-    // Initialize with a constant Y coordinate
-    void Setup(const A_u_char* base, A_long rowbytes, int w, int h, float y) {
-        width = w;
-        height = h;
-        
-        const int y0 = static_cast<int>(floorf(y));
-        const int y1 = y0 + 1;
-        const float fy = y - static_cast<float>(y0);
-        
-        w0_y = 1.0f - fy;
-        w1_y = fy;
-        
-        // Clamp Y and check bounds
-        const bool y0_in = (y0 >= 0 && y0 < h);
-        const bool y1_in = (y1 >= 0 && y1 < h);
-        
-        row0 = y0_in ? reinterpret_cast<const Pixel*>(base + y0 * rowbytes) : nullptr;
-        row1 = y1_in ? reinterpret_cast<const Pixel*>(base + y1 * rowbytes) : nullptr;
-    }
-    
-    // Sample at X coordinate with alpha-weighted interpolation
-    inline Pixel Sample(float x) const {
-        using Traits = PixelTraits<Pixel>;
-
-        const int x0 = static_cast<int>(floorf(x));
-        const float fx = x - static_cast<float>(x0);
-
-        // Fast path: if X is (nearly) integer and Y weight is heavily on one row
-        if (fx < EPSILON) {
-            if (x0 >= 0 && x0 < width) {
-                // Check if we can use single row (when fy was near 0 or 1)
-                if (row0 && w0_y > WEIGHT_THRESHOLD) {
-                    return row0[x0];
-                }
-                if (row1 && w1_y > WEIGHT_THRESHOLD) {
-                    return row1[x0];
-                }
-            }
-        }
-        
-        const int x1 = x0 + 1;
-        const float inv_fx = 1.0f - fx;
-        
-        // Check bounds for X
-        const bool x0_in = (x0 >= 0 && x0 < width);
-        const bool x1_in = (x1 >= 0 && x1 < width);
-        
-        // If completely out of bounds, return transparent
-        if (!row0 && !row1) {
-            Pixel result;
-            std::memset(&result, 0, sizeof(Pixel));
-            return result;
-        }
-        
-        float total_weight = 0.0f;
-        float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
-        
-        // Contribution from Row 0
-        if (row0) {
-            if (x0_in) {
-                const Pixel& p = row0[x0];
-                const float pa = Traits::ToFloat(p.alpha);
-                if (pa > ALPHA_THRESHOLD) {
-                    const float w = w0_y * inv_fx;
-                    const float weight = w * pa;
-                    total_weight += weight;
-                    r += Traits::ToFloat(p.red) * weight;
-                    g += Traits::ToFloat(p.green) * weight;
-                    b += Traits::ToFloat(p.blue) * weight;
-                    a += pa * w;
-                }
-            }
-            if (x1_in) {
-                const Pixel& p = row0[x1];
-                const float pa = Traits::ToFloat(p.alpha);
-                if (pa > ALPHA_THRESHOLD) {
-                    const float w = w0_y * fx;
-                    const float weight = w * pa;
-                    total_weight += weight;
-                    r += Traits::ToFloat(p.red) * weight;
-                    g += Traits::ToFloat(p.green) * weight;
-                    b += Traits::ToFloat(p.blue) * weight;
-                    a += pa * w;
-                }
-            }
-        }
-        
-        // Contribution from Row 1
-        if (row1) {
-            if (x0_in) {
-                const Pixel& p = row1[x0];
-                const float pa = Traits::ToFloat(p.alpha);
-                if (pa > ALPHA_THRESHOLD) {
-                    const float w = w1_y * inv_fx;
-                    const float weight = w * pa;
-                    total_weight += weight;
-                    r += Traits::ToFloat(p.red) * weight;
-                    g += Traits::ToFloat(p.green) * weight;
-                    b += Traits::ToFloat(p.blue) * weight;
-                    a += pa * w;
-                }
-            }
-            if (x1_in) {
-                const Pixel& p = row1[x1];
-                const float pa = Traits::ToFloat(p.alpha);
-                if (pa > ALPHA_THRESHOLD) {
-                    const float w = w1_y * fx;
-                    const float weight = w * pa;
-                    total_weight += weight;
-                    r += Traits::ToFloat(p.red) * weight;
-                    g += Traits::ToFloat(p.green) * weight;
-                    b += Traits::ToFloat(p.blue) * weight;
-                    a += pa * w;
-                }
-            }
+static PF_Err SequenceSetdown(PF_InData* in_data, PF_OutData* out_data)
+{
+    PF_Handle handle = in_data->sequence_data;
+    if (handle) {
+        const auto* seq = static_cast<const StretchSequenceData*>(*handle);
+        if (seq && seq->magic == STRETCH_SEQUENCE_MAGIC && !seq->flat) {
+            SharedResultCache().Detach(seq->cache_owner);
         }
+        AEGP_SuiteHandler suites(in_data->pica_basicP);
+        suites.HandleSuite1()->host_dispose_handle(handle);
+    }
+    out_data->sequence_data = nullptr;
+    return PF_Err_NONE;
+}
 
-        Pixel result;
-        if (total_weight > ALPHA_THRESHOLD) {
-            const float inv_weight = 1.0f / total_weight;
-            result.red = Traits::FromFloat(r * inv_weight);
-            result.green = Traits::FromFloat(g * inv_weight);
-            result.blue = Traits::FromFloat(b * inv_weight);
-            result.alpha = Traits::FromFloat(a);
-        } else {
-            std::memset(&result, 0, sizeof(Pixel));
+// The instance's sequence data for reading. Under multi-frame rendering
+// render threads only get a const view
+static const StretchSequenceData* GetSequenceData(PF_InData* in_data)
+{
+    const StretchSequenceData* seq = nullptr;
+    SPBasicSuite* basic = in_data->pica_basicP;
+    const PF_EffectSequenceDataSuite1* seq_suite = nullptr;
+    if (basic && basic->AcquireSuite(kPFEffectSequenceDataSuite, kPFEffectSequenceDataSuiteVersion1,
+                                     reinterpret_cast<const void**>(&seq_suite)) == kSPNoError && seq_suite) {
+        PF_ConstHandle handle = nullptr;
+        if (seq_suite->PF_GetConstSequenceData(in_data->effect_ref, &handle) == PF_Err_NONE && handle) {
+            seq = static_cast<const StretchSequenceData*>(*handle);
         }
-        return result;
+        basic->ReleaseSuite(kPFEffectSequenceDataSuite, kPFEffectSequenceDataSuiteVersion1);
+    }
+    else if (in_data->sequence_data) {
+        seq = static_cast<const StretchSequenceData*>(*in_data->sequence_data);
     }
+    return (seq && seq->magic == STRETCH_SEQUENCE_MAGIC) ? seq : nullptr;
+}
+
+// The shared cache and the instance a render reads and stores frames for
+struct InstanceCache
+{
+    StretchResultCache* cache = nullptr;
+    std::uint64_t owner = 0;
 };
 
-// Blend two pixels with anti-aliasing
-// coverage: 0.0 = fully pixel_a, 1.0 = fully pixel_b
-template <typename Pixel>
-static inline Pixel BlendPixels(const Pixel& pixel_a, const Pixel& pixel_b, float coverage)
+// Cache to use for this render: the instance's frames in the shared cache
+// when "Cache Results" is on and the instance is live
+static InstanceCache ResultCacheForRender(PF_InData* in_data, bool enabled)
 {
-    using Traits = PixelTraits<Pixel>;
-    
-    // Clamp coverage to [0, 1]
-    coverage = ClampScalar(coverage, 0.0f, 1.0f);
-    float inv_coverage = 1.0f - coverage;
-    
-    Pixel result;
-    result.alpha = Traits::FromFloat(Traits::ToFloat(pixel_a.alpha) * inv_coverage + 
-                                     Traits::ToFloat(pixel_b.alpha) * coverage);
-    result.red = Traits::FromFloat(Traits::ToFloat(pixel_a.red) * inv_coverage + 
-                                   Traits::ToFloat(pixel_b.red) * coverage);
-    result.green = Traits::FromFloat(Traits::ToFloat(pixel_a.green) * inv_coverage + 
-                                     Traits::ToFloat(pixel_b.green) * coverage);
-    result.blue = Traits::FromFloat(Traits::ToFloat(pixel_a.blue) * inv_coverage + 
-                                    Traits::ToFloat(pixel_b.blue) * coverage);
-    return result;
+    InstanceCache instance;
+    if (!enabled) {
+        return instance;
+    }
+    const StretchSequenceData* seq = GetSequenceData(in_data);
+    if (seq && SharedResultCache().IsAttached(seq->cache_owner)) {
+        instance.cache = &SharedResultCache();
+        instance.owner = seq->cache_owner;
+    }
+    return instance;
+}
+
+// Turning "Cache Results" off drops the instance's cached frames
+static PF_Err UserChangedParam(PF_InData* in_data, PF_ParamDef* params[], const PF_UserChangedParamExtra* extra)
+{
+    if (!in_data || !params || !extra || extra->param_index != STRETCH_CACHE_RESULTS || !params[STRETCH_CACHE_RESULTS]) {
+        return PF_Err_NONE;
+    }
+    const StretchSequenceData* seq = GetSequenceData(in_data);
+    if (seq && params[STRETCH_CACHE_RESULTS]->u.bd.value == 0) {
+        SharedResultCache().Clear(seq->cache_owner);
+    }
+    return PF_Err_NONE;
 }
 
 // -----------------------------------------------------------------------------
-// Stretch rendering helpers
+// Rendering
 // -----------------------------------------------------------------------------
 
+// Maps host pixel types onto the layout-compatible StretchCore pixel types
 template <typename Pixel>
-struct StretchRenderContext
+struct StretchCorePixel;
+
+template <>
+struct StretchCorePixel<PF_Pixel>
 {
-    const A_u_char* input_base;
-    A_u_char* output_base;
-    A_long input_rowbytes;
-    A_long output_rowbytes;
-    int width;
-    int height;
-    int input_width;
-    int input_height;
-
-    // Geometry
-    float anchor_x;
-    float anchor_y;
-    float effective_shift;
-    float shift_vec_x;
-    float shift_vec_y;
-    float perp_x;
-    float perp_y;
-    float para_x;
-    float para_y;
-    
-    // Output origin offset (for expanded buffer)
-    float output_origin_x;
-    float output_origin_y;
+    using Type = StretchPixel8;
 };
 
-template <typename Pixel>
-static inline void ProcessRowsBoth(const StretchRenderContext<Pixel>& ctx, int start_y, int end_y)
+template <>
+struct StretchCorePixel<PF_Pixel16>
 {
-    const float eff = ctx.effective_shift;
-    const float shift_vec_x = ctx.shift_vec_x;
-    const float shift_vec_y = ctx.shift_vec_y;
-    const float perp_x = ctx.perp_x;
-    const float perp_y = ctx.perp_y;
-    const float para_x = ctx.para_x;
-    const float para_y = ctx.para_y;
-    const float anchor_x_f = ctx.anchor_x;
-    const float anchor_y_f = ctx.anchor_y;
-
-    for (int y = start_y; y < end_y; ++y) {
-        // Convert output buffer y to input image coordinate system
-        const float yf_output = static_cast<float>(y);
-        const float yf_input = yf_output - ctx.output_origin_y;
-        
-        // Calculate distance from anchor point (in input image coordinate system)
-        const float dy = yf_input - anchor_y_f;
-
-        // Calculate x range in input image coordinate system
-        const float dx0 = 0.0f - ctx.output_origin_x - anchor_x_f;  // Left edge of output buffer in input coords
-        const float dxN = static_cast<float>(ctx.width - 1) - ctx.output_origin_x - anchor_x_f;  // Right edge
-
-        const float base_perp = dy * perp_y;
-        const float dist0 = dx0 * perp_x + base_perp;
-        const float distN = dxN * perp_x + base_perp;
-
-        const float row_min = (std::min)(dist0, distN);
-        const float row_max = (std::max)(dist0, distN);
-
-        const float base_para = dy * para_y;
-
-        // sample_x and sample_y are in input image coordinate system
-        float sample_x = 0.0f - ctx.output_origin_x;
-        const float sample_y = yf_input;
-
-        Pixel* out_row = reinterpret_cast<Pixel*>(ctx.output_base + static_cast<A_long>(y) * ctx.output_rowbytes);
-
-        // Entire row is on the negative side beyond the gap -> all pixels shift in +direction
-        if (row_max <= -eff) {
-            const float sy = sample_y + shift_vec_y;
-            FastRowSampler<Pixel> sampler;
-            sampler.Setup(ctx.input_base, ctx.input_rowbytes, ctx.input_width, ctx.input_height, sy);
-            for (int x = 0; x < ctx.width; ++x) {
-                const float sx = sample_x + shift_vec_x;
-                out_row[x] = sampler.Sample(sx);
-                sample_x += 1.0f;
-            }
-            continue;
-        }
+    using Type = StretchPixel16;
+};
 
-        // Entire row is on the positive side beyond the gap -> all pixels shift in -direction
-        if (row_min >= eff) {
-            const float sy = sample_y - shift_vec_y;
-            FastRowSampler<Pixel> sampler;
-            sampler.Setup(ctx.input_base, ctx.input_rowbytes, ctx.input_width, ctx.input_height, sy);
-            for (int x = 0; x < ctx.width; ++x) {
-                const float sx = sample_x - shift_vec_x;
-                out_row[x] = sampler.Sample(sx);
-                sample_x += 1.0f;
-            }
-            continue;
-        }
+template <>
+struct StretchCorePixel<PF_PixelFloat>
+{
+    using Type = StretchPixelF;
+};
 
-        // Entire row is inside the gap -> border sampling only
-        if (row_min > -eff && row_max < eff) {
-            float proj_len = dx0 * para_x + base_para;
-            for (int x = 0; x < ctx.width; ++x) {
-                const float border_x = anchor_x_f + proj_len * para_x;
-                const float border_y = anchor_y_f + proj_len * para_y;
-                out_row[x] = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, border_x, border_y, ctx.input_width, ctx.input_height);
-                proj_len += para_x;
-            }
-            continue;
-        }
+static_assert(sizeof(PF_Pixel) == sizeof(StretchPixel8), "PF_Pixel layout mismatch");
+static_assert(sizeof(PF_Pixel16) == sizeof(StretchPixel16), "PF_Pixel16 layout mismatch");
+static_assert(sizeof(PF_PixelFloat) == sizeof(StretchPixelF), "PF_PixelFloat layout mismatch");
+static_assert(offsetof(PF_Pixel, alpha) == offsetof(StretchPixel8, alpha) &&
+              offsetof(PF_Pixel, blue) == offsetof(StretchPixel8, blue), "PF_Pixel channel order mismatch");
 
-        // General case: mix of negative side, gap, and positive side
-        float dist = dist0;
-        float proj_len = dx0 * para_x + base_para;
-        
-        // Anti-aliasing feather width (in pixels)
-        const float feather = FEATHER_AMOUNT;
-        
-        // Pre-calculate constants to avoid repeated computation
-        const float eff_plus_feather = eff + feather;
-        const float eff_minus_feather = eff - feather;
-        const float neg_eff_plus_feather = -eff + feather;
-        const float neg_eff_minus_feather = -eff - feather;
-        const float feather_inv = 1.0f / (2.0f * feather);
-
-        for (int x = 0; x < ctx.width; ++x) {
-            // Pre-calculate border point (used in multiple branches)
-            // Note: Border sampling is complex (varying Y), so we use full SampleBilinear -> now SamplePixel
-            const float border_x = anchor_x_f + proj_len * para_x;
-            const float border_y = anchor_y_f + proj_len * para_y;
-
-            // Determine which region we're in and apply anti-aliasing at boundaries
-            if (dist > eff_plus_feather) {
-                // Fully in positive shifted region
-                const float sx = sample_x - shift_vec_x;
-                const float sy = sample_y - shift_vec_y;
-                out_row[x] = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, sx, sy, ctx.input_width, ctx.input_height);
-            }
-            else if (dist < neg_eff_minus_feather) {
-                // Fully in negative shifted region
-                const float sx = sample_x + shift_vec_x;
-                const float sy = sample_y + shift_vec_y;
-                out_row[x] = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, sx, sy, ctx.input_width, ctx.input_height);
-            }
-            else if (dist > eff_minus_feather) {
-                // Anti-aliasing zone: transition from gap to positive shifted
-                Pixel border_pixel = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, border_x, border_y, ctx.input_width, ctx.input_height);
-                
-                const float sx_shifted = sample_x - shift_vec_x;
-                const float sy_shifted = sample_y - shift_vec_y;
-                Pixel shifted_pixel = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, sx_shifted, sy_shifted, ctx.input_width, ctx.input_height);
-                
-                // coverage: 0 at (eff - feather), 1 at (eff + feather)
-                float coverage = (dist - eff_minus_feather) * feather_inv;
-                out_row[x] = BlendPixels(border_pixel, shifted_pixel, coverage);
-            }
-            else if (dist < neg_eff_plus_feather) {
-                // Anti-aliasing zone: transition from negative shifted to gap
-                Pixel border_pixel = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, border_x, border_y, ctx.input_width, ctx.input_height);
-                
-                const float sx_shifted = sample_x + shift_vec_x;
-                const float sy_shifted = sample_y + shift_vec_y;
-                Pixel shifted_pixel = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, sx_shifted, sy_shifted, ctx.input_width, ctx.input_height);
-                
-                // coverage: 1 at (-eff - feather), 0 at (-eff + feather)
-                float coverage = (neg_eff_plus_feather - dist) * feather_inv;
-                out_row[x] = BlendPixels(border_pixel, shifted_pixel, coverage);
-            }
-            else {
-                // Fully in gap region
-                out_row[x] = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, border_x, border_y, ctx.input_width, ctx.input_height);
-            }
-
-            sample_x += 1.0f;
-            dist += perp_x;
-            proj_len += para_x;
-        }
+// Arena blocks come from PF_HandleSuite so render scratch counts toward AE's
+// memory use. Each block is a locked handle; the handle is stored just before
+// the aligned pointer handed to the arena.
+static void* HostArenaAllocate(void* user, std::size_t bytes)
+{
+    auto* handle_suite = static_cast<PF_HandleSuite1*>(user);
+    constexpr std::size_t overhead = STRETCH_ARENA_ALIGNMENT + sizeof(PF_Handle);
+    if (bytes > static_cast<std::size_t>(std::numeric_limits<A_u_long>::max()) - overhead) {
+        return nullptr;
+    }
+
+    PF_Handle handle = handle_suite->host_new_handle(static_cast<A_u_long>(bytes + overhead));
+    if (!handle) {
+        return nullptr;
+    }
+    auto* base = static_cast<std::uint8_t*>(handle_suite->host_lock_handle(handle));
+    if (!base) {
+        handle_suite->host_dispose_handle(handle);
+        return nullptr;
     }
+
+    const std::uintptr_t aligned = (reinterpret_cast<std::uintptr_t>(base) + sizeof(PF_Handle) + STRETCH_ARENA_ALIGNMENT - 1)
+        & ~static_cast<std::uintptr_t>(STRETCH_ARENA_ALIGNMENT - 1);
+    std::memcpy(reinterpret_cast<void*>(aligned - sizeof(PF_Handle)), &handle, sizeof(PF_Handle));
+    return reinterpret_cast<void*>(aligned);
 }
 
-template <typename Pixel>
-static inline void ProcessRowsForward(const StretchRenderContext<Pixel>& ctx, int start_y, int end_y)
+static void HostArenaRelease(void* user, void* block)
 {
-    const float eff = ctx.effective_shift;
-    const float shift_vec_x = ctx.shift_vec_x;
-    const float shift_vec_y = ctx.shift_vec_y;
-    const float perp_x = ctx.perp_x;
-    const float perp_y = ctx.perp_y;
-    const float para_x = ctx.para_x;
-    const float para_y = ctx.para_y;
-    const float anchor_x_f = ctx.anchor_x;
-    const float anchor_y_f = ctx.anchor_y;
-
-    for (int y = start_y; y < end_y; ++y) {
-        // Convert output buffer y to input image coordinate system
-        const float yf_output = static_cast<float>(y);
-        const float yf_input = yf_output - ctx.output_origin_y;
-        
-        // Calculate distance from anchor point (in input image coordinate system)
-        const float dy = yf_input - anchor_y_f;
-
-        // Calculate x range in input image coordinate system
-        const float dx0 = 0.0f - ctx.output_origin_x - anchor_x_f;  // Left edge of output buffer in input coords
-        const float dxN = static_cast<float>(ctx.width - 1) - ctx.output_origin_x - anchor_x_f;  // Right edge
-
-        const float base_perp = dy * perp_y;
-        const float dist0 = dx0 * perp_x + base_perp;
-        const float distN = dxN * perp_x + base_perp;
-
-        const float row_min = (std::min)(dist0, distN);
-        const float row_max = (std::max)(dist0, distN);
-
-        Pixel* out_row = reinterpret_cast<Pixel*>(ctx.output_base + static_cast<A_long>(y) * ctx.output_rowbytes);
-
-        const float base_para = dy * para_y;
-
-        // sample_x and sample_y are in input image coordinate system
-        float sample_x = 0.0f - ctx.output_origin_x;
-        const float sample_y = yf_input;
-
-        // Entire row is fully shifted (dist >= eff)
-        if (row_min >= eff) {
-            const float sy = sample_y - shift_vec_y;
-            FastRowSampler<Pixel> sampler;
-            sampler.Setup(ctx.input_base, ctx.input_rowbytes, ctx.input_width, ctx.input_height, sy);
-            for (int x = 0; x < ctx.width; ++x) {
-                const float sx = sample_x - shift_vec_x;
-                out_row[x] = sampler.Sample(sx);
-                sample_x += 1.0f;
-            }
-            continue;
-        }
+    auto* handle_suite = static_cast<PF_HandleSuite1*>(user);
+    PF_Handle handle = nullptr;
+    std::memcpy(&handle, static_cast<std::uint8_t*>(block) - sizeof(PF_Handle), sizeof(PF_Handle));
+    handle_suite->host_unlock_handle(handle);
+    handle_suite->host_dispose_handle(handle);
+}
 
-        // Entire row is within gap: 0 <= dist < eff -> border only
-        if (row_min >= 0.0f && row_max < eff) {
-            float proj_len = dx0 * para_x + base_para;
-            for (int x = 0; x < ctx.width; ++x) {
-                const float border_x = anchor_x_f + proj_len * para_x;
-                const float border_y = anchor_y_f + proj_len * para_y;
-                out_row[x] = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, border_x, border_y, ctx.input_width, ctx.input_height);
-                proj_len += para_x;
-            }
-            continue;
-        }
+// Render scratch arenas, one per in-flight frame (StretchFrameArenaPool).
+// New arenas take their blocks from the host's handle suite, so a steady
+// workload reuses the same handles every frame instead of allocating and
+// disposing them. Blocks and the handle suite are held until global setdown.
+struct HostArenaPool
+{
+    std::mutex mutex;   // guards the suite fields
+    SPBasicSuite* basic = nullptr;
+    PF_HandleSuite1* handle_suite = nullptr;
+    StretchFrameArenaPool arenas;
+};
+
+static HostArenaPool& ArenaPool()
+{
+    static HostArenaPool pool;
+    return pool;
+}
 
-        // General case - always process pixel by pixel
-        float dist = dist0;
-        float proj_len = dx0 * para_x + base_para;
-
-        // Anti-aliasing constants
-        const float feather = FEATHER_AMOUNT;
-        const float eff_plus_feather = eff + feather;
-        const float eff_minus_feather = eff - feather;
-        const float feather_inv = 1.0f / (2.0f * feather);
-
-        for (int x = 0; x < ctx.width; ++x) {
-            // Pre-calculate border point (used in multiple branches)
-            const float border_x = anchor_x_f + proj_len * para_x;
-            const float border_y = anchor_y_f + proj_len * para_y;
-
-            if (dist < -feather) {
-                // Unchanged - sample from original position
-                out_row[x] = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, sample_x, sample_y, ctx.input_width, ctx.input_height);
-            }
-            else if (dist > eff_plus_feather) {
-                // Shifted
-                const float sx = sample_x - shift_vec_x;
-                const float sy = sample_y - shift_vec_y;
-                out_row[x] = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, sx, sy, ctx.input_width, ctx.input_height);
-            }
-            else if (dist <= feather) {
-                // Anti-aliasing zone: transition from original to gap (around dist=0)
-                // dist is in [-feather, feather]
-                Pixel border_pixel = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, border_x, border_y, ctx.input_width, ctx.input_height);
-                Pixel original_pixel = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, sample_x, sample_y, ctx.input_width, ctx.input_height);
-                
-                float t = (dist + feather) * feather_inv;
-                out_row[x] = BlendPixels(original_pixel, border_pixel, t);
-            }
-            else if (dist > eff_minus_feather) {
-                // Anti-aliasing zone: transition from gap to shifted (around dist=eff)
-                Pixel border_pixel = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, border_x, border_y, ctx.input_width, ctx.input_height);
-                
-                const float sx_shifted = sample_x - shift_vec_x;
-                const float sy_shifted = sample_y - shift_vec_y;
-                Pixel shifted_pixel = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, sx_shifted, sy_shifted, ctx.input_width, ctx.input_height);
-                
-                // coverage: 0 at eff-feather (Border), 1 at eff+feather (Shifted)
-                float t = (dist - eff_minus_feather) * feather_inv;
-                out_row[x] = BlendPixels(border_pixel, shifted_pixel, t);
-            }
-            else {
-                // Purely Border (Gap)
-                out_row[x] = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, border_x, border_y, ctx.input_width, ctx.input_height);
-            }
-
-            sample_x += 1.0f;
-            dist += perp_x;
-            proj_len += para_x;
+// Backend for new arenas: the host's handle suite, acquired on first use
+// (aligned malloc if the suite is unavailable)
+static StretchArenaAllocator HostArenaAllocator(PF_InData* in_data)
+{
+    HostArenaPool& pool = ArenaPool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (!pool.handle_suite && in_data->pica_basicP) {
+        const void* suite = nullptr;
+        if (in_data->pica_basicP->AcquireSuite(kPFHandleSuite, kPFHandleSuiteVersion1, &suite) == kSPNoError && suite) {
+            pool.basic = in_data->pica_basicP;
+            pool.handle_suite = static_cast<PF_HandleSuite1*>(const_cast<void*>(suite));
         }
     }
+    return pool.handle_suite
+        ? StretchArenaAllocator{ HostArenaAllocate, HostArenaRelease, pool.handle_suite }
+        : StretchMallocArenaAllocator();
 }
 
+// Disposes every pooled block, then lets go of the handle suite. No render
+// is in flight at global setdown
+static PF_Err GlobalSetdown()
+{
+    HostArenaPool& pool = ArenaPool();
+    pool.arenas.Clear();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (pool.handle_suite) {
+        pool.basic->ReleaseSuite(kPFHandleSuite, kPFHandleSuiteVersion1);
+        pool.handle_suite = nullptr;
+        pool.basic = nullptr;
+    }
+    return PF_Err_NONE;
+}
+
+// Runs the stretch kernels on host worlds. origin_x/y map output pixels onto
+// input pixels (input = output - origin); the geometry anchor is in input
+// world coordinates.
 template <typename Pixel>
-static inline void ProcessRowsBackward(const StretchRenderContext<Pixel>& ctx, int start_y, int end_y)
+static PF_Err RenderStretch(PF_InData* in_data,
+                            const StretchGeometry& geometry,
+                            const PF_EffectWorld* input,
+                            PF_EffectWorld* output,
+                            float origin_x,
+                            float origin_y,
+                            const InstanceCache& instance)
 {
-    const float eff = ctx.effective_shift;
-    const float shift_vec_x = ctx.shift_vec_x;
-    const float shift_vec_y = ctx.shift_vec_y;
-    const float perp_x = ctx.perp_x;
-    const float perp_y = ctx.perp_y;
-    const float para_x = ctx.para_x;
-    const float para_y = ctx.para_y;
-    const float anchor_x_f = ctx.anchor_x;
-    const float anchor_y_f = ctx.anchor_y;
-
-    for (int y = start_y; y < end_y; ++y) {
-        // Convert output buffer y to input image coordinate system
-        const float yf_output = static_cast<float>(y);
-        const float yf_input = yf_output - ctx.output_origin_y;
-        
-        // Calculate distance from anchor point (in input image coordinate system)
-        const float dy = yf_input - anchor_y_f;
-
-        // Calculate x range in input image coordinate system
-        const float dx0 = 0.0f - ctx.output_origin_x - anchor_x_f;  // Left edge of output buffer in input coords
-        const float dxN = static_cast<float>(ctx.width - 1) - ctx.output_origin_x - anchor_x_f;  // Right edge
-
-        const float base_perp = dy * perp_y;
-        const float dist0 = dx0 * perp_x + base_perp;
-        const float distN = dxN * perp_x + base_perp;
-
-        const float row_min = (std::min)(dist0, distN);
-        const float row_max = (std::max)(dist0, distN);
-
-        Pixel* out_row = reinterpret_cast<Pixel*>(ctx.output_base + static_cast<A_long>(y) * ctx.output_rowbytes);
-
-        const float base_para = dy * para_y;
-
-        // sample_x and sample_y are in input image coordinate system
-        float sample_x = 0.0f - ctx.output_origin_x;
-        const float sample_y = yf_input;
-
-        // Entire row is fully shifted (dist <= -eff)
-        if (row_max <= -eff) {
-            const float sy = sample_y + shift_vec_y;
-            FastRowSampler<Pixel> sampler;
-            sampler.Setup(ctx.input_base, ctx.input_rowbytes, ctx.input_width, ctx.input_height, sy);
-            for (int x = 0; x < ctx.width; ++x) {
-                const float sx = sample_x + shift_vec_x;
-                out_row[x] = sampler.Sample(sx);
-                sample_x += 1.0f;
-            }
-            continue;
-        }
+    // Check data pointers
+    if (!input->data || !output->data) {
+        return PF_Err_BAD_CALLBACK_PARAM;
+    }
 
-        // Entire row is within gap: -eff < dist <= 0 -> border only
-        if (row_min > -eff && row_max <= 0.0f) {
-            float proj_len = dx0 * para_x + base_para;
-            for (int x = 0; x < ctx.width; ++x) {
-                const float border_x = anchor_x_f + proj_len * para_x;
-                const float border_y = anchor_y_f + proj_len * para_y;
-                out_row[x] = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, border_x, border_y, ctx.input_width, ctx.input_height);
-                proj_len += para_x;
-            }
-            continue;
-        }
+    const int width = output->width;
+    const int height = output->height;
 
-        // General case - always process pixel by pixel
-        float dist = dist0;
-        float proj_len = dx0 * para_x + base_para;
-
-        // Anti-aliasing constants
-        const float feather = FEATHER_AMOUNT;
-        const float neg_eff_plus_feather = -eff + feather;
-        const float neg_eff_minus_feather = -eff - feather;
-        const float feather_inv = 1.0f / (2.0f * feather);
-
-        for (int x = 0; x < ctx.width; ++x) {
-            // Pre-calculate border point
-            const float border_x = anchor_x_f + proj_len * para_x;
-            const float border_y = anchor_y_f + proj_len * para_y;
-
-            if (dist > feather) {
-                // Unchanged - sample from original position
-                out_row[x] = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, sample_x, sample_y, ctx.input_width, ctx.input_height);
-            }
-            else if (dist < neg_eff_minus_feather) {
-                // Shifted
-                const float sx = sample_x + shift_vec_x;
-                const float sy = sample_y + shift_vec_y;
-                out_row[x] = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, sx, sy, ctx.input_width, ctx.input_height);
-            }
-            else if (dist >= -feather) {
-                // Anti-aliasing zone: transition from border to original (around dist=0)
-                // dist is in [-feather, feather]
-                Pixel border_pixel = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, border_x, border_y, ctx.input_width, ctx.input_height);
-                Pixel original_pixel = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, sample_x, sample_y, ctx.input_width, ctx.input_height);
-                
-                // coverage: 0 at feather (Original), 1 at -feather (Border)
-                float t = (feather - dist) * feather_inv;
-                out_row[x] = BlendPixels(original_pixel, border_pixel, t);
-            }
-            else if (dist < neg_eff_plus_feather) {
-                // Anti-aliasing zone: transition from shifted to border (around dist=-eff)
-                // dist is in [-eff-feather, -eff+feather]
-                Pixel border_pixel = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, border_x, border_y, ctx.input_width, ctx.input_height);
-                
-                const float sx_shifted = sample_x + shift_vec_x;
-                const float sy_shifted = sample_y + shift_vec_y;
-                Pixel shifted_pixel = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, sx_shifted, sy_shifted, ctx.input_width, ctx.input_height);
-                
-                // coverage: 0 at -eff+feather (Border), 1 at -eff-feather (Shifted)
-                float t = (neg_eff_plus_feather - dist) * feather_inv;
-                out_row[x] = BlendPixels(border_pixel, shifted_pixel, t);
-            }
-            else {
-                // Purely Border (Gap)
-                out_row[x] = SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, border_x, border_y, ctx.input_width, ctx.input_height);
-            }
-
-            sample_x += 1.0f;
-            dist += perp_x;
-            proj_len += para_x;
-        }
+    if (width <= 0 || height <= 0) {
+        return PF_Err_NONE;
     }
-}
 
-// -----------------------------------------------------------------------------
-// Rendering
-// -----------------------------------------------------------------------------
+    StretchCacheKey key;
+    if (instance.cache) {
+        key = StretchMakeCacheKey(geometry, input->data, input->rowbytes, input->width, input->height,
+                                  width, height, origin_x, origin_y, static_cast<int>(sizeof(Pixel)), instance.owner);
+    }
+
+    using CorePixel = typename StretchCorePixel<Pixel>::Type;
+    const StretchRenderContext<CorePixel> ctx = StretchMakeContext<CorePixel>(geometry,
+        input->data, input->rowbytes, input->width, input->height,
+        output->data, output->rowbytes, width, height,
+        origin_x, origin_y);
+
+    // Scratch from a pooled arena; StretchRenderFrame drops the last frame's
+    // allocations and keeps its blocks. Blocks are requested only from this
+    // thread
+    StretchFrameArenaPool::Lease lease(ArenaPool().arenas, HostArenaAllocator(in_data));
+
+    StretchRenderOptions options = StretchGetDefaultRenderOptions();
+    options.arena = &lease.Arena();
+    if (options.profile && in_data->time_step > 0) {
+        options.profile_frame = static_cast<int>(in_data->current_time / in_data->time_step);
+    }
+
+    // Frames of any size render in one pass: the host already holds the whole
+    // input and output, and render scratch (line cache, premultiplied copy)
+    // does not grow with the output height, so strips would bound nothing
+    // here (StretchRenderStrips is for StretchRender's streamed output).
+    // Held frames come from the instance's cache, and scrubbing Shift Amount
+    // redraws only what moved since a cached frame
+    if (!StretchRenderCached(instance.cache, key, ctx, geometry.direction, options)) {
+        return PF_Err_INTERNAL_STRUCT_DAMAGED;
+    }
+
+    return PF_Err_NONE;
+}
 
 template <typename Pixel>
 static PF_Err RenderGeneric(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* params[], PF_LayerDef* output)
@@ -1083,216 +710,273 @@ static PF_Err RenderGeneric(PF_InData* in_data, PF_OutData* out_data, PF_ParamDe
     // Checkout parameters for complex parameter access (especially ANCHOR_POINT)
     // This is required per Adobe SDK guidelines for accessing nested parameter data
     PF_ParamDef param;
-    AEFX_CLR_STRUCT(param);
-
-    // Checkout anchor point parameter to safely access its nested data
-    PF_Err err = PF_CHECKOUT_PARAM(in_data,
-                                   STRETCH_ANCHOR_POINT,
-                                   in_data->current_time,
-                                   in_data->time_step,
-                                   in_data->time_scale,
-                                   &param);
+    PF_Err err = CheckoutParam(in_data, STRETCH_ANCHOR_POINT, param);
     if (err != PF_Err_NONE) {
         return err;
     }
 
-    // Get anchor point values before checkin
     const int anchor_x = (param.u.td.x_value >> 16);
     const int anchor_y = (param.u.td.y_value >> 16);
 
-    // Checkin the parameter immediately after extracting needed values
-    err = PF_CHECKIN_PARAM(in_data, &param);
-    if (err != PF_Err_NONE) {
-        return err;
+    PF_EffectWorld* input = &params[STRETCH_INPUT]->u.ld;
+
+    const StretchGeometry geometry = StretchComputeGeometry(
+        GetStretchParams(in_data, params, static_cast<float>(anchor_x), static_cast<float>(anchor_y)));
+
+    if (!geometry.active) {
+        PF_Err copy_err = PF_COPY(input, output, nullptr, nullptr);
+        if (copy_err != PF_Err_NONE) {
+            return copy_err;
+        }
+        return PF_Err_NONE;
     }
 
-    PF_EffectWorld* input = &params[STRETCH_INPUT]->u.ld;
+    return RenderStretch<Pixel>(in_data, geometry, input, output,
+                                static_cast<float>(in_data->output_origin_x),
+                                static_cast<float>(in_data->output_origin_y),
+                                ResultCacheForRender(in_data, params[STRETCH_CACHE_RESULTS]->u.bd.value != 0));
+}
 
-    // Check data pointers
-    if (!input->data || !output->data) {
+static PF_Err Render(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* params[], PF_LayerDef* output)
+{
+    (void)out_data;
+
+    // Null pointer checks
+    if (!in_data || !output) {
         return PF_Err_BAD_CALLBACK_PARAM;
     }
 
-    const int width = output->width;
-    const int height = output->height;
-    const int input_width = input->width;
-    const int input_height = input->height;
+    // Determine bit depth from world_flags
+    // PF_WorldFlag_DEEP indicates 16-bit, absence indicates 8-bit.
+    // 32-bit float worlds only arrive through SmartRender
+    PF_EffectWorld* input = &params[STRETCH_INPUT]->u.ld;
 
-    if (width <= 0 || height <= 0) {
-        return PF_Err_NONE;
+    if ((output->world_flags & PF_WorldFlag_DEEP) ||
+        (input->world_flags & PF_WorldFlag_DEEP)) {
+        // 16-bit
+        return RenderGeneric<PF_Pixel16>(in_data, out_data, params, output);
+    }
+    else {
+        // Default to 8-bit
+        return RenderGeneric<PF_Pixel>(in_data, out_data, params, output);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// SmartFX
+// -----------------------------------------------------------------------------
+
+// Handed from PreRender to SmartRender. Rects are in layer coordinates
+struct StretchSmartData
+{
+    StretchGeometry geometry;
+    PF_LRect input_rect;  // area covered by the checked-out input world
+    PF_LRect output_rect; // area covered by the output world
+    bool cache_results;   // "Cache Results" checkbox
+};
+
+static void DeleteSmartData(void* data)
+{
+    delete static_cast<StretchSmartData*>(data);
+}
+
+static bool IsEmptyRect(const PF_LRect& r)
+{
+    return r.left >= r.right || r.top >= r.bottom;
+}
+
+static PF_LRect IntersectRect(const PF_LRect& a, const PF_LRect& b)
+{
+    PF_LRect r;
+    r.left = std::max(a.left, b.left);
+    r.top = std::max(a.top, b.top);
+    r.right = std::min(a.right, b.right);
+    r.bottom = std::min(a.bottom, b.bottom);
+    if (IsEmptyRect(r)) {
+        r.left = r.top = r.right = r.bottom = 0;
     }
+    return r;
+}
+
+static StretchRect ToStretchRect(const PF_LRect& r)
+{
+    StretchRect rect;
+    rect.left = r.left;
+    rect.top = r.top;
+    rect.right = r.right;
+    rect.bottom = r.bottom;
+    return rect;
+}
+
+static PF_LRect ToLRect(const StretchRect& r)
+{
+    PF_LRect rect;
+    rect.left = r.left;
+    rect.top = r.top;
+    rect.right = r.right;
+    rect.bottom = r.bottom;
+    return rect;
+}
+
+static PF_Err PreRender(PF_InData* in_data, PF_OutData* out_data, PF_PreRenderExtra* extra)
+{
+    (void)out_data;
 
-    // Maximum size validation to prevent memory issues
-    constexpr int MAX_WIDTH = 16384;
-    constexpr int MAX_HEIGHT = 16384;
-    if (width > MAX_WIDTH || height > MAX_HEIGHT) {
+    // Null pointer checks
+    if (!in_data || !extra || !extra->input || !extra->output || !extra->cb) {
         return PF_Err_BAD_CALLBACK_PARAM;
     }
 
-    const A_u_char* input_base = reinterpret_cast<const A_u_char*>(input->data);
-    A_u_char* output_base = reinterpret_cast<A_u_char*>(output->data);
-    const A_long input_rowbytes = input->rowbytes;
-    const A_long output_rowbytes = output->rowbytes;
+    StretchParams sp;
+    PF_Err err = CheckoutStretchParams(in_data, sp);
+    if (err != PF_Err_NONE) {
+        return err;
+    }
+    const StretchGeometry geometry = StretchComputeGeometry(sp);
 
-    // Parameters (anchor_x and anchor_y already extracted via PF_CHECKOUT_PARAM above)
-    float angle_deg = static_cast<float>(params[STRETCH_ANGLE]->u.ad.value >> 16);
-    const float angle_rad = angle_deg * (static_cast<float>(M_PI) / 180.0f);
-    const float shift_amount = static_cast<float>(params[STRETCH_SHIFT_AMOUNT]->u.fs_d.value);
-    const int direction = params[STRETCH_DIRECTION]->u.pd.value;
+    PF_ParamDef cache_results;
+    err = CheckoutParam(in_data, STRETCH_CACHE_RESULTS, cache_results);
+    if (err != PF_Err_NONE) {
+        return err;
+    }
 
-    // Downsample adjustment with division by zero protection (check both num > 0 and den != 0)
-    const float downsample_x = (in_data->downsample_x.num > 0 && in_data->downsample_x.den != 0)
-        ? static_cast<float>(in_data->downsample_x.den) / static_cast<float>(in_data->downsample_x.num)
-        : 1.0f;
-    const float downsample_y = (in_data->downsample_y.num > 0 && in_data->downsample_y.den != 0)
-        ? static_cast<float>(in_data->downsample_y.den) / static_cast<float>(in_data->downsample_y.num)
-        : 1.0f;
-    const float downsample = std::min(downsample_x, downsample_y);
+    // Only request the input the requested output can sample (layer space is
+    // the input image space, so the rects map directly)
+    PF_RenderRequest request = extra->input->output_request;
+    if (geometry.active) {
+        request.rect = ToLRect(StretchComputeInputRect(geometry, ToStretchRect(request.rect)));
+    }
 
-    // Effective shift in pixels with NaN/infinity validation
-    float effective_shift = (downsample > 0.0f && std::isfinite(downsample))
-        ? (shift_amount / downsample)
-        : shift_amount;
+    PF_CheckoutResult in_result;
+    err = extra->cb->checkout_layer(in_data->effect_ref,
+                                    STRETCH_INPUT,
+                                    STRETCH_INPUT,
+                                    &request,
+                                    in_data->current_time,
+                                    in_data->time_step,
+                                    in_data->time_scale,
+                                    &in_result);
+    if (err != PF_Err_NONE) {
+        return err;
+    }
 
-    // Validate effective_shift is finite
-    if (!std::isfinite(effective_shift)) {
-        effective_shift = 0.0f;
+    // The stretched layer can grow by the same expansion FrameSetup applies
+    PF_LRect max_rect = in_result.max_result_rect;
+    if (geometry.active && !IsEmptyRect(max_rect)) {
+        const StretchExpansion expansion = StretchComputeExpansion(geometry,
+            max_rect.right - max_rect.left, max_rect.bottom - max_rect.top);
+        max_rect.left -= expansion.left;
+        max_rect.top -= expansion.top;
+        max_rect.right += expansion.right;
+        max_rect.bottom += expansion.bottom;
     }
 
-    if (std::abs(effective_shift) < 0.01f) {
-        PF_Err copy_err = PF_COPY(input, output, nullptr, nullptr);
-        if (copy_err != PF_Err_NONE) {
-            return copy_err;
+    StretchSmartData* data = new StretchSmartData();
+    data->geometry = geometry;
+    data->input_rect = in_result.result_rect;
+    data->output_rect = geometry.active
+        ? IntersectRect(extra->input->output_request.rect, max_rect)
+        : in_result.result_rect;
+    data->cache_results = cache_results.u.bd.value != 0;
+
+    extra->output->result_rect = data->output_rect;
+    extra->output->max_result_rect = max_rect;
+    extra->output->pre_render_data = data;
+    extra->output->delete_pre_render_data_func = DeleteSmartData;
+
+    return PF_Err_NONE;
+}
+
+// Copies the overlap of two layer-space worlds and clears the rest of the output
+template <typename Pixel>
+static void CopyWorldRect(const PF_EffectWorld* input, const PF_LRect& input_rect,
+                          PF_EffectWorld* output, const PF_LRect& output_rect)
+{
+    for (int y = 0; y < output->height; ++y) {
+        auto* out_row = reinterpret_cast<Pixel*>(reinterpret_cast<char*>(output->data) + static_cast<std::ptrdiff_t>(y) * output->rowbytes);
+        std::memset(out_row, 0, sizeof(Pixel) * static_cast<size_t>(output->width));
+
+        const A_long layer_y = output_rect.top + y;
+        if (!input || !input->data || layer_y < input_rect.top || layer_y >= input_rect.top + input->height) {
+            continue;
         }
-        return PF_Err_NONE;
-    }
 
-    // Direction adjustment
-    if (direction == 1) { // Both
-        effective_shift *= 0.5f;
-    }
-
-    // Precompute vectors
-    const float sn = std::sin(angle_rad);
-    const float cs = std::cos(angle_rad);
-
-    const float perp_x = -sn;
-    const float perp_y = cs;
-
-    const float shift_vec_x = perp_x * effective_shift;
-    const float shift_vec_y = perp_y * effective_shift;
-
-    // Parallel vector (along the "cut" line)
-    const float para_x = cs;
-    const float para_y = sn;
-
-    // Anchor point is in input image coordinate system
-    const float anchor_x_f = static_cast<float>(anchor_x);
-    const float anchor_y_f = static_cast<float>(anchor_y);
-
-    StretchRenderContext<Pixel> ctx{};
-    ctx.input_base = input_base;
-    ctx.output_base = output_base;
-    ctx.input_rowbytes = input_rowbytes;
-    ctx.output_rowbytes = output_rowbytes;
-    ctx.width = width;
-    ctx.height = height;
-    ctx.input_width = input_width;
-    ctx.input_height = input_height;
-    ctx.anchor_x = anchor_x_f;
-    ctx.anchor_y = anchor_y_f;
-    ctx.effective_shift = effective_shift;
-    ctx.shift_vec_x = shift_vec_x;
-    ctx.shift_vec_y = shift_vec_y;
-    ctx.perp_x = perp_x;
-    ctx.perp_y = perp_y;
-    ctx.para_x = para_x;
-    ctx.para_y = para_y;
-    ctx.output_origin_x = static_cast<float>(in_data->output_origin_x);
-    ctx.output_origin_y = static_cast<float>(in_data->output_origin_y);
-
-    // Parallel processing using std::thread
-    // Safe because we only use our own SampleBilinear (no AE API calls)
-    // Thread count limit to prevent excessive resource consumption
-    constexpr int max_threads = 16;
-    const int num_threads = std::min(max_threads, std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
-    const int rows_per_thread = (height + num_threads - 1) / num_threads;
-
-    // Atomic error flag for proper error propagation from worker threads
-    std::atomic<bool> has_error{false};
-
-    std::vector<std::thread> threads;
-    threads.reserve(num_threads);
-
-    // Capture ctx by value to avoid dangling reference
-    for (int t = 0; t < num_threads; ++t) {
-        const int start_y = t * rows_per_thread;
-        const int end_y = std::min(start_y + rows_per_thread, height);
-
-        if (start_y >= height) break;
-
-        threads.emplace_back([ctx, direction, start_y, end_y, &has_error]() {
-            try {
-                if (direction == 1) {
-                    ProcessRowsBoth(ctx, start_y, end_y);
-                }
-                else if (direction == 2) {
-                    ProcessRowsForward(ctx, start_y, end_y);
-                }
-                else {
-                    ProcessRowsBackward(ctx, start_y, end_y);
-                }
-            }
-            catch (const std::exception& e) {
-                // Log error and set atomic flag
-                (void)e; // Suppress unused warning in release builds
-                has_error.store(true, std::memory_order_release);
-            }
-            catch (...) {
-                // Catch any other exceptions and set error flag
-                has_error.store(true, std::memory_order_release);
-            }
-        });
-    }
-
-    // Wait for all threads to complete
-    for (auto& t : threads) {
-        if (t.joinable()) {
-            t.join();
+        const A_long x0 = std::max(output_rect.left, input_rect.left);
+        const A_long x1 = std::min<A_long>(output_rect.left + output->width, input_rect.left + input->width);
+        if (x0 >= x1) {
+            continue;
         }
+
+        const auto* in_row = reinterpret_cast<const Pixel*>(reinterpret_cast<const char*>(input->data) +
+            static_cast<std::ptrdiff_t>(layer_y - input_rect.top) * input->rowbytes);
+        std::memcpy(out_row + (x0 - output_rect.left), in_row + (x0 - input_rect.left), sizeof(Pixel) * static_cast<size_t>(x1 - x0));
     }
+}
 
-    // Check if any worker thread encountered an error
-    if (has_error.load(std::memory_order_acquire)) {
-        return PF_Err_INTERNAL_STRUCT_DAMAGED;
+template <typename Pixel>
+static PF_Err SmartRenderGeneric(PF_InData* in_data, const StretchSmartData& data, const PF_EffectWorld* input, PF_EffectWorld* output)
+{
+    if (!output->data) {
+        return PF_Err_BAD_CALLBACK_PARAM;
     }
 
-    return PF_Err_NONE;
+    // Nothing to stretch, or the input has no pixels in the requested area
+    if (!data.geometry.active || !input || !input->data || input->width <= 0 || input->height <= 0) {
+        CopyWorldRect<Pixel>(input, data.input_rect, output, data.output_rect);
+        return PF_Err_NONE;
+    }
+
+    // Move the anchor from layer space into input world space
+    StretchGeometry geometry = data.geometry;
+    geometry.anchor_x -= static_cast<float>(data.input_rect.left);
+    geometry.anchor_y -= static_cast<float>(data.input_rect.top);
+
+    return RenderStretch<Pixel>(in_data, geometry, input, output,
+                                static_cast<float>(data.input_rect.left - data.output_rect.left),
+                                static_cast<float>(data.input_rect.top - data.output_rect.top),
+                                ResultCacheForRender(in_data, data.cache_results));
 }
 
-static PF_Err Render(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* params[], PF_LayerDef* output)
+static PF_Err SmartRender(PF_InData* in_data, PF_OutData* out_data, PF_SmartRenderExtra* extra)
 {
     (void)out_data;
 
     // Null pointer checks
-    if (!in_data || !output) {
+    if (!in_data || !extra || !extra->input || !extra->cb) {
         return PF_Err_BAD_CALLBACK_PARAM;
     }
 
-    // Determine bit depth from world_flags
-    // PF_WorldFlag_DEEP indicates 16-bit, absence indicates 8-bit
-    // For 32-bit float, we check both input and output flags
-    PF_EffectWorld* input = &params[STRETCH_INPUT]->u.ld;
+    const StretchSmartData* data = static_cast<const StretchSmartData*>(extra->input->pre_render_data);
+    if (!data) {
+        return PF_Err_BAD_CALLBACK_PARAM;
+    }
 
-    if ((output->world_flags & PF_WorldFlag_DEEP) ||
-        (input->world_flags & PF_WorldFlag_DEEP)) {
-        // 16-bit
-        return RenderGeneric<PF_Pixel16>(in_data, out_data, params, output);
+    PF_EffectWorld* input = nullptr;
+    PF_Err err = extra->cb->checkout_layer_pixels(in_data->effect_ref, STRETCH_INPUT, &input);
+    if (err != PF_Err_NONE) {
+        return err;
     }
-    else {
-        // Default to 8-bit
-        return RenderGeneric<PF_Pixel>(in_data, out_data, params, output);
+
+    PF_EffectWorld* output = nullptr;
+    err = extra->cb->checkout_output(in_data->effect_ref, &output);
+
+    if (err == PF_Err_NONE && output) {
+        switch (extra->input->bitdepth) {
+        case 32:
+            err = SmartRenderGeneric<PF_PixelFloat>(in_data, *data, input, output);
+            break;
+        case 16:
+            err = SmartRenderGeneric<PF_Pixel16>(in_data, *data, input, output);
+            break;
+        default:
+            err = SmartRenderGeneric<PF_Pixel>(in_data, *data, input, output);
+            break;
+        }
     }
+
+    // Always check the input back in, even when rendering failed
+    const PF_Err checkin_err = extra->cb->checkin_layer_pixels(in_data->effect_ref, STRETCH_INPUT);
+    return (err != PF_Err_NONE) ? err : checkin_err;
 }
 
 extern "C" DllExport
@@ -1327,8 +1011,6 @@ PF_Err EffectMain(PF_Cmd cmd,
     PF_LayerDef* output,
     void* extra)
 {
-    (void)extra;
-
     PF_Err err = PF_Err_NONE;
     try {
         switch (cmd) {
@@ -1338,15 +1020,42 @@ PF_Err EffectMain(PF_Cmd cmd,
         case PF_Cmd_GLOBAL_SETUP:
             err = GlobalSetup(in_data, out_data, params, output);
             break;
+        case PF_Cmd_GLOBAL_SETDOWN:
+            err = GlobalSetdown();
+            break;
         case PF_Cmd_FRAME_SETUP:
             err = FrameSetup(in_data, out_data, params, output);
             break;
         case PF_Cmd_PARAMS_SETUP:
             err = ParamsSetup(in_data, out_data, params, output);
             break;
+        case PF_Cmd_SEQUENCE_SETUP:
+            err = SequenceSetup(in_data, out_data);
+            break;
+        case PF_Cmd_SEQUENCE_RESETUP:
+            err = SequenceResetup(in_data, out_data);
+            break;
+        case PF_Cmd_SEQUENCE_FLATTEN:
+            err = SequenceFlatten(in_data, out_data);
+            break;
+        case PF_Cmd_GET_FLATTENED_SEQUENCE_DATA:
+            err = GetFlattenedSequenceData(in_data, out_data);
+            break;
+        case PF_Cmd_SEQUENCE_SETDOWN:
+            err = SequenceSetdown(in_data, out_data);
+            break;
+        case PF_Cmd_USER_CHANGED_PARAM:
+            err = UserChangedParam(in_data, params, reinterpret_cast<const PF_UserChangedParamExtra*>(extra));
+            break;
         case PF_Cmd_RENDER:
             err = Render(in_data, out_data, params, output);
             break;
+        case PF_Cmd_SMART_PRE_RENDER:
+            err = PreRender(in_data, out_data, reinterpret_cast<PF_PreRenderExtra*>(extra));
+            break;
+        case PF_Cmd_SMART_RENDER:
+            err = SmartRender(in_data, out_data, reinterpret_cast<PF_SmartRenderExtra*>(extra));
+            break;
         default:
             break;
         }
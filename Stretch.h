@@ -39,6 +39,7 @@
 #include "String_Utils.h"
 #include "AE_GeneralPlug.h"
 #include "AEGP_SuiteHandler.h"
+#include "StretchCore.h"
 #include <cmath>
 
 #if defined(_WIN32)
@@ -71,6 +72,8 @@ enum
     STRETCH_ANCHOR_POINT,
     STRETCH_ANGLE,
     STRETCH_DIRECTION,
+    STRETCH_QUALITY,
+    STRETCH_CACHE_RESULTS,
     STRETCH_NUM_PARAMS
 };
 
@@ -79,7 +82,9 @@ enum
     SHIFT_AMOUNT_DISK_ID = 1,
     ANCHOR_POINT_DISK_ID,
     ANGLE_DISK_ID,
-    DIRECTION_DISK_ID
+    DIRECTION_DISK_ID,
+    CACHE_RESULTS_DISK_ID,
+    QUALITY_DISK_ID
 };
 
 #ifdef __cplusplus
@@ -108,17 +113,6 @@ extern "C"
 }
 #endif
 
-// Constants for anti-aliasing and sampling
-constexpr float ALPHA_THRESHOLD = 0.001f;
-constexpr float FEATHER_AMOUNT = 0.5f;
-constexpr float EPSILON = 0.001f;
-constexpr float WEIGHT_THRESHOLD = 0.999f;
-
-// Floating point comparison helper
-constexpr inline bool IsApproximatelyEqual(float a, float b, float epsilon = EPSILON) {
-    return (a > b ? a - b : b - a) < epsilon;
-}
-
 #endif // AE_STRETCH_PIPL_BUILD
 
 #endif // STRETCH_H
@@ -0,0 +1,240 @@
+#include "StretchArena.h"
+#include "StretchThreadPool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+// -----------------------------------------------------------------------------
+// Malloc backend
+// -----------------------------------------------------------------------------
+
+static void* MallocAllocate(void* user, std::size_t bytes)
+{
+    (void)user;
+#if defined(_MSC_VER)
+    return _aligned_malloc(bytes, STRETCH_ARENA_ALIGNMENT);
+#else
+    void* block = nullptr;
+    return posix_memalign(&block, STRETCH_ARENA_ALIGNMENT, bytes) == 0 ? block : nullptr;
+#endif
+}
+
+static void MallocRelease(void* user, void* block)
+{
+    (void)user;
+#if defined(_MSC_VER)
+    _aligned_free(block);
+#else
+    std::free(block);
+#endif
+}
+
+StretchArenaAllocator StretchMallocArenaAllocator()
+{
+    return { MallocAllocate, MallocRelease, nullptr };
+}
+
+// -----------------------------------------------------------------------------
+// StretchArena
+// -----------------------------------------------------------------------------
+
+static inline std::size_t AlignUp(std::size_t bytes)
+{
+    return (bytes + STRETCH_ARENA_ALIGNMENT - 1) & ~(STRETCH_ARENA_ALIGNMENT - 1);
+}
+
+StretchArena::StretchArena(const StretchArenaAllocator& allocator)
+    : allocator_(allocator)
+{
+}
+
+StretchArena::~StretchArena()
+{
+    ReleaseBlocks();
+}
+
+StretchArena::StretchArena(StretchArena&& other) noexcept
+    : allocator_(other.allocator_)
+    , blocks_(std::move(other.blocks_))
+    , current_(other.current_)
+    , offset_(other.offset_)
+{
+    other.blocks_.clear();
+    other.current_ = 0;
+    other.offset_ = 0;
+}
+
+bool StretchArena::AddBlock(std::size_t bytes)
+{
+    void* data = allocator_.allocate(allocator_.user, bytes);
+    if (!data) {
+        return false;
+    }
+    try {
+        blocks_.push_back({ static_cast<std::uint8_t*>(data), bytes });
+    }
+    catch (const std::bad_alloc&) {
+        allocator_.release(allocator_.user, data);
+        return false;
+    }
+    return true;
+}
+
+void StretchArena::ReleaseBlocks()
+{
+    for (const Block& block : blocks_) {
+        allocator_.release(allocator_.user, block.data);
+    }
+    blocks_.clear();
+    current_ = 0;
+    offset_ = 0;
+}
+
+void* StretchArena::Allocate(std::size_t bytes)
+{
+    if (bytes > SIZE_MAX - STRETCH_ARENA_ALIGNMENT) {
+        return nullptr;
+    }
+    bytes = AlignUp(std::max<std::size_t>(bytes, 1));
+
+    // Later blocks are free: they were used before the last Rewind
+    for (; current_ < blocks_.size(); ++current_, offset_ = 0) {
+        if (blocks_[current_].size - offset_ >= bytes) {
+            void* p = blocks_[current_].data + offset_;
+            offset_ += bytes;
+            return p;
+        }
+    }
+
+    // Grow geometrically so a cycle needs few blocks before Reset merges them
+    const std::size_t last = blocks_.empty() ? 0 : blocks_.back().size;
+    const std::size_t size = std::max({ bytes, STRETCH_ARENA_MIN_BLOCK, last <= SIZE_MAX / 2 ? last * 2 : last });
+    if (!AddBlock(size)) {
+        return nullptr;
+    }
+    current_ = blocks_.size() - 1;
+    offset_ = bytes;
+    return blocks_[current_].data;
+}
+
+bool StretchArena::Reserve(std::size_t bytes)
+{
+    if (bytes > SIZE_MAX - STRETCH_ARENA_ALIGNMENT) {
+        return false;
+    }
+    bytes = AlignUp(bytes);
+    for (std::size_t i = current_; i < blocks_.size(); ++i) {
+        const std::size_t used = (i == current_) ? offset_ : 0;
+        if (blocks_[i].size - used >= bytes) {
+            return true;
+        }
+    }
+    return AddBlock(std::max(bytes, STRETCH_ARENA_MIN_BLOCK));
+}
+
+void StretchArena::Rewind(const Marker& marker)
+{
+    current_ = marker.block;
+    offset_ = marker.offset;
+}
+
+void StretchArena::Reset()
+{
+    if (blocks_.size() > 1) {
+        std::size_t total = 0;
+        for (const Block& block : blocks_) {
+            total += block.size;
+        }
+        ReleaseBlocks();
+        AddBlock(total);
+    }
+    current_ = 0;
+    offset_ = 0;
+}
+
+std::size_t StretchArena::BytesReserved() const
+{
+    std::size_t total = 0;
+    for (const Block& block : blocks_) {
+        total += block.size;
+    }
+    return total;
+}
+
+// -----------------------------------------------------------------------------
+// StretchFrameArena
+// -----------------------------------------------------------------------------
+
+StretchFrameArena::StretchFrameArena(const StretchArenaAllocator& allocator)
+{
+    arenas_.reserve(1 + StretchThreadPool::MAX_THREADS);
+    for (int i = 0; i < 1 + StretchThreadPool::MAX_THREADS; ++i) {
+        arenas_.emplace_back(allocator);
+    }
+}
+
+bool StretchFrameArena::ReserveThreads(std::size_t bytes)
+{
+    const int threads = StretchThreadPool::Instance().WorkerCount() + 1;
+    for (int i = 0; i < threads; ++i) {
+        if (!ForThread(i).Reserve(bytes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StretchFrameArena::Reset()
+{
+    for (StretchArena& arena : arenas_) {
+        arena.Reset();
+    }
+}
+
+std::size_t StretchFrameArena::BytesReserved() const
+{
+    std::size_t total = 0;
+    for (const StretchArena& arena : arenas_) {
+        total += arena.BytesReserved();
+    }
+    return total;
+}
+
+// -----------------------------------------------------------------------------
+// StretchFrameArenaPool
+// -----------------------------------------------------------------------------
+
+std::unique_ptr<StretchFrameArena> StretchFrameArenaPool::Acquire(const StretchArenaAllocator& allocator)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            std::unique_ptr<StretchFrameArena> arena = std::move(free_.back());
+            free_.pop_back();
+            return arena;
+        }
+    }
+    return std::make_unique<StretchFrameArena>(allocator);
+}
+
+void StretchFrameArenaPool::Release(std::unique_ptr<StretchFrameArena> arena) noexcept
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    try {
+        free_.push_back(std::move(arena));
+    }
+    catch (...) {
+    }
+}
+
+void StretchFrameArenaPool::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.clear();
+}
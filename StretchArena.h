@@ -0,0 +1,168 @@
+#pragma once
+#ifndef STRETCH_ARENA_H
+#define STRETCH_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Scratch arenas
+// -----------------------------------------------------------------------------
+//
+// Per-render scratch memory (line caches, premultiplied copies, span staging)
+// comes from bump arenas instead of the global heap, so concurrent frames do
+// not contend on the allocator. Blocks come from a pluggable backend: inside
+// After Effects the plugin routes them through PF_HandleSuite so they show up
+// in the host's memory accounting; the SDK-free build uses aligned malloc.
+
+// Alignment of every arena allocation (one cache line)
+constexpr std::size_t STRETCH_ARENA_ALIGNMENT = 64;
+
+// Smallest block requested from the backend
+constexpr std::size_t STRETCH_ARENA_MIN_BLOCK = 64 * 1024;
+
+struct StretchArenaAllocator
+{
+    // Returns a STRETCH_ARENA_ALIGNMENT-aligned block, or nullptr
+    void* (*allocate)(void* user, std::size_t bytes);
+    void (*release)(void* user, void* block);
+    void* user;
+};
+
+// Aligned malloc backend
+StretchArenaAllocator StretchMallocArenaAllocator();
+
+// Bump allocator over a list of backend blocks. Not thread-safe: each thread
+// allocates from its own arena (see StretchFrameArena).
+class StretchArena
+{
+public:
+    explicit StretchArena(const StretchArenaAllocator& allocator = StretchMallocArenaAllocator());
+    ~StretchArena();
+
+    StretchArena(StretchArena&& other) noexcept;
+    StretchArena(const StretchArena&) = delete;
+    StretchArena& operator=(const StretchArena&) = delete;
+    StretchArena& operator=(StretchArena&&) = delete;
+
+    // Uninitialized, aligned storage valid until Rewind/Reset.
+    // Returns nullptr when the backend is out of memory.
+    void* Allocate(std::size_t bytes);
+
+    template <typename T>
+    T* AllocateArray(std::size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed");
+        if (count > SIZE_MAX / sizeof(T)) {
+            return nullptr;
+        }
+        return static_cast<T*>(Allocate(count * sizeof(T)));
+    }
+
+    // Makes sure the next allocations of up to `bytes` in total need no new
+    // block. Call from the thread that owns the backend before parallel work.
+    bool Reserve(std::size_t bytes);
+
+    // Position to roll back to, for scratch that lives for one task
+    struct Marker
+    {
+        std::size_t block;
+        std::size_t offset;
+    };
+
+    Marker Mark() const { return { current_, offset_ }; }
+    void Rewind(const Marker& marker);
+
+    // Drops every allocation but keeps the blocks. If the last cycle spilled
+    // into several blocks they are merged into one, so a steady workload
+    // settles on a single block and no backend calls.
+    void Reset();
+
+    std::size_t BytesReserved() const;
+
+private:
+    struct Block
+    {
+        std::uint8_t* data;
+        std::size_t size;
+    };
+
+    bool AddBlock(std::size_t bytes);
+    void ReleaseBlocks();
+
+    StretchArenaAllocator allocator_;
+    std::vector<Block> blocks_;
+    std::size_t current_ = 0;  // block being bumped
+    std::size_t offset_ = 0;   // bytes used in blocks_[current_]
+};
+
+// One render's scratch: a shared arena for frame-level buffers, used by the
+// thread that calls StretchRenderFrame, plus one sub-arena per pool thread
+// for per-task staging, indexed by StretchThreadPool::CurrentThreadIndex().
+class StretchFrameArena
+{
+public:
+    explicit StretchFrameArena(const StretchArenaAllocator& allocator = StretchMallocArenaAllocator());
+
+    StretchArena& Shared() { return arenas_[0]; }
+    StretchArena& ForThread(int thread_index) { return arenas_[1 + thread_index]; }
+
+    // Reserves `bytes` in the sub-arena of every pool thread
+    bool ReserveThreads(std::size_t bytes);
+
+    void Reset();
+
+    std::size_t BytesReserved() const;
+
+private:
+    std::vector<StretchArena> arenas_;
+};
+
+// Frame arenas shared by concurrent renders, one per frame in flight. A
+// render leases a free arena and returns it when done, so a steady workload
+// reuses the same blocks every frame instead of allocating them; the pool
+// grows to the number of frames rendered at once (multi-frame rendering).
+// Thread-safe.
+class StretchFrameArenaPool
+{
+public:
+    // A free arena, or a new one on allocator if none is free
+    std::unique_ptr<StretchFrameArena> Acquire(const StretchArenaAllocator& allocator);
+
+    // Returns arena to the pool. Out of memory for the free list, the arena
+    // is disposed instead
+    void Release(std::unique_ptr<StretchFrameArena> arena) noexcept;
+
+    // Disposes every free arena; leased ones return to the pool as usual
+    void Clear();
+
+    // Holds an arena of the pool for one render, however the render exits
+    class Lease
+    {
+    public:
+        Lease(StretchFrameArenaPool& pool, const StretchArenaAllocator& allocator)
+            : pool_(pool), arena_(pool.Acquire(allocator))
+        {
+        }
+        ~Lease() { pool_.Release(std::move(arena_)); }
+
+        StretchFrameArena& Arena() { return *arena_; }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+    private:
+        StretchFrameArenaPool& pool_;
+        std::unique_ptr<StretchFrameArena> arena_;
+    };
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<StretchFrameArena>> free_;
+};
+
+#endif // STRETCH_ARENA_H
@@ -0,0 +1,1173 @@
+#include "StretchCore.h"
+#include "StretchArena.h"
+#include "StretchThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// -----------------------------------------------------------------------------
+// Geometry
+// -----------------------------------------------------------------------------
+
+StretchGeometry StretchComputeGeometry(const StretchParams& params)
+{
+    StretchGeometry geometry;
+    geometry.direction = params.direction;
+    geometry.quality = (params.quality >= STRETCH_QUALITY_NEAREST && params.quality <= STRETCH_QUALITY_LANCZOS3)
+        ? params.quality
+        : STRETCH_QUALITY_BILINEAR;
+    if (params.draft) {
+        geometry.quality = STRETCH_QUALITY_NEAREST;
+        geometry.feather = 0.0f;
+    }
+    geometry.anchor_x = params.anchor_x;
+    geometry.anchor_y = params.anchor_y;
+
+    const float downsample = std::min(params.downsample_x, params.downsample_y);
+
+    // Effective shift in pixels with NaN/infinity validation
+    float effective_shift = (downsample > 0.0f && std::isfinite(downsample))
+        ? (params.shift_amount / downsample)
+        : params.shift_amount;
+
+    if (!std::isfinite(effective_shift)) {
+        effective_shift = 0.0f;
+    }
+
+    // No shift: input passes through unchanged
+    if (std::abs(effective_shift) < 0.01f) {
+        return geometry;
+    }
+
+    // Direction adjustment (Both mode splits the shift)
+    if (params.direction == STRETCH_DIRECTION_BOTH) {
+        effective_shift *= 0.5f;
+    }
+
+    const float angle_rad = params.angle_deg * (static_cast<float>(M_PI) / 180.0f);
+    float sn = std::sin(angle_rad);
+    float cs = std::cos(angle_rad);
+
+    // Snap quarter turns to exact axis vectors so the axis-aligned kernels apply
+    const float quarter_turns = params.angle_deg / 90.0f;
+    if (std::isfinite(quarter_turns) && quarter_turns == std::floor(quarter_turns)) {
+        static const float QUARTER_SIN[4] = { 0.0f, 1.0f, 0.0f, -1.0f };
+        static const float QUARTER_COS[4] = { 1.0f, 0.0f, -1.0f, 0.0f };
+        const int quadrant = static_cast<int>(std::fmod(quarter_turns, 4.0f) + 4.0f) & 3;
+        sn = QUARTER_SIN[quadrant];
+        cs = QUARTER_COS[quadrant];
+    }
+
+    // Perpendicular vector (direction of shift)
+    geometry.perp_x = -sn;
+    geometry.perp_y = cs;
+
+    // Parallel vector (along the "cut" line)
+    geometry.para_x = cs;
+    geometry.para_y = sn;
+
+    geometry.effective_shift = effective_shift;
+    geometry.shift_vec_x = geometry.perp_x * effective_shift;
+    geometry.shift_vec_y = geometry.perp_y * effective_shift;
+    geometry.active = true;
+    return geometry;
+}
+
+StretchExpansion StretchComputeExpansion(const StretchGeometry& geometry, int input_width, int input_height)
+{
+    StretchExpansion expansion;
+    if (!geometry.active || input_width <= 0 || input_height <= 0) {
+        return expansion;
+    }
+
+    const float shift_vec_x = geometry.shift_vec_x;
+    const float shift_vec_y = geometry.shift_vec_y;
+
+    // Calculate bounding box
+    float min_x = 0.0f;
+    float max_x = static_cast<float>(input_width);
+    float min_y = 0.0f;
+    float max_y = static_cast<float>(input_height);
+
+    const float corners[4][2] = {
+        {0.0f, 0.0f},
+        {static_cast<float>(input_width), 0.0f},
+        {0.0f, static_cast<float>(input_height)},
+        {static_cast<float>(input_width), static_cast<float>(input_height)}
+    };
+
+    for (int i = 0; i < 4; i++) {
+        const float x = corners[i][0];
+        const float y = corners[i][1];
+
+        if (geometry.direction == STRETCH_DIRECTION_BOTH) {
+            const float x_pos = x + shift_vec_x;
+            const float y_pos = y + shift_vec_y;
+            const float x_neg = x - shift_vec_x;
+            const float y_neg = y - shift_vec_y;
+
+            min_x = std::min({min_x, x_pos, x_neg});
+            max_x = std::max({max_x, x_pos, x_neg});
+            min_y = std::min({min_y, y_pos, y_neg});
+            max_y = std::max({max_y, y_pos, y_neg});
+        }
+        else if (geometry.direction == STRETCH_DIRECTION_FORWARD) {
+            // Forward: pixels shift in -shift_vec direction (sampling from -shift_vec)
+            // So the image appears to move in +shift_vec direction
+            // We need to expand buffer in +shift_vec direction
+            const float x_shifted = x + shift_vec_x;
+            const float y_shifted = y + shift_vec_y;
+
+            min_x = std::min(min_x, x_shifted);
+            max_x = std::max(max_x, x_shifted);
+            min_y = std::min(min_y, y_shifted);
+            max_y = std::max(max_y, y_shifted);
+        }
+        else {
+            // Backward: pixels shift in +shift_vec direction (sampling from +shift_vec)
+            // So the image appears to move in -shift_vec direction
+            // We need to expand buffer in -shift_vec direction
+            const float x_shifted = x - shift_vec_x;
+            const float y_shifted = y - shift_vec_y;
+
+            min_x = std::min(min_x, x_shifted);
+            max_x = std::max(max_x, x_shifted);
+            min_y = std::min(min_y, y_shifted);
+            max_y = std::max(max_y, y_shifted);
+        }
+    }
+
+    // Calculate required expansion
+    expansion.left = std::max(0, static_cast<int>(std::ceil(-min_x)));
+    expansion.top = std::max(0, static_cast<int>(std::ceil(-min_y)));
+    expansion.right = std::max(0, static_cast<int>(std::ceil(max_x - input_width)));
+    expansion.bottom = std::max(0, static_cast<int>(std::ceil(max_y - input_height)));
+    return expansion;
+}
+
+// -----------------------------------------------------------------------------
+// Resampling kernels
+// -----------------------------------------------------------------------------
+
+namespace {
+
+// Catmull-Rom spline (cubic convolution with a = -0.5)
+double CatmullRom(double x)
+{
+    x = std::fabs(x);
+    if (x < 1.0) {
+        return (1.5 * x - 2.5) * x * x + 1.0;
+    }
+    if (x < 2.0) {
+        return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+    }
+    return 0.0;
+}
+
+double Sinc(double x)
+{
+    if (x == 0.0) {
+        return 1.0;
+    }
+    const double px = M_PI * x;
+    return std::sin(px) / px;
+}
+
+double Lanczos3(double x)
+{
+    return std::fabs(x) < 3.0 ? Sinc(x) * Sinc(x / 3.0) : 0.0;
+}
+
+// Weights of every phase, each row normalized so flat areas stay flat.
+// Weights within float rounding of zero are stored as zero so the samplers
+// can skip those taps (phase 0 of both kernels is a single tap)
+template <int TAPS>
+struct KernelTable
+{
+    static_assert(TAPS <= STRETCH_MAX_KERNEL_TAPS, "kernel wider than STRETCH_MAX_KERNEL_TAPS");
+
+    float weights[(STRETCH_KERNEL_PHASES + 1) * TAPS];
+    StretchKernel kernel;
+
+    KernelTable(int first, double (*function)(double))
+    {
+        for (int phase = 0; phase <= STRETCH_KERNEL_PHASES; ++phase) {
+            const double f = static_cast<double>(phase) / STRETCH_KERNEL_PHASES;
+            double w[TAPS];
+            double total = 0.0;
+            for (int i = 0; i < TAPS; ++i) {
+                w[i] = function(static_cast<double>(first + i) - f);
+                total += w[i];
+            }
+            for (int i = 0; i < TAPS; ++i) {
+                const double normalized = w[i] / total;
+                weights[phase * TAPS + i] = std::fabs(normalized) < 1e-7 ? 0.0f : static_cast<float>(normalized);
+            }
+        }
+        kernel = { TAPS, first, weights };
+    }
+};
+
+const KernelTable<4> BICUBIC_TABLE(-1, CatmullRom);
+const KernelTable<6> LANCZOS3_TABLE(-2, Lanczos3);
+
+} // namespace
+
+const StretchKernel* StretchGetKernel(int quality)
+{
+    switch (quality) {
+    case STRETCH_QUALITY_BICUBIC:
+        return &BICUBIC_TABLE.kernel;
+    case STRETCH_QUALITY_LANCZOS3:
+        return &LANCZOS3_TABLE.kernel;
+    default:
+        return nullptr;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Input rect
+// -----------------------------------------------------------------------------
+
+namespace {
+
+struct BandPoint
+{
+    double x;
+    double y;
+};
+
+// Convex polygon, at most 4 + 2 vertices after clipping a rect by two lines
+struct BandPolygon
+{
+    BandPoint points[8];
+    int count = 0;
+};
+
+// Keeps the part of the polygon where sign * (dist - limit) >= 0
+BandPolygon ClipPolygon(const BandPolygon& poly, const StretchGeometry& g, double limit, double sign)
+{
+    BandPolygon out;
+    for (int i = 0; i < poly.count; ++i) {
+        const BandPoint& a = poly.points[i];
+        const BandPoint& b = poly.points[(i + 1) % poly.count];
+        const double da = sign * ((a.x - g.anchor_x) * g.perp_x + (a.y - g.anchor_y) * g.perp_y - limit);
+        const double db = sign * ((b.x - g.anchor_x) * g.perp_x + (b.y - g.anchor_y) * g.perp_y - limit);
+
+        if (da >= 0.0) {
+            out.points[out.count++] = a;
+        }
+        if ((da >= 0.0) != (db >= 0.0)) {
+            const double t = da / (da - db);
+            out.points[out.count++] = { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t };
+        }
+    }
+    return out;
+}
+
+// Bounding box of sample points, grown to the kernel footprint
+struct SampleBounds
+{
+    double min_x = HUGE_VAL;
+    double min_y = HUGE_VAL;
+    double max_x = -HUGE_VAL;
+    double max_y = -HUGE_VAL;
+
+    void Add(double x, double y)
+    {
+        min_x = std::min(min_x, x);
+        min_y = std::min(min_y, y);
+        max_x = std::max(max_x, x);
+        max_y = std::max(max_y, y);
+    }
+};
+
+// Output pixels with dist in [lo, hi], sampled at p + (offset_x, offset_y) or,
+// for gap bands, at their projection onto the anchor line
+void AddBand(SampleBounds& bounds, const BandPolygon& rect, const StretchGeometry& g,
+    double lo, double hi, bool project, double offset_x, double offset_y)
+{
+    BandPolygon poly = ClipPolygon(rect, g, lo, 1.0);
+    poly = ClipPolygon(poly, g, hi, -1.0);
+
+    for (int i = 0; i < poly.count; ++i) {
+        const BandPoint& p = poly.points[i];
+        if (project) {
+            const double t = (p.x - g.anchor_x) * g.para_x + (p.y - g.anchor_y) * g.para_y;
+            bounds.Add(g.anchor_x + t * g.para_x, g.anchor_y + t * g.para_y);
+        } else {
+            bounds.Add(p.x + offset_x, p.y + offset_y);
+        }
+    }
+}
+
+// Input read for output_rect; gap pixels count only with `gap` (their
+// projections onto the anchor line)
+StretchRect ComputeFootprint(const StretchGeometry& geometry, const StretchRect& output_rect, bool gap)
+{
+    if (output_rect.IsEmpty() || !geometry.active) {
+        return output_rect;
+    }
+
+    // Pixel centers of the output rect (output pixel i samples input coordinate i)
+    BandPolygon rect;
+    rect.count = 4;
+    rect.points[0] = { static_cast<double>(output_rect.left), static_cast<double>(output_rect.top) };
+    rect.points[1] = { static_cast<double>(output_rect.right - 1), static_cast<double>(output_rect.top) };
+    rect.points[2] = { static_cast<double>(output_rect.right - 1), static_cast<double>(output_rect.bottom - 1) };
+    rect.points[3] = { static_cast<double>(output_rect.left), static_cast<double>(output_rect.bottom - 1) };
+
+    const double eff = geometry.effective_shift;
+    const double feather = geometry.feather;
+    const double sx = geometry.shift_vec_x;
+    const double sy = geometry.shift_vec_y;
+    const double inf = HUGE_VAL;
+
+    // Bands include the feather zones, where both neighbours are sampled
+    SampleBounds bounds;
+    if (geometry.direction == STRETCH_DIRECTION_BOTH) {
+        AddBand(bounds, rect, geometry, eff - feather, inf, false, -sx, -sy);
+        AddBand(bounds, rect, geometry, -inf, -eff + feather, false, sx, sy);
+        if (gap) {
+            AddBand(bounds, rect, geometry, -eff - feather, eff + feather, true, 0.0, 0.0);
+        }
+    }
+    else if (geometry.direction == STRETCH_DIRECTION_FORWARD) {
+        AddBand(bounds, rect, geometry, -inf, feather, false, 0.0, 0.0);
+        AddBand(bounds, rect, geometry, eff - feather, inf, false, -sx, -sy);
+        if (gap) {
+            AddBand(bounds, rect, geometry, -feather, eff + feather, true, 0.0, 0.0);
+        }
+    }
+    else {
+        AddBand(bounds, rect, geometry, -feather, inf, false, 0.0, 0.0);
+        AddBand(bounds, rect, geometry, -inf, -eff + feather, false, sx, sy);
+        if (gap) {
+            AddBand(bounds, rect, geometry, -eff - feather, feather, true, 0.0, 0.0);
+        }
+    }
+
+    if (bounds.min_x > bounds.max_x) {
+        return StretchRect();
+    }
+
+    // A kernel of radius r reads floor(x) - (r - 1) through floor(x) + r
+    // (bilinear: floor(x) and floor(x) + 1). The kernels step coordinates
+    // incrementally in float, so keep a small margin for accumulated error
+    constexpr double MARGIN = 2.0;
+    const int radius = StretchKernelRadius(geometry.quality);
+    StretchRect input_rect;
+    input_rect.left = static_cast<int>(std::floor(bounds.min_x - MARGIN)) - (radius - 1);
+    input_rect.top = static_cast<int>(std::floor(bounds.min_y - MARGIN)) - (radius - 1);
+    input_rect.right = static_cast<int>(std::floor(bounds.max_x + MARGIN)) + 1 + radius;
+    input_rect.bottom = static_cast<int>(std::floor(bounds.max_y + MARGIN)) + 1 + radius;
+    return input_rect;
+}
+
+} // namespace
+
+StretchRect StretchComputeInputRect(const StretchGeometry& geometry, const StretchRect& output_rect)
+{
+    return ComputeFootprint(geometry, output_rect, true);
+}
+
+StretchRect StretchComputeSourceRect(const StretchGeometry& geometry, const StretchRect& output_rect)
+{
+    return ComputeFootprint(geometry, output_rect, false);
+}
+
+// -----------------------------------------------------------------------------
+// Frame rendering
+// -----------------------------------------------------------------------------
+
+// Line cache samples per pool task
+constexpr int LINE_CACHE_GRAIN = 1024;
+
+// Premultiplied copy rows per pool task
+constexpr int PREMULTIPLY_ROWS_PER_TASK = 32;
+
+namespace {
+
+// STRETCH_PROFILE, read once; empty when unset or "0"
+const std::string& ProfileDestination()
+{
+    static const std::string destination = []() {
+        const char* env = std::getenv("STRETCH_PROFILE");
+        return std::string((env && std::strcmp(env, "0") != 0) ? env : "");
+    }();
+    return destination;
+}
+
+} // namespace
+
+StretchRenderOptions StretchGetDefaultRenderOptions()
+{
+    static const bool premultiplied = []() {
+        const char* env = std::getenv("STRETCH_PREMULTIPLIED");
+        return env && std::strcmp(env, "1") == 0;
+    }();
+
+    StretchRenderOptions options;
+    options.premultiplied = premultiplied;
+    options.profile = !ProfileDestination().empty();
+    return options;
+}
+
+void StretchWriteRenderStats(const StretchRenderStats& stats)
+{
+    const std::string& destination = ProfileDestination();
+    if (destination.empty()) {
+        return;
+    }
+
+    const auto us = [](std::int64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    const char* kernel = stats.premultiplied ? "premultiplied" : (stats.axis_aligned ? "axis_aligned" : "general");
+    char line[1024];
+    std::snprintf(line, sizeof(line),
+        "{\"frame\":%d,\"width\":%d,\"height\":%d,\"depth\":%d,\"quality\":%d,\"direction\":%d,"
+        "\"kernel\":\"%s\",\"reuse\":%s,\"strips\":%d,\"threads\":%d,\"tasks\":%d,"
+        "\"total_us\":%.1f,\"setup_us\":%.1f,\"render_us\":%.1f,\"join_us\":%.1f,\"sink_us\":%.1f,"
+        "\"task_us\":%.1f,\"task_max_us\":%.1f,"
+        "\"source_px\":%llu,\"gap_px\":%llu,\"feather_px\":%llu,\"reused_px\":%llu}\n",
+        stats.frame, stats.width, stats.height, stats.depth, stats.quality, stats.direction,
+        kernel, stats.reuse ? "true" : "false", stats.strips, stats.threads, stats.tasks,
+        us(stats.total_ns), us(stats.setup_ns), us(stats.render_ns), us(stats.join_ns), us(stats.sink_ns),
+        us(stats.task_ns), us(stats.task_max_ns),
+        static_cast<unsigned long long>(stats.pixels[STRETCH_SPAN_SOURCE]),
+        static_cast<unsigned long long>(stats.pixels[STRETCH_SPAN_BORDER]),
+        static_cast<unsigned long long>(stats.pixels[STRETCH_SPAN_FEATHER]),
+        static_cast<unsigned long long>(stats.reused_pixels));
+
+    // Whole lines, also from concurrent frames. The file is reopened per line
+    // so several processes (render farm nodes, say) can share it
+    static std::mutex mutex;
+    const std::lock_guard<std::mutex> lock(mutex);
+    if (destination == "1") {
+        std::fputs(line, stderr);
+        std::fflush(stderr);
+    }
+    else if (std::FILE* file = std::fopen(destination.c_str(), "a")) {
+        std::fputs(line, file);
+        std::fclose(file);
+    }
+}
+
+namespace {
+
+std::int64_t ProfileClock()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void AtomicMax(std::atomic<std::int64_t>& target, std::int64_t value)
+{
+    std::int64_t current = target.load(std::memory_order_relaxed);
+    while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+// Statistics of a render in flight (see StretchRenderStats). Pool tasks add
+// theirs once each, when they end; the rest is the render thread's
+struct FrameProfile
+{
+    std::atomic<std::uint64_t> pixels[STRETCH_SPAN_KIND_COUNT];
+    std::atomic<std::uint64_t> reused_pixels{0};
+    std::atomic<int> tasks{0};
+    std::atomic<std::int64_t> task_ns{0};
+    std::atomic<std::int64_t> task_max_ns{0};
+    std::atomic<std::int64_t> last_task_end{0};
+
+    std::int64_t render_ns = 0;
+    std::int64_t join_ns = 0;
+    std::int64_t sink_ns = 0;
+
+    FrameProfile()
+    {
+        for (std::atomic<std::uint64_t>& count : pixels) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void AddTask(std::int64_t begin, std::int64_t end, const StretchSpanCounts& counts, std::uint64_t reused)
+    {
+        for (int kind = 0; kind < STRETCH_SPAN_KIND_COUNT; ++kind) {
+            pixels[kind].fetch_add(counts.pixels[kind], std::memory_order_relaxed);
+        }
+        reused_pixels.fetch_add(reused, std::memory_order_relaxed);
+        tasks.fetch_add(1, std::memory_order_relaxed);
+        task_ns.fetch_add(end - begin, std::memory_order_relaxed);
+        AtomicMax(task_max_ns, end - begin);
+        AtomicMax(last_task_end, end);
+    }
+
+    // A ParallelFor over tasks, dispatched and returned at the given times
+    void AddPass(std::int64_t dispatched, std::int64_t joined)
+    {
+        const std::int64_t last = (std::max)(last_task_end.load(std::memory_order_relaxed), dispatched);
+        render_ns += last - dispatched;
+        join_ns += joined - last;
+    }
+};
+
+// Knots of a frame's gap line cache (StretchLineCacheKnots), from the
+// arena. count is 0 without a cache
+struct LineCacheKnots
+{
+    const float* knots = nullptr;
+    const int* cells = nullptr;
+    int size = 0;
+    int count = 0;
+    float t0 = 0.0f;
+};
+
+template <typename Pixel>
+LineCacheKnots PlaceLineCacheKnots(StretchArena& arena, const StretchRenderContext<Pixel>& ctx)
+{
+    LineCacheKnots layout;
+    float t0 = 0.0f;
+    const int size = StretchLineCacheRange(ctx, t0);
+    if (size < 2) {
+        return layout;
+    }
+    float* knots = arena.AllocateArray<float>(static_cast<std::size_t>(StretchLineCacheKnotCapacity(ctx, size)));
+    int* cells = arena.AllocateArray<int>(static_cast<std::size_t>(size));
+    if (!knots || !cells) {
+        return layout;
+    }
+    layout.count = StretchLineCacheKnots(ctx, t0, size, knots, cells);
+    layout.knots = knots;
+    layout.cells = cells;
+    layout.size = size;
+    layout.t0 = t0;
+    return layout;
+}
+
+// Arena arrays of a gap line cache beside its knots
+template <typename Sample>
+struct LineCacheArrays
+{
+    Sample* samples = nullptr;
+    std::uint8_t* direct = nullptr;
+    Sample* grid = nullptr;
+    std::uint8_t* plain = nullptr;
+};
+
+// False when the layout is empty or the arena is out of memory
+template <typename Sample>
+bool AllocateLineCache(StretchArena& arena, const LineCacheKnots& layout, LineCacheArrays<Sample>& arrays)
+{
+    if (layout.count <= 0) {
+        return false;
+    }
+    const std::size_t count = static_cast<std::size_t>(layout.count);
+    const std::size_t size = static_cast<std::size_t>(layout.size);
+    arrays.samples = arena.AllocateArray<Sample>(count);
+    arrays.direct = arena.AllocateArray<std::uint8_t>(count);
+    arrays.grid = arena.AllocateArray<Sample>(size);
+    arrays.plain = arena.AllocateArray<std::uint8_t>(size);
+    return arrays.samples && arrays.direct && arrays.grid && arrays.plain;
+}
+
+// The filled cache, with its grid
+template <typename Sample>
+StretchLineCache<Sample> FinishLineCache(const LineCacheKnots& layout, const LineCacheArrays<Sample>& arrays)
+{
+    StretchLineCacheFillGrid(arrays.samples, layout.cells, arrays.direct, layout.size, arrays.grid, arrays.plain);
+    return { arrays.samples, layout.knots, layout.cells, arrays.direct, arrays.grid, arrays.plain, layout.size, layout.t0 };
+}
+
+// samples[k] = sample(t0 + knots[k] / LINE_CACHE_OVERSAMPLE) for the gap line cache
+template <typename Sample, typename SampleFunc>
+bool FillLineCache(StretchThreadPool& pool, int parallelism, Sample* samples, const LineCacheKnots& layout, const SampleFunc& sample)
+{
+    return pool.ParallelFor(0, layout.count, LINE_CACHE_GRAIN,
+        [samples, &layout, &sample](int begin, int end) {
+            for (int k = begin; k < end; ++k) {
+                samples[k] = sample(layout.t0 + layout.knots[k] / static_cast<float>(LINE_CACHE_OVERSAMPLE));
+            }
+        }, parallelism);
+}
+
+// direct[k] = is_direct(samples[k], samples[k + 1]) for the gap line cache,
+// except between transparent knots over clear input (StretchLineCacheClear);
+// the last knot starts no segment
+template <typename Pixel, typename Sample, typename DirectFunc>
+bool MarkLineCacheDirect(StretchThreadPool& pool, int parallelism, const StretchRenderContext<Pixel>& ctx,
+    const LineCacheKnots& layout, const Sample* samples, std::uint8_t* direct, const DirectFunc& is_direct)
+{
+    direct[layout.count - 1] = 0;
+    return pool.ParallelFor(0, layout.count - 1, LINE_CACHE_GRAIN,
+        [&ctx, &layout, samples, direct, &is_direct](int begin, int end) {
+            const float scale = 1.0f / static_cast<float>(LINE_CACHE_OVERSAMPLE);
+            const auto transparent = [](const Sample& s) { return PixelTraits<Sample>::ToFloat(s.alpha) <= ALPHA_THRESHOLD; };
+            for (int k = begin; k < end; ++k) {
+                bool sampled = is_direct(samples[k], samples[k + 1]);
+                if (sampled && transparent(samples[k]) && transparent(samples[k + 1])) {
+                    sampled = !StretchLineCacheClear(ctx,
+                        layout.t0 + layout.knots[k] * scale, layout.t0 + layout.knots[k + 1] * scale);
+                }
+                direct[k] = sampled ? 1 : 0;
+            }
+        }, parallelism);
+}
+
+// Premultiplied copy of the input with a transparent one-pixel border.
+// scratch holds (input_width + 2) x (input_height + 2) pixels
+template <typename Pixel>
+bool FillPremultipliedInput(StretchThreadPool& pool, int parallelism, const StretchRenderContext<Pixel>& ctx, StretchPixelF* scratch)
+{
+    const std::ptrdiff_t stride = ctx.input_width + 2;
+    return pool.ParallelFor(-1, ctx.input_height + 1, PREMULTIPLY_ROWS_PER_TASK,
+        [&ctx, scratch, stride](int begin, int end) {
+            for (int y = begin; y < end; ++y) {
+                StretchPixelF* out = scratch + (static_cast<std::ptrdiff_t>(y) + 1) * stride;
+                if (y < 0 || y >= ctx.input_height) {
+                    std::memset(out, 0, static_cast<size_t>(stride) * sizeof(StretchPixelF));
+                    continue;
+                }
+                const Pixel* in = reinterpret_cast<const Pixel*>(ctx.input_base + static_cast<std::ptrdiff_t>(y) * ctx.input_rowbytes);
+                std::memset(out, 0, sizeof(StretchPixelF));
+                for (int x = 0; x < ctx.input_width; ++x) {
+                    out[x + 1] = Premultiply(in[x]);
+                }
+                std::memset(out + ctx.input_width + 1, 0, sizeof(StretchPixelF));
+            }
+        }, parallelism);
+}
+
+// Probe grid (per axis) for the share of a frame that reuse can copy
+constexpr int REUSE_PROBE_GRID = 32;
+
+// Below this share, rendering in row pieces costs more than copying saves
+constexpr float REUSE_MIN_SHARE = 0.125f;
+
+// StretchRenderOptions::reuse resolved for one frame
+struct FrameReuse
+{
+    StretchReuseClassifier classifier;
+    const std::uint8_t* data;
+    std::ptrdiff_t rowbytes;
+    int width;
+    int height;
+
+    // Output position of the previous frame's pixel (0, 0)
+    int offset_x;
+    int offset_y;
+};
+
+// Checks that reuse differs from ctx only in the shift and a whole-pixel
+// origin move, and that copying pays off: the axis-aligned kernels already
+// run at copy speed, and a frame needs enough reusable pixels
+template <typename Pixel>
+bool PlanReuse(const StretchRenderContext<Pixel>& ctx, int direction, const StretchReuseFrame& reuse, FrameReuse& plan)
+{
+    const StretchGeometry& previous = reuse.geometry;
+    if (!reuse.data || reuse.data == ctx.output_base || reuse.width <= 0 || reuse.height <= 0
+        || previous.direction != direction || previous.quality != ctx.quality
+        || previous.feather != ctx.feather
+        || previous.anchor_x != ctx.anchor_x || previous.anchor_y != ctx.anchor_y
+        || previous.perp_x != ctx.perp_x || previous.perp_y != ctx.perp_y
+        || previous.para_x != ctx.para_x || previous.para_y != ctx.para_y) {
+        return false;
+    }
+
+    const float offset_x = ctx.output_origin_x - reuse.output_origin_x;
+    const float offset_y = ctx.output_origin_y - reuse.output_origin_y;
+    if (offset_x != std::floor(offset_x) || offset_y != std::floor(offset_y)
+        || std::fabs(offset_x) > 1.0e6f || std::fabs(offset_y) > 1.0e6f) {
+        return false;
+    }
+
+    StretchRenderContext<Pixel> previous_ctx = ctx;
+    previous_ctx.shift_vec_x = previous.shift_vec_x;
+    previous_ctx.shift_vec_y = previous.shift_vec_y;
+    previous_ctx.output_origin_x = reuse.output_origin_x;
+    previous_ctx.output_origin_y = reuse.output_origin_y;
+    if (StretchIsAxisAligned(ctx) || StretchIsAxisAligned(previous_ctx)) {
+        return false;
+    }
+
+    plan.classifier = StretchMakeReuseClassifier(ctx, direction, previous);
+    plan.data = static_cast<const std::uint8_t*>(reuse.data);
+    plan.rowbytes = reuse.rowbytes;
+    plan.width = reuse.width;
+    plan.height = reuse.height;
+    plan.offset_x = static_cast<int>(offset_x);
+    plan.offset_y = static_cast<int>(offset_y);
+
+    // Pixel centers of a coarse grid over the output
+    int reusable = 0;
+    for (int j = 0; j < REUSE_PROBE_GRID; ++j) {
+        const int y = static_cast<int>((static_cast<long long>(2 * j + 1) * ctx.height) / (2 * REUSE_PROBE_GRID));
+        const int previous_y = y - plan.offset_y;
+        if (previous_y < 0 || previous_y >= plan.height) {
+            continue;
+        }
+        const float dy = static_cast<float>(y) - ctx.output_origin_y - ctx.anchor_y;
+        for (int i = 0; i < REUSE_PROBE_GRID; ++i) {
+            const int x = static_cast<int>((static_cast<long long>(2 * i + 1) * ctx.width) / (2 * REUSE_PROBE_GRID));
+            const int previous_x = x - plan.offset_x;
+            if (previous_x < 0 || previous_x >= plan.width) {
+                continue;
+            }
+            const float dx = static_cast<float>(x) - ctx.output_origin_x - ctx.anchor_x;
+            if (plan.classifier.Classify(dx * ctx.perp_x + dy * ctx.perp_y) < STRETCH_MAX_REGIONS) {
+                ++reusable;
+            }
+        }
+    }
+    return reusable >= REUSE_MIN_SHARE * static_cast<float>(REUSE_PROBE_GRID * REUSE_PROBE_GRID);
+}
+
+// Copies the pixels of [start_x, end_x) x [start_y, end_y) that plan can
+// reuse, and passes each remaining run to render(start_x, y, end_x, y + 1).
+// Returns the number of pixels copied
+template <typename Pixel, typename RenderFunc>
+std::uint64_t RenderTileReusing(const StretchRenderContext<Pixel>& ctx, const FrameReuse& plan,
+    int start_x, int start_y, int end_x, int end_y, const RenderFunc& render)
+{
+    const float dx0 = 0.0f - ctx.output_origin_x - ctx.anchor_x;
+
+    // Output columns the previous frame covers
+    const int copy_x0 = (std::max)(start_x, plan.offset_x);
+    const int copy_x1 = (std::min)(end_x, plan.offset_x + plan.width);
+
+    std::uint64_t copied = 0;
+    for (int y = start_y; y < end_y; ++y) {
+        const int previous_y = y - plan.offset_y;
+        if (previous_y < 0 || previous_y >= plan.height || copy_x0 >= copy_x1) {
+            render(start_x, y, end_x, y + 1);
+            continue;
+        }
+
+        const float dy = static_cast<float>(y) - ctx.output_origin_y - ctx.anchor_y;
+        const float dist0 = dx0 * ctx.perp_x + dy * ctx.perp_y;
+        StretchSpan spans[STRETCH_MAX_REUSE_SPANS];
+        const int span_count = StretchSegmentRowBy(plan.classifier, dist0, ctx.perp_x, copy_x0, copy_x1,
+            spans, STRETCH_MAX_REUSE_SPANS);
+
+        Pixel* out_row = reinterpret_cast<Pixel*>(ctx.output_base + static_cast<std::ptrdiff_t>(y) * ctx.output_rowbytes);
+        const Pixel* previous_row = reinterpret_cast<const Pixel*>(plan.data + static_cast<std::ptrdiff_t>(previous_y) * plan.rowbytes);
+
+        // Start of the run still to render
+        int dirty = start_x;
+        for (int s = 0; s < span_count; ++s) {
+            const StretchSpan& span = spans[s];
+            if (span.region >= STRETCH_MAX_REGIONS) {
+                continue;
+            }
+            if (dirty < span.begin) {
+                render(dirty, y, span.begin, y + 1);
+            }
+            std::memcpy(out_row + span.begin, previous_row + (span.begin - plan.offset_x),
+                static_cast<size_t>(span.end - span.begin) * sizeof(Pixel));
+            copied += static_cast<std::uint64_t>(span.end - span.begin);
+            dirty = span.end;
+        }
+        if (dirty < end_x) {
+            render(dirty, y, end_x, y + 1);
+        }
+    }
+    return copied;
+}
+
+// Runs render(start_x, start_y, end_x, end_y, staging, counts) over the whole
+// output, or over the pixels reuse cannot copy when it is set.
+// Work is scheduled on the process-wide worker pool instead of spawning
+// threads per frame, on at most `parallelism` threads (the frame's share, see
+// StretchThreadPool::FrameScope). Safe because the kernels make no host API
+// calls.
+// When staged, each task gets 2 * (tile width) pixels of staging from its
+// thread's sub-arena, reserved up front so no task allocates blocks.
+// With a profile, each task times itself and counts its pixels (counts is
+// nullptr otherwise)
+template <typename Pixel, typename RenderFunc>
+bool ScheduleFrame(StretchThreadPool& pool, int parallelism, StretchFrameArena& arena, const StretchRenderContext<Pixel>& ctx,
+    StretchSchedule schedule, bool staged, const FrameReuse* reuse, FrameProfile* profile, const RenderFunc& render_tile)
+{
+    const int tile_width = (schedule == STRETCH_SCHEDULE_ROWS) ? ctx.width : StretchTileWidth<Pixel>();
+    const std::size_t staging_count = 2 * static_cast<std::size_t>((std::min)(tile_width, ctx.width));
+    staged = staged && arena.ReserveThreads(staging_count * sizeof(Pixel));
+
+    // Pixels one pool task rendered and copied
+    struct TaskCounts
+    {
+        StretchSpanCounts spans;
+        std::uint64_t reused = 0;
+    };
+
+    const auto render = [&ctx, reuse, &render_tile](int start_x, int start_y, int end_x, int end_y, Pixel* staging,
+        TaskCounts* counts) {
+        StretchSpanCounts* span_counts = counts ? &counts->spans : nullptr;
+        if (!reuse) {
+            render_tile(start_x, start_y, end_x, end_y, staging, span_counts);
+            return;
+        }
+        const std::uint64_t copied = RenderTileReusing(ctx, *reuse, start_x, start_y, end_x, end_y,
+            [&render_tile, staging, span_counts](int x0, int y0, int x1, int y1) {
+                render_tile(x0, y0, x1, y1, staging, span_counts);
+            });
+        if (counts) {
+            counts->reused += copied;
+        }
+    };
+
+    // Staging for one pool task, released when the task ends
+    const auto run_task = [&arena, staged, staging_count, profile](const auto& body) {
+        StretchArena& scratch = arena.ForThread(StretchThreadPool::CurrentThreadIndex());
+        const StretchArena::Marker mark = scratch.Mark();
+        Pixel* staging = staged ? scratch.AllocateArray<Pixel>(staging_count) : nullptr;
+        if (profile) {
+            TaskCounts counts;
+            const std::int64_t begin = ProfileClock();
+            body(staging, &counts);
+            profile->AddTask(begin, ProfileClock(), counts.spans, counts.reused);
+        }
+        else {
+            body(staging, nullptr);
+        }
+        scratch.Rewind(mark);
+    };
+
+    const std::int64_t dispatched = profile ? ProfileClock() : 0;
+    const auto joined = [profile, dispatched](bool ok) {
+        if (profile) {
+            profile->AddPass(dispatched, ProfileClock());
+        }
+        return ok;
+    };
+
+    if (schedule == STRETCH_SCHEDULE_ROWS) {
+        return joined(pool.ParallelFor(0, ctx.height, ROWS_PER_TASK,
+            [&ctx, &render, &run_task](int start_y, int end_y) {
+                run_task([&](Pixel* staging, TaskCounts* counts) {
+                    render(0, start_y, ctx.width, end_y, staging, counts);
+                });
+            }, parallelism));
+    }
+
+    // Tiles are numbered row by row, serpentine, so consecutive tiles (which
+    // a worker takes as one chunk) are neighbours and share input footprint
+    const int tiles_x = (ctx.width + tile_width - 1) / tile_width;
+    const int tiles_y = (ctx.height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    if (tiles_x <= 0 || tiles_y <= 0) {
+        return true;
+    }
+    return joined(pool.ParallelFor(0, tiles_x * tiles_y, 1,
+        [&ctx, &render, &run_task, tiles_x, tile_width](int begin, int end) {
+            run_task([&](Pixel* staging, TaskCounts* counts) {
+                for (int tile = begin; tile < end; ++tile) {
+                    const int ty = tile / tiles_x;
+                    const int column = tile % tiles_x;
+                    const int tx = (ty & 1) ? tiles_x - 1 - column : column;
+                    const int start_x = tx * tile_width;
+                    const int start_y = ty * TILE_HEIGHT;
+                    render(start_x, start_y,
+                        (std::min)(start_x + tile_width, ctx.width),
+                        (std::min)(start_y + TILE_HEIGHT, ctx.height), staging, counts);
+                }
+            });
+        }, parallelism));
+}
+
+template <typename Pixel>
+bool RenderFramePremultiplied(StretchThreadPool& pool, int parallelism, StretchFrameArena& arena, const StretchRenderContext<Pixel>& ctx,
+    int direction, StretchSchedule schedule, const FrameReuse* reuse, FrameProfile* profile, bool& rendered)
+{
+    rendered = false;
+    const std::ptrdiff_t stride = ctx.input_width + 2;
+    StretchPixelF* scratch = arena.Shared().AllocateArray<StretchPixelF>(
+        static_cast<std::size_t>(stride) * static_cast<std::size_t>(ctx.input_height + 2));
+    if (!scratch) {
+        return true;
+    }
+    if (!FillPremultipliedInput(pool, parallelism, ctx, scratch)) {
+        return false;
+    }
+
+    StretchPremultipliedInput in{};
+    in.origin = scratch + stride + 1;
+    in.stride = stride;
+    in.width = ctx.input_width;
+    in.height = ctx.input_height;
+
+    const LineCacheKnots layout = PlaceLineCacheKnots(arena.Shared(), ctx);
+    LineCacheArrays<StretchPixelF> cache;
+    if (AllocateLineCache(arena.Shared(), layout, cache)) {
+        const StretchPremultipliedInput& source = in;
+        const bool filled = FillLineCache(pool, parallelism, cache.samples, layout,
+            [&ctx, &source](float t) { return SampleBorderPremultipliedDirect(ctx, source, t); });
+        if (!filled || !MarkLineCacheDirect(pool, parallelism, ctx, layout, cache.samples, cache.direct,
+                StretchLineCachePremultipliedDirect)) {
+            return false;
+        }
+        in.line_cache = FinishLineCache(layout, cache);
+    }
+
+    rendered = true;
+    const StretchPremultipliedRowKernel<Pixel> kernel = StretchSelectPremultipliedRowKernel(ctx, direction);
+    const StretchRegionSet set = StretchMakeRegions(ctx, direction);
+    return ScheduleFrame(pool, parallelism, arena, ctx, schedule, true, reuse, profile,
+        [&ctx, &in, kernel, &set](int start_x, int start_y, int end_x, int end_y, Pixel* staging, StretchSpanCounts* counts) {
+            kernel(ctx, in, set, start_x, start_y, end_x, end_y, staging, counts);
+        });
+}
+
+} // namespace
+
+std::vector<StretchStrip> StretchPlanStrips(const StretchGeometry& geometry, int input_width, int input_height,
+    int output_width, int output_height, float origin_x, float origin_y,
+    int output_pixel_bytes, int input_pixel_bytes, std::size_t budget_bytes)
+{
+    std::vector<StretchStrip> strips;
+    if (output_width <= 0 || output_height <= 0) {
+        return strips;
+    }
+
+    // Input rows read by output rows [start_y, end_y), clipped to the input
+    const auto source_rect = [&](int start_y, int end_y) {
+        StretchRect rect;
+        rect.left = static_cast<int>(std::floor(-origin_x));
+        rect.top = static_cast<int>(std::floor(static_cast<float>(start_y) - origin_y));
+        rect.right = static_cast<int>(std::ceil(static_cast<float>(output_width) - origin_x));
+        rect.bottom = static_cast<int>(std::ceil(static_cast<float>(end_y) - origin_y));
+        rect = StretchComputeSourceRect(geometry, rect);
+        rect.left = (std::max)(rect.left, 0);
+        rect.top = (std::max)(rect.top, 0);
+        rect.right = (std::min)(rect.right, input_width);
+        rect.bottom = (std::min)(rect.bottom, input_height);
+        return rect.IsEmpty() ? StretchRect() : rect;
+    };
+    const auto fits = [&](int start_y, int end_y) {
+        const StretchRect rect = source_rect(start_y, end_y);
+        const double bytes = static_cast<double>(end_y - start_y) * output_width * output_pixel_bytes
+            + static_cast<double>(rect.bottom - rect.top) * input_width * input_pixel_bytes;
+        return bytes <= static_cast<double>(budget_bytes);
+    };
+
+    // Each strip takes as many rows as fit (the input rows only grow with
+    // them), in whole tiles so the strips tile the frame like one render.
+    // The input rows of the two shifted sides lie 2 * shift apart, which a
+    // strip reads whatever its height; a strip of one tile is the minimum
+    for (int start_y = 0; start_y < output_height;) {
+        int lo = (std::min)(start_y + TILE_HEIGHT, output_height);
+        int hi = output_height;
+        while (lo < hi) {
+            const int mid = lo + (hi - lo + 1) / 2;
+            if (fits(start_y, mid)) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        int end_y = lo;
+        if (end_y < output_height && end_y - start_y > TILE_HEIGHT) {
+            end_y = start_y + (end_y - start_y) / TILE_HEIGHT * TILE_HEIGHT;
+        }
+
+        StretchStrip strip;
+        strip.start_y = start_y;
+        strip.end_y = end_y;
+        strip.input_rect = source_rect(start_y, end_y);
+        strips.push_back(strip);
+        start_y = end_y;
+    }
+    return strips;
+}
+
+template <typename Pixel>
+bool StretchRenderStrips(const StretchRenderContext<Pixel>& ctx, int direction, const std::vector<StretchStrip>& strips,
+    const StretchStripSink& sink, const StretchRenderOptions& options)
+{
+    // Statistics only when asked for
+    StretchRenderStats profile_stats;
+    StretchRenderStats* stats = options.stats ? options.stats : (options.profile ? &profile_stats : nullptr);
+    FrameProfile frame_profile;
+    FrameProfile* profile = stats ? &frame_profile : nullptr;
+    const std::int64_t started = profile ? ProfileClock() : 0;
+
+    StretchThreadPool& pool = StretchThreadPool::Instance();
+
+    // Under multi-frame rendering each frame in flight takes its share of the
+    // pool rather than all of it
+    const StretchThreadPool::FrameScope frame(pool);
+    const int parallelism = frame.Parallelism();
+
+    // Scratch from the previous frame on this arena is dead by now
+    static thread_local StretchFrameArena thread_arena;
+    StretchFrameArena& arena = options.arena ? *options.arena : thread_arena;
+    arena.Reset();
+
+    // The axis-aligned kernels copy input pixels and gain nothing from the
+    // premultiplied copy, which only implements the bilinear kernel. The copy
+    // holds the whole input, so a frame split into strips (to bound its
+    // memory) renders in straight alpha instead
+    const bool axis_aligned = StretchIsAxisAligned(ctx);
+    const StretchTileRenderer<Pixel> renderer = StretchSelectTileRenderer(ctx, direction);
+    const bool premultiplied = options.premultiplied && strips.size() == 1 && ctx.quality == STRETCH_QUALITY_BILINEAR
+        && !axis_aligned && ctx.input_width > 0 && ctx.input_height > 0;
+
+    // Every row crossing the gap samples the same anchor line, so resample it
+    // once per frame, for all strips. Without memory for the cache the
+    // kernels sample directly. The axis-aligned kernels read the border
+    // straight from the input, and so does Nearest (StretchUsesLineCache)
+    StretchRenderContext<Pixel> frame_ctx = ctx;
+    bool has_line_cache = false;
+    const auto add_line_cache = [&]() {
+        has_line_cache = true;
+        if (ctx.line_cache.samples || axis_aligned || !StretchUsesLineCache(ctx.quality)) {
+            return true;
+        }
+        const LineCacheKnots layout = PlaceLineCacheKnots(arena.Shared(), ctx);
+        LineCacheArrays<Pixel> cache;
+        if (!AllocateLineCache(arena.Shared(), layout, cache)) {
+            return true;
+        }
+        const bool filled = FillLineCache(pool, parallelism, cache.samples, layout,
+            [&ctx](float t) { return SampleBorderDirect(ctx, t); });
+        if (!filled || !MarkLineCacheDirect(pool, parallelism, ctx, layout, cache.samples, cache.direct,
+                StretchLineCacheDirect<Pixel>)) {
+            return false;
+        }
+        frame_ctx.line_cache = FinishLineCache(layout, cache);
+        return true;
+    };
+
+    // Sink callbacks, timed apart from the render when profiling
+    const auto call_sink = [profile](const auto& call) {
+        if (!profile) {
+            return call();
+        }
+        const std::int64_t begin = ProfileClock();
+        const bool ok = call();
+        profile->sink_ns += ProfileClock() - begin;
+        return ok;
+    };
+
+    bool sampled_premultiplied = false;
+    bool reused = false;
+    for (const StretchStrip& strip : strips) {
+        void* data = nullptr;
+        std::ptrdiff_t rowbytes = 0;
+        if (!call_sink([&]() { return sink.begin(strip, data, rowbytes); }) || !data) {
+            return false;
+        }
+
+        // The strip as a frame of its own: its row 0 is frame row start_y
+        StretchRenderContext<Pixel> strip_ctx = frame_ctx;
+        strip_ctx.output_base = static_cast<std::uint8_t*>(data);
+        strip_ctx.output_rowbytes = rowbytes;
+        strip_ctx.height = strip.end_y - strip.start_y;
+        strip_ctx.output_origin_y = ctx.output_origin_y - static_cast<float>(strip.start_y);
+
+        FrameReuse reuse_plan;
+        const FrameReuse* reuse = (options.reuse && PlanReuse(strip_ctx, direction, *options.reuse, reuse_plan))
+            ? &reuse_plan
+            : nullptr;
+        reused = reused || reuse;
+
+        bool rendered = false;
+        if (premultiplied) {
+            if (!RenderFramePremultiplied(pool, parallelism, arena, strip_ctx, direction, options.schedule, reuse, profile,
+                    rendered)) {
+                return false;
+            }
+            if (!rendered) {
+                arena.Reset();
+            }
+            sampled_premultiplied = rendered;
+        }
+        if (!rendered) {
+            if (!has_line_cache && !add_line_cache()) {
+                return false;
+            }
+            strip_ctx.line_cache = frame_ctx.line_cache;
+            const bool ok = ScheduleFrame(pool, parallelism, arena, strip_ctx, options.schedule, !axis_aligned, reuse, profile,
+                [&strip_ctx, &renderer](int start_x, int start_y, int end_x, int end_y, Pixel* staging,
+                    StretchSpanCounts* counts) {
+                    renderer.Render(strip_ctx, start_x, start_y, end_x, end_y, staging, counts);
+                });
+            if (!ok) {
+                return false;
+            }
+        }
+        if (!call_sink([&]() { return sink.end(strip); })) {
+            return false;
+        }
+    }
+
+    if (stats) {
+        *stats = StretchRenderStats();
+        stats->frame = options.profile_frame;
+        stats->width = ctx.width;
+        stats->height = ctx.height;
+        stats->depth = static_cast<int>(sizeof(Pixel)) * 2;
+        stats->quality = ctx.quality;
+        stats->direction = direction;
+        stats->strips = static_cast<int>(strips.size());
+        stats->threads = parallelism;
+        stats->tasks = frame_profile.tasks.load();
+        stats->axis_aligned = axis_aligned;
+        stats->premultiplied = sampled_premultiplied;
+        stats->reuse = reused;
+        stats->total_ns = ProfileClock() - started;
+        stats->render_ns = frame_profile.render_ns;
+        stats->join_ns = frame_profile.join_ns;
+        stats->sink_ns = frame_profile.sink_ns;
+        stats->setup_ns = stats->total_ns - stats->render_ns - stats->join_ns - stats->sink_ns;
+        stats->task_ns = frame_profile.task_ns.load();
+        stats->task_max_ns = frame_profile.task_max_ns.load();
+        for (int kind = 0; kind < STRETCH_SPAN_KIND_COUNT; ++kind) {
+            stats->pixels[kind] = frame_profile.pixels[kind].load();
+        }
+        stats->reused_pixels = frame_profile.reused_pixels.load();
+        if (options.profile) {
+            StretchWriteRenderStats(*stats);
+        }
+    }
+    return true;
+}
+
+template <typename Pixel>
+bool StretchRenderFrame(const StretchRenderContext<Pixel>& ctx, int direction, const StretchRenderOptions& options)
+{
+    if (ctx.width <= 0 || ctx.height <= 0) {
+        return true;
+    }
+
+    // One strip: the whole output, reading the whole input
+    StretchStrip strip;
+    strip.end_y = ctx.height;
+    strip.input_rect.right = ctx.input_width;
+    strip.input_rect.bottom = ctx.input_height;
+
+    StretchStripSink sink;
+    sink.begin = [&ctx](const StretchStrip&, void*& data, std::ptrdiff_t& rowbytes) {
+        data = ctx.output_base;
+        rowbytes = ctx.output_rowbytes;
+        return true;
+    };
+    sink.end = [](const StretchStrip&) { return true; };
+    return StretchRenderStrips(ctx, direction, std::vector<StretchStrip>(1, strip), sink, options);
+}
+
+template bool StretchRenderFrame(const StretchRenderContext<StretchPixel8>&, int, const StretchRenderOptions&);
+template bool StretchRenderFrame(const StretchRenderContext<StretchPixel16>&, int, const StretchRenderOptions&);
+template bool StretchRenderFrame(const StretchRenderContext<StretchPixelF>&, int, const StretchRenderOptions&);
+
+template bool StretchRenderStrips(const StretchRenderContext<StretchPixel8>&, int, const std::vector<StretchStrip>&,
+    const StretchStripSink&, const StretchRenderOptions&);
+template bool StretchRenderStrips(const StretchRenderContext<StretchPixel16>&, int, const std::vector<StretchStrip>&,
+    const StretchStripSink&, const StretchRenderOptions&);
+template bool StretchRenderStrips(const StretchRenderContext<StretchPixelF>&, int, const std::vector<StretchStrip>&,
+    const StretchStripSink&, const StretchRenderOptions&);
@@ -0,0 +1,2568 @@
+#pragma once
+#ifndef STRETCH_CORE_H
+#define STRETCH_CORE_H
+
+// SDK-free stretch kernels. Everything in this header builds without the
+// After Effects SDK so the same pixel math can run in the plugin, in the
+// Linux CMake build, benchmarks and headless tools.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "StretchSimd.h"
+
+// -----------------------------------------------------------------------------
+// Pixel types (layout-compatible with PF_Pixel / PF_Pixel16 / PF_PixelFloat)
+// -----------------------------------------------------------------------------
+
+struct StretchPixel8
+{
+    std::uint8_t alpha;
+    std::uint8_t red;
+    std::uint8_t green;
+    std::uint8_t blue;
+};
+
+struct StretchPixel16
+{
+    std::uint16_t alpha;
+    std::uint16_t red;
+    std::uint16_t green;
+    std::uint16_t blue;
+};
+
+struct StretchPixelF
+{
+    float alpha;
+    float red;
+    float green;
+    float blue;
+};
+
+// Constants for anti-aliasing and sampling
+constexpr float ALPHA_THRESHOLD = 0.001f;
+constexpr float FEATHER_AMOUNT = 0.5f;
+constexpr float EPSILON = 0.001f;
+constexpr float WEIGHT_THRESHOLD = 0.999f;
+
+// Floating point comparison helper
+constexpr inline bool IsApproximatelyEqual(float a, float b, float epsilon = EPSILON) {
+    return (a > b ? a - b : b - a) < epsilon;
+}
+
+// Direction popup values
+enum StretchDirection
+{
+    STRETCH_DIRECTION_BOTH = 1,
+    STRETCH_DIRECTION_FORWARD,
+    STRETCH_DIRECTION_BACKWARD
+};
+
+// Quality popup values (sampling kernel)
+enum StretchQuality
+{
+    STRETCH_QUALITY_NEAREST = 1,
+    STRETCH_QUALITY_BILINEAR,
+    STRETCH_QUALITY_BICUBIC,
+    STRETCH_QUALITY_LANCZOS3
+};
+
+// -----------------------------------------------------------------------------
+// Geometry
+// -----------------------------------------------------------------------------
+
+// Valid range of the Shift Amount slider (full-resolution pixels)
+constexpr float STRETCH_SHIFT_MIN = 0.0f;
+constexpr float STRETCH_SHIFT_MAX = 10000.0f;
+
+// Effect parameters in host units (shift in full-resolution pixels)
+struct StretchParams
+{
+    float shift_amount = 0.0f;
+    float angle_deg = 0.0f;
+    float anchor_x = 0.0f;
+    float anchor_y = 0.0f;
+    int direction = STRETCH_DIRECTION_BOTH;
+    int quality = STRETCH_QUALITY_BILINEAR;
+
+    // Draft render (host quality Low): nearest samples, hard region edges
+    bool draft = false;
+
+    // Downsample factors (den / num of the host's downsample ratio)
+    float downsample_x = 1.0f;
+    float downsample_y = 1.0f;
+};
+
+// Per-frame stretch geometry derived from StretchParams
+struct StretchGeometry
+{
+    // False when the shift is negligible and the input passes through unchanged
+    bool active = false;
+    int direction = STRETCH_DIRECTION_BOTH;
+    int quality = STRETCH_QUALITY_BILINEAR;
+
+    // Width of the blend on each side of a region boundary (0 for drafts)
+    float feather = FEATHER_AMOUNT;
+
+    float anchor_x = 0.0f;
+    float anchor_y = 0.0f;
+    float effective_shift = 0.0f;
+    float shift_vec_x = 0.0f;
+    float shift_vec_y = 0.0f;
+    float perp_x = 0.0f;
+    float perp_y = 1.0f;
+    float para_x = 1.0f;
+    float para_y = 0.0f;
+};
+
+// Output buffer growth (in pixels) needed to hold the stretched layer
+struct StretchExpansion
+{
+    int left = 0;
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+};
+
+// Pixel rect [left, right) x [top, bottom) in input image coordinates
+struct StretchRect
+{
+    int left = 0;
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+
+    bool IsEmpty() const { return left >= right || top >= bottom; }
+};
+
+StretchGeometry StretchComputeGeometry(const StretchParams& params);
+StretchExpansion StretchComputeExpansion(const StretchGeometry& geometry, int input_width, int input_height);
+
+// Input pixels the kernels can read while rendering output_rect (both in input
+// image coordinates), including the sampling kernel's footprint. Derived from the
+// inverse mapping: pixels beyond the gap sample at -/+ shift_vec, pixels in
+// the gap sample their projection onto the anchor line.
+StretchRect StretchComputeInputRect(const StretchGeometry& geometry, const StretchRect& output_rect);
+
+// StretchComputeInputRect without the gap's anchor-line samples: the input a
+// render reads for output_rect when the gap comes from a line cache built
+// for the whole frame (see "Strip streaming")
+StretchRect StretchComputeSourceRect(const StretchGeometry& geometry, const StretchRect& output_rect);
+
+// -----------------------------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------------------------
+
+template <typename T>
+inline T ClampScalar(T value, T min_value, T max_value)
+{
+    if (value < min_value) return min_value;
+    if (value > max_value) return max_value;
+    return value;
+}
+
+// -----------------------------------------------------------------------------
+// Pixel Traits
+// -----------------------------------------------------------------------------
+
+template <typename PixelT>
+struct PixelTraits;
+
+template <>
+struct PixelTraits<StretchPixel8>
+{
+    using ChannelType = std::uint8_t;
+    static constexpr float MAX_VAL = 255.0f;
+
+    // 8.8 fixed-point bilinear weights; weight products are 16.16
+    using WideType = std::uint32_t;
+    static constexpr int FIXED_POINT_BITS = 8;
+    static inline float ToFloat(ChannelType v) { return static_cast<float>(v); }
+    static inline ChannelType FromFloat(float v)
+    {
+        return static_cast<ChannelType>(ClampScalar(v, 0.0f, MAX_VAL) + 0.5f);
+    }
+};
+
+template <>
+struct PixelTraits<StretchPixel16>
+{
+    using ChannelType = std::uint16_t;
+    static constexpr float MAX_VAL = 32768.0f;
+
+    // 16.16 fixed-point bilinear weights; weight products are 32.32
+    using WideType = std::uint64_t;
+    static constexpr int FIXED_POINT_BITS = 16;
+    static inline float ToFloat(ChannelType v) { return static_cast<float>(v); }
+    static inline ChannelType FromFloat(float v)
+    {
+        return static_cast<ChannelType>(ClampScalar(v, 0.0f, MAX_VAL) + 0.5f);
+    }
+};
+
+template <>
+struct PixelTraits<StretchPixelF>
+{
+    using ChannelType = float;
+    static constexpr float MAX_VAL = 1.0f;
+
+    // No fixed-point path for float
+    static constexpr int FIXED_POINT_BITS = 0;
+    static inline float ToFloat(ChannelType v) { return static_cast<float>(v); }
+    static inline ChannelType FromFloat(float v) { return static_cast<ChannelType>(v); }
+};
+
+// -----------------------------------------------------------------------------
+// Fixed-point bilinear (8 and 16 bpc)
+// -----------------------------------------------------------------------------
+
+// Fractional coordinate -> fixed-point weight in [0, 1 << FIXED_POINT_BITS]
+template <typename Pixel>
+inline std::uint32_t FixedPointWeight(float f)
+{
+    constexpr float ONE = static_cast<float>(1u << PixelTraits<Pixel>::FIXED_POINT_BITS);
+    return static_cast<std::uint32_t>(f * ONE + 0.5f);
+}
+
+// Integer bilinear blend for four in-bounds taps that share one alpha value,
+// the common case inside opaque (or uniformly faded) footage. The alpha
+// weights cancel, so the blend is a plain weighted sum with a rounding shift
+// and the result stays within 1 LSB of the float path.
+// Returns false when the taps need alpha-weighted normalization (float path).
+template <typename Pixel>
+inline bool BlendUniformAlphaFixed(const Pixel& p00, const Pixel& p10, const Pixel& p01, const Pixel& p11,
+    float fx, float fy, Pixel& result)
+{
+    using Traits = PixelTraits<Pixel>;
+    if constexpr (Traits::FIXED_POINT_BITS == 0) {
+        return false;
+    } else {
+        using ChannelType = typename Traits::ChannelType;
+        using WideType = typename Traits::WideType;
+        constexpr int BITS = Traits::FIXED_POINT_BITS;
+        constexpr std::uint32_t ONE = 1u << BITS;
+
+        const ChannelType alpha = p00.alpha;
+        if (p10.alpha != alpha || p01.alpha != alpha || p11.alpha != alpha) {
+            return false;
+        }
+        if (alpha == 0) {
+            std::memset(&result, 0, sizeof(Pixel));
+            return true;
+        }
+
+        const std::uint32_t wx1 = FixedPointWeight<Pixel>(fx);
+        const std::uint32_t wy1 = FixedPointWeight<Pixel>(fy);
+        const std::uint32_t wx0 = ONE - wx1;
+        const std::uint32_t wy0 = ONE - wy1;
+
+        auto blend = [=](ChannelType c00, ChannelType c10, ChannelType c01, ChannelType c11) {
+            const WideType h0 = static_cast<WideType>(c00) * wx0 + static_cast<WideType>(c10) * wx1;
+            const WideType h1 = static_cast<WideType>(c01) * wx0 + static_cast<WideType>(c11) * wx1;
+            const WideType v = h0 * wy0 + h1 * wy1 + (static_cast<WideType>(1) << (2 * BITS - 1));
+            return static_cast<ChannelType>(v >> (2 * BITS));
+        };
+
+        result.alpha = alpha;
+        result.red = blend(p00.red, p10.red, p01.red, p11.red);
+        result.green = blend(p00.green, p10.green, p01.green, p11.green);
+        result.blue = blend(p00.blue, p10.blue, p01.blue, p11.blue);
+        return true;
+    }
+}
+
+// Two-tap counterpart of BlendUniformAlphaFixed: p0 and p1 weighted 1 - f and
+// f. Equals the four-tap blend when the other axis carries no weight
+template <typename Pixel>
+inline bool BlendUniformAlphaFixed1D(const Pixel& p0, const Pixel& p1, float f, Pixel& result)
+{
+    using Traits = PixelTraits<Pixel>;
+    if constexpr (Traits::FIXED_POINT_BITS == 0) {
+        return false;
+    } else {
+        using ChannelType = typename Traits::ChannelType;
+        using WideType = typename Traits::WideType;
+        constexpr int BITS = Traits::FIXED_POINT_BITS;
+        constexpr std::uint32_t ONE = 1u << BITS;
+
+        const ChannelType alpha = p0.alpha;
+        if (p1.alpha != alpha) {
+            return false;
+        }
+        if (alpha == 0) {
+            std::memset(&result, 0, sizeof(Pixel));
+            return true;
+        }
+
+        const std::uint32_t w1 = FixedPointWeight<Pixel>(f);
+        const std::uint32_t w0 = ONE - w1;
+
+        auto blend = [=](ChannelType c0, ChannelType c1) {
+            const WideType v = static_cast<WideType>(c0) * w0 + static_cast<WideType>(c1) * w1 + (static_cast<WideType>(1) << (BITS - 1));
+            return static_cast<ChannelType>(v >> BITS);
+        };
+
+        result.alpha = alpha;
+        result.red = blend(p0.red, p1.red);
+        result.green = blend(p0.green, p1.green);
+        result.blue = blend(p0.blue, p1.blue);
+        return true;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Sampling
+// -----------------------------------------------------------------------------
+
+// Nearest Neighbor sampling to avoid black fringe artifacts
+// This method prevents blending with transparent (alpha=0) black pixels,
+// which is the recommended approach per Adobe's documentation:
+// https://ae-plugins.docsforadobe.dev/effect-details/pixel-aspect-ratio/?h=anti+aliasing#dont-assume-pixels-are-square-or-1-to-1
+template <typename Pixel>
+inline Pixel SampleNearestNeighbor(const std::uint8_t* base_ptr,
+    std::ptrdiff_t rowbytes,
+    float xf,
+    float yf,
+    int width,
+    int height)
+{
+    // Round to nearest integer (floor, so coordinates just left of or above
+    // the input do not truncate onto its first column or row)
+    const int x = static_cast<int>(floorf(xf + 0.5f));
+    const int y = static_cast<int>(floorf(yf + 0.5f));
+
+    // Bounds check
+    if (x < 0 || x >= width || y < 0 || y >= height) {
+        Pixel result;
+        std::memset(&result, 0, sizeof(Pixel));
+        return result;
+    }
+
+    const Pixel* row = reinterpret_cast<const Pixel*>(base_ptr + y * rowbytes);
+    return row[x];
+}
+
+// Alpha-weighted bilinear sampling for proper anti-aliasing with transparency
+// This avoids black fringing by excluding transparent pixels from interpolation
+template <typename Pixel>
+inline Pixel SampleBilinear(const std::uint8_t* base_ptr,
+    std::ptrdiff_t rowbytes,
+    float xf,
+    float yf,
+    int width,
+    int height)
+{
+    using Traits = PixelTraits<Pixel>;
+    
+    // Get integer and fractional parts
+    const int x0 = static_cast<int>(floorf(xf));
+    const int y0 = static_cast<int>(floorf(yf));
+    const float fx = xf - static_cast<float>(x0);
+    const float fy = yf - static_cast<float>(y0);
+    
+    // Fast path: if coordinate is (nearly) integer, skip bilinear interpolation
+    if (fx < EPSILON && fy < EPSILON) {
+        // Check bounds
+        if (x0 >= 0 && x0 < width && y0 >= 0 && y0 < height) {
+            const Pixel* row = reinterpret_cast<const Pixel*>(base_ptr + y0 * rowbytes);
+            return row[x0];
+        }
+        // Out of bounds - return transparent
+        Pixel result;
+        std::memset(&result, 0, sizeof(Pixel));
+        return result;
+    }
+    
+    const int x1 = x0 + 1;
+    const int y1 = y0 + 1;
+    
+    // Check if all four pixels are within bounds
+    const bool in_bounds_00 = (x0 >= 0 && x0 < width && y0 >= 0 && y0 < height);
+    const bool in_bounds_10 = (x1 >= 0 && x1 < width && y0 >= 0 && y0 < height);
+    const bool in_bounds_01 = (x0 >= 0 && x0 < width && y1 >= 0 && y1 < height);
+    const bool in_bounds_11 = (x1 >= 0 && x1 < width && y1 >= 0 && y1 < height);
+    
+    // If all pixels are out of bounds, return transparent
+    if (!in_bounds_00 && !in_bounds_10 && !in_bounds_01 && !in_bounds_11) {
+        Pixel result;
+        std::memset(&result, 0, sizeof(Pixel));
+        return result;
+    }
+    
+    // Get pixels (use transparent for out-of-bounds)
+    Pixel p00, p10, p01, p11;
+    std::memset(&p00, 0, sizeof(Pixel));
+    std::memset(&p10, 0, sizeof(Pixel));
+    std::memset(&p01, 0, sizeof(Pixel));
+    std::memset(&p11, 0, sizeof(Pixel));
+    
+    if (in_bounds_00) {
+        const Pixel* row0 = reinterpret_cast<const Pixel*>(base_ptr + y0 * rowbytes);
+        p00 = row0[x0];
+    }
+    if (in_bounds_10) {
+        const Pixel* row0 = reinterpret_cast<const Pixel*>(base_ptr + y0 * rowbytes);
+        p10 = row0[x1];
+    }
+    if (in_bounds_01) {
+        const Pixel* row1 = reinterpret_cast<const Pixel*>(base_ptr + y1 * rowbytes);
+        p01 = row1[x0];
+    }
+    if (in_bounds_11) {
+        const Pixel* row1 = reinterpret_cast<const Pixel*>(base_ptr + y1 * rowbytes);
+        p11 = row1[x1];
+    }
+    
+    // Interior taps with a shared alpha: integer blend for 8/16 bpc
+    if (in_bounds_00 && in_bounds_10 && in_bounds_01 && in_bounds_11) {
+        Pixel result;
+        if (BlendUniformAlphaFixed(p00, p10, p01, p11, fx, fy, result)) {
+            return result;
+        }
+    }
+
+    // Bilinear weights - pre-compute (1-fx) and (1-fy) to avoid redundant subtraction
+    const float inv_fx = 1.0f - fx;
+    const float inv_fy = 1.0f - fy;
+    const float w00 = inv_fx * inv_fy;
+    const float w10 = fx * inv_fy;
+    const float w01 = inv_fx * fy;
+    const float w11 = fx * fy;
+    
+    // Get alpha values for weighting - convert once and reuse
+    const float a00 = Traits::ToFloat(p00.alpha);
+    const float a10 = Traits::ToFloat(p10.alpha);
+    const float a01 = Traits::ToFloat(p01.alpha);
+    const float a11 = Traits::ToFloat(p11.alpha);
+    
+    // Alpha-weighted interpolation
+    // Pixels with zero or near-zero alpha don't contribute to color
+    
+    float total_weight = 0.0f;
+    float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+    
+    // Process each pixel - convert RGB values only when alpha is significant
+    if (a00 > ALPHA_THRESHOLD) {
+        const float weight = w00 * a00;
+        total_weight += weight;
+        r += Traits::ToFloat(p00.red) * weight;
+        g += Traits::ToFloat(p00.green) * weight;
+        b += Traits::ToFloat(p00.blue) * weight;
+        a += a00 * w00;
+    }
+    
+    if (a10 > ALPHA_THRESHOLD) {
+        const float weight = w10 * a10;
+        total_weight += weight;
+        r += Traits::ToFloat(p10.red) * weight;
+        g += Traits::ToFloat(p10.green) * weight;
+        b += Traits::ToFloat(p10.blue) * weight;
+        a += a10 * w10;
+    }
+    
+    if (a01 > ALPHA_THRESHOLD) {
+        const float weight = w01 * a01;
+        total_weight += weight;
+        r += Traits::ToFloat(p01.red) * weight;
+        g += Traits::ToFloat(p01.green) * weight;
+        b += Traits::ToFloat(p01.blue) * weight;
+        a += a01 * w01;
+    }
+    
+    if (a11 > ALPHA_THRESHOLD) {
+        const float weight = w11 * a11;
+        total_weight += weight;
+        r += Traits::ToFloat(p11.red) * weight;
+        g += Traits::ToFloat(p11.green) * weight;
+        b += Traits::ToFloat(p11.blue) * weight;
+        a += a11 * w11;
+    }
+    
+    Pixel result;
+    
+    if (total_weight > ALPHA_THRESHOLD) {
+        // Normalize by total weight - use multiplication by inverse instead of division
+        const float inv_weight = 1.0f / total_weight;
+        result.red = Traits::FromFloat(r * inv_weight);
+        result.green = Traits::FromFloat(g * inv_weight);
+        result.blue = Traits::FromFloat(b * inv_weight);
+        result.alpha = Traits::FromFloat(a);
+    } else {
+        // All pixels were transparent
+        std::memset(&result, 0, sizeof(Pixel));
+    }
+    
+    return result;
+}
+
+// Fast row sampler for cases where Y coordinate is constant across the row
+// This avoids repeated Y-coordinate calculations (floor, clamp, row pointer lookup)
+// Uses alpha-weighted interpolation to avoid black fringing with transparent pixels
+template <typename Pixel>
+class FastRowSampler {
+public:
+    const Pixel* row0;
+    const Pixel* row1;
+    float w0_y; // Weight for row0 (1 - fy)
+    float w1_y; // Weight for row1 (fy)
+    int width;
+    int height;
+    
+    // Initialize with a constant Y coordinate
+    void Setup(const std::uint8_t* base, std::ptrdiff_t rowbytes, int w, int h, float y) {
+        width = w;
+        height = h;
+        
+        const int y0 = static_cast<int>(floorf(y));
+        const int y1 = y0 + 1;
+        const float fy = y - static_cast<float>(y0);
+        
+        w0_y = 1.0f - fy;
+        w1_y = fy;
+        
+        // Clamp Y and check bounds
+        const bool y0_in = (y0 >= 0 && y0 < h);
+        const bool y1_in = (y1 >= 0 && y1 < h);
+        
+        row0 = y0_in ? reinterpret_cast<const Pixel*>(base + y0 * rowbytes) : nullptr;
+        row1 = y1_in ? reinterpret_cast<const Pixel*>(base + y1 * rowbytes) : nullptr;
+    }
+    
+    // Sample at X coordinate with alpha-weighted interpolation
+    inline Pixel Sample(float x) const {
+        using Traits = PixelTraits<Pixel>;
+
+        const int x0 = static_cast<int>(floorf(x));
+        const float fx = x - static_cast<float>(x0);
+
+        // Fast path: if X is (nearly) integer and Y weight is heavily on one row
+        if (fx < EPSILON) {
+            if (x0 >= 0 && x0 < width) {
+                // Check if we can use single row (when fy was near 0 or 1)
+                if (row0 && w0_y > WEIGHT_THRESHOLD) {
+                    return row0[x0];
+                }
+                if (row1 && w1_y > WEIGHT_THRESHOLD) {
+                    return row1[x0];
+                }
+            }
+        }
+        
+        const int x1 = x0 + 1;
+        const float inv_fx = 1.0f - fx;
+        
+        // Check bounds for X
+        const bool x0_in = (x0 >= 0 && x0 < width);
+        const bool x1_in = (x1 >= 0 && x1 < width);
+        
+        // If completely out of bounds, return transparent
+        if (!row0 && !row1) {
+            Pixel result;
+            std::memset(&result, 0, sizeof(Pixel));
+            return result;
+        }
+
+        // Interior taps with a shared alpha: integer blend for 8/16 bpc
+        if (row0 && row1 && x0_in && x1_in) {
+            Pixel result;
+            if (BlendUniformAlphaFixed(row0[x0], row0[x1], row1[x0], row1[x1], fx, w1_y, result)) {
+                return result;
+            }
+        }
+        
+        float total_weight = 0.0f;
+        float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+        
+        // Contribution from Row 0
+        if (row0) {
+            if (x0_in) {
+                const Pixel& p = row0[x0];
+                const float pa = Traits::ToFloat(p.alpha);
+                if (pa > ALPHA_THRESHOLD) {
+                    const float w = w0_y * inv_fx;
+                    const float weight = w * pa;
+                    total_weight += weight;
+                    r += Traits::ToFloat(p.red) * weight;
+                    g += Traits::ToFloat(p.green) * weight;
+                    b += Traits::ToFloat(p.blue) * weight;
+                    a += pa * w;
+                }
+            }
+            if (x1_in) {
+                const Pixel& p = row0[x1];
+                const float pa = Traits::ToFloat(p.alpha);
+                if (pa > ALPHA_THRESHOLD) {
+                    const float w = w0_y * fx;
+                    const float weight = w * pa;
+                    total_weight += weight;
+                    r += Traits::ToFloat(p.red) * weight;
+                    g += Traits::ToFloat(p.green) * weight;
+                    b += Traits::ToFloat(p.blue) * weight;
+                    a += pa * w;
+                }
+            }
+        }
+        
+        // Contribution from Row 1
+        if (row1) {
+            if (x0_in) {
+                const Pixel& p = row1[x0];
+                const float pa = Traits::ToFloat(p.alpha);
+                if (pa > ALPHA_THRESHOLD) {
+                    const float w = w1_y * inv_fx;
+                    const float weight = w * pa;
+                    total_weight += weight;
+                    r += Traits::ToFloat(p.red) * weight;
+                    g += Traits::ToFloat(p.green) * weight;
+                    b += Traits::ToFloat(p.blue) * weight;
+                    a += pa * w;
+                }
+            }
+            if (x1_in) {
+                const Pixel& p = row1[x1];
+                const float pa = Traits::ToFloat(p.alpha);
+                if (pa > ALPHA_THRESHOLD) {
+                    const float w = w1_y * fx;
+                    const float weight = w * pa;
+                    total_weight += weight;
+                    r += Traits::ToFloat(p.red) * weight;
+                    g += Traits::ToFloat(p.green) * weight;
+                    b += Traits::ToFloat(p.blue) * weight;
+                    a += pa * w;
+                }
+            }
+        }
+
+        Pixel result;
+        if (total_weight > ALPHA_THRESHOLD) {
+            const float inv_weight = 1.0f / total_weight;
+            result.red = Traits::FromFloat(r * inv_weight);
+            result.green = Traits::FromFloat(g * inv_weight);
+            result.blue = Traits::FromFloat(b * inv_weight);
+            result.alpha = Traits::FromFloat(a);
+        } else {
+            std::memset(&result, 0, sizeof(Pixel));
+        }
+        return result;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Separable spans
+// -----------------------------------------------------------------------------
+//
+// Within a source span the fractional offsets are the same for every pixel.
+// With a whole row offset (fy == 0, e.g. 90 degree cuts at fractional shifts)
+// the second row carries no weight, and with whole column offsets (fx == 0,
+// e.g. 0 degree cuts) neither do the right-hand taps. Such spans are a 1D
+// resample along the row, or between two rows at the same columns, and only
+// the taps that carry weight are read. Results equal FastRowSampler::Sample
+// except that zero-weight taps no longer decide between the fixed-point and
+// float blends (within 1 LSB either way).
+
+// Alpha-weighted blend of up to two taps (null taps are missing): the two-tap
+// form of FastRowSampler::Sample's float path, in the same operation order
+template <typename Pixel>
+inline Pixel BlendTwoTaps(const Pixel* p0, float w0, const Pixel* p1, float w1)
+{
+    using Traits = PixelTraits<Pixel>;
+
+    float total_weight = 0.0f;
+    float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+    const Pixel* taps[2] = { p0, p1 };
+    const float weights[2] = { w0, w1 };
+    for (int k = 0; k < 2; ++k) {
+        if (!taps[k]) {
+            continue;
+        }
+        const Pixel& p = *taps[k];
+        const float pa = Traits::ToFloat(p.alpha);
+        if (pa > ALPHA_THRESHOLD) {
+            const float weight = weights[k] * pa;
+            total_weight += weight;
+            r += Traits::ToFloat(p.red) * weight;
+            g += Traits::ToFloat(p.green) * weight;
+            b += Traits::ToFloat(p.blue) * weight;
+            a += pa * weights[k];
+        }
+    }
+
+    Pixel result;
+    if (total_weight > ALPHA_THRESHOLD) {
+        const float inv_weight = 1.0f / total_weight;
+        result.red = Traits::FromFloat(r * inv_weight);
+        result.green = Traits::FromFloat(g * inv_weight);
+        result.blue = Traits::FromFloat(b * inv_weight);
+        result.alpha = Traits::FromFloat(a);
+    } else {
+        std::memset(&result, 0, sizeof(Pixel));
+    }
+    return result;
+}
+
+// Horizontal 1D sample of one row at weight 1 (fy == 0)
+template <typename Pixel>
+inline Pixel SampleRowHorizontal(const Pixel* row, int width, float x)
+{
+    const int x0 = static_cast<int>(floorf(x));
+    const int x1 = x0 + 1;
+    const float fx = x - static_cast<float>(x0);
+    const bool x0_in = (x0 >= 0 && x0 < width);
+    const bool x1_in = (x1 >= 0 && x1 < width);
+
+    if (fx < EPSILON && x0_in) {
+        return row[x0];
+    }
+    if (x0_in && x1_in) {
+        Pixel result;
+        if (BlendUniformAlphaFixed1D(row[x0], row[x1], fx, result)) {
+            return result;
+        }
+    }
+    return BlendTwoTaps(x0_in ? row + x0 : nullptr, 1.0f - fx, x1_in ? row + x1 : nullptr, fx);
+}
+
+// Vertical 1D sample of the sampler's rows at whole column x (fx == 0)
+template <typename Pixel>
+inline Pixel SampleColumnVertical(const FastRowSampler<Pixel>& sampler, int x)
+{
+    if (x < 0 || x >= sampler.width || (!sampler.row0 && !sampler.row1)) {
+        Pixel result;
+        std::memset(&result, 0, sizeof(Pixel));
+        return result;
+    }
+    if (sampler.row0 && sampler.w0_y > WEIGHT_THRESHOLD) {
+        return sampler.row0[x];
+    }
+    if (sampler.row1 && sampler.w1_y > WEIGHT_THRESHOLD) {
+        return sampler.row1[x];
+    }
+    if (sampler.row0 && sampler.row1) {
+        Pixel result;
+        if (BlendUniformAlphaFixed1D(sampler.row0[x], sampler.row1[x], sampler.w1_y, result)) {
+            return result;
+        }
+    }
+    return BlendTwoTaps(sampler.row0 ? sampler.row0 + x : nullptr, sampler.w0_y,
+                        sampler.row1 ? sampler.row1 + x : nullptr, sampler.w1_y);
+}
+
+// Samples `count` consecutive pixels of a constant-Y row:
+// out[i] = sampler.Sample((sample_x + i) + offset_x)
+// Separable spans take the 1D kernels above. Dispatches to the AVX2/NEON
+// kernels in StretchSimd.cpp when available.
+template <typename Pixel>
+void StretchSampleRowSpan(const FastRowSampler<Pixel>& sampler, float sample_x, float offset_x, int count, Pixel* out);
+
+extern template void StretchSampleRowSpan(const FastRowSampler<StretchPixel8>&, float, float, int, StretchPixel8*);
+extern template void StretchSampleRowSpan(const FastRowSampler<StretchPixel16>&, float, float, int, StretchPixel16*);
+extern template void StretchSampleRowSpan(const FastRowSampler<StretchPixelF>&, float, float, int, StretchPixelF*);
+
+// -----------------------------------------------------------------------------
+// Resampling kernels
+// -----------------------------------------------------------------------------
+//
+// Bicubic (Catmull-Rom) and Lanczos3 read their weights from tables: per
+// axis, a fractional offset f selects the row of its nearest phase
+// (1 / STRETCH_KERNEL_PHASES steps). Taps are alpha-weighted as in
+// SampleBilinear, so transparent pixels lend no color: the sums are
+// (a, r * a, g * a, b * a) and color is divided by the alpha sum at the end.
+// Negative lobes can push that sum out of range; alpha is clamped, and a sum
+// at or below ALPHA_THRESHOLD gives a transparent pixel.
+
+constexpr int STRETCH_KERNEL_PHASES = 1024;
+constexpr int STRETCH_MAX_KERNEL_TAPS = 6;
+
+// Weight table of one kernel. The taps of offset f weight pixels
+// floor(x) + first .. floor(x) + first + taps - 1
+struct StretchKernel
+{
+    int taps;
+    int first;
+    const float* weights;  // STRETCH_KERNEL_PHASES + 1 rows of `taps` weights, each summing to 1
+
+    // Table row of a fractional offset f in [0, 1]
+    static int Phase(float f)
+    {
+        return static_cast<int>(f * static_cast<float>(STRETCH_KERNEL_PHASES) + 0.5f);
+    }
+
+    const float* Weights(float f) const
+    {
+        return weights + Phase(f) * taps;
+    }
+};
+
+// Table for a table-driven quality (bicubic, Lanczos3); nullptr otherwise
+const StretchKernel* StretchGetKernel(int quality);
+
+// Input pixels a quality reads on each side of a sample at x:
+// floor(x) - (radius - 1) .. floor(x) + radius
+constexpr int StretchKernelRadius(int quality)
+{
+    return quality == STRETCH_QUALITY_LANCZOS3 ? 3 : (quality == STRETCH_QUALITY_BICUBIC ? 2 : 1);
+}
+
+// Alpha-weighted tap (a, r * a, g * a, b * a); zero at or below ALPHA_THRESHOLD
+template <typename Pixel>
+inline StretchPixelF KernelTap(const Pixel& p)
+{
+    using Traits = PixelTraits<Pixel>;
+    const float a = Traits::ToFloat(p.alpha);
+    if (!(a > ALPHA_THRESHOLD)) {
+        return { 0.0f, 0.0f, 0.0f, 0.0f };
+    }
+    return { a, Traits::ToFloat(p.red) * a, Traits::ToFloat(p.green) * a, Traits::ToFloat(p.blue) * a };
+}
+
+// sum += tap * w
+inline void KernelAccumulate(StretchPixelF& sum, const StretchPixelF& tap, float w)
+{
+    sum.alpha += tap.alpha * w;
+    sum.red += tap.red * w;
+    sum.green += tap.green * w;
+    sum.blue += tap.blue * w;
+}
+
+// Pixel from alpha-weighted sums
+template <typename Pixel>
+inline Pixel ResolveKernelSum(const StretchPixelF& sum)
+{
+    using Traits = PixelTraits<Pixel>;
+    Pixel result;
+    if (sum.alpha > ALPHA_THRESHOLD) {
+        const float inv_weight = 1.0f / sum.alpha;
+        result.alpha = Traits::FromFloat(ClampScalar(sum.alpha, 0.0f, Traits::MAX_VAL));
+        result.red = Traits::FromFloat(sum.red * inv_weight);
+        result.green = Traits::FromFloat(sum.green * inv_weight);
+        result.blue = Traits::FromFloat(sum.blue * inv_weight);
+    } else {
+        std::memset(&result, 0, sizeof(Pixel));
+    }
+    return result;
+}
+
+// Kernel sample at (xf, yf); pixels outside the input are transparent.
+// Columns are summed first, in the order StretchSampleKernelSpan uses, so a
+// point sample equals the span sample at the same position
+template <typename Pixel>
+inline Pixel SampleKernel(const StretchKernel& kernel, const std::uint8_t* base_ptr, std::ptrdiff_t rowbytes,
+    float xf, float yf, int width, int height)
+{
+    const int x0 = static_cast<int>(floorf(xf));
+    const int y0 = static_cast<int>(floorf(yf));
+    const float* wx = kernel.Weights(xf - static_cast<float>(x0));
+    const float* wy = kernel.Weights(yf - static_cast<float>(y0));
+
+    StretchPixelF sum = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < kernel.taps; ++i) {
+        const int x = x0 + kernel.first + i;
+        if (wx[i] == 0.0f || x < 0 || x >= width) {
+            continue;
+        }
+        StretchPixelF column = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int j = 0; j < kernel.taps; ++j) {
+            const int y = y0 + kernel.first + j;
+            if (wy[j] == 0.0f || y < 0 || y >= height) {
+                continue;
+            }
+            const Pixel* row = reinterpret_cast<const Pixel*>(base_ptr + static_cast<std::ptrdiff_t>(y) * rowbytes);
+            KernelAccumulate(column, KernelTap(row[x]), wy[j]);
+        }
+        KernelAccumulate(sum, column, wx[i]);
+    }
+    return ResolveKernelSum<Pixel>(sum);
+}
+
+// Samples `count` consecutive pixels of a constant-Y row with a table kernel:
+// out[i] = SampleKernel(kernel, ..., (sample_x + i) + offset_x, sample_y, ...).
+// The Y weights are the same along the span, so the kernel rows are summed
+// once into a row of columns, which are then filtered along X. Dispatches to
+// the AVX2/NEON kernels in StretchSimd.cpp
+template <typename Pixel>
+void StretchSampleKernelSpan(const StretchKernel& kernel, const std::uint8_t* base_ptr, std::ptrdiff_t rowbytes,
+    int width, int height, float sample_x, float offset_x, float sample_y, int count, Pixel* out);
+
+extern template void StretchSampleKernelSpan(const StretchKernel&, const std::uint8_t*, std::ptrdiff_t, int, int, float, float, float, int, StretchPixel8*);
+extern template void StretchSampleKernelSpan(const StretchKernel&, const std::uint8_t*, std::ptrdiff_t, int, int, float, float, float, int, StretchPixel16*);
+extern template void StretchSampleKernelSpan(const StretchKernel&, const std::uint8_t*, std::ptrdiff_t, int, int, float, float, float, int, StretchPixelF*);
+
+// Blend two pixels with anti-aliasing
+// coverage: 0.0 = fully pixel_a, 1.0 = fully pixel_b
+template <typename Pixel>
+inline Pixel BlendPixels(const Pixel& pixel_a, const Pixel& pixel_b, float coverage)
+{
+    using Traits = PixelTraits<Pixel>;
+    
+    // Clamp coverage to [0, 1]
+    coverage = ClampScalar(coverage, 0.0f, 1.0f);
+    float inv_coverage = 1.0f - coverage;
+    
+    Pixel result;
+    result.alpha = Traits::FromFloat(Traits::ToFloat(pixel_a.alpha) * inv_coverage + 
+                                     Traits::ToFloat(pixel_b.alpha) * coverage);
+    result.red = Traits::FromFloat(Traits::ToFloat(pixel_a.red) * inv_coverage + 
+                                   Traits::ToFloat(pixel_b.red) * coverage);
+    result.green = Traits::FromFloat(Traits::ToFloat(pixel_a.green) * inv_coverage + 
+                                     Traits::ToFloat(pixel_b.green) * coverage);
+    result.blue = Traits::FromFloat(Traits::ToFloat(pixel_a.blue) * inv_coverage + 
+                                    Traits::ToFloat(pixel_b.blue) * coverage);
+    return result;
+}
+
+// -----------------------------------------------------------------------------
+// Stretch rendering helpers
+// -----------------------------------------------------------------------------
+
+// Gap line cache: the border profile along the anchor line, resampled once
+// per frame at knots (StretchLineCacheKnots). samples[k] is the input sampled
+// at projected position t0 + knots[k] / LINE_CACHE_OVERSAMPLE, and cells[i]
+// is the index of the knot at cache position i, for i < size. Gap pixels
+// between knots k and k + 1 are interpolated, or sampled from the input where
+// direct[k] is set (StretchLineCacheDirect).
+// Most cells hold one interpolated segment (plain[i] set); those read the
+// knots at whole positions from grid, the compact copy the gap loops walk
+template <typename Sample>
+struct StretchLineCache
+{
+    const Sample* samples;        // null when there is no cache
+    const float* knots;
+    const int* cells;
+    const std::uint8_t* direct;
+    const Sample* grid;           // grid[i] = samples[cells[i]]
+    const std::uint8_t* plain;
+    int size;
+    float t0;
+};
+
+template <typename Pixel>
+struct StretchRenderContext
+{
+    const std::uint8_t* input_base;
+    std::uint8_t* output_base;
+    std::ptrdiff_t input_rowbytes;
+    std::ptrdiff_t output_rowbytes;
+    int width;
+    int height;
+    int input_width;
+    int input_height;
+
+    // Geometry
+    float anchor_x;
+    float anchor_y;
+    float effective_shift;
+    float shift_vec_x;
+    float shift_vec_y;
+    float perp_x;
+    float perp_y;
+    float para_x;
+    float para_y;
+    
+    // Output origin offset (for expanded buffer)
+    float output_origin_x;
+    float output_origin_y;
+
+    // Sampling kernel (StretchQuality) and half-width of the region blends
+    int quality;
+    float feather;
+
+    // Gap line cache; samples null when absent
+    StretchLineCache<Pixel> line_cache;
+};
+
+// Line cache positions per pixel along the anchor line
+constexpr int LINE_CACHE_OVERSAMPLE = 16;
+
+// Whether gap pixels at a quality are read from a line cache. Nearest's
+// profile is a staircase that interpolating between knots would blend into
+// colors it never produces, and its direct sample is a single pixel read
+constexpr bool StretchUsesLineCache(int quality)
+{
+    return quality != STRETCH_QUALITY_NEAREST;
+}
+
+// Crossings closer than this to a knot already placed (in cache positions)
+// add none
+constexpr float LINE_CACHE_KNOT_MARGIN = 1.0e-3f;
+
+// Input pixel (x, y), transparent outside the input
+template <typename Pixel>
+inline Pixel ReadInputPixel(const StretchRenderContext<Pixel>& ctx, int x, int y)
+{
+    if (x >= 0 && x < ctx.input_width && y >= 0 && y < ctx.input_height) {
+        return reinterpret_cast<const Pixel*>(ctx.input_base + static_cast<std::ptrdiff_t>(y) * ctx.input_rowbytes)[x];
+    }
+    Pixel result;
+    std::memset(&result, 0, sizeof(Pixel));
+    return result;
+}
+
+// Copies input pixels [x, x + count) of row y, transparent outside the input
+template <typename Pixel>
+inline void CopyInputSpan(const StretchRenderContext<Pixel>& ctx, int x, int y, int count, Pixel* out)
+{
+    if (y < 0 || y >= ctx.input_height || x >= ctx.input_width || x + count <= 0) {
+        std::memset(out, 0, static_cast<size_t>(count) * sizeof(Pixel));
+        return;
+    }
+
+    const int lead = (std::max)(0, -x);
+    const int copy_end = (std::min)(count, ctx.input_width - x);
+    if (lead > 0) {
+        std::memset(out, 0, static_cast<size_t>(lead) * sizeof(Pixel));
+    }
+    const Pixel* row = reinterpret_cast<const Pixel*>(ctx.input_base + static_cast<std::ptrdiff_t>(y) * ctx.input_rowbytes);
+    std::memcpy(out + lead, row + x + lead, static_cast<size_t>(copy_end - lead) * sizeof(Pixel));
+    if (copy_end < count) {
+        std::memset(out + copy_end, 0, static_cast<size_t>(count - copy_end) * sizeof(Pixel));
+    }
+}
+
+// Input sample at (xf, yf) with sampling kernel Quality (StretchQuality;
+// other values sample bilinear)
+template <int Quality, typename Pixel>
+inline Pixel StretchSamplePointAs(const StretchRenderContext<Pixel>& ctx, float xf, float yf)
+{
+    if constexpr (Quality == STRETCH_QUALITY_NEAREST) {
+        return SampleNearestNeighbor<Pixel>(ctx.input_base, ctx.input_rowbytes, xf, yf, ctx.input_width, ctx.input_height);
+    }
+    else if constexpr (Quality == STRETCH_QUALITY_BICUBIC || Quality == STRETCH_QUALITY_LANCZOS3) {
+        return SampleKernel<Pixel>(*StretchGetKernel(Quality), ctx.input_base, ctx.input_rowbytes,
+                                   xf, yf, ctx.input_width, ctx.input_height);
+    }
+    else {
+        return SampleBilinear<Pixel>(ctx.input_base, ctx.input_rowbytes, xf, yf, ctx.input_width, ctx.input_height);
+    }
+}
+
+// Input sample at (xf, yf) with the context's sampling kernel
+template <typename Pixel>
+inline Pixel StretchSamplePoint(const StretchRenderContext<Pixel>& ctx, float xf, float yf)
+{
+    switch (ctx.quality) {
+    case STRETCH_QUALITY_NEAREST:
+        return StretchSamplePointAs<STRETCH_QUALITY_NEAREST>(ctx, xf, yf);
+    case STRETCH_QUALITY_BICUBIC:
+        return StretchSamplePointAs<STRETCH_QUALITY_BICUBIC>(ctx, xf, yf);
+    case STRETCH_QUALITY_LANCZOS3:
+        return StretchSamplePointAs<STRETCH_QUALITY_LANCZOS3>(ctx, xf, yf);
+    default:
+        return StretchSamplePointAs<STRETCH_QUALITY_BILINEAR>(ctx, xf, yf);
+    }
+}
+
+// Source span: out[i] = StretchSamplePointAs<Quality>(ctx, (sample_x + i) + offset_x, sample_y)
+template <int Quality, typename Pixel>
+inline void StretchSampleSourceSpanAs(const StretchRenderContext<Pixel>& ctx, float sample_x, float offset_x, float sample_y,
+    int count, Pixel* out)
+{
+    if constexpr (Quality == STRETCH_QUALITY_NEAREST) {
+        // One rounding for the span: the fractional offset is the same throughout
+        CopyInputSpan(ctx, static_cast<int>(floorf(sample_x + offset_x + 0.5f)),
+                      static_cast<int>(floorf(sample_y + 0.5f)), count, out);
+    }
+    else if constexpr (Quality == STRETCH_QUALITY_BICUBIC || Quality == STRETCH_QUALITY_LANCZOS3) {
+        StretchSampleKernelSpan(*StretchGetKernel(Quality), ctx.input_base, ctx.input_rowbytes,
+                                ctx.input_width, ctx.input_height, sample_x, offset_x, sample_y, count, out);
+    }
+    else {
+        FastRowSampler<Pixel> sampler;
+        sampler.Setup(ctx.input_base, ctx.input_rowbytes, ctx.input_width, ctx.input_height, sample_y);
+        StretchSampleRowSpan(sampler, sample_x, offset_x, count, out);
+    }
+}
+
+// Source span: out[i] = StretchSamplePoint(ctx, (sample_x + i) + offset_x, sample_y)
+template <typename Pixel>
+inline void StretchSampleSourceSpan(const StretchRenderContext<Pixel>& ctx, float sample_x, float offset_x, float sample_y,
+    int count, Pixel* out)
+{
+    switch (ctx.quality) {
+    case STRETCH_QUALITY_NEAREST:
+        StretchSampleSourceSpanAs<STRETCH_QUALITY_NEAREST>(ctx, sample_x, offset_x, sample_y, count, out);
+        return;
+    case STRETCH_QUALITY_BICUBIC:
+        StretchSampleSourceSpanAs<STRETCH_QUALITY_BICUBIC>(ctx, sample_x, offset_x, sample_y, count, out);
+        return;
+    case STRETCH_QUALITY_LANCZOS3:
+        StretchSampleSourceSpanAs<STRETCH_QUALITY_LANCZOS3>(ctx, sample_x, offset_x, sample_y, count, out);
+        return;
+    default:
+        StretchSampleSourceSpanAs<STRETCH_QUALITY_BILINEAR>(ctx, sample_x, offset_x, sample_y, count, out);
+        return;
+    }
+}
+
+// 1D counterpart of SampleBilinear: alpha-weighted blend of two samples
+template <typename Pixel>
+inline Pixel LerpAlphaWeighted(const Pixel& p0, const Pixel& p1, float f)
+{
+    using Traits = PixelTraits<Pixel>;
+
+    if (f < EPSILON) {
+        return p0;
+    }
+    if (f > 1.0f - EPSILON) {
+        return p1;
+    }
+
+    const float w0 = 1.0f - f;
+    const float w1 = f;
+    const float a0 = Traits::ToFloat(p0.alpha);
+    const float a1 = Traits::ToFloat(p1.alpha);
+
+    float total_weight = 0.0f;
+    float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+
+    if (a0 > ALPHA_THRESHOLD) {
+        const float weight = w0 * a0;
+        total_weight += weight;
+        r += Traits::ToFloat(p0.red) * weight;
+        g += Traits::ToFloat(p0.green) * weight;
+        b += Traits::ToFloat(p0.blue) * weight;
+        a += a0 * w0;
+    }
+    if (a1 > ALPHA_THRESHOLD) {
+        const float weight = w1 * a1;
+        total_weight += weight;
+        r += Traits::ToFloat(p1.red) * weight;
+        g += Traits::ToFloat(p1.green) * weight;
+        b += Traits::ToFloat(p1.blue) * weight;
+        a += a1 * w1;
+    }
+
+    Pixel result;
+    if (total_weight > ALPHA_THRESHOLD) {
+        const float inv_weight = 1.0f / total_weight;
+        result.red = Traits::FromFloat(r * inv_weight);
+        result.green = Traits::FromFloat(g * inv_weight);
+        result.blue = Traits::FromFloat(b * inv_weight);
+        result.alpha = Traits::FromFloat(a);
+    } else {
+        std::memset(&result, 0, sizeof(Pixel));
+    }
+    return result;
+}
+
+// StretchLineCache::grid and plain from the knots: a cell is plain when it
+// holds no crossing and its segment is not sampled directly
+template <typename Sample>
+inline void StretchLineCacheFillGrid(const Sample* samples, const int* cells, const std::uint8_t* direct, int size,
+    Sample* grid, std::uint8_t* plain)
+{
+    for (int i = 0; i < size; ++i) {
+        const int k = cells[i];
+        grid[i] = samples[k];
+        plain[i] = (i + 1 < size && cells[i + 1] == k + 1 && !direct[k]) ? 1 : 0;
+    }
+}
+
+// Segment of a line cache holding cache position u (0 < u < size - 1): sets
+// k to the knot it starts at and returns u's fraction of the way to knot
+// k + 1. Most cells hold no crossing and take the fast path
+inline float StretchLineCacheSegment(const float* knots, const int* cells, float u, int& k)
+{
+    const int i = static_cast<int>(u);
+    k = cells[i];
+    const int end = cells[i + 1];
+    if (end - k == 1) {
+        return u - static_cast<float>(i);
+    }
+    while (k + 1 < end && knots[k + 1] <= u) {
+        ++k;
+    }
+    return (u - knots[k]) / (knots[k + 1] - knots[k]);
+}
+
+// Clamps a sample sits at, one bit each: alpha at or below ALPHA_THRESHOLD
+// (no color), and each channel at zero or full scale
+template <typename Pixel>
+inline unsigned StretchLineCacheClamps(const Pixel& p)
+{
+    using Traits = PixelTraits<Pixel>;
+    const auto clamped = [](float v) { return v <= 0.0f || v >= Traits::MAX_VAL; };
+    return (Traits::ToFloat(p.alpha) <= ALPHA_THRESHOLD ? 1u : 0u)
+        | (clamped(Traits::ToFloat(p.alpha)) ? 2u : 0u)
+        | (clamped(Traits::ToFloat(p.red)) ? 4u : 0u)
+        | (clamped(Traits::ToFloat(p.green)) ? 8u : 0u)
+        | (clamped(Traits::ToFloat(p.blue)) ? 16u : 0u);
+}
+
+// Whether gap pixels between knot samples a and b are sampled from the input
+// instead of interpolated: where a channel enters or leaves a clamp between
+// them the profile has a kink off the knots (alpha meeting zero, a kernel's
+// ringing clipped at zero or full scale), and next to a transparent sample
+// the color is undefined enough (the integer fast path returns a
+// transparent pixel's own color) that no interpolation reproduces it
+template <typename Pixel>
+inline bool StretchLineCacheDirect(const Pixel& a, const Pixel& b)
+{
+    const unsigned clamps_a = StretchLineCacheClamps(a);
+    const unsigned clamps_b = StretchLineCacheClamps(b);
+    return clamps_a != clamps_b || ((clamps_a | clamps_b) & 1u) != 0;
+}
+
+// Anchor line coordinate of a gap sample. Within EPSILON of a pixel center it
+// snaps to the center from either side: the anchor line crosses pixel centers
+// and the samplers' exact pixel path is one-sided, so rounding alone would
+// otherwise pick between a transparent pixel's own (straight) color and its
+// neighbours'
+inline float StretchSnapBorderCoordinate(float v)
+{
+    const float center = std::floor(v + 0.5f);
+    return std::fabs(v - center) < EPSILON ? center : v;
+}
+
+// Distance from a tie between two pixels within which Nearest's gap samples
+// count as on it. Only float rounding moves a tie, so the window is narrower
+// than EPSILON, which real positions near a tie would straddle
+constexpr float NEAREST_TIE_EPSILON = 1.0e-4f;
+
+// Nearest's version of StretchSnapBorderCoordinate: near a tie between two
+// pixels it snaps onto the tie, which rounds up. The anchor line often runs
+// along pixel edges (an anchor on a pixel center at 45 degrees lands every
+// other gap sample on a corner), and each kernel's own rounding would
+// otherwise pick either side
+inline float StretchSnapNearestCoordinate(float v)
+{
+    const float tie = std::floor(v) + 0.5f;
+    return std::fabs(v - tie) < NEAREST_TIE_EPSILON ? tie : v;
+}
+
+// Whether every input pixel read by samples on the anchor line between
+// projected positions t0 and t1 (one line cache segment) is fully
+// transparent, as past the input's edges or inside a matte's hole. Gap pixels
+// there are transparent either way, so a segment between two transparent
+// knots needs no direct samples
+template <typename Pixel>
+inline bool StretchLineCacheClear(const StretchRenderContext<Pixel>& ctx, float t0, float t1)
+{
+    using Traits = PixelTraits<Pixel>;
+    const int reach = StretchKernelRadius(ctx.quality);
+    const float x0 = ctx.anchor_x + t0 * ctx.para_x;
+    const float x1 = ctx.anchor_x + t1 * ctx.para_x;
+    const float y0 = ctx.anchor_y + t0 * ctx.para_y;
+    const float y1 = ctx.anchor_y + t1 * ctx.para_y;
+
+    // Taps of both ends, widened by the snap in SampleBorderDirect
+    const int left = (std::max)(static_cast<int>(std::floor((std::min)(x0, x1) - EPSILON)) - (reach - 1), 0);
+    const int right = (std::min)(static_cast<int>(std::floor((std::max)(x0, x1) + EPSILON)) + reach, ctx.input_width - 1);
+    const int top = (std::max)(static_cast<int>(std::floor((std::min)(y0, y1) - EPSILON)) - (reach - 1), 0);
+    const int bottom = (std::min)(static_cast<int>(std::floor((std::max)(y0, y1) + EPSILON)) + reach, ctx.input_height - 1);
+    for (int y = top; y <= bottom; ++y) {
+        const Pixel* row = reinterpret_cast<const Pixel*>(ctx.input_base + static_cast<std::ptrdiff_t>(y) * ctx.input_rowbytes);
+        for (int x = left; x <= right; ++x) {
+            if (Traits::ToFloat(row[x].alpha) > 0.0f) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Gap pixel sampled from the input on the anchor line
+template <typename Pixel>
+inline Pixel SampleBorderDirect(const StretchRenderContext<Pixel>& ctx, float proj_len)
+{
+    const float x = ctx.anchor_x + proj_len * ctx.para_x;
+    const float y = ctx.anchor_y + proj_len * ctx.para_y;
+    if (ctx.quality == STRETCH_QUALITY_NEAREST) {
+        return StretchSamplePointAs<STRETCH_QUALITY_NEAREST>(ctx, StretchSnapNearestCoordinate(x), StretchSnapNearestCoordinate(y));
+    }
+    return StretchSamplePoint(ctx, StretchSnapBorderCoordinate(x), StretchSnapBorderCoordinate(y));
+}
+
+// Gap pixel: the input on the anchor line at projected position proj_len
+template <typename Pixel>
+inline Pixel SampleBorder(const StretchRenderContext<Pixel>& ctx, float proj_len)
+{
+    const StretchLineCache<Pixel>& cache = ctx.line_cache;
+    if (!cache.samples) {
+        return SampleBorderDirect(ctx, proj_len);
+    }
+
+    const float u = (proj_len - cache.t0) * static_cast<float>(LINE_CACHE_OVERSAMPLE);
+    if (!(u > 0.0f)) {
+        return cache.grid[0];
+    }
+    if (u >= static_cast<float>(cache.size - 1)) {
+        return cache.grid[cache.size - 1];
+    }
+    const int index = static_cast<int>(u);
+    if (cache.plain[index]) {
+        return LerpAlphaWeighted(cache.grid[index], cache.grid[index + 1], u - static_cast<float>(index));
+    }
+    int k = 0;
+    const float f = StretchLineCacheSegment(cache.knots, cache.cells, u, k);
+    if (cache.direct[k]) {
+        return SampleBorderDirect(ctx, proj_len);
+    }
+    return LerpAlphaWeighted(cache.samples[k], cache.samples[k + 1], f);
+}
+
+// Walks a line cache with a fixed step: out[i], for i from begin, is the
+// cache at position u0 + step * i, interpolated like SampleBorder. Stops at
+// the first pixel to be sampled from the input and returns its index (count
+// if none). Compiled once per pixel type in StretchSimd.cpp, so the gap loop
+// keeps LerpAlphaWeighted inlined whichever row kernel calls it
+template <typename Pixel>
+int StretchSampleLineCacheSpan(const StretchLineCache<Pixel>& cache, float u0, float step, int begin, int count, Pixel* out);
+
+extern template int StretchSampleLineCacheSpan(const StretchLineCache<StretchPixel8>&, float, float, int, int, StretchPixel8*);
+extern template int StretchSampleLineCacheSpan(const StretchLineCache<StretchPixel16>&, float, float, int, int, StretchPixel16*);
+extern template int StretchSampleLineCacheSpan(const StretchLineCache<StretchPixelF>&, float, float, int, int, StretchPixelF*);
+
+// count gap pixels starting at projected position proj_len and stepping
+// para_x. Walks the line cache with a fixed step when it is present
+template <typename Pixel>
+inline void SampleBorderSpan(const StretchRenderContext<Pixel>& ctx, float proj_len, int count, Pixel* out)
+{
+    if (!ctx.line_cache.samples) {
+        for (int i = 0; i < count; ++i) {
+            out[i] = SampleBorderDirect(ctx, proj_len + ctx.para_x * static_cast<float>(i));
+        }
+        return;
+    }
+
+    const float u0 = (proj_len - ctx.line_cache.t0) * static_cast<float>(LINE_CACHE_OVERSAMPLE);
+    const float step = ctx.para_x * static_cast<float>(LINE_CACHE_OVERSAMPLE);
+    for (int i = StretchSampleLineCacheSpan(ctx.line_cache, u0, step, 0, count, out); i < count;
+         i = StretchSampleLineCacheSpan(ctx.line_cache, u0, step, i + 1, count, out)) {
+        out[i] = SampleBorderDirect(ctx, proj_len + ctx.para_x * static_cast<float>(i));
+    }
+}
+
+// Projected range of the gap line cache for a frame: returns the sample
+// count (0 for an empty frame) and the first projected position in t0
+template <typename Pixel>
+inline int StretchLineCacheRange(const StretchRenderContext<Pixel>& ctx, float& t0)
+{
+    if (ctx.width <= 0 || ctx.height <= 0) {
+        return 0;
+    }
+
+    // Projected positions of the output corners
+    const float dx0 = 0.0f - ctx.output_origin_x - ctx.anchor_x;
+    const float dx1 = static_cast<float>(ctx.width - 1) - ctx.output_origin_x - ctx.anchor_x;
+    const float dy0 = 0.0f - ctx.output_origin_y - ctx.anchor_y;
+    const float dy1 = static_cast<float>(ctx.height - 1) - ctx.output_origin_y - ctx.anchor_y;
+    const float px0 = dx0 * ctx.para_x;
+    const float px1 = dx1 * ctx.para_x;
+    const float py0 = dy0 * ctx.para_y;
+    const float py1 = dy1 * ctx.para_y;
+    const float t_min = (std::min)(px0, px1) + (std::min)(py0, py1);
+    const float t_max = (std::max)(px0, px1) + (std::max)(py0, py1);
+
+    // Start on a whole pixel so axis-aligned lines hit the input grid exactly
+    t0 = std::floor(t_min) - 1.0f;
+    return static_cast<int>(std::ceil((t_max + 1.0f - t0) * static_cast<float>(LINE_CACHE_OVERSAMPLE))) + 1;
+}
+
+// Most knots StretchLineCacheKnots can place for a line cache of size
+// positions
+template <typename Pixel>
+inline int StretchLineCacheKnotCapacity(const StretchRenderContext<Pixel>& ctx, int size)
+{
+    const float pixels = static_cast<float>(size) / static_cast<float>(LINE_CACHE_OVERSAMPLE);
+    return size + static_cast<int>(pixels * (std::fabs(ctx.para_x) + std::fabs(ctx.para_y))) + 4;
+}
+
+// Knots of a line cache of size positions from projected position t0: every
+// cache position, plus each point between two where the anchor line crosses
+// a whole input column or row. Every sampling kernel changes pieces there
+// (and alpha meets zero there at the input's edges), so the profile has a
+// kink that samples on either side would round off; with a knot on it,
+// linear interpolation stays within an 8-bit step or so of sampling the line
+// directly. Fills knots (ascending, in cache positions) and cells (see
+// StretchLineCache) and returns the knot count, at most
+// StretchLineCacheKnotCapacity
+template <typename Pixel>
+inline int StretchLineCacheKnots(const StretchRenderContext<Pixel>& ctx, float t0, int size, float* knots, int* cells)
+{
+    const float scale = static_cast<float>(LINE_CACHE_OVERSAMPLE);
+
+    // Next whole coordinate the line reaches along one axis, and the cache
+    // position where it does
+    struct Axis
+    {
+        float origin;   // coordinate at cache position 0
+        float para;
+        float next;
+        float step;
+        float u;
+    };
+    Axis axes[2] = {
+        { ctx.anchor_x + t0 * ctx.para_x, ctx.para_x, 0.0f, 0.0f, 0.0f },
+        { ctx.anchor_y + t0 * ctx.para_y, ctx.para_y, 0.0f, 0.0f, 0.0f }
+    };
+    for (Axis& axis : axes) {
+        axis.step = (axis.para > 0.0f) ? 1.0f : -1.0f;
+        axis.next = (axis.para > 0.0f) ? std::floor(axis.origin) + 1.0f : std::ceil(axis.origin) - 1.0f;
+        axis.u = (axis.para != 0.0f) ? (axis.next - axis.origin) / axis.para * scale
+                                     : std::numeric_limits<float>::infinity();
+    }
+
+    // Past the kernel's reach of the input every sample is transparent and
+    // crossings there are no kinks
+    const float reach = static_cast<float>(StretchKernelRadius(ctx.quality));
+    const auto reaches_input = [&](float u) {
+        const float x = axes[0].origin + u / scale * axes[0].para;
+        const float y = axes[1].origin + u / scale * axes[1].para;
+        return x >= -reach && x <= static_cast<float>(ctx.input_width - 1) + reach
+            && y >= -reach && y <= static_cast<float>(ctx.input_height - 1) + reach;
+    };
+
+    int count = 0;
+    for (int i = 0; i < size; ++i) {
+        cells[i] = count;
+        knots[count++] = static_cast<float>(i);
+        const float end = static_cast<float>(i + 1);
+        while (i + 1 < size) {
+            Axis& axis = (axes[0].u <= axes[1].u) ? axes[0] : axes[1];
+            if (!(axis.u < end)) {
+                break;
+            }
+            if (axis.u > knots[count - 1] + LINE_CACHE_KNOT_MARGIN && axis.u < end - LINE_CACHE_KNOT_MARGIN
+                && reaches_input(axis.u)) {
+                knots[count++] = axis.u;
+            }
+            axis.next += axis.step;
+            axis.u = (axis.next - axis.origin) / axis.para * scale;
+        }
+    }
+    return count;
+}
+
+// -----------------------------------------------------------------------------
+// Row regions
+// -----------------------------------------------------------------------------
+//
+// Along a row, dist changes monotonically, and each region is one interval of
+// dist. So a row splits into at most five contiguous spans, solved once per
+// row. The kernels then run one tight loop per span instead of testing every
+// pixel. Regions are tested in the order below, which decides overlaps when
+// the shift is narrower than the feather.
+
+enum StretchSpanKind
+{
+    STRETCH_SPAN_SOURCE,   // input at the pixel's position + offset
+    STRETCH_SPAN_BORDER,   // anchor line (gap)
+    STRETCH_SPAN_FEATHER   // source and border blended across a boundary
+};
+
+constexpr int STRETCH_SPAN_KIND_COUNT = 3;
+
+// Output pixels rendered per span kind, counted by the kernels when given
+// one (render statistics, see StretchRenderStats)
+struct StretchSpanCounts
+{
+    std::uint64_t pixels[STRETCH_SPAN_KIND_COUNT] = {};
+};
+
+struct StretchRegion
+{
+    StretchSpanKind kind;
+
+    // Offset of the source sample from the unshifted position
+    float offset_x;
+    float offset_y;
+
+    // Feather: coverage = (dist - coverage_origin) * coverage_scale, blended as
+    // BlendPixels(border, source) when border_first, else BlendPixels(source, border)
+    float coverage_origin;
+    float coverage_scale;
+    bool border_first;
+};
+
+constexpr int STRETCH_MAX_REGIONS = 5;
+
+// Region index of a pixel at signed distance dist from the anchor line, for
+// a StretchDirection (other values classify as Backward), shift eff and
+// feather half-width feather. Feathered = false drops feather from the tests,
+// which is exact for a feather of 0. With no feather the feather regions are
+// empty or a single boundary dist, which then renders as plain source
+template <int Direction, bool Feathered>
+inline int StretchClassifyRegion(float eff, float feather, float dist)
+{
+    if constexpr (!Feathered) {
+        feather = 0.0f;
+    }
+    if constexpr (Direction == STRETCH_DIRECTION_BOTH) {
+        if (dist > eff + feather) return 0;
+        if (dist < -eff - feather) return 1;
+        if (dist > eff - feather) return 2;
+        if (dist < -eff + feather) return 3;
+        return 4;
+    }
+    else if constexpr (Direction == STRETCH_DIRECTION_FORWARD) {
+        if (dist < -feather) return 0;
+        if (dist > eff + feather) return 1;
+        if (dist <= feather) return 2;
+        if (dist > eff - feather) return 3;
+        return 4;
+    }
+    else {
+        if (dist > feather) return 0;
+        if (dist < -eff - feather) return 1;
+        if (dist >= -feather) return 2;
+        if (dist < -eff + feather) return 3;
+        return 4;
+    }
+}
+
+struct StretchRegionSet
+{
+    int direction;
+    float eff;
+    float feather;
+    StretchRegion regions[STRETCH_MAX_REGIONS];
+
+    // Region index of a pixel at signed distance dist from the anchor line
+    int Classify(float dist) const
+    {
+        if (direction == STRETCH_DIRECTION_BOTH) {
+            return StretchClassifyRegion<STRETCH_DIRECTION_BOTH, true>(eff, feather, dist);
+        }
+        if (direction == STRETCH_DIRECTION_FORWARD) {
+            return StretchClassifyRegion<STRETCH_DIRECTION_FORWARD, true>(eff, feather, dist);
+        }
+        return StretchClassifyRegion<STRETCH_DIRECTION_BACKWARD, true>(eff, feather, dist);
+    }
+};
+
+// StretchRegionSet::Classify with the direction and feather fixed at compile
+// time, for StretchSegmentRowBy
+template <int Direction, bool Feathered>
+struct StretchRegionClassifier
+{
+    float eff;
+    float feather;
+
+    int Classify(float dist) const
+    {
+        return StretchClassifyRegion<Direction, Feathered>(eff, feather, dist);
+    }
+};
+
+template <typename Pixel>
+inline StretchRegionSet StretchMakeRegions(const StretchRenderContext<Pixel>& ctx, int direction)
+{
+    const float eff = ctx.effective_shift;
+    const float feather = ctx.feather;
+    const float feather_inv = feather > 0.0f ? 1.0f / (2.0f * feather) : 0.0f;
+    const float sx = ctx.shift_vec_x;
+    const float sy = ctx.shift_vec_y;
+
+    const StretchRegion border = { STRETCH_SPAN_BORDER, 0.0f, 0.0f, 0.0f, 0.0f, false };
+
+    StretchRegionSet set;
+    set.direction = direction;
+    set.eff = eff;
+    set.feather = feather;
+    if (direction == STRETCH_DIRECTION_BOTH) {
+        set.regions[0] = { STRETCH_SPAN_SOURCE, -sx, -sy, 0.0f, 0.0f, false };
+        set.regions[1] = { STRETCH_SPAN_SOURCE, sx, sy, 0.0f, 0.0f, false };
+        set.regions[2] = { STRETCH_SPAN_FEATHER, -sx, -sy, eff - feather, feather_inv, true };
+        set.regions[3] = { STRETCH_SPAN_FEATHER, sx, sy, -eff + feather, -feather_inv, true };
+    }
+    else if (direction == STRETCH_DIRECTION_FORWARD) {
+        set.regions[0] = { STRETCH_SPAN_SOURCE, 0.0f, 0.0f, 0.0f, 0.0f, false };
+        set.regions[1] = { STRETCH_SPAN_SOURCE, -sx, -sy, 0.0f, 0.0f, false };
+        set.regions[2] = { STRETCH_SPAN_FEATHER, 0.0f, 0.0f, -feather, feather_inv, false };
+        set.regions[3] = { STRETCH_SPAN_FEATHER, -sx, -sy, eff - feather, feather_inv, true };
+    }
+    else {
+        set.regions[0] = { STRETCH_SPAN_SOURCE, 0.0f, 0.0f, 0.0f, 0.0f, false };
+        set.regions[1] = { STRETCH_SPAN_SOURCE, sx, sy, 0.0f, 0.0f, false };
+        set.regions[2] = { STRETCH_SPAN_FEATHER, 0.0f, 0.0f, feather, -feather_inv, false };
+        set.regions[3] = { STRETCH_SPAN_FEATHER, sx, sy, -eff + feather, -feather_inv, true };
+    }
+    set.regions[4] = border;
+    return set;
+}
+
+struct StretchSpan
+{
+    int begin;
+    int end;
+    int region;
+};
+
+// Splits [start_x, end_x) into spans of equal classifier.Classify(dist), with
+// dist = dist0 + step * x. Every class must cover one interval of dist. Span
+// ends are found by bisection, so the cost per row is logarithmic in width.
+// Returns the span count (at most max_spans)
+template <typename Classifier>
+inline int StretchSegmentRowBy(const Classifier& classifier, float dist0, float step, int start_x, int end_x,
+    StretchSpan* spans, int max_spans)
+{
+    int count = 0;
+    int x = start_x;
+    while (x < end_x && count < max_spans) {
+        const int region = classifier.Classify(dist0 + step * static_cast<float>(x));
+
+        // First pixel after x in another region (end_x if none)
+        int lo = x;
+        int hi = end_x;
+        while (hi - lo > 1) {
+            const int mid = lo + (hi - lo) / 2;
+            if (classifier.Classify(dist0 + step * static_cast<float>(mid)) == region) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+
+        spans[count++] = { x, hi, region };
+        x = hi;
+    }
+    return count;
+}
+
+// Splits [start_x, end_x) into spans of equal region.
+// Returns the span count (at most STRETCH_MAX_REGIONS)
+inline int StretchSegmentRow(const StretchRegionSet& set, float dist0, float step, int start_x, int end_x, StretchSpan* spans)
+{
+    return StretchSegmentRowBy(set, dist0, step, start_x, end_x, spans, STRETCH_MAX_REGIONS);
+}
+
+// StretchSegmentRow for a set of the given direction and feather
+template <int Direction, bool Feathered>
+inline int StretchSegmentRowAs(const StretchRegionSet& set, float dist0, float step, int start_x, int end_x, StretchSpan* spans)
+{
+    const StretchRegionClassifier<Direction, Feathered> classifier = { set.eff, set.feather };
+    return StretchSegmentRowBy(classifier, dist0, step, start_x, end_x, spans, STRETCH_MAX_REGIONS);
+}
+
+// -----------------------------------------------------------------------------
+// Incremental re-render
+// -----------------------------------------------------------------------------
+//
+// While Shift Amount is scrubbed only effective_shift changes, and most of the
+// frame does not depend on it: the unshifted side and its feather (Forward and
+// Backward) and the gap away from its edges. A pixel can be copied from the
+// previous frame when it lies in the same region under both shifts and that
+// region's parameters are equal; only the rest is rendered.
+
+// Output origins move with the shift, so both frames round dist slightly
+// differently. Pixels this close to a region boundary are always re-rendered
+constexpr float REUSE_DIST_MARGIN = 1.0f / 16.0f;
+
+// Classes per row: each of the four classifications below changes at most
+// STRETCH_MAX_REGIONS - 1 times along a row
+constexpr int STRETCH_MAX_REUSE_SPANS = 4 * (STRETCH_MAX_REGIONS - 1) + 1;
+
+inline bool StretchSameRegion(const StretchRegion& a, const StretchRegion& b)
+{
+    return a.kind == b.kind
+        && a.offset_x == b.offset_x
+        && a.offset_y == b.offset_y
+        && a.coverage_origin == b.coverage_origin
+        && a.coverage_scale == b.coverage_scale
+        && a.border_first == b.border_first;
+}
+
+struct StretchReuseClassifier
+{
+    StretchRegionSet current;
+    StretchRegionSet previous;
+    bool same[STRETCH_MAX_REGIONS];  // region renders identically in both frames
+
+    // The region index (< STRETCH_MAX_REGIONS) for pixels that can be copied.
+    // Other pixels get a key >= STRETCH_MAX_REGIONS per combination of the
+    // regions around them, so every key covers one interval of dist
+    int Classify(float dist) const
+    {
+        const int a = current.Classify(dist - REUSE_DIST_MARGIN);
+        const int b = current.Classify(dist + REUSE_DIST_MARGIN);
+        const int c = previous.Classify(dist - REUSE_DIST_MARGIN);
+        const int d = previous.Classify(dist + REUSE_DIST_MARGIN);
+        if (a == b && a == c && a == d && same[a]) {
+            return a;
+        }
+        return STRETCH_MAX_REGIONS + ((a * STRETCH_MAX_REGIONS + b) * STRETCH_MAX_REGIONS + c) * STRETCH_MAX_REGIONS + d;
+    }
+};
+
+// Classifier for rendering ctx over a frame rendered with `previous`, which
+// differs from ctx only in the shift
+template <typename Pixel>
+inline StretchReuseClassifier StretchMakeReuseClassifier(const StretchRenderContext<Pixel>& ctx, int direction,
+    const StretchGeometry& previous)
+{
+    StretchRenderContext<Pixel> previous_ctx = ctx;
+    previous_ctx.effective_shift = previous.effective_shift;
+    previous_ctx.shift_vec_x = previous.shift_vec_x;
+    previous_ctx.shift_vec_y = previous.shift_vec_y;
+
+    StretchReuseClassifier classifier;
+    classifier.current = StretchMakeRegions(ctx, direction);
+    classifier.previous = StretchMakeRegions(previous_ctx, direction);
+    for (int r = 0; r < STRETCH_MAX_REGIONS; ++r) {
+        classifier.same[r] = StretchSameRegion(classifier.current.regions[r], classifier.previous.regions[r]);
+    }
+    return classifier;
+}
+
+// -----------------------------------------------------------------------------
+// General kernel
+// -----------------------------------------------------------------------------
+
+// Renders output pixels [start_x, end_x) x [start_y, end_y) of a frame
+// whose direction, quality and feather (Feathered: ctx.feather != 0) are the
+// template arguments; set is StretchMakeRegions(ctx, Direction). Called
+// through the tables of "Kernel selection" or ProcessRows.
+// staging (optional) holds 2 * (end_x - start_x) pixels; feather spans then
+// stage their source and gap samples with the span samplers before blending.
+// counts (optional) accumulates the pixels rendered per span kind
+template <int Direction, int Quality, bool Feathered, typename Pixel>
+inline void ProcessRowsAs(const StretchRenderContext<Pixel>& ctx, const StretchRegionSet& set,
+    int start_x, int start_y, int end_x, int end_y, Pixel* staging, StretchSpanCounts* counts)
+{
+    // Left edge of the output buffer in input image coordinates
+    const float sample_x0 = 0.0f - ctx.output_origin_x;
+    const float dx0 = sample_x0 - ctx.anchor_x;
+
+    for (int y = start_y; y < end_y; ++y) {
+        Pixel* out_row = reinterpret_cast<Pixel*>(ctx.output_base + static_cast<std::ptrdiff_t>(y) * ctx.output_rowbytes);
+
+        // Convert output buffer y to input image coordinate system
+        const float sample_y = static_cast<float>(y) - ctx.output_origin_y;
+        const float dy = sample_y - ctx.anchor_y;
+
+        // dist and proj_len at the first pixel; both are linear along the row
+        const float dist0 = dx0 * ctx.perp_x + dy * ctx.perp_y;
+        const float proj0 = dx0 * ctx.para_x + dy * ctx.para_y;
+
+        StretchSpan spans[STRETCH_MAX_REGIONS];
+        const int span_count = StretchSegmentRowAs<Direction, Feathered>(set, dist0, ctx.perp_x, start_x, end_x, spans);
+
+        for (int s = 0; s < span_count; ++s) {
+            const StretchSpan& span = spans[s];
+            const StretchRegion& region = set.regions[span.region];
+            const int count = span.end - span.begin;
+            const float begin_f = static_cast<float>(span.begin);
+            Pixel* out = out_row + span.begin;
+            if (counts) {
+                counts->pixels[region.kind] += static_cast<std::uint64_t>(count);
+            }
+
+            if (region.kind == STRETCH_SPAN_SOURCE) {
+                StretchSampleSourceSpanAs<Quality>(ctx, sample_x0 + begin_f, region.offset_x, sample_y + region.offset_y, count, out);
+            }
+            else if (region.kind == STRETCH_SPAN_BORDER) {
+                SampleBorderSpan(ctx, proj0 + ctx.para_x * begin_f, count, out);
+            }
+            else if (staging) {
+                Pixel* source = staging;
+                Pixel* border = staging + count;
+                StretchSampleSourceSpanAs<Quality>(ctx, sample_x0 + begin_f, region.offset_x, sample_y + region.offset_y, count, source);
+                SampleBorderSpan(ctx, proj0 + ctx.para_x * begin_f, count, border);
+                for (int i = 0; i < count; ++i) {
+                    const float dist = dist0 + ctx.perp_x * static_cast<float>(span.begin + i);
+                    const float coverage = (dist - region.coverage_origin) * region.coverage_scale;
+                    out[i] = region.border_first ? BlendPixels(border[i], source[i], coverage) : BlendPixels(source[i], border[i], coverage);
+                }
+            }
+            else {
+                const float source_y = sample_y + region.offset_y;
+                for (int i = 0; i < count; ++i) {
+                    const float xf = static_cast<float>(span.begin + i);
+                    const float dist = dist0 + ctx.perp_x * xf;
+                    const Pixel border = SampleBorder(ctx, proj0 + ctx.para_x * xf);
+                    const Pixel source = StretchSamplePointAs<Quality>(ctx, sample_x0 + xf + region.offset_x, source_y);
+                    const float coverage = (dist - region.coverage_origin) * region.coverage_scale;
+                    out[i] = region.border_first ? BlendPixels(border, source, coverage) : BlendPixels(source, border, coverage);
+                }
+            }
+        }
+    }
+}
+
+// Output pixel (x, y) evaluated on its own: its region from its distance to
+// the anchor line, a point sample for the source and SampleBorder for the
+// gap (the context's line cache, if any), then the feather blend. This is the
+// specification the span, axis-aligned, SIMD and premultiplied kernels are
+// checked against (tests/StretchCheck.cpp); far too slow to render with
+template <typename Pixel>
+inline Pixel StretchReferencePixel(const StretchRenderContext<Pixel>& ctx, int direction, int x, int y)
+{
+    const StretchRegionSet set = StretchMakeRegions(ctx, direction);
+    const float sample_x = static_cast<float>(x) - ctx.output_origin_x;
+    const float sample_y = static_cast<float>(y) - ctx.output_origin_y;
+    const float dx = sample_x - ctx.anchor_x;
+    const float dy = sample_y - ctx.anchor_y;
+    const float dist = dx * ctx.perp_x + dy * ctx.perp_y;
+    const float proj_len = dx * ctx.para_x + dy * ctx.para_y;
+    const StretchRegion& region = set.regions[set.Classify(dist)];
+
+    const Pixel border = SampleBorder(ctx, proj_len);
+    if (region.kind == STRETCH_SPAN_BORDER) {
+        return border;
+    }
+    const Pixel source = StretchSamplePoint(ctx, sample_x + region.offset_x, sample_y + region.offset_y);
+    if (region.kind == STRETCH_SPAN_SOURCE) {
+        return source;
+    }
+    const float coverage = (dist - region.coverage_origin) * region.coverage_scale;
+    return region.border_first ? BlendPixels(border, source, coverage) : BlendPixels(source, border, coverage);
+}
+
+// -----------------------------------------------------------------------------
+// Axis-aligned fast path
+// -----------------------------------------------------------------------------
+//
+// At 0/90/180/270 degrees with whole-pixel shifts and origin, every source
+// sample lands on an input pixel, so source spans are plain copies. The gap
+// repeats one border row (horizontal line) or one border pixel per row
+// (vertical line).
+
+template <typename Pixel>
+inline bool StretchIsAxisAligned(const StretchRenderContext<Pixel>& ctx)
+{
+    const bool horizontal = ctx.perp_x == 0.0f && std::fabs(ctx.perp_y) == 1.0f;
+    const bool vertical = ctx.perp_y == 0.0f && std::fabs(ctx.perp_x) == 1.0f;
+    return (horizontal || vertical)
+        && ctx.shift_vec_x == std::floor(ctx.shift_vec_x)
+        && ctx.shift_vec_y == std::floor(ctx.shift_vec_y)
+        && ctx.output_origin_x == std::floor(ctx.output_origin_x)
+        && ctx.output_origin_y == std::floor(ctx.output_origin_y);
+}
+
+// Copy kernel; template arguments, set, staging (unused) and counts as for
+// ProcessRowsAs. Quality matters only for a gap row between input rows
+template <int Direction, int Quality, bool Feathered, typename Pixel>
+inline void ProcessRowsAxisAlignedAs(const StretchRenderContext<Pixel>& ctx, const StretchRegionSet& set,
+    int start_x, int start_y, int end_x, int end_y, Pixel* /*staging*/, StretchSpanCounts* counts)
+{
+    const int origin_x = static_cast<int>(ctx.output_origin_x);
+    const int origin_y = static_cast<int>(ctx.output_origin_y);
+
+    // Horizontal anchor line: dist is constant along each row and the gap
+    // repeats the input row at anchor_y. Vertical: dist depends on x only, so
+    // every row has the same spans
+    const bool horizontal = ctx.perp_x == 0.0f;
+    const float dist_x0 = (0.0f - ctx.output_origin_x - ctx.anchor_x) * ctx.perp_x;
+    const bool border_row_exact = ctx.anchor_y == std::floor(ctx.anchor_y);
+
+    StretchSpan column_spans[STRETCH_MAX_REGIONS];
+    const int column_span_count = horizontal ? 0
+        : StretchSegmentRowAs<Direction, Feathered>(set, dist_x0, ctx.perp_x, start_x, end_x, column_spans);
+
+    for (int y = start_y; y < end_y; ++y) {
+        Pixel* out_row = reinterpret_cast<Pixel*>(ctx.output_base + static_cast<std::ptrdiff_t>(y) * ctx.output_rowbytes);
+        const int sample_y = y - origin_y;
+        const float yf_input = static_cast<float>(sample_y);
+        const float dist_y = (yf_input - ctx.anchor_y) * ctx.perp_y;
+
+        StretchSpan row_span = { start_x, end_x,
+            horizontal ? StretchClassifyRegion<Direction, Feathered>(set.eff, set.feather, dist_y) : 0 };
+        const StretchSpan* spans = horizontal ? &row_span : column_spans;
+        const int span_count = horizontal ? 1 : column_span_count;
+
+        // Vertical line: the gap is the input at (anchor_x, y)
+        Pixel border_pixel;
+        if (!horizontal) {
+            border_pixel = StretchSamplePointAs<Quality>(ctx, ctx.anchor_x, yf_input);
+        }
+
+        for (int s = 0; s < span_count; ++s) {
+            const StretchSpan& span = spans[s];
+            const StretchRegion& region = set.regions[span.region];
+            const int count = span.end - span.begin;
+            const int sample_x = span.begin - origin_x;
+            Pixel* out = out_row + span.begin;
+            if (counts) {
+                counts->pixels[region.kind] += static_cast<std::uint64_t>(count);
+            }
+
+            if (region.kind == STRETCH_SPAN_SOURCE) {
+                CopyInputSpan(ctx, sample_x + static_cast<int>(region.offset_x), sample_y + static_cast<int>(region.offset_y), count, out);
+            }
+            else if (region.kind == STRETCH_SPAN_BORDER) {
+                if (!horizontal) {
+                    std::fill(out, out + count, border_pixel);
+                }
+                else if (border_row_exact) {
+                    CopyInputSpan(ctx, sample_x, static_cast<int>(ctx.anchor_y), count, out);
+                }
+                else {
+                    StretchSampleSourceSpanAs<Quality>(ctx, static_cast<float>(sample_x), 0.0f, ctx.anchor_y, count, out);
+                }
+            }
+            else {
+                const int source_x = sample_x + static_cast<int>(region.offset_x);
+                const int source_y = sample_y + static_cast<int>(region.offset_y);
+                for (int i = 0; i < count; ++i) {
+                    const int x = span.begin + i;
+                    const float dist = horizontal ? dist_y : dist_x0 + ctx.perp_x * static_cast<float>(x);
+                    const Pixel border = horizontal
+                        ? StretchSamplePointAs<Quality>(ctx, static_cast<float>(sample_x + i), ctx.anchor_y)
+                        : border_pixel;
+                    const Pixel source = ReadInputPixel(ctx, source_x + i, source_y);
+                    const float coverage = (dist - region.coverage_origin) * region.coverage_scale;
+                    out[i] = region.border_first ? BlendPixels(border, source, coverage) : BlendPixels(source, border, coverage);
+                }
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Premultiplied mode
+// -----------------------------------------------------------------------------
+//
+// Optional input representation for the general kernel. The input is copied
+// once per frame into float, premultiplied by alpha, with a transparent
+// one-pixel border. A bilinear tap is then a plain weighted sum with no bounds
+// or alpha tests, and each output pixel is unpremultiplied once. The alpha
+// weights cancel exactly as in the straight-alpha samplers, so transparent
+// texels still contribute no color (no black fringes).
+//
+// Premultiplied pixels use the channel units of the source Pixel type:
+// alpha in [0, MAX_VAL], color = straight color * alpha / MAX_VAL.
+
+struct StretchPremultipliedInput
+{
+    // Pixel (0, 0). Rows -1..height and columns -1..width are addressable
+    const StretchPixelF* origin;
+    std::ptrdiff_t stride;  // in pixels
+    int width;
+    int height;
+
+    // Premultiplied gap line cache, direct set by
+    // StretchLineCachePremultipliedDirect
+    StretchLineCache<StretchPixelF> line_cache;
+};
+
+template <typename Pixel>
+inline StretchPixelF Premultiply(const Pixel& p)
+{
+    using Traits = PixelTraits<Pixel>;
+    const float alpha = Traits::ToFloat(p.alpha);
+    const float scale = alpha / Traits::MAX_VAL;
+    return { alpha, Traits::ToFloat(p.red) * scale, Traits::ToFloat(p.green) * scale, Traits::ToFloat(p.blue) * scale };
+}
+
+template <typename Pixel>
+inline Pixel Unpremultiply(const StretchPixelF& p)
+{
+    using Traits = PixelTraits<Pixel>;
+    Pixel result;
+    if (p.alpha > ALPHA_THRESHOLD) {
+        const float scale = Traits::MAX_VAL / p.alpha;
+        result.alpha = Traits::FromFloat(p.alpha);
+        result.red = Traits::FromFloat(p.red * scale);
+        result.green = Traits::FromFloat(p.green * scale);
+        result.blue = Traits::FromFloat(p.blue * scale);
+    } else {
+        std::memset(&result, 0, sizeof(Pixel));
+    }
+    return result;
+}
+
+// Whether gap pixels between premultiplied knot samples a and b are sampled
+// from the input instead of interpolated. Premultiplied samples have no
+// clamps to kink at, but next to a transparent knot Unpremultiply divides the
+// interpolation's small error by an alpha near zero
+inline bool StretchLineCachePremultipliedDirect(const StretchPixelF& a, const StretchPixelF& b)
+{
+    return a.alpha <= ALPHA_THRESHOLD || b.alpha <= ALPHA_THRESHOLD;
+}
+
+inline StretchPixelF LerpPremultiplied(const StretchPixelF& p0, const StretchPixelF& p1, float f)
+{
+    const float w0 = 1.0f - f;
+    return {
+        p0.alpha * w0 + p1.alpha * f,
+        p0.red * w0 + p1.red * f,
+        p0.green * w0 + p1.green * f,
+        p0.blue * w0 + p1.blue * f
+    };
+}
+
+// Weighted sum of the 2x2 taps whose top-left is row0[0]
+inline StretchPixelF SumTapsPremultiplied(const StretchPixelF* row0, const StretchPixelF* row1,
+    float w00, float w10, float w01, float w11)
+{
+    return {
+        row0[0].alpha * w00 + row0[1].alpha * w10 + row1[0].alpha * w01 + row1[1].alpha * w11,
+        row0[0].red * w00 + row0[1].red * w10 + row1[0].red * w01 + row1[1].red * w11,
+        row0[0].green * w00 + row0[1].green * w10 + row1[0].green * w01 + row1[1].green * w11,
+        row0[0].blue * w00 + row0[1].blue * w10 + row1[0].blue * w01 + row1[1].blue * w11
+    };
+}
+
+inline StretchPixelF SamplePremultiplied(const StretchPremultipliedInput& in, float xf, float yf)
+{
+    const int x0 = static_cast<int>(floorf(xf));
+    const int y0 = static_cast<int>(floorf(yf));
+
+    // Taps past the transparent border
+    if (x0 < -1 || x0 >= in.width || y0 < -1 || y0 >= in.height) {
+        return { 0.0f, 0.0f, 0.0f, 0.0f };
+    }
+
+    const float fx = xf - static_cast<float>(x0);
+    const float fy = yf - static_cast<float>(y0);
+    const StretchPixelF* row0 = in.origin + static_cast<std::ptrdiff_t>(y0) * in.stride + x0;
+    return SumTapsPremultiplied(row0, row0 + in.stride,
+        (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy);
+}
+
+// Premultiplied SampleBorderDirect
+template <typename Pixel>
+inline StretchPixelF SampleBorderPremultipliedDirect(const StretchRenderContext<Pixel>& ctx, const StretchPremultipliedInput& in,
+    float proj_len)
+{
+    return SamplePremultiplied(in, StretchSnapBorderCoordinate(ctx.anchor_x + proj_len * ctx.para_x),
+        StretchSnapBorderCoordinate(ctx.anchor_y + proj_len * ctx.para_y));
+}
+
+template <typename Pixel>
+inline StretchPixelF SampleBorderPremultiplied(const StretchRenderContext<Pixel>& ctx, const StretchPremultipliedInput& in, float proj_len)
+{
+    const StretchLineCache<StretchPixelF>& cache = in.line_cache;
+    if (!cache.samples) {
+        return SampleBorderPremultipliedDirect(ctx, in, proj_len);
+    }
+
+    const float u = (proj_len - cache.t0) * static_cast<float>(LINE_CACHE_OVERSAMPLE);
+    if (!(u > 0.0f)) {
+        return cache.grid[0];
+    }
+    if (u >= static_cast<float>(cache.size - 1)) {
+        return cache.grid[cache.size - 1];
+    }
+    const int index = static_cast<int>(u);
+    if (cache.plain[index]) {
+        return LerpPremultiplied(cache.grid[index], cache.grid[index + 1], u - static_cast<float>(index));
+    }
+    int k = 0;
+    const float f = StretchLineCacheSegment(cache.knots, cache.cells, u, k);
+    if (cache.direct[k]) {
+        return SampleBorderPremultipliedDirect(ctx, in, proj_len);
+    }
+    return LerpPremultiplied(cache.samples[k], cache.samples[k + 1], f);
+}
+
+// count unpremultiplied gap pixels starting at projected position proj_len
+// and stepping para_x: SampleBorderPremultiplied walked with a fixed step, as
+// SampleBorderSpan does for straight alpha
+template <typename Pixel>
+inline void SampleBorderSpanPremultiplied(const StretchRenderContext<Pixel>& ctx, const StretchPremultipliedInput& in,
+    float proj_len, int count, Pixel* out)
+{
+    const StretchLineCache<StretchPixelF>& cache = in.line_cache;
+    if (!cache.samples) {
+        for (int i = 0; i < count; ++i) {
+            out[i] = Unpremultiply<Pixel>(SampleBorderPremultipliedDirect(ctx, in, proj_len + ctx.para_x * static_cast<float>(i)));
+        }
+        return;
+    }
+
+    // Locals, so stores to out do not reload the cache's fields
+    const StretchPixelF* grid = cache.grid;
+    const std::uint8_t* plain = cache.plain;
+    const int last = cache.size - 1;
+    const float u0 = (proj_len - cache.t0) * static_cast<float>(LINE_CACHE_OVERSAMPLE);
+    const float step = ctx.para_x * static_cast<float>(LINE_CACHE_OVERSAMPLE);
+    for (int i = 0; i < count; ++i) {
+        const float u = u0 + step * static_cast<float>(i);
+        if (!(u > 0.0f)) {
+            out[i] = Unpremultiply<Pixel>(grid[0]);
+            continue;
+        }
+        const int index = static_cast<int>(u);
+        const StretchPixelF sample = (index >= last) ? grid[last]
+            : plain[index] ? LerpPremultiplied(grid[index], grid[index + 1], u - static_cast<float>(index))
+            : SampleBorderPremultiplied(ctx, in, proj_len + ctx.para_x * static_cast<float>(i));
+        out[i] = Unpremultiply<Pixel>(sample);
+    }
+}
+
+// Unpremultiplied 2x2 sums with fixed weights: out[i] = Unpremultiply(
+// SumTapsPremultiplied(row0 + i, row1 + i, ...)).
+// Dispatches to the AVX2/NEON kernels in StretchSimd.cpp when available.
+template <typename Pixel>
+void StretchBlendSpanPremultiplied(const StretchPixelF* row0, const StretchPixelF* row1,
+    float w00, float w10, float w01, float w11, int count, Pixel* out);
+
+extern template void StretchBlendSpanPremultiplied(const StretchPixelF*, const StretchPixelF*, float, float, float, float, int, StretchPixel8*);
+extern template void StretchBlendSpanPremultiplied(const StretchPixelF*, const StretchPixelF*, float, float, float, float, int, StretchPixel16*);
+extern template void StretchBlendSpanPremultiplied(const StretchPixelF*, const StretchPixelF*, float, float, float, float, int, StretchPixelF*);
+
+// count source pixels of one row: input at (sample_x + i, sample_y).
+// The fractional offsets are the same for the whole span, so are the weights
+template <typename Pixel>
+inline void SampleSpanPremultiplied(const StretchPremultipliedInput& in, float sample_x, float sample_y, int count, Pixel* out)
+{
+    const int x0 = static_cast<int>(floorf(sample_x));
+    const int y0 = static_cast<int>(floorf(sample_y));
+    if (y0 < -1 || y0 >= in.height) {
+        std::memset(out, 0, static_cast<size_t>(count) * sizeof(Pixel));
+        return;
+    }
+
+    // Pixels whose taps stay inside the bordered copy
+    const int first = ClampScalar(-1 - x0, 0, count);
+    const int last = ClampScalar(in.width - x0, first, count);
+    if (first > 0) {
+        std::memset(out, 0, static_cast<size_t>(first) * sizeof(Pixel));
+    }
+    if (last < count) {
+        std::memset(out + last, 0, static_cast<size_t>(count - last) * sizeof(Pixel));
+    }
+
+    const float fx = sample_x - static_cast<float>(x0);
+    const float fy = sample_y - static_cast<float>(y0);
+    const float w00 = (1.0f - fx) * (1.0f - fy);
+    const float w10 = fx * (1.0f - fy);
+    const float w01 = (1.0f - fx) * fy;
+    const float w11 = fx * fy;
+    const StretchPixelF* row0 = in.origin + static_cast<std::ptrdiff_t>(y0) * in.stride + x0;
+    const StretchPixelF* row1 = row0 + in.stride;
+
+    StretchBlendSpanPremultiplied(row0 + first, row1 + first, w00, w10, w01, w11, last - first, out + first);
+}
+
+// General kernel on the premultiplied copy (bilinear only). Feather pixels
+// are blended after unpremultiplying, like BlendPixels in the straight-alpha
+// kernel. set, staging and counts are as for ProcessRowsAs
+template <int Direction, bool Feathered, typename Pixel>
+inline void ProcessRowsPremultipliedAs(const StretchRenderContext<Pixel>& ctx, const StretchPremultipliedInput& in,
+    const StretchRegionSet& set, int start_x, int start_y, int end_x, int end_y, Pixel* staging, StretchSpanCounts* counts)
+{
+    const float sample_x0 = 0.0f - ctx.output_origin_x;
+    const float dx0 = sample_x0 - ctx.anchor_x;
+
+    for (int y = start_y; y < end_y; ++y) {
+        Pixel* out_row = reinterpret_cast<Pixel*>(ctx.output_base + static_cast<std::ptrdiff_t>(y) * ctx.output_rowbytes);
+        const float sample_y = static_cast<float>(y) - ctx.output_origin_y;
+        const float dy = sample_y - ctx.anchor_y;
+        const float dist0 = dx0 * ctx.perp_x + dy * ctx.perp_y;
+        const float proj0 = dx0 * ctx.para_x + dy * ctx.para_y;
+
+        StretchSpan spans[STRETCH_MAX_REGIONS];
+        const int span_count = StretchSegmentRowAs<Direction, Feathered>(set, dist0, ctx.perp_x, start_x, end_x, spans);
+
+        for (int s = 0; s < span_count; ++s) {
+            const StretchSpan& span = spans[s];
+            const StretchRegion& region = set.regions[span.region];
+            const int count = span.end - span.begin;
+            const float begin_f = static_cast<float>(span.begin);
+            Pixel* out = out_row + span.begin;
+            if (counts) {
+                counts->pixels[region.kind] += static_cast<std::uint64_t>(count);
+            }
+
+            if (region.kind == STRETCH_SPAN_SOURCE) {
+                SampleSpanPremultiplied(in, sample_x0 + begin_f + region.offset_x, sample_y + region.offset_y, count, out);
+            }
+            else if (region.kind == STRETCH_SPAN_BORDER) {
+                SampleBorderSpanPremultiplied(ctx, in, proj0 + ctx.para_x * begin_f, count, out);
+            }
+            else if (staging) {
+                Pixel* source = staging;
+                Pixel* border = staging + count;
+                SampleSpanPremultiplied(in, sample_x0 + begin_f + region.offset_x, sample_y + region.offset_y, count, source);
+                SampleBorderSpanPremultiplied(ctx, in, proj0 + ctx.para_x * begin_f, count, border);
+                for (int i = 0; i < count; ++i) {
+                    const float dist = dist0 + ctx.perp_x * static_cast<float>(span.begin + i);
+                    const float coverage = (dist - region.coverage_origin) * region.coverage_scale;
+                    out[i] = region.border_first ? BlendPixels(border[i], source[i], coverage) : BlendPixels(source[i], border[i], coverage);
+                }
+            }
+            else {
+                const float source_y = sample_y + region.offset_y;
+                for (int i = 0; i < count; ++i) {
+                    const float xf = static_cast<float>(span.begin + i);
+                    const float dist = dist0 + ctx.perp_x * xf;
+                    const Pixel border = Unpremultiply<Pixel>(SampleBorderPremultiplied(ctx, in, proj0 + ctx.para_x * xf));
+                    const Pixel source = Unpremultiply<Pixel>(SamplePremultiplied(in, sample_x0 + xf + region.offset_x, source_y));
+                    const float coverage = (dist - region.coverage_origin) * region.coverage_scale;
+                    out[i] = region.border_first ? BlendPixels(border, source, coverage) : BlendPixels(source, border, coverage);
+                }
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Kernel selection
+// -----------------------------------------------------------------------------
+//
+// Each row kernel is compiled once per direction, sampling quality and
+// feather on/off, so region classification, sampler choice and the feather
+// terms are constants inside the span loops. The tables below hold every
+// combination and are built at compile time; a frame looks its kernel up
+// once and every tile calls it directly
+
+template <typename Pixel>
+using StretchRowKernel = void (*)(const StretchRenderContext<Pixel>& ctx, const StretchRegionSet& set,
+    int start_x, int start_y, int end_x, int end_y, Pixel* staging, StretchSpanCounts* counts);
+
+template <typename Pixel>
+using StretchPremultipliedRowKernel = void (*)(const StretchRenderContext<Pixel>& ctx, const StretchPremultipliedInput& in,
+    const StretchRegionSet& set, int start_x, int start_y, int end_x, int end_y, Pixel* staging, StretchSpanCounts* counts);
+
+constexpr int STRETCH_DIRECTION_COUNT = 3;
+constexpr int STRETCH_QUALITY_COUNT = 4;
+constexpr int STRETCH_KERNEL_VARIANTS = STRETCH_QUALITY_COUNT * STRETCH_DIRECTION_COUNT * 2;
+
+// Table index of a kernel variant. Out-of-range directions and qualities
+// select Backward and Bilinear, as the runtime dispatch always has
+constexpr int StretchKernelVariant(int direction, int quality, bool feathered)
+{
+    const int d = (direction >= STRETCH_DIRECTION_BOTH && direction <= STRETCH_DIRECTION_BACKWARD)
+        ? direction - STRETCH_DIRECTION_BOTH : STRETCH_DIRECTION_BACKWARD - STRETCH_DIRECTION_BOTH;
+    const int q = (quality >= STRETCH_QUALITY_NEAREST && quality <= STRETCH_QUALITY_LANCZOS3)
+        ? quality - STRETCH_QUALITY_NEAREST : STRETCH_QUALITY_BILINEAR - STRETCH_QUALITY_NEAREST;
+    return (q * STRETCH_DIRECTION_COUNT + d) * 2 + (feathered ? 1 : 0);
+}
+
+constexpr int StretchVariantQuality(int variant)
+{
+    return STRETCH_QUALITY_NEAREST + variant / (STRETCH_DIRECTION_COUNT * 2);
+}
+
+constexpr int StretchVariantDirection(int variant)
+{
+    return STRETCH_DIRECTION_BOTH + (variant / 2) % STRETCH_DIRECTION_COUNT;
+}
+
+constexpr bool StretchVariantFeathered(int variant)
+{
+    return (variant % 2) != 0;
+}
+
+template <typename Pixel, int... V>
+constexpr std::array<StretchRowKernel<Pixel>, sizeof...(V)> StretchMakeRowKernels(bool axis_aligned, std::integer_sequence<int, V...>)
+{
+    return axis_aligned
+        ? std::array<StretchRowKernel<Pixel>, sizeof...(V)>{ { &ProcessRowsAxisAlignedAs<StretchVariantDirection(V),
+              StretchVariantQuality(V), StretchVariantFeathered(V), Pixel>... } }
+        : std::array<StretchRowKernel<Pixel>, sizeof...(V)>{ { &ProcessRowsAs<StretchVariantDirection(V),
+              StretchVariantQuality(V), StretchVariantFeathered(V), Pixel>... } };
+}
+
+// The premultiplied kernel samples bilinear only: one variant per direction
+// and feather, indexed as StretchKernelVariant with quality Nearest
+template <typename Pixel, int... V>
+constexpr std::array<StretchPremultipliedRowKernel<Pixel>, sizeof...(V)> StretchMakePremultipliedRowKernels(std::integer_sequence<int, V...>)
+{
+    return { { &ProcessRowsPremultipliedAs<StretchVariantDirection(V), StretchVariantFeathered(V), Pixel>... } };
+}
+
+// Row kernel for a frame: the copy kernel when axis_aligned
+// (StretchIsAxisAligned), else the general span kernel
+template <typename Pixel>
+inline StretchRowKernel<Pixel> StretchSelectRowKernel(const StretchRenderContext<Pixel>& ctx, int direction, bool axis_aligned)
+{
+    static constexpr std::array<StretchRowKernel<Pixel>, STRETCH_KERNEL_VARIANTS> general =
+        StretchMakeRowKernels<Pixel>(false, std::make_integer_sequence<int, STRETCH_KERNEL_VARIANTS>());
+    static constexpr std::array<StretchRowKernel<Pixel>, STRETCH_KERNEL_VARIANTS> copy =
+        StretchMakeRowKernels<Pixel>(true, std::make_integer_sequence<int, STRETCH_KERNEL_VARIANTS>());
+    const int variant = StretchKernelVariant(direction, ctx.quality, ctx.feather != 0.0f);
+    return axis_aligned ? copy[variant] : general[variant];
+}
+
+template <typename Pixel>
+inline StretchPremultipliedRowKernel<Pixel> StretchSelectPremultipliedRowKernel(const StretchRenderContext<Pixel>& ctx, int direction)
+{
+    static constexpr std::array<StretchPremultipliedRowKernel<Pixel>, STRETCH_DIRECTION_COUNT * 2> kernels =
+        StretchMakePremultipliedRowKernels<Pixel>(std::make_integer_sequence<int, STRETCH_DIRECTION_COUNT * 2>());
+    return kernels[StretchKernelVariant(direction, STRETCH_QUALITY_NEAREST, ctx.feather != 0.0f)];
+}
+
+// Runtime-dispatched forms, for callers that render a single tile
+
+template <typename Pixel>
+inline void ProcessRows(const StretchRenderContext<Pixel>& ctx, int direction, int start_x, int start_y, int end_x, int end_y,
+    Pixel* staging = nullptr, StretchSpanCounts* counts = nullptr)
+{
+    StretchSelectRowKernel(ctx, direction, false)(ctx, StretchMakeRegions(ctx, direction),
+                                                  start_x, start_y, end_x, end_y, staging, counts);
+}
+
+template <typename Pixel>
+inline void ProcessRowsAxisAligned(const StretchRenderContext<Pixel>& ctx, int direction, int start_x, int start_y, int end_x, int end_y,
+    StretchSpanCounts* counts = nullptr)
+{
+    StretchSelectRowKernel(ctx, direction, true)(ctx, StretchMakeRegions(ctx, direction),
+                                                 start_x, start_y, end_x, end_y, nullptr, counts);
+}
+
+template <typename Pixel>
+inline void ProcessRowsPremultiplied(const StretchRenderContext<Pixel>& ctx, const StretchPremultipliedInput& in,
+    int direction, int start_x, int start_y, int end_x, int end_y, Pixel* staging = nullptr,
+    StretchSpanCounts* counts = nullptr)
+{
+    StretchSelectPremultipliedRowKernel(ctx, direction)(ctx, in, StretchMakeRegions(ctx, direction),
+                                                        start_x, start_y, end_x, end_y, staging, counts);
+}
+
+// A frame's row kernel and regions, selected once and shared by its tiles
+template <typename Pixel>
+struct StretchTileRenderer
+{
+    StretchRowKernel<Pixel> kernel;
+    StretchRegionSet set;
+
+    // Renders output pixels [start_x, end_x) x [start_y, end_y); staging and
+    // counts as for ProcessRowsAs
+    void Render(const StretchRenderContext<Pixel>& ctx, int start_x, int start_y, int end_x, int end_y,
+        Pixel* staging = nullptr, StretchSpanCounts* counts = nullptr) const
+    {
+        kernel(ctx, set, start_x, start_y, end_x, end_y, staging, counts);
+    }
+};
+
+template <typename Pixel>
+inline StretchTileRenderer<Pixel> StretchSelectTileRenderer(const StretchRenderContext<Pixel>& ctx, int direction)
+{
+    return { StretchSelectRowKernel(ctx, direction, StretchIsAxisAligned(ctx)), StretchMakeRegions(ctx, direction) };
+}
+
+// -----------------------------------------------------------------------------
+// Frame rendering
+// -----------------------------------------------------------------------------
+
+// Rows per pool task: small enough for work stealing to balance uneven rows
+// (rows crossing the gap or feather cost more than pure source rows)
+constexpr int ROWS_PER_TASK = 16;
+
+class StretchFrameArena;
+
+// A finished frame of the same input pixels, rendered with the same options
+// into a separate buffer. StretchRenderFrame uses it only when it differs
+// from the new frame in nothing but the shift and a whole-pixel move of the
+// output origin, and renders every pixel otherwise
+struct StretchReuseFrame
+{
+    StretchGeometry geometry;
+    const void* data = nullptr;
+    std::ptrdiff_t rowbytes = 0;
+    int width = 0;
+    int height = 0;
+    float output_origin_x = 0.0f;
+    float output_origin_y = 0.0f;
+};
+
+// Statistics of one StretchRenderFrame or StretchRenderStrips call, for
+// finding out where a slow render spends its time. Collected only when asked
+// for (StretchRenderOptions::stats or ::profile); otherwise the kernels pay
+// one pointer test per span. Times are wall-clock nanoseconds on the render
+// thread; task times are summed over the pool
+struct StretchRenderStats
+{
+    int frame = -1;                  // StretchRenderOptions::profile_frame
+    int width = 0;
+    int height = 0;
+    int depth = 0;                   // bits per channel
+    int quality = 0;
+    int direction = 0;
+    int strips = 0;
+    int threads = 0;                 // the frame's share of the pool
+    int tasks = 0;                   // pool tasks that rendered output
+    bool axis_aligned = false;       // copy kernels (see "Axis-aligned fast path")
+    bool premultiplied = false;      // sampled the premultiplied copy
+    bool reuse = false;              // copied pixels from a previous frame
+
+    std::int64_t total_ns = 0;
+    std::int64_t setup_ns = 0;       // everything but the three below: arena,
+                                     // reuse plan, premultiplied copy, line cache
+    std::int64_t render_ns = 0;      // tasks dispatched until the last one ended
+    std::int64_t join_ns = 0;        // last task ended until the render thread resumed
+    std::int64_t sink_ns = 0;        // StretchStripSink callbacks
+    std::int64_t task_ns = 0;        // summed over tasks
+    std::int64_t task_max_ns = 0;    // slowest task
+
+    // Output pixels rendered per StretchSpanKind, and copied from the
+    // previous frame instead
+    std::uint64_t pixels[STRETCH_SPAN_KIND_COUNT] = {};
+    std::uint64_t reused_pixels = 0;
+};
+
+// Writes stats as one JSON line to the STRETCH_PROFILE destination: stderr
+// for "1", else the file it names (appended to). Safe to call from
+// concurrent renders; does nothing when STRETCH_PROFILE is unset
+void StretchWriteRenderStats(const StretchRenderStats& stats);
+
+// How StretchRenderFrame splits the output into pool tasks
+enum StretchSchedule
+{
+    STRETCH_SCHEDULE_TILES = 0,  // cache-sized 2D tiles (default)
+    STRETCH_SCHEDULE_ROWS        // full-width bands of ROWS_PER_TASK rows
+};
+
+struct StretchRenderOptions
+{
+    StretchSchedule schedule = STRETCH_SCHEDULE_TILES;
+
+    // Sample a premultiplied float copy of the input (see "Premultiplied
+    // mode"). Costs a per-frame copy of 16 bytes per input pixel; falls back
+    // to the straight-alpha kernel if that cannot be allocated
+    bool premultiplied = false;
+
+    // Scratch for line caches, the premultiplied copy and span staging.
+    // Reset by StretchRenderFrame. nullptr uses an arena owned by the calling
+    // thread (malloc backend), kept across frames
+    StretchFrameArena* arena = nullptr;
+
+    // Previous frame to copy unchanged pixels from (see "Incremental
+    // re-render"); nullptr renders every pixel
+    const StretchReuseFrame* reuse = nullptr;
+
+    // Receives the render's statistics; nullptr collects none unless profile
+    // is set
+    StretchRenderStats* stats = nullptr;
+
+    // Write the render's statistics with StretchWriteRenderStats, labelled
+    // with profile_frame (a frame number, -1 for none)
+    bool profile = false;
+    int profile_frame = -1;
+};
+
+// Options for host renders: defaults, with STRETCH_PREMULTIPLIED=1 in the
+// environment enabling premultiplied mode and STRETCH_PROFILE (see
+// StretchWriteRenderStats) enabling profile
+StretchRenderOptions StretchGetDefaultRenderOptions();
+
+// Tile height, and the per-tile budget for output rows plus the input
+// footprint they read, sized to stay within a typical L2 (1 MB or more on
+// current desktop cores)
+constexpr int TILE_HEIGHT = 32;
+constexpr int TILE_CACHE_BYTES = 1024 * 1024;
+
+// Tile width for a pixel type: a multiple of 8 so SIMD groups stay whole
+template <typename Pixel>
+constexpr int StretchTileWidth()
+{
+    return (TILE_CACHE_BYTES / (2 * TILE_HEIGHT * static_cast<int>(sizeof(Pixel)))) & ~7;
+}
+
+template <typename Pixel>
+inline StretchRenderContext<Pixel> StretchMakeContext(const StretchGeometry& geometry,
+    const void* input_data, std::ptrdiff_t input_rowbytes, int input_width, int input_height,
+    void* output_data, std::ptrdiff_t output_rowbytes, int width, int height,
+    float output_origin_x, float output_origin_y)
+{
+    StretchRenderContext<Pixel> ctx{};
+    ctx.input_base = static_cast<const std::uint8_t*>(input_data);
+    ctx.output_base = static_cast<std::uint8_t*>(output_data);
+    ctx.input_rowbytes = input_rowbytes;
+    ctx.output_rowbytes = output_rowbytes;
+    ctx.width = width;
+    ctx.height = height;
+    ctx.input_width = input_width;
+    ctx.input_height = input_height;
+    ctx.anchor_x = geometry.anchor_x;
+    ctx.anchor_y = geometry.anchor_y;
+    ctx.effective_shift = geometry.effective_shift;
+    ctx.shift_vec_x = geometry.shift_vec_x;
+    ctx.shift_vec_y = geometry.shift_vec_y;
+    ctx.perp_x = geometry.perp_x;
+    ctx.perp_y = geometry.perp_y;
+    ctx.para_x = geometry.para_x;
+    ctx.para_y = geometry.para_y;
+    ctx.output_origin_x = output_origin_x;
+    ctx.output_origin_y = output_origin_y;
+    ctx.quality = geometry.quality;
+    ctx.feather = geometry.feather;
+    return ctx;
+}
+
+// Renders output pixels [start_x, end_x) x [start_y, end_y).
+// staging (optional): 2 * (end_x - start_x) pixels of scratch, see ProcessRowsAs.
+// counts (optional) accumulates the pixels rendered per span kind. Selects
+// the kernel on every call; a frame's tiles share a StretchTileRenderer
+template <typename Pixel>
+inline void StretchRenderTile(const StretchRenderContext<Pixel>& ctx, int direction, int start_x, int start_y, int end_x, int end_y,
+    Pixel* staging = nullptr, StretchSpanCounts* counts = nullptr)
+{
+    StretchSelectTileRenderer(ctx, direction).Render(ctx, start_x, start_y, end_x, end_y, staging, counts);
+}
+
+template <typename Pixel>
+inline void StretchRenderRows(const StretchRenderContext<Pixel>& ctx, int direction, int start_y, int end_y)
+{
+    StretchRenderTile(ctx, direction, 0, start_y, ctx.width, end_y);
+}
+
+// Renders the whole output on the process-wide worker pool.
+// Returns false if any worker failed.
+template <typename Pixel>
+bool StretchRenderFrame(const StretchRenderContext<Pixel>& ctx, int direction, const StretchRenderOptions& options = StretchRenderOptions());
+
+extern template bool StretchRenderFrame(const StretchRenderContext<StretchPixel8>&, int, const StretchRenderOptions&);
+extern template bool StretchRenderFrame(const StretchRenderContext<StretchPixel16>&, int, const StretchRenderOptions&);
+extern template bool StretchRenderFrame(const StretchRenderContext<StretchPixelF>&, int, const StretchRenderOptions&);
+
+// -----------------------------------------------------------------------------
+// Strip streaming
+// -----------------------------------------------------------------------------
+//
+// Frames too large to hold at once render as strips of whole output rows,
+// one after another. A strip reads only the input rows of its source regions
+// (StretchComputeSourceRect); the gap comes from one line cache built for the
+// whole frame, so per-frame scratch grows with the frame's width and the
+// strip height rather than its area, and the output and input only need the
+// current strip in memory. Strips render bit-identically to the whole frame
+// in straight alpha.
+
+// Output rows [start_y, end_y) and the input rows they read
+struct StretchStrip
+{
+    int start_y = 0;
+    int end_y = 0;
+    StretchRect input_rect;  // clipped to the input; empty if no source is read
+};
+
+// Receives the strips of StretchRenderStrips in order, on the calling thread.
+// Returning false from either stops the render (StretchRenderStrips fails)
+struct StretchStripSink
+{
+    // Where the strip's rows go: row start_y at data, rows rowbytes apart.
+    // The place to bring the strip's input rows into memory
+    std::function<bool(const StretchStrip& strip, void*& data, std::ptrdiff_t& rowbytes)> begin;
+
+    // The strip's rows are rendered
+    std::function<bool(const StretchStrip& strip)> end;
+};
+
+// Splits output_height rows into strips whose output rows plus input rows
+// (output_width and input_width pixels of the given sizes) fit in
+// budget_bytes. A strip has at least TILE_HEIGHT rows, so a budget below
+// that footprint is exceeded rather than cut into rows too thin to spread
+// over the pool. Output pixel (x, y) is input pixel (x - origin_x,
+// y - origin_y)
+std::vector<StretchStrip> StretchPlanStrips(const StretchGeometry& geometry, int input_width, int input_height,
+    int output_width, int output_height, float origin_x, float origin_y,
+    int output_pixel_bytes, int input_pixel_bytes, std::size_t budget_bytes);
+
+// Renders ctx's output as strips (ctx.output_base and output_rowbytes are
+// ignored; the sink places each strip). Options are as for StretchRenderFrame,
+// except that the premultiplied mode applies to a single strip only: its
+// copy holds the whole input.
+// Returns false if a worker or the sink failed.
+template <typename Pixel>
+bool StretchRenderStrips(const StretchRenderContext<Pixel>& ctx, int direction, const std::vector<StretchStrip>& strips,
+    const StretchStripSink& sink, const StretchRenderOptions& options = StretchRenderOptions());
+
+extern template bool StretchRenderStrips(const StretchRenderContext<StretchPixel8>&, int, const std::vector<StretchStrip>&,
+    const StretchStripSink&, const StretchRenderOptions&);
+extern template bool StretchRenderStrips(const StretchRenderContext<StretchPixel16>&, int, const std::vector<StretchStrip>&,
+    const StretchStripSink&, const StretchRenderOptions&);
+extern template bool StretchRenderStrips(const StretchRenderContext<StretchPixelF>&, int, const std::vector<StretchStrip>&,
+    const StretchStripSink&, const StretchRenderOptions&);
+
+#endif // STRETCH_CORE_H
@@ -54,13 +54,16 @@ resource 'PiPL' (16000) {
 	},
 	
 	AE_Effect_Global_OutFlags {
-		// PF_OutFlag_DEEP_COLOR_AWARE | PF_OutFlag_PIX_INDEPENDENT | PF_OutFlag_I_EXPAND_BUFFER
-		0x02000600
+		// PF_OutFlag_DEEP_COLOR_AWARE | PF_OutFlag_PIX_INDEPENDENT | PF_OutFlag_I_EXPAND_BUFFER |
+		// PF_OutFlag_SEQUENCE_DATA_NEEDS_FLATTENING
+		0x02000610
 	},
 		
 		AE_Effect_Global_OutFlags_2 {
-			// PF_OutFlag2_SUPPORTS_THREADED_RENDERING | PF_OutFlag2_REVEALS_ZERO_ALPHA
-			0x08000080
+			// PF_OutFlag2_SUPPORTS_THREADED_RENDERING | PF_OutFlag2_FLOAT_COLOR_AWARE |
+			// PF_OutFlag2_SUPPORTS_SMART_RENDER | PF_OutFlag2_REVEALS_ZERO_ALPHA |
+			// PF_OutFlag2_SUPPORTS_GET_FLATTENED_SEQUENCE_DATA
+			0x08801480
 		},
 		
 		AE_Effect_Match_Name {
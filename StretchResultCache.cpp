@@ -0,0 +1,377 @@
+#include "StretchResultCache.h"
+
+#include <cstring>
+#include <new>
+
+// -----------------------------------------------------------------------------
+// Keys
+// -----------------------------------------------------------------------------
+
+static bool SameAnchorLine(const StretchGeometry& a, const StretchGeometry& b)
+{
+    return a.active == b.active
+        && a.direction == b.direction
+        && a.quality == b.quality
+        && a.feather == b.feather
+        && a.anchor_x == b.anchor_x
+        && a.anchor_y == b.anchor_y
+        && a.perp_x == b.perp_x
+        && a.perp_y == b.perp_y
+        && a.para_x == b.para_x
+        && a.para_y == b.para_y;
+}
+
+static bool SameGeometry(const StretchGeometry& a, const StretchGeometry& b)
+{
+    return SameAnchorLine(a, b)
+        && a.effective_shift == b.effective_shift
+        && a.shift_vec_x == b.shift_vec_x
+        && a.shift_vec_y == b.shift_vec_y;
+}
+
+bool StretchCacheKey::operator==(const StretchCacheKey& other) const
+{
+    return owner == other.owner
+        && input_hash == other.input_hash
+        && SameGeometry(geometry, other.geometry)
+        && origin_x == other.origin_x
+        && origin_y == other.origin_y
+        && input_width == other.input_width
+        && input_height == other.input_height
+        && output_width == other.output_width
+        && output_height == other.output_height
+        && pixel_bytes == other.pixel_bytes;
+}
+
+// Four independent multiply-rotate lanes over 8-byte words (xxHash64 rounds),
+// so the loop runs at memory speed
+static constexpr std::uint64_t HASH_PRIME1 = 0x9E3779B185EBCA87ull;
+static constexpr std::uint64_t HASH_PRIME2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr std::uint64_t HASH_PRIME3 = 0x165667B19E3779F9ull;
+
+static inline std::uint64_t RotateLeft(std::uint64_t v, int bits)
+{
+    return (v << bits) | (v >> (64 - bits));
+}
+
+static inline std::uint64_t HashRound(std::uint64_t acc, std::uint64_t word)
+{
+    return RotateLeft(acc + word * HASH_PRIME2, 31) * HASH_PRIME1;
+}
+
+static inline std::uint64_t LoadWord(const std::uint8_t* p)
+{
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static std::uint64_t HashRow(const std::uint8_t* p, std::size_t bytes, std::uint64_t seed)
+{
+    std::uint64_t lanes[4] = { seed + HASH_PRIME1, seed + HASH_PRIME2, seed, seed - HASH_PRIME1 };
+    std::size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        lanes[0] = HashRound(lanes[0], LoadWord(p + i));
+        lanes[1] = HashRound(lanes[1], LoadWord(p + i + 8));
+        lanes[2] = HashRound(lanes[2], LoadWord(p + i + 16));
+        lanes[3] = HashRound(lanes[3], LoadWord(p + i + 24));
+    }
+    std::uint64_t h = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+    for (; i + 8 <= bytes; i += 8) {
+        h = HashRound(h, LoadWord(p + i));
+    }
+    for (; i < bytes; ++i) {
+        h = RotateLeft(h ^ (p[i] * HASH_PRIME3), 11) * HASH_PRIME1;
+    }
+
+    // Final avalanche
+    h ^= h >> 33;
+    h *= HASH_PRIME2;
+    h ^= h >> 29;
+    h *= HASH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::uint64_t StretchHashPixels(const void* data, std::ptrdiff_t rowbytes, std::size_t row_bytes, int height)
+{
+    // Each row is seeded with the running hash, so row order matters
+    std::uint64_t h = HASH_PRIME3 ^ (static_cast<std::uint64_t>(row_bytes) * HASH_PRIME1);
+    const auto* base = static_cast<const std::uint8_t*>(data);
+    for (int y = 0; y < height; ++y) {
+        h = HashRow(base + static_cast<std::ptrdiff_t>(y) * rowbytes, row_bytes, h);
+    }
+    return h;
+}
+
+StretchCacheKey StretchMakeCacheKey(const StretchGeometry& geometry,
+    const void* input_data, std::ptrdiff_t input_rowbytes, int input_width, int input_height,
+    int output_width, int output_height, float origin_x, float origin_y, int pixel_bytes,
+    std::uint64_t owner)
+{
+    StretchCacheKey key;
+    key.owner = owner;
+    key.input_hash = (input_data && input_width > 0 && input_height > 0)
+        ? StretchHashPixels(input_data, input_rowbytes, static_cast<std::size_t>(input_width) * pixel_bytes, input_height)
+        : 0;
+    key.geometry = geometry;
+    key.origin_x = origin_x;
+    key.origin_y = origin_y;
+    key.input_width = input_width;
+    key.input_height = input_height;
+    key.output_width = output_width;
+    key.output_height = output_height;
+    key.pixel_bytes = pixel_bytes;
+    return key;
+}
+
+// -----------------------------------------------------------------------------
+// StretchResultCache
+// -----------------------------------------------------------------------------
+
+StretchResultCache::StretchResultCache(std::size_t capacity_bytes, std::size_t max_entries)
+    : capacity_bytes_(capacity_bytes)
+    , max_entries_(max_entries)
+{
+}
+
+bool StretchResultCache::Fetch(const StretchCacheKey& key, void* output, std::ptrdiff_t output_rowbytes)
+{
+    FramePtr entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if ((*it)->key == key) {
+                entry = *it;
+                entries_.splice(entries_.begin(), entries_, it);
+                break;
+            }
+        }
+        const auto owner = owners_.find(key.owner);
+        if (owner != owners_.end()) {
+            if (entry) {
+                ++owner->second.hits;
+            }
+            else {
+                ++owner->second.misses;
+            }
+        }
+    }
+    if (!entry) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // The entry stays alive through our reference even if it is evicted now
+    const std::size_t row_bytes = static_cast<std::size_t>(key.output_width) * key.pixel_bytes;
+    auto* out = static_cast<std::uint8_t*>(output);
+    for (int y = 0; y < key.output_height; ++y) {
+        std::memcpy(out + static_cast<std::ptrdiff_t>(y) * output_rowbytes,
+                    entry->pixels.data() + static_cast<std::size_t>(y) * row_bytes, row_bytes);
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void StretchResultCache::EvictLocked(std::size_t incoming_bytes)
+{
+    while (!entries_.empty() && (bytes_ + incoming_bytes > capacity_bytes_ || entries_.size() + 1 > max_entries_)) {
+        bytes_ -= entries_.back()->pixels.size();
+        entries_.pop_back();
+    }
+}
+
+void StretchResultCache::Store(const StretchCacheKey& key, const void* output, std::ptrdiff_t output_rowbytes)
+{
+    const std::size_t row_bytes = static_cast<std::size_t>(key.output_width) * key.pixel_bytes;
+    const std::size_t bytes = row_bytes * static_cast<std::size_t>(key.output_height);
+    if (bytes == 0 || bytes > capacity_bytes_ || max_entries_ == 0) {
+        return;
+    }
+
+    // Copy outside the lock; a failed allocation just skips caching
+    std::shared_ptr<Frame> entry;
+    try {
+        entry = std::make_shared<Frame>();
+        entry->key = key;
+        entry->pixels.resize(bytes);
+    }
+    catch (const std::bad_alloc&) {
+        return;
+    }
+    const auto* in = static_cast<const std::uint8_t*>(output);
+    for (int y = 0; y < key.output_height; ++y) {
+        std::memcpy(entry->pixels.data() + static_cast<std::size_t>(y) * row_bytes,
+                    in + static_cast<std::ptrdiff_t>(y) * output_rowbytes, row_bytes);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Another render may have stored the same frame meanwhile
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if ((*it)->key == key) {
+            entries_.splice(entries_.begin(), entries_, it);
+            return;
+        }
+    }
+
+    EvictLocked(bytes);
+    try {
+        entries_.push_front(std::move(entry));
+    }
+    catch (const std::bad_alloc&) {
+        return;
+    }
+    bytes_ += bytes;
+}
+
+StretchResultCache::FramePtr StretchResultCache::FindReusable(const StretchCacheKey& key) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const FramePtr& frame : entries_) {
+        const StretchCacheKey& other = frame->key;
+        if (other.owner == key.owner
+            && other.input_hash == key.input_hash
+            && other.input_width == key.input_width
+            && other.input_height == key.input_height
+            && other.pixel_bytes == key.pixel_bytes
+            && SameAnchorLine(other.geometry, key.geometry)
+            && other != key) {
+            return frame;
+        }
+    }
+    return nullptr;
+}
+
+void StretchResultCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    bytes_ = 0;
+}
+
+void StretchResultCache::ClearLocked(std::uint64_t owner)
+{
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if ((*it)->key.owner == owner) {
+            bytes_ -= (*it)->pixels.size();
+            it = entries_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void StretchResultCache::Clear(std::uint64_t owner)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ClearLocked(owner);
+}
+
+void StretchResultCache::Attach(std::uint64_t owner, std::uint64_t hits, std::uint64_t misses)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Owner& state = owners_[owner];
+    if (state.references++ == 0) {
+        state.hits = hits;
+        state.misses = misses;
+    }
+}
+
+void StretchResultCache::Detach(std::uint64_t owner)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = owners_.find(owner);
+    if (it == owners_.end() || --it->second.references > 0) {
+        return;
+    }
+    owners_.erase(it);
+    ClearLocked(owner);
+}
+
+bool StretchResultCache::IsAttached(std::uint64_t owner) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return owners_.find(owner) != owners_.end();
+}
+
+StretchResultCache::Stats StretchResultCache::GetStats() const
+{
+    Stats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.entries = entries_.size();
+    stats.bytes = bytes_;
+    return stats;
+}
+
+StretchResultCache::Stats StretchResultCache::GetStats(std::uint64_t owner) const
+{
+    Stats stats;
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = owners_.find(owner);
+    if (it != owners_.end()) {
+        stats.hits = it->second.hits;
+        stats.misses = it->second.misses;
+    }
+    for (const FramePtr& frame : entries_) {
+        if (frame->key.owner == owner) {
+            ++stats.entries;
+            stats.bytes += frame->pixels.size();
+        }
+    }
+    return stats;
+}
+
+void StretchResultCache::SetCounters(std::uint64_t hits, std::uint64_t misses)
+{
+    hits_.store(hits, std::memory_order_relaxed);
+    misses_.store(misses, std::memory_order_relaxed);
+}
+
+// -----------------------------------------------------------------------------
+// Cached renders
+// -----------------------------------------------------------------------------
+
+template <typename Pixel>
+bool StretchRenderCached(StretchResultCache* cache, const StretchCacheKey& key,
+    const StretchRenderContext<Pixel>& ctx, int direction, StretchRenderOptions options)
+{
+    if (!cache) {
+        return StretchRenderFrame(ctx, direction, options);
+    }
+
+    // Held frames of a static input: reuse the stored output
+    if (cache->Fetch(key, ctx.output_base, ctx.output_rowbytes)) {
+        return true;
+    }
+
+    // Scrubbing Shift Amount: redraw only what moved since a cached frame
+    const StretchResultCache::FramePtr previous = cache->FindReusable(key);
+    StretchReuseFrame reuse;
+    if (previous) {
+        reuse.geometry = previous->key.geometry;
+        reuse.data = previous->pixels.data();
+        reuse.rowbytes = static_cast<std::ptrdiff_t>(previous->key.output_width) * previous->key.pixel_bytes;
+        reuse.width = previous->key.output_width;
+        reuse.height = previous->key.output_height;
+        reuse.output_origin_x = previous->key.origin_x;
+        reuse.output_origin_y = previous->key.origin_y;
+        options.reuse = &reuse;
+    }
+
+    if (!StretchRenderFrame(ctx, direction, options)) {
+        return false;
+    }
+    cache->Store(key, ctx.output_base, ctx.output_rowbytes);
+    return true;
+}
+
+template bool StretchRenderCached(StretchResultCache*, const StretchCacheKey&,
+    const StretchRenderContext<StretchPixel8>&, int, StretchRenderOptions);
+template bool StretchRenderCached(StretchResultCache*, const StretchCacheKey&,
+    const StretchRenderContext<StretchPixel16>&, int, StretchRenderOptions);
+template bool StretchRenderCached(StretchResultCache*, const StretchCacheKey&,
+    const StretchRenderContext<StretchPixelF>&, int, StretchRenderOptions);
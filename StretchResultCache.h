@@ -0,0 +1,167 @@
+#pragma once
+#ifndef STRETCH_RESULT_CACHE_H
+#define STRETCH_RESULT_CACHE_H
+
+#include "StretchCore.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Result cache
+// -----------------------------------------------------------------------------
+//
+// Optional frame-to-frame reuse of rendered output. A frame is keyed by a
+// checksum of its input pixels plus everything that places the output: the
+// geometry, the output/input mapping, sizes and pixel depth. Held frames of
+// a static input then cost a checksum and a copy instead of a render. On a
+// miss, a cached frame of the same input at another shift lets the renderer
+// redraw only the pixels the shift moves (StretchRenderOptions::reuse).
+//
+// One cache can serve several effect instances under a single budget: each
+// key names its owner, and an attached owner has its own hit/miss counters.
+
+struct StretchCacheKey
+{
+    // Instance the frame belongs to (StretchResultCache::Attach), 0 for none
+    std::uint64_t owner = 0;
+
+    std::uint64_t input_hash = 0;
+
+    StretchGeometry geometry;
+
+    // Output placement (see StretchMakeContext)
+    float origin_x = 0.0f;
+    float origin_y = 0.0f;
+    int input_width = 0;
+    int input_height = 0;
+    int output_width = 0;
+    int output_height = 0;
+    int pixel_bytes = 0;
+
+    bool operator==(const StretchCacheKey& other) const;
+    bool operator!=(const StretchCacheKey& other) const { return !(*this == other); }
+};
+
+// 64-bit checksum of `height` rows of `row_bytes` bytes each. Meant for change
+// detection, not security
+std::uint64_t StretchHashPixels(const void* data, std::ptrdiff_t rowbytes, std::size_t row_bytes, int height);
+
+StretchCacheKey StretchMakeCacheKey(const StretchGeometry& geometry,
+    const void* input_data, std::ptrdiff_t input_rowbytes, int input_width, int input_height,
+    int output_width, int output_height, float origin_x, float origin_y, int pixel_bytes,
+    std::uint64_t owner = 0);
+
+// Default budget per cache
+constexpr std::size_t STRETCH_RESULT_CACHE_BYTES = 256 * 1024 * 1024;
+constexpr std::size_t STRETCH_RESULT_CACHE_ENTRIES = 16;
+
+// LRU cache of output frames, bounded by bytes and entry count.
+// Thread-safe: concurrent renders (AE multi-frame rendering) and several
+// owners may share one.
+class StretchResultCache
+{
+public:
+    explicit StretchResultCache(std::size_t capacity_bytes = STRETCH_RESULT_CACHE_BYTES,
+                                std::size_t max_entries = STRETCH_RESULT_CACHE_ENTRIES);
+
+    // Copies a cached frame into output and counts a hit; counts a miss and
+    // returns false if the key is not cached. Counts go to the cache and to
+    // the key's owner, if attached
+    bool Fetch(const StretchCacheKey& key, void* output, std::ptrdiff_t output_rowbytes);
+
+    // Stores a copy of output, evicting least recently used frames to stay in
+    // budget. Frames larger than the whole budget are not stored
+    void Store(const StretchCacheKey& key, const void* output, std::ptrdiff_t output_rowbytes);
+
+    // A cached frame and the key it was rendered for
+    struct Frame
+    {
+        StretchCacheKey key;
+        std::vector<std::uint8_t> pixels;  // rows packed at output_width * pixel_bytes
+    };
+
+    using FramePtr = std::shared_ptr<const Frame>;
+
+    // Most recently used frame of the same owner, input pixels and anchor
+    // line as key, rendered at another shift or output placement, for
+    // StretchRenderOptions::reuse. nullptr if there is none. The frame stays
+    // valid while the pointer is held, even if it is evicted meanwhile
+    FramePtr FindReusable(const StretchCacheKey& key) const;
+
+    void Clear();
+
+    // Drops owner's frames
+    void Clear(std::uint64_t owner);
+
+    // Adds a reference to owner. A new owner starts with the given counters
+    // (saved with the project, say)
+    void Attach(std::uint64_t owner, std::uint64_t hits, std::uint64_t misses);
+
+    // Drops a reference to owner; the last one drops its frames and counters
+    void Detach(std::uint64_t owner);
+
+    bool IsAttached(std::uint64_t owner) const;
+
+    struct Stats
+    {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::size_t entries = 0;
+        std::size_t bytes = 0;
+    };
+
+    Stats GetStats() const;
+
+    // owner's counters, frames and bytes
+    Stats GetStats(std::uint64_t owner) const;
+
+    // Restores counters saved with the project
+    void SetCounters(std::uint64_t hits, std::uint64_t misses);
+
+private:
+    void EvictLocked(std::size_t incoming_bytes);
+    void ClearLocked(std::uint64_t owner);
+
+    struct Owner
+    {
+        int references = 0;
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+    };
+
+    const std::size_t capacity_bytes_;
+    const std::size_t max_entries_;
+
+    mutable std::mutex mutex_;
+    std::list<FramePtr> entries_;  // most recently used first
+    std::size_t bytes_ = 0;
+    std::unordered_map<std::uint64_t, Owner> owners_;
+
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+};
+
+// Renders ctx with StretchRenderFrame through cache, as a host render does:
+// a cached frame for key is copied instead of rendered, and on a miss the
+// most recent cached frame of key's input at another shift (FindReusable)
+// seeds options.reuse. The rendered frame is stored under key. A null cache
+// renders directly. Returns false if the render failed
+template <typename Pixel>
+bool StretchRenderCached(StretchResultCache* cache, const StretchCacheKey& key,
+    const StretchRenderContext<Pixel>& ctx, int direction, StretchRenderOptions options);
+
+extern template bool StretchRenderCached(StretchResultCache*, const StretchCacheKey&,
+    const StretchRenderContext<StretchPixel8>&, int, StretchRenderOptions);
+extern template bool StretchRenderCached(StretchResultCache*, const StretchCacheKey&,
+    const StretchRenderContext<StretchPixel16>&, int, StretchRenderOptions);
+extern template bool StretchRenderCached(StretchResultCache*, const StretchCacheKey&,
+    const StretchRenderContext<StretchPixelF>&, int, StretchRenderOptions);
+
+#endif // STRETCH_RESULT_CACHE_H
@@ -0,0 +1,1838 @@
+#include "StretchCore.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define STRETCH_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define STRETCH_TARGET_AVX2
+#else
+#define STRETCH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define STRETCH_SIMD_ARM 1
+#include <arm_neon.h>
+#endif
+
+// -----------------------------------------------------------------------------
+// Dispatch
+// -----------------------------------------------------------------------------
+
+#if STRETCH_SIMD_X86
+static bool CpuHasAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4] = {};
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) {
+        return false;
+    }
+    // OS must save YMM state
+    if ((_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+StretchSimdLevel StretchDetectSimdLevel()
+{
+    static const StretchSimdLevel detected = []() {
+#if STRETCH_SIMD_X86
+        return CpuHasAvx2() ? STRETCH_SIMD_AVX2 : STRETCH_SIMD_SCALAR;
+#elif STRETCH_SIMD_ARM
+        return STRETCH_SIMD_NEON;
+#else
+        return STRETCH_SIMD_SCALAR;
+#endif
+    }();
+    return detected;
+}
+
+static StretchSimdLevel ClampSimdLevel(StretchSimdLevel level)
+{
+    return (level == STRETCH_SIMD_SCALAR || level == StretchDetectSimdLevel()) ? level : StretchDetectSimdLevel();
+}
+
+static std::atomic<int>& ActiveSimdLevel()
+{
+    static std::atomic<int> level([]() {
+        StretchSimdLevel initial = StretchDetectSimdLevel();
+        if (const char* env = std::getenv("STRETCH_SIMD")) {
+            if (std::strcmp(env, "scalar") == 0) {
+                initial = STRETCH_SIMD_SCALAR;
+            }
+        }
+        return static_cast<int>(initial);
+    }());
+    return level;
+}
+
+StretchSimdLevel StretchGetSimdLevel()
+{
+    return static_cast<StretchSimdLevel>(ActiveSimdLevel().load(std::memory_order_relaxed));
+}
+
+void StretchSetSimdLevel(StretchSimdLevel level)
+{
+    ActiveSimdLevel().store(static_cast<int>(ClampSimdLevel(level)), std::memory_order_relaxed);
+}
+
+const char* StretchSimdLevelName(StretchSimdLevel level)
+{
+    switch (level) {
+    case STRETCH_SIMD_AVX2:
+        return "avx2";
+    case STRETCH_SIMD_NEON:
+        return "neon";
+    default:
+        return "scalar";
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Scalar span sampling
+// -----------------------------------------------------------------------------
+
+template <typename Pixel>
+static void SampleRowSpanScalar(const FastRowSampler<Pixel>& sampler, float sample_x, float offset_x, int count, Pixel* out)
+{
+    for (int i = 0; i < count; ++i) {
+        out[i] = sampler.Sample(sample_x + offset_x);
+        sample_x += 1.0f;
+    }
+}
+
+template <typename Pixel>
+static void BlendSpanPremultipliedScalar(const StretchPixelF* row0, const StretchPixelF* row1,
+    float w00, float w10, float w01, float w11, int count, Pixel* out)
+{
+    for (int i = 0; i < count; ++i) {
+        out[i] = Unpremultiply<Pixel>(SumTapsPremultiplied(row0 + i, row1 + i, w00, w10, w01, w11));
+    }
+}
+
+template <typename Pixel>
+static void SampleRowSpanHorizontalScalar(const FastRowSampler<Pixel>& sampler, float sample_x, float offset_x, int count, Pixel* out)
+{
+    for (int i = 0; i < count; ++i) {
+        out[i] = SampleRowHorizontal(sampler.row0, sampler.width, sample_x + offset_x);
+        sample_x += 1.0f;
+    }
+}
+
+template <typename Pixel>
+static void SampleColumnSpanScalar(const FastRowSampler<Pixel>& sampler, int x, int count, Pixel* out)
+{
+    for (int i = 0; i < count; ++i) {
+        out[i] = SampleColumnVertical(sampler, x + i);
+    }
+}
+
+// Scalar span kernel, for the groups a vector kernel hands back
+template <typename Pixel>
+using SpanKernel = void (*)(const FastRowSampler<Pixel>&, float, float, int, Pixel*);
+
+// row[x, x + count) with transparent pixels outside the row
+template <typename Pixel>
+static void CopyRowSpan(const Pixel* row, int width, int x, int count, Pixel* out)
+{
+    const int lead = std::min(std::max(-x, 0), count);
+    const int end = std::max(std::min(width - x, count), lead);
+    std::memset(out, 0, sizeof(Pixel) * static_cast<size_t>(lead));
+    std::memcpy(out + lead, row + x + lead, sizeof(Pixel) * static_cast<size_t>(end - lead));
+    std::memset(out + end, 0, sizeof(Pixel) * static_cast<size_t>(count - end));
+}
+
+// Pixel the scalar sampler returns verbatim when X is (nearly) integer,
+// or nullptr if neither row carries enough weight
+template <typename Pixel>
+static const Pixel* RawSourceRow(const FastRowSampler<Pixel>& sampler)
+{
+    if (sampler.row0 && sampler.w0_y > WEIGHT_THRESHOLD) {
+        return sampler.row0;
+    }
+    if (sampler.row1 && sampler.w1_y > WEIGHT_THRESHOLD) {
+        return sampler.row1;
+    }
+    return nullptr;
+}
+
+// -----------------------------------------------------------------------------
+// Scalar kernel spans
+// -----------------------------------------------------------------------------
+//
+// A table-kernel span is filtered in chunks: the kernel rows are first summed
+// into one row of alpha-weighted columns (see KernelTap), then each output
+// pixel sums the columns under its X taps. Each pixel keeps its own X
+// position and weights, and sums run in SampleKernel's order, so spans match
+// point samples exactly.
+
+// Output pixels per chunk, and the columns a chunk can read
+constexpr int KERNEL_CHUNK = 256;
+constexpr int KERNEL_CHUNK_COLUMNS = KERNEL_CHUNK + STRETCH_MAX_KERNEL_TAPS + 2;
+
+// floorf(v) as an int without the libm call; exact for |v| < 2^31
+static inline int KernelFloor(float v)
+{
+    const int t = static_cast<int>(v);
+    return t - (static_cast<float>(t) > v ? 1 : 0);
+}
+
+// Input rows a span reads: the kernel rows with nonzero weight inside the input
+template <typename Pixel>
+struct KernelRows
+{
+    const Pixel* rows[STRETCH_MAX_KERNEL_TAPS];
+    float weights[STRETCH_MAX_KERNEL_TAPS];
+    int count;
+};
+
+// Positions of one chunk: pixel i samples at floor(x) = column[i] with the
+// kernel row phase[i] (see StretchKernel::Phase)
+struct KernelChunk
+{
+    int column[KERNEL_CHUNK];
+    int phase[KERNEL_CHUNK];
+};
+
+// Positions of pixels [begin, count) of a chunk starting at span pixel start
+static void KernelPositionsScalar(float sample_x, float offset_x, int start, int begin, int count, KernelChunk& chunk)
+{
+    for (int i = begin; i < count; ++i) {
+        const float xf = (sample_x + static_cast<float>(start + i)) + offset_x;
+        const int x0 = KernelFloor(xf);
+        chunk.column[i] = x0;
+        chunk.phase[i] = StretchKernel::Phase(xf - static_cast<float>(x0));
+    }
+}
+
+// columns[c] = alpha-weighted sum of input column x + c over rows;
+// columns outside the input are zero
+template <typename Pixel>
+static void KernelColumnsScalar(const KernelRows<Pixel>& rows, int width, int x, int count, StretchPixelF* columns)
+{
+    for (int c = 0; c < count; ++c) {
+        StretchPixelF sum = { 0.0f, 0.0f, 0.0f, 0.0f };
+        if (x + c >= 0 && x + c < width) {
+            for (int j = 0; j < rows.count; ++j) {
+                KernelAccumulate(sum, KernelTap(rows.rows[j][x + c]), rows.weights[j]);
+            }
+        }
+        columns[c] = sum;
+    }
+}
+
+template <typename Pixel>
+static inline Pixel KernelFilterPixel(const StretchPixelF* columns, const float* weights, int taps)
+{
+    StretchPixelF sum = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int k = 0; k < taps; ++k) {
+        if (weights[k] != 0.0f) {
+            KernelAccumulate(sum, columns[k], weights[k]);
+        }
+    }
+    return ResolveKernelSum<Pixel>(sum);
+}
+
+// Filters pixels [begin, count) of a chunk; columns[0] is input column
+// chunk.column[0] + kernel.first
+template <typename Pixel>
+static void KernelFilterScalar(const StretchKernel& kernel, const StretchPixelF* columns, const KernelChunk& chunk,
+    int begin, int count, Pixel* out)
+{
+    for (int i = begin; i < count; ++i) {
+        out[i] = KernelFilterPixel<Pixel>(columns + (chunk.column[i] - chunk.column[0]),
+                                          kernel.weights + chunk.phase[i] * kernel.taps, kernel.taps);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// AVX2: 8 output pixels per iteration
+// -----------------------------------------------------------------------------
+//
+// Pixels are transposed to one register per channel. The transpose leaves the
+// lanes in the order [0 2 4 6 1 3 5 7]; per-lane values (x, fx) are built in
+// the same order and the inverse transpose restores pixel order on store.
+// The arithmetic mirrors FastRowSampler::Sample operation for operation
+// (no FMA), so results are bit-identical to the scalar path. For 8/16 bpc the
+// uniform-alpha taps use the same fixed-point blend as BlendUniformAlphaFixed.
+
+#if STRETCH_SIMD_X86
+
+struct Avx2Channels
+{
+    __m256 a;
+    __m256 r;
+    __m256 g;
+    __m256 b;
+};
+
+struct Avx2IntChannels
+{
+    __m256i a;
+    __m256i r;
+    __m256i g;
+    __m256i b;
+};
+
+// Four registers of two ARGB pixels each -> one register per channel
+STRETCH_TARGET_AVX2 static inline Avx2Channels Avx2Deinterleave(__m256 p01, __m256 p23, __m256 p45, __m256 p67)
+{
+    const __m256 t0 = _mm256_unpacklo_ps(p01, p23);
+    const __m256 t1 = _mm256_unpackhi_ps(p01, p23);
+    const __m256 t2 = _mm256_unpacklo_ps(p45, p67);
+    const __m256 t3 = _mm256_unpackhi_ps(p45, p67);
+    Avx2Channels c;
+    c.a = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    c.r = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    c.g = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    c.b = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    return c;
+}
+
+STRETCH_TARGET_AVX2 static inline void Avx2Interleave(const Avx2Channels& c, __m256 out[4])
+{
+    const __m256 t0 = _mm256_unpacklo_ps(c.a, c.r);
+    const __m256 t1 = _mm256_unpackhi_ps(c.a, c.r);
+    const __m256 t2 = _mm256_unpacklo_ps(c.g, c.b);
+    const __m256 t3 = _mm256_unpackhi_ps(c.g, c.b);
+    out[0] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    out[1] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    out[2] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    out[3] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+// Integer channels use the same shuffles (pure bit moves)
+STRETCH_TARGET_AVX2 static inline Avx2IntChannels Avx2DeinterleaveInt(__m256i p01, __m256i p23, __m256i p45, __m256i p67)
+{
+    const Avx2Channels c = Avx2Deinterleave(_mm256_castsi256_ps(p01), _mm256_castsi256_ps(p23),
+                                            _mm256_castsi256_ps(p45), _mm256_castsi256_ps(p67));
+    return { _mm256_castps_si256(c.a), _mm256_castps_si256(c.r), _mm256_castps_si256(c.g), _mm256_castps_si256(c.b) };
+}
+
+STRETCH_TARGET_AVX2 static inline void Avx2InterleaveInt(const Avx2IntChannels& c, __m256i out[4])
+{
+    const Avx2Channels f = { _mm256_castsi256_ps(c.a), _mm256_castsi256_ps(c.r),
+                             _mm256_castsi256_ps(c.g), _mm256_castsi256_ps(c.b) };
+    __m256 pairs[4];
+    Avx2Interleave(f, pairs);
+    for (int k = 0; k < 4; ++k) {
+        out[k] = _mm256_castps_si256(pairs[k]);
+    }
+}
+
+template <typename Pixel>
+struct Avx2Pixels;
+
+template <>
+struct Avx2Pixels<StretchPixel8>
+{
+    STRETCH_TARGET_AVX2 static inline __m256i LoadPair(const StretchPixel8* p)
+    {
+        return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+    }
+
+    STRETCH_TARGET_AVX2 static inline void StorePair(StretchPixel8* p, __m256i v)
+    {
+        const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(words, words));
+    }
+};
+
+template <>
+struct Avx2Pixels<StretchPixel16>
+{
+    STRETCH_TARGET_AVX2 static inline __m256i LoadPair(const StretchPixel16* p)
+    {
+        return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    }
+
+    STRETCH_TARGET_AVX2 static inline void StorePair(StretchPixel16* p, __m256i v)
+    {
+        const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), words);
+    }
+};
+
+template <typename Pixel>
+STRETCH_TARGET_AVX2 static inline Avx2IntChannels Avx2LoadInt8(const Pixel* p)
+{
+    return Avx2DeinterleaveInt(Avx2Pixels<Pixel>::LoadPair(p),
+                               Avx2Pixels<Pixel>::LoadPair(p + 2),
+                               Avx2Pixels<Pixel>::LoadPair(p + 4),
+                               Avx2Pixels<Pixel>::LoadPair(p + 6));
+}
+
+template <typename Pixel>
+STRETCH_TARGET_AVX2 static inline void Avx2StoreInt8(Pixel* p, const Avx2IntChannels& c)
+{
+    __m256i pairs[4];
+    Avx2InterleaveInt(c, pairs);
+    Avx2Pixels<Pixel>::StorePair(p, pairs[0]);
+    Avx2Pixels<Pixel>::StorePair(p + 2, pairs[1]);
+    Avx2Pixels<Pixel>::StorePair(p + 4, pairs[2]);
+    Avx2Pixels<Pixel>::StorePair(p + 6, pairs[3]);
+}
+
+STRETCH_TARGET_AVX2 static inline Avx2Channels Avx2LoadFloat8(const StretchPixelF* p)
+{
+    return Avx2Deinterleave(_mm256_loadu_ps(&p[0].alpha), _mm256_loadu_ps(&p[2].alpha),
+                            _mm256_loadu_ps(&p[4].alpha), _mm256_loadu_ps(&p[6].alpha));
+}
+
+STRETCH_TARGET_AVX2 static inline void Avx2StoreFloat8(StretchPixelF* p, const Avx2Channels& c)
+{
+    __m256 pairs[4];
+    Avx2Interleave(c, pairs);
+    for (int k = 0; k < 4; ++k) {
+        _mm256_storeu_ps(&p[2 * k].alpha, pairs[k]);
+    }
+}
+
+STRETCH_TARGET_AVX2 static inline Avx2Channels Avx2ToFloat(const Avx2IntChannels& c)
+{
+    return { _mm256_cvtepi32_ps(c.a), _mm256_cvtepi32_ps(c.r), _mm256_cvtepi32_ps(c.g), _mm256_cvtepi32_ps(c.b) };
+}
+
+// Traits::FromFloat for integer depths: clamp, +0.5, truncate
+template <typename Pixel>
+STRETCH_TARGET_AVX2 static inline __m256i Avx2FromFloat(__m256 v)
+{
+    const __m256 max_val = _mm256_set1_ps(PixelTraits<Pixel>::MAX_VAL);
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), max_val);
+    return _mm256_cvttps_epi32(_mm256_add_ps(v, _mm256_set1_ps(0.5f)));
+}
+
+template <typename Pixel>
+STRETCH_TARGET_AVX2 static inline Avx2IntChannels Avx2FromFloat(const Avx2Channels& c)
+{
+    return { Avx2FromFloat<Pixel>(c.a), Avx2FromFloat<Pixel>(c.r), Avx2FromFloat<Pixel>(c.g), Avx2FromFloat<Pixel>(c.b) };
+}
+
+STRETCH_TARGET_AVX2 static inline Avx2IntChannels Avx2Select(const Avx2IntChannels& a, const Avx2IntChannels& b, __m256i mask)
+{
+    return { _mm256_blendv_epi8(a.a, b.a, mask), _mm256_blendv_epi8(a.r, b.r, mask),
+             _mm256_blendv_epi8(a.g, b.g, mask), _mm256_blendv_epi8(a.b, b.b, mask) };
+}
+
+STRETCH_TARGET_AVX2 static inline Avx2Channels Avx2Select(const Avx2Channels& a, const Avx2Channels& b, __m256 mask)
+{
+    return { _mm256_blendv_ps(a.a, b.a, mask), _mm256_blendv_ps(a.r, b.r, mask),
+             _mm256_blendv_ps(a.g, b.g, mask), _mm256_blendv_ps(a.b, b.b, mask) };
+}
+
+// Accumulates one bilinear tap. Taps at or below ALPHA_THRESHOLD are masked
+// after the multiply so non-finite color in transparent pixels cannot leak in
+STRETCH_TARGET_AVX2 static inline void Avx2Tap(const Avx2Channels& p, __m256 w,
+    __m256& total_weight, Avx2Channels& acc)
+{
+    const __m256 mask = _mm256_cmp_ps(p.a, _mm256_set1_ps(ALPHA_THRESHOLD), _CMP_GT_OQ);
+    const __m256 weight = _mm256_mul_ps(w, p.a);
+    total_weight = _mm256_add_ps(total_weight, _mm256_and_ps(mask, weight));
+    acc.r = _mm256_add_ps(acc.r, _mm256_and_ps(mask, _mm256_mul_ps(p.r, weight)));
+    acc.g = _mm256_add_ps(acc.g, _mm256_and_ps(mask, _mm256_mul_ps(p.g, weight)));
+    acc.b = _mm256_add_ps(acc.b, _mm256_and_ps(mask, _mm256_mul_ps(p.b, weight)));
+    acc.a = _mm256_add_ps(acc.a, _mm256_and_ps(mask, _mm256_mul_ps(p.a, w)));
+}
+
+// Normalizes accumulated taps by total weight; fully transparent taps give a
+// zero pixel
+STRETCH_TARGET_AVX2 static inline Avx2Channels Avx2Normalize(__m256 total_weight, const Avx2Channels& acc)
+{
+    const __m256 valid = _mm256_cmp_ps(total_weight, _mm256_set1_ps(ALPHA_THRESHOLD), _CMP_GT_OQ);
+    const __m256 inv_weight = _mm256_div_ps(_mm256_set1_ps(1.0f), total_weight);
+    Avx2Channels result;
+    result.r = _mm256_and_ps(valid, _mm256_mul_ps(acc.r, inv_weight));
+    result.g = _mm256_and_ps(valid, _mm256_mul_ps(acc.g, inv_weight));
+    result.b = _mm256_and_ps(valid, _mm256_mul_ps(acc.b, inv_weight));
+    result.a = _mm256_and_ps(valid, acc.a);
+    return result;
+}
+
+// Float alpha-weighted blend of the taps present (row pointers may be null).
+// Returns unclamped channel values; zero where every tap is transparent
+STRETCH_TARGET_AVX2 static inline Avx2Channels Avx2BlendFloat(const Avx2Channels* p00, const Avx2Channels* p10,
+    const Avx2Channels* p01, const Avx2Channels* p11, __m256 fx, float w0_y, float w1_y)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 inv_fx = _mm256_sub_ps(one, fx);
+    __m256 total_weight = _mm256_setzero_ps();
+    Avx2Channels acc = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+
+    if (p00) {
+        const __m256 wy = _mm256_set1_ps(w0_y);
+        Avx2Tap(*p00, _mm256_mul_ps(wy, inv_fx), total_weight, acc);
+        Avx2Tap(*p10, _mm256_mul_ps(wy, fx), total_weight, acc);
+    }
+    if (p01) {
+        const __m256 wy = _mm256_set1_ps(w1_y);
+        Avx2Tap(*p01, _mm256_mul_ps(wy, inv_fx), total_weight, acc);
+        Avx2Tap(*p11, _mm256_mul_ps(wy, fx), total_weight, acc);
+    }
+
+    return Avx2Normalize(total_weight, acc);
+}
+
+// Two-tap form of Avx2BlendFloat (see BlendTwoTaps)
+STRETCH_TARGET_AVX2 static inline Avx2Channels Avx2BlendFloat1D(const Avx2Channels* p0, __m256 w0,
+    const Avx2Channels* p1, __m256 w1)
+{
+    __m256 total_weight = _mm256_setzero_ps();
+    Avx2Channels acc = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+    if (p0) {
+        Avx2Tap(*p0, w0, total_weight, acc);
+    }
+    if (p1) {
+        Avx2Tap(*p1, w1, total_weight, acc);
+    }
+    return Avx2Normalize(total_weight, acc);
+}
+
+// One channel of BlendUniformAlphaFixed
+template <int BITS>
+STRETCH_TARGET_AVX2 static inline __m256i Avx2BlendFixed(__m256i c00, __m256i c10, __m256i c01, __m256i c11,
+    __m256i wx1, __m256i wy0, __m256i wy1)
+{
+    // Horizontal pass as c0 * ONE + (c1 - c0) * wx1: one multiply per row.
+    // The result is <= 2^31, so wrapping 32-bit arithmetic is exact
+    const __m256i h0 = _mm256_add_epi32(_mm256_slli_epi32(c00, BITS), _mm256_mullo_epi32(_mm256_sub_epi32(c10, c00), wx1));
+    const __m256i h1 = _mm256_add_epi32(_mm256_slli_epi32(c01, BITS), _mm256_mullo_epi32(_mm256_sub_epi32(c11, c01), wx1));
+
+    if constexpr (BITS == 8) {
+        // 8 bpc: vertical pass fits in 24 bits
+        const __m256i v = _mm256_add_epi32(_mm256_slli_epi32(h0, BITS), _mm256_mullo_epi32(_mm256_sub_epi32(h1, h0), wy1));
+        return _mm256_srli_epi32(_mm256_add_epi32(v, _mm256_set1_epi32(1 << 15)), 16);
+    } else {
+        // 16 bpc: vertical pass needs 64-bit products, even and odd lanes separately
+        const __m256i round = _mm256_set1_epi64x(static_cast<long long>(1) << 31);
+        const __m256i even = _mm256_add_epi64(
+            _mm256_add_epi64(_mm256_mul_epu32(h0, wy0), _mm256_mul_epu32(h1, wy1)), round);
+        const __m256i odd = _mm256_add_epi64(
+            _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(h0, 32), wy0),
+                             _mm256_mul_epu32(_mm256_srli_epi64(h1, 32), wy1)), round);
+        const __m256i high_mask = _mm256_set1_epi64x(static_cast<long long>(0xFFFFFFFF00000000ull));
+        return _mm256_or_si256(_mm256_srli_epi64(even, 32), _mm256_and_si256(odd, high_mask));
+    }
+}
+
+// One channel of BlendUniformAlphaFixed1D, in the same c0 * ONE + (c1 - c0) * w1
+// form. The sum stays below 2^32, so the logical shift is exact
+template <int BITS>
+STRETCH_TARGET_AVX2 static inline __m256i Avx2BlendFixed1D(__m256i c0, __m256i c1, __m256i w1)
+{
+    const __m256i h = _mm256_add_epi32(_mm256_slli_epi32(c0, BITS), _mm256_mullo_epi32(_mm256_sub_epi32(c1, c0), w1));
+    return _mm256_srli_epi32(_mm256_add_epi32(h, _mm256_set1_epi32(1 << (BITS - 1))), BITS);
+}
+
+// Shared per-group setup: returns false (after handling the group with
+// `fallback`) when the vector kernel cannot be used for these 8 pixels
+template <typename Pixel>
+STRETCH_TARGET_AVX2 static inline bool Avx2GroupSetup(const FastRowSampler<Pixel>& sampler, float group_x,
+    float offset_x, Pixel* out, __m256& fx, int& first, SpanKernel<Pixel> fallback = SampleRowSpanScalar<Pixel>)
+{
+    const __m256 lane_f = _mm256_setr_ps(0.0f, 2.0f, 4.0f, 6.0f, 1.0f, 3.0f, 5.0f, 7.0f);
+    const __m256i lane = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+    // Same rounding as the scalar loop: (integer x) + offset
+    const __m256 xs = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(group_x), lane_f), _mm256_set1_ps(offset_x));
+    const __m256 x0f = _mm256_floor_ps(xs);
+    fx = _mm256_sub_ps(xs, x0f);
+    const __m256i x0 = _mm256_cvttps_epi32(x0f);
+    first = _mm256_cvtsi256_si32(x0);
+    const int last = _mm256_extract_epi32(x0, 7);
+
+    // Entirely left or right of the input: no taps contribute
+    if (last + 1 < 0 || first >= sampler.width) {
+        std::memset(out, 0, sizeof(Pixel) * 8);
+        return false;
+    }
+
+    // Vector path needs 8 consecutive taps with x0 and x1 inside the row
+    const __m256i expected = _mm256_add_epi32(_mm256_set1_epi32(first), lane);
+    const bool contiguous = _mm256_movemask_epi8(_mm256_cmpeq_epi32(x0, expected)) == -1;
+    if (!contiguous || first < 0 || first + 8 >= sampler.width) {
+        fallback(sampler, group_x, offset_x, 8, out);
+        return false;
+    }
+    return true;
+}
+
+template <typename Pixel>
+STRETCH_TARGET_AVX2 static void SampleRowSpanAvx2(const FastRowSampler<Pixel>& sampler, float sample_x, float offset_x, int count, Pixel* out)
+{
+    if (!sampler.row0 && !sampler.row1) {
+        std::memset(out, 0, sizeof(Pixel) * static_cast<size_t>(count));
+        return;
+    }
+
+    const Pixel* raw_row = RawSourceRow(sampler);
+    const bool raw_is_row0 = (raw_row != nullptr && raw_row == sampler.row0);
+    const bool both_rows = (sampler.row0 != nullptr && sampler.row1 != nullptr);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 fx;
+        int first = 0;
+        if (!Avx2GroupSetup(sampler, sample_x + static_cast<float>(i), offset_x, out + i, fx, first)) {
+            continue;
+        }
+
+        // (Nearly) integer X on a dominant row returns the source pixel verbatim
+        const __m256 integer_x = _mm256_cmp_ps(fx, _mm256_set1_ps(EPSILON), _CMP_LT_OQ);
+
+        if constexpr (PixelTraits<Pixel>::FIXED_POINT_BITS == 0) {
+            Avx2Channels p00 = {}, p10 = {}, p01 = {}, p11 = {};
+            if (sampler.row0) {
+                p00 = Avx2LoadFloat8(sampler.row0 + first);
+                p10 = Avx2LoadFloat8(sampler.row0 + first + 1);
+            }
+            if (sampler.row1) {
+                p01 = Avx2LoadFloat8(sampler.row1 + first);
+                p11 = Avx2LoadFloat8(sampler.row1 + first + 1);
+            }
+
+            Avx2Channels result = Avx2BlendFloat(sampler.row0 ? &p00 : nullptr, &p10,
+                                                 sampler.row1 ? &p01 : nullptr, &p11,
+                                                 fx, sampler.w0_y, sampler.w1_y);
+            if (raw_row != nullptr) {
+                result = Avx2Select(result, raw_is_row0 ? p00 : p01, integer_x);
+            }
+            Avx2StoreFloat8(out + i, result);
+        } else {
+            Avx2IntChannels q00 = {}, q10 = {}, q01 = {}, q11 = {};
+            if (sampler.row0) {
+                q00 = Avx2LoadInt8(sampler.row0 + first);
+                q10 = Avx2LoadInt8(sampler.row0 + first + 1);
+            }
+            if (sampler.row1) {
+                q01 = Avx2LoadInt8(sampler.row1 + first);
+                q11 = Avx2LoadInt8(sampler.row1 + first + 1);
+            }
+
+            // Lanes whose four taps share a non-zero alpha take the fixed-point blend
+            __m256i fixed_mask = _mm256_setzero_si256();
+            if (both_rows) {
+                const __m256i uniform = _mm256_and_si256(_mm256_cmpeq_epi32(q00.a, q10.a),
+                    _mm256_and_si256(_mm256_cmpeq_epi32(q00.a, q01.a), _mm256_cmpeq_epi32(q00.a, q11.a)));
+                fixed_mask = _mm256_andnot_si256(_mm256_cmpeq_epi32(q00.a, _mm256_setzero_si256()), uniform);
+            }
+            const int fixed_bits = _mm256_movemask_epi8(fixed_mask);
+
+            Avx2IntChannels result = {};
+            if (fixed_bits != -1) {
+                const Avx2Channels p00 = sampler.row0 ? Avx2ToFloat(q00) : Avx2Channels();
+                const Avx2Channels p10 = sampler.row0 ? Avx2ToFloat(q10) : Avx2Channels();
+                const Avx2Channels p01 = sampler.row1 ? Avx2ToFloat(q01) : Avx2Channels();
+                const Avx2Channels p11 = sampler.row1 ? Avx2ToFloat(q11) : Avx2Channels();
+                result = Avx2FromFloat<Pixel>(Avx2BlendFloat(sampler.row0 ? &p00 : nullptr, &p10,
+                                                             sampler.row1 ? &p01 : nullptr, &p11,
+                                                             fx, sampler.w0_y, sampler.w1_y));
+            }
+            if (fixed_bits != 0) {
+                constexpr int BITS = PixelTraits<Pixel>::FIXED_POINT_BITS;
+                const __m256 fx_scaled = _mm256_mul_ps(fx, _mm256_set1_ps(static_cast<float>(1 << BITS)));
+                const __m256i wx1 = _mm256_cvttps_epi32(_mm256_add_ps(fx_scaled, _mm256_set1_ps(0.5f)));
+                const std::uint32_t wy1_scalar = FixedPointWeight<Pixel>(sampler.w1_y);
+                const __m256i wy1 = _mm256_set1_epi32(static_cast<int>(wy1_scalar));
+                const __m256i wy0 = _mm256_set1_epi32(static_cast<int>((1u << BITS) - wy1_scalar));
+
+                Avx2IntChannels fixed;
+                fixed.a = q00.a;
+                fixed.r = Avx2BlendFixed<BITS>(q00.r, q10.r, q01.r, q11.r, wx1, wy0, wy1);
+                fixed.g = Avx2BlendFixed<BITS>(q00.g, q10.g, q01.g, q11.g, wx1, wy0, wy1);
+                fixed.b = Avx2BlendFixed<BITS>(q00.b, q10.b, q01.b, q11.b, wx1, wy0, wy1);
+                result = (fixed_bits == -1) ? fixed : Avx2Select(result, fixed, fixed_mask);
+            }
+
+            if (raw_row != nullptr) {
+                result = Avx2Select(result, raw_is_row0 ? q00 : q01, _mm256_castps_si256(integer_x));
+            }
+            Avx2StoreInt8(out + i, result);
+        }
+    }
+
+    SampleRowSpanScalar(sampler, sample_x + static_cast<float>(i), offset_x, count - i, out + i);
+}
+
+// Separable span, fy == 0: taps x0 and x1 of row0 only
+template <typename Pixel>
+STRETCH_TARGET_AVX2 static void SampleRowSpanHorizontalAvx2(const FastRowSampler<Pixel>& sampler, float sample_x, float offset_x, int count, Pixel* out)
+{
+    const Pixel* row = sampler.row0;
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 fx;
+        int first = 0;
+        if (!Avx2GroupSetup(sampler, sample_x + static_cast<float>(i), offset_x, out + i, fx, first,
+                            SampleRowSpanHorizontalScalar<Pixel>)) {
+            continue;
+        }
+
+        const __m256 integer_x = _mm256_cmp_ps(fx, _mm256_set1_ps(EPSILON), _CMP_LT_OQ);
+        const __m256 inv_fx = _mm256_sub_ps(_mm256_set1_ps(1.0f), fx);
+
+        if constexpr (PixelTraits<Pixel>::FIXED_POINT_BITS == 0) {
+            const Avx2Channels p0 = Avx2LoadFloat8(row + first);
+            const Avx2Channels p1 = Avx2LoadFloat8(row + first + 1);
+            const Avx2Channels result = Avx2BlendFloat1D(&p0, inv_fx, &p1, fx);
+            Avx2StoreFloat8(out + i, Avx2Select(result, p0, integer_x));
+        } else {
+            const Avx2IntChannels q0 = Avx2LoadInt8(row + first);
+            const Avx2IntChannels q1 = Avx2LoadInt8(row + first + 1);
+
+            // Lanes whose two taps share a non-zero alpha take the fixed-point blend
+            const __m256i fixed_mask = _mm256_andnot_si256(_mm256_cmpeq_epi32(q0.a, _mm256_setzero_si256()),
+                                                           _mm256_cmpeq_epi32(q0.a, q1.a));
+            const int fixed_bits = _mm256_movemask_epi8(fixed_mask);
+
+            Avx2IntChannels result = {};
+            if (fixed_bits != -1) {
+                const Avx2Channels p0 = Avx2ToFloat(q0);
+                const Avx2Channels p1 = Avx2ToFloat(q1);
+                result = Avx2FromFloat<Pixel>(Avx2BlendFloat1D(&p0, inv_fx, &p1, fx));
+            }
+            if (fixed_bits != 0) {
+                constexpr int BITS = PixelTraits<Pixel>::FIXED_POINT_BITS;
+                const __m256 fx_scaled = _mm256_mul_ps(fx, _mm256_set1_ps(static_cast<float>(1 << BITS)));
+                const __m256i wx1 = _mm256_cvttps_epi32(_mm256_add_ps(fx_scaled, _mm256_set1_ps(0.5f)));
+
+                Avx2IntChannels fixed;
+                fixed.a = q0.a;
+                fixed.r = Avx2BlendFixed1D<BITS>(q0.r, q1.r, wx1);
+                fixed.g = Avx2BlendFixed1D<BITS>(q0.g, q1.g, wx1);
+                fixed.b = Avx2BlendFixed1D<BITS>(q0.b, q1.b, wx1);
+                result = (fixed_bits == -1) ? fixed : Avx2Select(result, fixed, fixed_mask);
+            }
+            Avx2StoreInt8(out + i, Avx2Select(result, q0, _mm256_castps_si256(integer_x)));
+        }
+    }
+
+    SampleRowSpanHorizontalScalar(sampler, sample_x + static_cast<float>(i), offset_x, count - i, out + i);
+}
+
+// Separable span, whole columns: row0 and row1 at the same x
+template <typename Pixel>
+STRETCH_TARGET_AVX2 static void SampleColumnSpanAvx2(const FastRowSampler<Pixel>& sampler, int x, int count, Pixel* out)
+{
+    // Columns left and right of the input are transparent
+    const int lead = std::min(std::max(-x, 0), count);
+    const int end = std::max(std::min(sampler.width - x, count), lead);
+    std::memset(out, 0, sizeof(Pixel) * static_cast<size_t>(lead));
+    std::memset(out + end, 0, sizeof(Pixel) * static_cast<size_t>(count - end));
+
+    const Pixel* row0 = sampler.row0 ? sampler.row0 + x : nullptr;
+    const Pixel* row1 = sampler.row1 ? sampler.row1 + x : nullptr;
+    const __m256 w0 = _mm256_set1_ps(sampler.w0_y);
+    const __m256 w1 = _mm256_set1_ps(sampler.w1_y);
+
+    int i = lead;
+    for (; i + 8 <= end; i += 8) {
+        if constexpr (PixelTraits<Pixel>::FIXED_POINT_BITS == 0) {
+            const Avx2Channels p0 = row0 ? Avx2LoadFloat8(row0 + i) : Avx2Channels();
+            const Avx2Channels p1 = row1 ? Avx2LoadFloat8(row1 + i) : Avx2Channels();
+            Avx2StoreFloat8(out + i, Avx2BlendFloat1D(row0 ? &p0 : nullptr, w0, row1 ? &p1 : nullptr, w1));
+        } else {
+            const Avx2IntChannels q0 = row0 ? Avx2LoadInt8(row0 + i) : Avx2IntChannels();
+            const Avx2IntChannels q1 = row1 ? Avx2LoadInt8(row1 + i) : Avx2IntChannels();
+
+            __m256i fixed_mask = _mm256_setzero_si256();
+            if (row0 && row1) {
+                fixed_mask = _mm256_andnot_si256(_mm256_cmpeq_epi32(q0.a, _mm256_setzero_si256()),
+                                                 _mm256_cmpeq_epi32(q0.a, q1.a));
+            }
+            const int fixed_bits = _mm256_movemask_epi8(fixed_mask);
+
+            Avx2IntChannels result = {};
+            if (fixed_bits != -1) {
+                const Avx2Channels p0 = row0 ? Avx2ToFloat(q0) : Avx2Channels();
+                const Avx2Channels p1 = row1 ? Avx2ToFloat(q1) : Avx2Channels();
+                result = Avx2FromFloat<Pixel>(Avx2BlendFloat1D(row0 ? &p0 : nullptr, w0, row1 ? &p1 : nullptr, w1));
+            }
+            if (fixed_bits != 0) {
+                constexpr int BITS = PixelTraits<Pixel>::FIXED_POINT_BITS;
+                const __m256i wy1 = _mm256_set1_epi32(static_cast<int>(FixedPointWeight<Pixel>(sampler.w1_y)));
+
+                Avx2IntChannels fixed;
+                fixed.a = q0.a;
+                fixed.r = Avx2BlendFixed1D<BITS>(q0.r, q1.r, wy1);
+                fixed.g = Avx2BlendFixed1D<BITS>(q0.g, q1.g, wy1);
+                fixed.b = Avx2BlendFixed1D<BITS>(q0.b, q1.b, wy1);
+                result = (fixed_bits == -1) ? fixed : Avx2Select(result, fixed, fixed_mask);
+            }
+            Avx2StoreInt8(out + i, result);
+        }
+    }
+
+    SampleColumnSpanScalar(sampler, x + i, end - i, out + i);
+}
+
+// Premultiplied span: plain weighted sums, then one unpremultiply per pixel.
+// Sums run in SumTapsPremultiplied's order so results match the scalar path
+STRETCH_TARGET_AVX2 static inline __m256 Avx2SumTaps(__m256 c00, __m256 c10, __m256 c01, __m256 c11,
+    __m256 w00, __m256 w10, __m256 w01, __m256 w11)
+{
+    return _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c00, w00), _mm256_mul_ps(c10, w10)),
+                                       _mm256_mul_ps(c01, w01)), _mm256_mul_ps(c11, w11));
+}
+
+template <typename Pixel>
+STRETCH_TARGET_AVX2 static void BlendSpanPremultipliedAvx2(const StretchPixelF* row0, const StretchPixelF* row1,
+    float w00, float w10, float w01, float w11, int count, Pixel* out)
+{
+    const __m256 v00 = _mm256_set1_ps(w00);
+    const __m256 v10 = _mm256_set1_ps(w10);
+    const __m256 v01 = _mm256_set1_ps(w01);
+    const __m256 v11 = _mm256_set1_ps(w11);
+    const __m256 threshold = _mm256_set1_ps(ALPHA_THRESHOLD);
+    const __m256 max_val = _mm256_set1_ps(PixelTraits<Pixel>::MAX_VAL);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const Avx2Channels p00 = Avx2LoadFloat8(row0 + i);
+        const Avx2Channels p10 = Avx2LoadFloat8(row0 + i + 1);
+        const Avx2Channels p01 = Avx2LoadFloat8(row1 + i);
+        const Avx2Channels p11 = Avx2LoadFloat8(row1 + i + 1);
+
+        const __m256 alpha = Avx2SumTaps(p00.a, p10.a, p01.a, p11.a, v00, v10, v01, v11);
+        const __m256 visible = _mm256_cmp_ps(alpha, threshold, _CMP_GT_OQ);
+        const __m256 scale = _mm256_div_ps(max_val, alpha);
+        const Avx2Channels straight = {
+            alpha,
+            _mm256_mul_ps(Avx2SumTaps(p00.r, p10.r, p01.r, p11.r, v00, v10, v01, v11), scale),
+            _mm256_mul_ps(Avx2SumTaps(p00.g, p10.g, p01.g, p11.g, v00, v10, v01, v11), scale),
+            _mm256_mul_ps(Avx2SumTaps(p00.b, p10.b, p01.b, p11.b, v00, v10, v01, v11), scale)
+        };
+
+        if constexpr (std::is_same<Pixel, StretchPixelF>::value) {
+            Avx2StoreFloat8(out + i, {
+                _mm256_and_ps(straight.a, visible), _mm256_and_ps(straight.r, visible),
+                _mm256_and_ps(straight.g, visible), _mm256_and_ps(straight.b, visible) });
+        }
+        else {
+            const __m256i keep = _mm256_castps_si256(visible);
+            const Avx2IntChannels q = Avx2FromFloat<Pixel>(straight);
+            Avx2StoreInt8(out + i, {
+                _mm256_and_si256(q.a, keep), _mm256_and_si256(q.r, keep),
+                _mm256_and_si256(q.g, keep), _mm256_and_si256(q.b, keep) });
+        }
+    }
+
+    BlendSpanPremultipliedScalar(row0 + i, row1 + i, w00, w10, w01, w11, count - i, out + i);
+}
+
+// Kernel spans: two pixels per register in memory order [a r g b a r g b],
+// so column sums need no transposes. Taps mirror KernelTap/KernelAccumulate
+// and the resolve mirrors ResolveKernelSum, operation for operation
+template <typename Pixel>
+STRETCH_TARGET_AVX2 static inline __m256 Avx2LoadPairFloat(const Pixel* p)
+{
+    if constexpr (std::is_same<Pixel, StretchPixelF>::value) {
+        return _mm256_loadu_ps(&p->alpha);
+    } else {
+        return _mm256_cvtepi32_ps(Avx2Pixels<Pixel>::LoadPair(p));
+    }
+}
+
+template <typename Pixel>
+STRETCH_TARGET_AVX2 static void KernelColumnsAvx2(const KernelRows<Pixel>& rows, int width, int x, int count, StretchPixelF* columns)
+{
+    // Columns left and right of the input are zero
+    const int lead = std::min(std::max(-x, 0), count);
+    const int end = std::max(std::min(width - x, count), lead);
+    std::memset(columns, 0, sizeof(StretchPixelF) * static_cast<size_t>(lead));
+    std::memset(columns + end, 0, sizeof(StretchPixelF) * static_cast<size_t>(count - end));
+
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 threshold = _mm256_set1_ps(ALPHA_THRESHOLD);
+
+    int c = lead;
+    for (; c + 2 <= end; c += 2) {
+        __m256 sum = _mm256_setzero_ps();
+        for (int j = 0; j < rows.count; ++j) {
+            const __m256 p = Avx2LoadPairFloat(rows.rows[j] + x + c);
+            const __m256 alpha = _mm256_permute_ps(p, _MM_SHUFFLE(0, 0, 0, 0));
+            const __m256 visible = _mm256_cmp_ps(alpha, threshold, _CMP_GT_OQ);
+            const __m256 tap = _mm256_and_ps(visible, _mm256_mul_ps(p, _mm256_blend_ps(alpha, one, 0x11)));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(tap, _mm256_set1_ps(rows.weights[j])));
+        }
+        _mm256_storeu_ps(&columns[c].alpha, sum);
+    }
+
+    KernelColumnsScalar(rows, width, x + c, end - c, columns + c);
+}
+
+STRETCH_TARGET_AVX2 static void KernelPositionsAvx2(float sample_x, float offset_x, int start, int count, KernelChunk& chunk)
+{
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 phases = _mm256_set1_ps(static_cast<float>(STRETCH_KERNEL_PHASES));
+    const __m256 half = _mm256_set1_ps(0.5f);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 index = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(start + i), lanes));
+        const __m256 xs = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(sample_x), index), _mm256_set1_ps(offset_x));
+        const __m256 x0 = _mm256_floor_ps(xs);
+        const __m256 phase = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(xs, x0), phases), half);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(chunk.column + i), _mm256_cvttps_epi32(x0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(chunk.phase + i), _mm256_cvttps_epi32(phase));
+    }
+
+    KernelPositionsScalar(sample_x, offset_x, start, i, count, chunk);
+}
+
+// Sums the columns under a pair of pixels with the nonzero taps of one phase
+STRETCH_TARGET_AVX2 static inline __m256 Avx2SumKernelPair(const StretchPixelF* first,
+    const int* tap_offset, const __m256* tap_weight, int tap_count)
+{
+    __m256 sum = _mm256_setzero_ps();
+    for (int t = 0; t < tap_count; ++t) {
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(&first[tap_offset[t]].alpha), tap_weight[t]));
+    }
+    return sum;
+}
+
+// Resolves a pair of kernel sums (see ResolveKernelSum); inv_alpha holds
+// 1 / alpha of each pixel in all its lanes
+template <typename Pixel>
+STRETCH_TARGET_AVX2 static inline void Avx2StoreKernelPair(Pixel* out, __m256 sum, __m256 inv_alpha)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 alpha = _mm256_permute_ps(sum, _MM_SHUFFLE(0, 0, 0, 0));
+    const __m256 valid = _mm256_cmp_ps(alpha, _mm256_set1_ps(ALPHA_THRESHOLD), _CMP_GT_OQ);
+    const __m256 clamped = _mm256_min_ps(_mm256_max_ps(sum, zero), _mm256_set1_ps(PixelTraits<Pixel>::MAX_VAL));
+    const __m256 result = _mm256_and_ps(valid, _mm256_blend_ps(_mm256_mul_ps(sum, inv_alpha), clamped, 0x11));
+
+    if constexpr (std::is_same<Pixel, StretchPixelF>::value) {
+        _mm256_storeu_ps(&out->alpha, result);
+    } else {
+        Avx2Pixels<Pixel>::StorePair(out, Avx2FromFloat<Pixel>(result));
+    }
+}
+
+template <typename Pixel>
+STRETCH_TARGET_AVX2 static void KernelFilterAvx2(const StretchKernel& kernel, const StretchPixelF* columns,
+    const KernelChunk& chunk, int count, Pixel* out)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    // Nonzero taps of the current phase, rebuilt when the phase changes
+    int phase = -1;
+    int tap_count = 0;
+    int tap_offset[STRETCH_MAX_KERNEL_TAPS];
+    __m256 tap_weight[STRETCH_MAX_KERNEL_TAPS];
+
+    int i = 0;
+    while (i + 2 <= count) {
+        // A pair shares one register when its pixels are adjacent columns
+        // with the same weights, as they are unless X rounding crosses a phase
+        if (chunk.phase[i + 1] != chunk.phase[i] || chunk.column[i + 1] != chunk.column[i] + 1) {
+            KernelFilterScalar(kernel, columns, chunk, i, i + 1, out);
+            ++i;
+            continue;
+        }
+
+        if (chunk.phase[i] != phase) {
+            phase = chunk.phase[i];
+            const float* weights = kernel.weights + phase * kernel.taps;
+            tap_count = 0;
+            for (int k = 0; k < kernel.taps; ++k) {
+                if (weights[k] != 0.0f) {
+                    tap_offset[tap_count] = k;
+                    tap_weight[tap_count] = _mm256_set1_ps(weights[k]);
+                    ++tap_count;
+                }
+            }
+        }
+
+        const StretchPixelF* first = columns + (chunk.column[i] - chunk.column[0]);
+
+        // Eight pixels of one phase share a single division
+        if (i + 8 <= count) {
+            const __m256i column = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chunk.column + i));
+            const __m256i phases = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chunk.phase + i));
+            const __m256i same = _mm256_and_si256(
+                _mm256_cmpeq_epi32(column, _mm256_add_epi32(_mm256_set1_epi32(chunk.column[i]), lanes)),
+                _mm256_cmpeq_epi32(phases, _mm256_set1_epi32(phase)));
+            if (_mm256_movemask_epi8(same) == -1) {
+                const __m256 s0 = Avx2SumKernelPair(first, tap_offset, tap_weight, tap_count);
+                const __m256 s1 = Avx2SumKernelPair(first + 2, tap_offset, tap_weight, tap_count);
+                const __m256 s2 = Avx2SumKernelPair(first + 4, tap_offset, tap_weight, tap_count);
+                const __m256 s3 = Avx2SumKernelPair(first + 6, tap_offset, tap_weight, tap_count);
+
+                // Alphas in the order [s0 s2 s1 s3] per 128-bit lane
+                const __m256 alphas = _mm256_blend_ps(_mm256_shuffle_ps(s0, s1, _MM_SHUFFLE(0, 0, 0, 0)),
+                                                      _mm256_shuffle_ps(s2, s3, _MM_SHUFFLE(0, 0, 0, 0)), 0xAA);
+                const __m256 inv = _mm256_div_ps(one, alphas);
+                Avx2StoreKernelPair(out + i, s0, _mm256_permute_ps(inv, _MM_SHUFFLE(0, 0, 0, 0)));
+                Avx2StoreKernelPair(out + i + 2, s1, _mm256_permute_ps(inv, _MM_SHUFFLE(2, 2, 2, 2)));
+                Avx2StoreKernelPair(out + i + 4, s2, _mm256_permute_ps(inv, _MM_SHUFFLE(1, 1, 1, 1)));
+                Avx2StoreKernelPair(out + i + 6, s3, _mm256_permute_ps(inv, _MM_SHUFFLE(3, 3, 3, 3)));
+                i += 8;
+                continue;
+            }
+        }
+
+        const __m256 sum = Avx2SumKernelPair(first, tap_offset, tap_weight, tap_count);
+        Avx2StoreKernelPair(out + i, sum, _mm256_div_ps(one, _mm256_permute_ps(sum, _MM_SHUFFLE(0, 0, 0, 0))));
+        i += 2;
+    }
+
+    KernelFilterScalar(kernel, columns, chunk, i, count, out);
+}
+
+#endif // STRETCH_SIMD_X86
+
+// -----------------------------------------------------------------------------
+// NEON: 4 output pixels per iteration
+// -----------------------------------------------------------------------------
+
+#if STRETCH_SIMD_ARM
+
+struct NeonChannels
+{
+    float32x4_t a;
+    float32x4_t r;
+    float32x4_t g;
+    float32x4_t b;
+};
+
+struct NeonIntChannels
+{
+    uint32x4_t a;
+    uint32x4_t r;
+    uint32x4_t g;
+    uint32x4_t b;
+};
+
+template <typename Pixel>
+struct NeonPixels;
+
+template <>
+struct NeonPixels<StretchPixel8>
+{
+    static inline NeonIntChannels Load4(const StretchPixel8* p)
+    {
+        // Little-endian ARGB: alpha in the low byte
+        const uint32x4_t v = vld1q_u32(reinterpret_cast<const uint32_t*>(p));
+        const uint32x4_t byte_mask = vdupq_n_u32(0xFF);
+        NeonIntChannels c;
+        c.a = vandq_u32(v, byte_mask);
+        c.r = vandq_u32(vshrq_n_u32(v, 8), byte_mask);
+        c.g = vandq_u32(vshrq_n_u32(v, 16), byte_mask);
+        c.b = vshrq_n_u32(v, 24);
+        return c;
+    }
+
+    static inline void Store4(StretchPixel8* p, const NeonIntChannels& c)
+    {
+        uint32x4_t v = c.a;
+        v = vorrq_u32(v, vshlq_n_u32(c.r, 8));
+        v = vorrq_u32(v, vshlq_n_u32(c.g, 16));
+        v = vorrq_u32(v, vshlq_n_u32(c.b, 24));
+        vst1q_u32(reinterpret_cast<uint32_t*>(p), v);
+    }
+};
+
+template <>
+struct NeonPixels<StretchPixel16>
+{
+    static inline NeonIntChannels Load4(const StretchPixel16* p)
+    {
+        const uint16x4x4_t v = vld4_u16(reinterpret_cast<const uint16_t*>(p));
+        NeonIntChannels c;
+        c.a = vmovl_u16(v.val[0]);
+        c.r = vmovl_u16(v.val[1]);
+        c.g = vmovl_u16(v.val[2]);
+        c.b = vmovl_u16(v.val[3]);
+        return c;
+    }
+
+    static inline void Store4(StretchPixel16* p, const NeonIntChannels& c)
+    {
+        uint16x4x4_t v;
+        v.val[0] = vmovn_u32(c.a);
+        v.val[1] = vmovn_u32(c.r);
+        v.val[2] = vmovn_u32(c.g);
+        v.val[3] = vmovn_u32(c.b);
+        vst4_u16(reinterpret_cast<uint16_t*>(p), v);
+    }
+};
+
+static inline NeonChannels NeonLoadFloat4(const StretchPixelF* p)
+{
+    const float32x4x4_t v = vld4q_f32(&p->alpha);
+    return { v.val[0], v.val[1], v.val[2], v.val[3] };
+}
+
+static inline void NeonStoreFloat4(StretchPixelF* p, const NeonChannels& c)
+{
+    float32x4x4_t v;
+    v.val[0] = c.a;
+    v.val[1] = c.r;
+    v.val[2] = c.g;
+    v.val[3] = c.b;
+    vst4q_f32(&p->alpha, v);
+}
+
+static inline NeonChannels NeonToFloat(const NeonIntChannels& c)
+{
+    return { vcvtq_f32_u32(c.a), vcvtq_f32_u32(c.r), vcvtq_f32_u32(c.g), vcvtq_f32_u32(c.b) };
+}
+
+// Traits::FromFloat for integer depths: clamp, +0.5, truncate
+template <typename Pixel>
+static inline uint32x4_t NeonFromFloat(float32x4_t v)
+{
+    v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(PixelTraits<Pixel>::MAX_VAL));
+    return vcvtq_u32_f32(vaddq_f32(v, vdupq_n_f32(0.5f)));
+}
+
+template <typename Pixel>
+static inline NeonIntChannels NeonFromFloat(const NeonChannels& c)
+{
+    return { NeonFromFloat<Pixel>(c.a), NeonFromFloat<Pixel>(c.r), NeonFromFloat<Pixel>(c.g), NeonFromFloat<Pixel>(c.b) };
+}
+
+static inline NeonIntChannels NeonSelect(const NeonIntChannels& a, const NeonIntChannels& b, uint32x4_t mask)
+{
+    return { vbslq_u32(mask, b.a, a.a), vbslq_u32(mask, b.r, a.r), vbslq_u32(mask, b.g, a.g), vbslq_u32(mask, b.b, a.b) };
+}
+
+static inline NeonChannels NeonSelect(const NeonChannels& a, const NeonChannels& b, uint32x4_t mask)
+{
+    return { vbslq_f32(mask, b.a, a.a), vbslq_f32(mask, b.r, a.r), vbslq_f32(mask, b.g, a.g), vbslq_f32(mask, b.b, a.b) };
+}
+
+static inline float32x4_t NeonAndMask(uint32x4_t mask, float32x4_t v)
+{
+    return vreinterpretq_f32_u32(vandq_u32(mask, vreinterpretq_u32_f32(v)));
+}
+
+static inline void NeonTap(const NeonChannels& p, float32x4_t w, float32x4_t& total_weight, NeonChannels& acc)
+{
+    const uint32x4_t mask = vcgtq_f32(p.a, vdupq_n_f32(ALPHA_THRESHOLD));
+    const float32x4_t weight = vmulq_f32(w, p.a);
+    total_weight = vaddq_f32(total_weight, NeonAndMask(mask, weight));
+    acc.r = vaddq_f32(acc.r, NeonAndMask(mask, vmulq_f32(p.r, weight)));
+    acc.g = vaddq_f32(acc.g, NeonAndMask(mask, vmulq_f32(p.g, weight)));
+    acc.b = vaddq_f32(acc.b, NeonAndMask(mask, vmulq_f32(p.b, weight)));
+    acc.a = vaddq_f32(acc.a, NeonAndMask(mask, vmulq_f32(p.a, w)));
+}
+
+static inline NeonChannels NeonNormalize(float32x4_t total_weight, const NeonChannels& acc)
+{
+    const uint32x4_t valid = vcgtq_f32(total_weight, vdupq_n_f32(ALPHA_THRESHOLD));
+    const float32x4_t inv_weight = vdivq_f32(vdupq_n_f32(1.0f), total_weight);
+    NeonChannels result;
+    result.r = NeonAndMask(valid, vmulq_f32(acc.r, inv_weight));
+    result.g = NeonAndMask(valid, vmulq_f32(acc.g, inv_weight));
+    result.b = NeonAndMask(valid, vmulq_f32(acc.b, inv_weight));
+    result.a = NeonAndMask(valid, acc.a);
+    return result;
+}
+
+static inline NeonChannels NeonBlendFloat(const NeonChannels* p00, const NeonChannels* p10,
+    const NeonChannels* p01, const NeonChannels* p11, float32x4_t fx, float w0_y, float w1_y)
+{
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t inv_fx = vsubq_f32(one, fx);
+    float32x4_t total_weight = zero;
+    NeonChannels acc = { zero, zero, zero, zero };
+
+    if (p00) {
+        const float32x4_t wy = vdupq_n_f32(w0_y);
+        NeonTap(*p00, vmulq_f32(wy, inv_fx), total_weight, acc);
+        NeonTap(*p10, vmulq_f32(wy, fx), total_weight, acc);
+    }
+    if (p01) {
+        const float32x4_t wy = vdupq_n_f32(w1_y);
+        NeonTap(*p01, vmulq_f32(wy, inv_fx), total_weight, acc);
+        NeonTap(*p11, vmulq_f32(wy, fx), total_weight, acc);
+    }
+
+    return NeonNormalize(total_weight, acc);
+}
+
+// Two-tap form of NeonBlendFloat (see BlendTwoTaps)
+static inline NeonChannels NeonBlendFloat1D(const NeonChannels* p0, float32x4_t w0, const NeonChannels* p1, float32x4_t w1)
+{
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    float32x4_t total_weight = zero;
+    NeonChannels acc = { zero, zero, zero, zero };
+    if (p0) {
+        NeonTap(*p0, w0, total_weight, acc);
+    }
+    if (p1) {
+        NeonTap(*p1, w1, total_weight, acc);
+    }
+    return NeonNormalize(total_weight, acc);
+}
+
+// One channel of BlendUniformAlphaFixed
+template <int BITS>
+static inline uint32x4_t NeonBlendFixed(uint32x4_t c00, uint32x4_t c10, uint32x4_t c01, uint32x4_t c11,
+    uint32x4_t wx0, uint32x4_t wx1, uint32_t wy0, uint32_t wy1)
+{
+    const uint32x4_t h0 = vmlaq_u32(vmulq_u32(c00, wx0), c10, wx1);
+    const uint32x4_t h1 = vmlaq_u32(vmulq_u32(c01, wx0), c11, wx1);
+
+    if constexpr (BITS == 8) {
+        const uint32x4_t v = vmlaq_n_u32(vmulq_n_u32(h0, wy0), h1, wy1);
+        return vshrq_n_u32(vaddq_u32(v, vdupq_n_u32(1u << 15)), 16);
+    } else {
+        const uint64x2_t round = vdupq_n_u64(static_cast<uint64_t>(1) << 31);
+        const uint64x2_t lo = vmlal_n_u32(vmlal_n_u32(round, vget_low_u32(h0), wy0), vget_low_u32(h1), wy1);
+        const uint64x2_t hi = vmlal_n_u32(vmlal_n_u32(round, vget_high_u32(h0), wy0), vget_high_u32(h1), wy1);
+        return vcombine_u32(vshrn_n_u64(lo, 32), vshrn_n_u64(hi, 32));
+    }
+}
+
+// One channel of BlendUniformAlphaFixed1D
+template <int BITS>
+static inline uint32x4_t NeonBlendFixed1D(uint32x4_t c0, uint32x4_t c1, uint32x4_t w0, uint32x4_t w1)
+{
+    const uint32x4_t h = vmlaq_u32(vmulq_u32(c0, w0), c1, w1);
+    return vshrq_n_u32(vaddq_u32(h, vdupq_n_u32(1u << (BITS - 1))), BITS);
+}
+
+template <typename Pixel>
+static void SampleRowSpanNeon(const FastRowSampler<Pixel>& sampler, float sample_x, float offset_x, int count, Pixel* out)
+{
+    if (!sampler.row0 && !sampler.row1) {
+        std::memset(out, 0, sizeof(Pixel) * static_cast<size_t>(count));
+        return;
+    }
+
+    const Pixel* raw_row = RawSourceRow(sampler);
+    const bool raw_is_row0 = (raw_row != nullptr && raw_row == sampler.row0);
+    const bool both_rows = (sampler.row0 != nullptr && sampler.row1 != nullptr);
+
+    static const int32_t lane_values[4] = {0, 1, 2, 3};
+    const int32x4_t lane = vld1q_s32(lane_values);
+    const float32x4_t lane_f = vcvtq_f32_s32(lane);
+    const float32x4_t offset = vdupq_n_f32(offset_x);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t xs = vaddq_f32(vaddq_f32(vdupq_n_f32(sample_x + static_cast<float>(i)), lane_f), offset);
+        const float32x4_t x0f = vrndmq_f32(xs);
+        const float32x4_t fx = vsubq_f32(xs, x0f);
+        const int32x4_t x0 = vcvtq_s32_f32(x0f);
+        const int first = vgetq_lane_s32(x0, 0);
+        const int last = vgetq_lane_s32(x0, 3);
+
+        if (last + 1 < 0 || first >= sampler.width) {
+            std::memset(out + i, 0, sizeof(Pixel) * 4);
+            continue;
+        }
+
+        const uint32x4_t same = vceqq_s32(x0, vaddq_s32(vdupq_n_s32(first), lane));
+        if (vminvq_u32(same) == 0 || first < 0 || first + 4 >= sampler.width) {
+            SampleRowSpanScalar(sampler, sample_x + static_cast<float>(i), offset_x, 4, out + i);
+            continue;
+        }
+
+        const uint32x4_t integer_x = vcltq_f32(fx, vdupq_n_f32(EPSILON));
+
+        if constexpr (PixelTraits<Pixel>::FIXED_POINT_BITS == 0) {
+            NeonChannels p00 = {}, p10 = {}, p01 = {}, p11 = {};
+            if (sampler.row0) {
+                p00 = NeonLoadFloat4(sampler.row0 + first);
+                p10 = NeonLoadFloat4(sampler.row0 + first + 1);
+            }
+            if (sampler.row1) {
+                p01 = NeonLoadFloat4(sampler.row1 + first);
+                p11 = NeonLoadFloat4(sampler.row1 + first + 1);
+            }
+
+            NeonChannels result = NeonBlendFloat(sampler.row0 ? &p00 : nullptr, &p10,
+                                                 sampler.row1 ? &p01 : nullptr, &p11,
+                                                 fx, sampler.w0_y, sampler.w1_y);
+            if (raw_row != nullptr) {
+                result = NeonSelect(result, raw_is_row0 ? p00 : p01, integer_x);
+            }
+            NeonStoreFloat4(out + i, result);
+        } else {
+            NeonIntChannels q00 = {}, q10 = {}, q01 = {}, q11 = {};
+            if (sampler.row0) {
+                q00 = NeonPixels<Pixel>::Load4(sampler.row0 + first);
+                q10 = NeonPixels<Pixel>::Load4(sampler.row0 + first + 1);
+            }
+            if (sampler.row1) {
+                q01 = NeonPixels<Pixel>::Load4(sampler.row1 + first);
+                q11 = NeonPixels<Pixel>::Load4(sampler.row1 + first + 1);
+            }
+
+            // Lanes whose four taps share a non-zero alpha take the fixed-point blend
+            uint32x4_t fixed_mask = vdupq_n_u32(0);
+            if (both_rows) {
+                const uint32x4_t uniform = vandq_u32(vceqq_u32(q00.a, q10.a),
+                    vandq_u32(vceqq_u32(q00.a, q01.a), vceqq_u32(q00.a, q11.a)));
+                fixed_mask = vandq_u32(uniform, vtstq_u32(q00.a, q00.a));
+            }
+            const bool all_fixed = vminvq_u32(fixed_mask) != 0;
+            const bool any_fixed = vmaxvq_u32(fixed_mask) != 0;
+
+            NeonIntChannels result = {};
+            if (!all_fixed) {
+                const NeonChannels p00 = sampler.row0 ? NeonToFloat(q00) : NeonChannels();
+                const NeonChannels p10 = sampler.row0 ? NeonToFloat(q10) : NeonChannels();
+                const NeonChannels p01 = sampler.row1 ? NeonToFloat(q01) : NeonChannels();
+                const NeonChannels p11 = sampler.row1 ? NeonToFloat(q11) : NeonChannels();
+                result = NeonFromFloat<Pixel>(NeonBlendFloat(sampler.row0 ? &p00 : nullptr, &p10,
+                                                             sampler.row1 ? &p01 : nullptr, &p11,
+                                                             fx, sampler.w0_y, sampler.w1_y));
+            }
+            if (any_fixed) {
+                constexpr int BITS = PixelTraits<Pixel>::FIXED_POINT_BITS;
+                const float32x4_t fx_scaled = vmulq_f32(fx, vdupq_n_f32(static_cast<float>(1 << BITS)));
+                const uint32x4_t wx1 = vcvtq_u32_f32(vaddq_f32(fx_scaled, vdupq_n_f32(0.5f)));
+                const uint32x4_t wx0 = vsubq_u32(vdupq_n_u32(1u << BITS), wx1);
+                const std::uint32_t wy1 = FixedPointWeight<Pixel>(sampler.w1_y);
+                const std::uint32_t wy0 = (1u << BITS) - wy1;
+
+                NeonIntChannels fixed;
+                fixed.a = q00.a;
+                fixed.r = NeonBlendFixed<BITS>(q00.r, q10.r, q01.r, q11.r, wx0, wx1, wy0, wy1);
+                fixed.g = NeonBlendFixed<BITS>(q00.g, q10.g, q01.g, q11.g, wx0, wx1, wy0, wy1);
+                fixed.b = NeonBlendFixed<BITS>(q00.b, q10.b, q01.b, q11.b, wx0, wx1, wy0, wy1);
+                result = all_fixed ? fixed : NeonSelect(result, fixed, fixed_mask);
+            }
+
+            if (raw_row != nullptr) {
+                result = NeonSelect(result, raw_is_row0 ? q00 : q01, integer_x);
+            }
+            NeonPixels<Pixel>::Store4(out + i, result);
+        }
+    }
+
+    SampleRowSpanScalar(sampler, sample_x + static_cast<float>(i), offset_x, count - i, out + i);
+}
+
+// Separable span, fy == 0: taps x0 and x1 of row0 only
+template <typename Pixel>
+static void SampleRowSpanHorizontalNeon(const FastRowSampler<Pixel>& sampler, float sample_x, float offset_x, int count, Pixel* out)
+{
+    const Pixel* row = sampler.row0;
+
+    static const int32_t lane_values[4] = {0, 1, 2, 3};
+    const int32x4_t lane = vld1q_s32(lane_values);
+    const float32x4_t lane_f = vcvtq_f32_s32(lane);
+    const float32x4_t offset = vdupq_n_f32(offset_x);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t xs = vaddq_f32(vaddq_f32(vdupq_n_f32(sample_x + static_cast<float>(i)), lane_f), offset);
+        const float32x4_t x0f = vrndmq_f32(xs);
+        const float32x4_t fx = vsubq_f32(xs, x0f);
+        const int32x4_t x0 = vcvtq_s32_f32(x0f);
+        const int first = vgetq_lane_s32(x0, 0);
+        const int last = vgetq_lane_s32(x0, 3);
+
+        if (last + 1 < 0 || first >= sampler.width) {
+            std::memset(out + i, 0, sizeof(Pixel) * 4);
+            continue;
+        }
+
+        const uint32x4_t same = vceqq_s32(x0, vaddq_s32(vdupq_n_s32(first), lane));
+        if (vminvq_u32(same) == 0 || first < 0 || first + 4 >= sampler.width) {
+            SampleRowSpanHorizontalScalar(sampler, sample_x + static_cast<float>(i), offset_x, 4, out + i);
+            continue;
+        }
+
+        const uint32x4_t integer_x = vcltq_f32(fx, vdupq_n_f32(EPSILON));
+        const float32x4_t inv_fx = vsubq_f32(vdupq_n_f32(1.0f), fx);
+
+        if constexpr (PixelTraits<Pixel>::FIXED_POINT_BITS == 0) {
+            const NeonChannels p0 = NeonLoadFloat4(row + first);
+            const NeonChannels p1 = NeonLoadFloat4(row + first + 1);
+            NeonStoreFloat4(out + i, NeonSelect(NeonBlendFloat1D(&p0, inv_fx, &p1, fx), p0, integer_x));
+        } else {
+            const NeonIntChannels q0 = NeonPixels<Pixel>::Load4(row + first);
+            const NeonIntChannels q1 = NeonPixels<Pixel>::Load4(row + first + 1);
+
+            // Lanes whose two taps share a non-zero alpha take the fixed-point blend
+            const uint32x4_t fixed_mask = vandq_u32(vceqq_u32(q0.a, q1.a), vtstq_u32(q0.a, q0.a));
+            const bool all_fixed = vminvq_u32(fixed_mask) != 0;
+            const bool any_fixed = vmaxvq_u32(fixed_mask) != 0;
+
+            NeonIntChannels result = {};
+            if (!all_fixed) {
+                const NeonChannels p0 = NeonToFloat(q0);
+                const NeonChannels p1 = NeonToFloat(q1);
+                result = NeonFromFloat<Pixel>(NeonBlendFloat1D(&p0, inv_fx, &p1, fx));
+            }
+            if (any_fixed) {
+                constexpr int BITS = PixelTraits<Pixel>::FIXED_POINT_BITS;
+                const float32x4_t fx_scaled = vmulq_f32(fx, vdupq_n_f32(static_cast<float>(1 << BITS)));
+                const uint32x4_t wx1 = vcvtq_u32_f32(vaddq_f32(fx_scaled, vdupq_n_f32(0.5f)));
+                const uint32x4_t wx0 = vsubq_u32(vdupq_n_u32(1u << BITS), wx1);
+
+                NeonIntChannels fixed;
+                fixed.a = q0.a;
+                fixed.r = NeonBlendFixed1D<BITS>(q0.r, q1.r, wx0, wx1);
+                fixed.g = NeonBlendFixed1D<BITS>(q0.g, q1.g, wx0, wx1);
+                fixed.b = NeonBlendFixed1D<BITS>(q0.b, q1.b, wx0, wx1);
+                result = all_fixed ? fixed : NeonSelect(result, fixed, fixed_mask);
+            }
+            NeonPixels<Pixel>::Store4(out + i, NeonSelect(result, q0, integer_x));
+        }
+    }
+
+    SampleRowSpanHorizontalScalar(sampler, sample_x + static_cast<float>(i), offset_x, count - i, out + i);
+}
+
+// Separable span, whole columns: row0 and row1 at the same x
+template <typename Pixel>
+static void SampleColumnSpanNeon(const FastRowSampler<Pixel>& sampler, int x, int count, Pixel* out)
+{
+    // Columns left and right of the input are transparent
+    const int lead = std::min(std::max(-x, 0), count);
+    const int end = std::max(std::min(sampler.width - x, count), lead);
+    std::memset(out, 0, sizeof(Pixel) * static_cast<size_t>(lead));
+    std::memset(out + end, 0, sizeof(Pixel) * static_cast<size_t>(count - end));
+
+    const Pixel* row0 = sampler.row0 ? sampler.row0 + x : nullptr;
+    const Pixel* row1 = sampler.row1 ? sampler.row1 + x : nullptr;
+    const float32x4_t w0 = vdupq_n_f32(sampler.w0_y);
+    const float32x4_t w1 = vdupq_n_f32(sampler.w1_y);
+
+    int i = lead;
+    for (; i + 4 <= end; i += 4) {
+        if constexpr (PixelTraits<Pixel>::FIXED_POINT_BITS == 0) {
+            const NeonChannels p0 = row0 ? NeonLoadFloat4(row0 + i) : NeonChannels();
+            const NeonChannels p1 = row1 ? NeonLoadFloat4(row1 + i) : NeonChannels();
+            NeonStoreFloat4(out + i, NeonBlendFloat1D(row0 ? &p0 : nullptr, w0, row1 ? &p1 : nullptr, w1));
+        } else {
+            const NeonIntChannels q0 = row0 ? NeonPixels<Pixel>::Load4(row0 + i) : NeonIntChannels();
+            const NeonIntChannels q1 = row1 ? NeonPixels<Pixel>::Load4(row1 + i) : NeonIntChannels();
+
+            uint32x4_t fixed_mask = vdupq_n_u32(0);
+            if (row0 && row1) {
+                fixed_mask = vandq_u32(vceqq_u32(q0.a, q1.a), vtstq_u32(q0.a, q0.a));
+            }
+            const bool all_fixed = vminvq_u32(fixed_mask) != 0;
+            const bool any_fixed = vmaxvq_u32(fixed_mask) != 0;
+
+            NeonIntChannels result = {};
+            if (!all_fixed) {
+                const NeonChannels p0 = row0 ? NeonToFloat(q0) : NeonChannels();
+                const NeonChannels p1 = row1 ? NeonToFloat(q1) : NeonChannels();
+                result = NeonFromFloat<Pixel>(NeonBlendFloat1D(row0 ? &p0 : nullptr, w0, row1 ? &p1 : nullptr, w1));
+            }
+            if (any_fixed) {
+                constexpr int BITS = PixelTraits<Pixel>::FIXED_POINT_BITS;
+                const std::uint32_t wy1 = FixedPointWeight<Pixel>(sampler.w1_y);
+
+                NeonIntChannels fixed;
+                fixed.a = q0.a;
+                fixed.r = NeonBlendFixed1D<BITS>(q0.r, q1.r, vdupq_n_u32((1u << BITS) - wy1), vdupq_n_u32(wy1));
+                fixed.g = NeonBlendFixed1D<BITS>(q0.g, q1.g, vdupq_n_u32((1u << BITS) - wy1), vdupq_n_u32(wy1));
+                fixed.b = NeonBlendFixed1D<BITS>(q0.b, q1.b, vdupq_n_u32((1u << BITS) - wy1), vdupq_n_u32(wy1));
+                result = all_fixed ? fixed : NeonSelect(result, fixed, fixed_mask);
+            }
+            NeonPixels<Pixel>::Store4(out + i, result);
+        }
+    }
+
+    SampleColumnSpanScalar(sampler, x + i, end - i, out + i);
+}
+
+static inline float32x4_t NeonSumTaps(float32x4_t c00, float32x4_t c10, float32x4_t c01, float32x4_t c11,
+    float32x4_t w00, float32x4_t w10, float32x4_t w01, float32x4_t w11)
+{
+    return vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(c00, w00), vmulq_f32(c10, w10)),
+                               vmulq_f32(c01, w01)), vmulq_f32(c11, w11));
+}
+
+template <typename Pixel>
+static void BlendSpanPremultipliedNeon(const StretchPixelF* row0, const StretchPixelF* row1,
+    float w00, float w10, float w01, float w11, int count, Pixel* out)
+{
+    const float32x4_t v00 = vdupq_n_f32(w00);
+    const float32x4_t v10 = vdupq_n_f32(w10);
+    const float32x4_t v01 = vdupq_n_f32(w01);
+    const float32x4_t v11 = vdupq_n_f32(w11);
+    const float32x4_t threshold = vdupq_n_f32(ALPHA_THRESHOLD);
+    const float32x4_t max_val = vdupq_n_f32(PixelTraits<Pixel>::MAX_VAL);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const NeonChannels p00 = NeonLoadFloat4(row0 + i);
+        const NeonChannels p10 = NeonLoadFloat4(row0 + i + 1);
+        const NeonChannels p01 = NeonLoadFloat4(row1 + i);
+        const NeonChannels p11 = NeonLoadFloat4(row1 + i + 1);
+
+        const float32x4_t alpha = NeonSumTaps(p00.a, p10.a, p01.a, p11.a, v00, v10, v01, v11);
+        const uint32x4_t visible = vcgtq_f32(alpha, threshold);
+        const float32x4_t scale = vdivq_f32(max_val, alpha);
+        const NeonChannels straight = {
+            alpha,
+            vmulq_f32(NeonSumTaps(p00.r, p10.r, p01.r, p11.r, v00, v10, v01, v11), scale),
+            vmulq_f32(NeonSumTaps(p00.g, p10.g, p01.g, p11.g, v00, v10, v01, v11), scale),
+            vmulq_f32(NeonSumTaps(p00.b, p10.b, p01.b, p11.b, v00, v10, v01, v11), scale)
+        };
+
+        if constexpr (std::is_same<Pixel, StretchPixelF>::value) {
+            NeonStoreFloat4(out + i, {
+                NeonAndMask(visible, straight.a), NeonAndMask(visible, straight.r),
+                NeonAndMask(visible, straight.g), NeonAndMask(visible, straight.b) });
+        }
+        else {
+            const NeonIntChannels q = NeonFromFloat<Pixel>(straight);
+            NeonPixels<Pixel>::Store4(out + i, {
+                vandq_u32(q.a, visible), vandq_u32(q.r, visible),
+                vandq_u32(q.g, visible), vandq_u32(q.b, visible) });
+        }
+    }
+
+    BlendSpanPremultipliedScalar(row0 + i, row1 + i, w00, w10, w01, w11, count - i, out + i);
+}
+
+// Kernel spans: one pixel per register in memory order [a r g b]. Taps and
+// the resolve mirror the scalar helpers operation for operation
+template <typename Pixel>
+static inline float32x4_t NeonLoadPixelFloat(const Pixel* p)
+{
+    if constexpr (std::is_same<Pixel, StretchPixelF>::value) {
+        return vld1q_f32(&p->alpha);
+    } else if constexpr (std::is_same<Pixel, StretchPixel16>::value) {
+        return vcvtq_f32_u32(vmovl_u16(vld1_u16(reinterpret_cast<const uint16_t*>(p))));
+    } else {
+        const uint8x8_t bytes = vreinterpret_u8_u32(vld1_dup_u32(reinterpret_cast<const uint32_t*>(p)));
+        return vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(bytes))));
+    }
+}
+
+template <typename Pixel>
+static inline void NeonStorePixelFloat(Pixel* p, float32x4_t v)
+{
+    if constexpr (std::is_same<Pixel, StretchPixelF>::value) {
+        vst1q_f32(&p->alpha, v);
+    } else {
+        const uint16x4_t words = vmovn_u32(NeonFromFloat<Pixel>(v));
+        if constexpr (std::is_same<Pixel, StretchPixel16>::value) {
+            vst1_u16(reinterpret_cast<uint16_t*>(p), words);
+        } else {
+            const uint8x8_t bytes = vmovn_u16(vcombine_u16(words, words));
+            vst1_lane_u32(reinterpret_cast<uint32_t*>(p), vreinterpret_u32_u8(bytes), 0);
+        }
+    }
+}
+
+template <typename Pixel>
+static void KernelColumnsNeon(const KernelRows<Pixel>& rows, int width, int x, int count, StretchPixelF* columns)
+{
+    // Columns left and right of the input are zero
+    const int lead = std::min(std::max(-x, 0), count);
+    const int end = std::max(std::min(width - x, count), lead);
+    std::memset(columns, 0, sizeof(StretchPixelF) * static_cast<size_t>(lead));
+    std::memset(columns + end, 0, sizeof(StretchPixelF) * static_cast<size_t>(count - end));
+
+    const float32x4_t threshold = vdupq_n_f32(ALPHA_THRESHOLD);
+    for (int c = lead; c < end; ++c) {
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        for (int j = 0; j < rows.count; ++j) {
+            const float32x4_t p = NeonLoadPixelFloat(rows.rows[j] + x + c);
+            const float32x4_t alpha = vdupq_laneq_f32(p, 0);
+            const uint32x4_t visible = vcgtq_f32(alpha, threshold);
+            const float32x4_t tap = NeonAndMask(visible, vmulq_f32(p, vsetq_lane_f32(1.0f, alpha, 0)));
+            sum = vaddq_f32(sum, vmulq_f32(tap, vdupq_n_f32(rows.weights[j])));
+        }
+        vst1q_f32(&columns[c].alpha, sum);
+    }
+}
+
+static void KernelPositionsNeon(float sample_x, float offset_x, int start, int count, KernelChunk& chunk)
+{
+    static const int32_t lane_values[4] = {0, 1, 2, 3};
+    const int32x4_t lanes = vld1q_s32(lane_values);
+    const float32x4_t phases = vdupq_n_f32(static_cast<float>(STRETCH_KERNEL_PHASES));
+    const float32x4_t half = vdupq_n_f32(0.5f);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t index = vcvtq_f32_s32(vaddq_s32(vdupq_n_s32(start + i), lanes));
+        const float32x4_t xs = vaddq_f32(vaddq_f32(vdupq_n_f32(sample_x), index), vdupq_n_f32(offset_x));
+        const float32x4_t x0 = vrndmq_f32(xs);
+        const float32x4_t phase = vaddq_f32(vmulq_f32(vsubq_f32(xs, x0), phases), half);
+        vst1q_s32(chunk.column + i, vcvtq_s32_f32(x0));
+        vst1q_s32(chunk.phase + i, vcvtq_s32_f32(phase));
+    }
+
+    KernelPositionsScalar(sample_x, offset_x, start, i, count, chunk);
+}
+
+template <typename Pixel>
+static void KernelFilterNeon(const StretchKernel& kernel, const StretchPixelF* columns, const KernelChunk& chunk,
+    int count, Pixel* out)
+{
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t threshold = vdupq_n_f32(ALPHA_THRESHOLD);
+    const float32x4_t max_val = vdupq_n_f32(PixelTraits<Pixel>::MAX_VAL);
+    const int taps = kernel.taps;
+
+    for (int i = 0; i < count; ++i) {
+        const StretchPixelF* first = columns + (chunk.column[i] - chunk.column[0]);
+        const float* weights = kernel.weights + chunk.phase[i] * taps;
+        float32x4_t sum = zero;
+        for (int k = 0; k < taps; ++k) {
+            if (weights[k] != 0.0f) {
+                sum = vaddq_f32(sum, vmulq_f32(vld1q_f32(&first[k].alpha), vdupq_n_f32(weights[k])));
+            }
+        }
+
+        const float32x4_t alpha = vdupq_laneq_f32(sum, 0);
+        const uint32x4_t valid = vcgtq_f32(alpha, threshold);
+        const float32x4_t color = vmulq_f32(sum, vdivq_f32(vdupq_n_f32(1.0f), alpha));
+        const float32x4_t clamped = vminq_f32(vmaxq_f32(sum, zero), max_val);
+        NeonStorePixelFloat(out + i, NeonAndMask(valid, vsetq_lane_f32(vgetq_lane_f32(clamped, 0), color, 0)));
+    }
+}
+
+#endif // STRETCH_SIMD_ARM
+
+// -----------------------------------------------------------------------------
+// Entry point
+// -----------------------------------------------------------------------------
+
+template <typename Pixel>
+void StretchSampleRowSpan(const FastRowSampler<Pixel>& sampler, float sample_x, float offset_x, int count, Pixel* out)
+{
+    if (!sampler.row0 && !sampler.row1) {
+        std::memset(out, 0, sizeof(Pixel) * static_cast<size_t>(count));
+        return;
+    }
+
+    const StretchSimdLevel level = StretchGetSimdLevel();
+
+    // Whole columns: (sample_x + i) + offset_x is exact below 2^23
+    const bool whole_x = sample_x == std::floor(sample_x) && offset_x == std::floor(offset_x)
+        && std::fabs(sample_x) + std::fabs(offset_x) + static_cast<float>(count) < 8388608.0f;
+    if (whole_x) {
+        const int x = static_cast<int>(sample_x) + static_cast<int>(offset_x);
+        if (const Pixel* raw_row = RawSourceRow(sampler)) {
+            CopyRowSpan(raw_row, sampler.width, x, count, out);
+            return;
+        }
+        switch (level) {
+#if STRETCH_SIMD_X86
+        case STRETCH_SIMD_AVX2:
+            SampleColumnSpanAvx2(sampler, x, count, out);
+            return;
+#endif
+#if STRETCH_SIMD_ARM
+        case STRETCH_SIMD_NEON:
+            SampleColumnSpanNeon(sampler, x, count, out);
+            return;
+#endif
+        default:
+            SampleColumnSpanScalar(sampler, x, count, out);
+            return;
+        }
+    }
+
+    // Whole rows: row1 carries no weight
+    if (sampler.w1_y == 0.0f) {
+        if (!sampler.row0) {
+            std::memset(out, 0, sizeof(Pixel) * static_cast<size_t>(count));
+            return;
+        }
+        switch (level) {
+#if STRETCH_SIMD_X86
+        case STRETCH_SIMD_AVX2:
+            SampleRowSpanHorizontalAvx2(sampler, sample_x, offset_x, count, out);
+            return;
+#endif
+#if STRETCH_SIMD_ARM
+        case STRETCH_SIMD_NEON:
+            SampleRowSpanHorizontalNeon(sampler, sample_x, offset_x, count, out);
+            return;
+#endif
+        default:
+            SampleRowSpanHorizontalScalar(sampler, sample_x, offset_x, count, out);
+            return;
+        }
+    }
+
+    switch (level) {
+#if STRETCH_SIMD_X86
+    case STRETCH_SIMD_AVX2:
+        SampleRowSpanAvx2(sampler, sample_x, offset_x, count, out);
+        return;
+#endif
+#if STRETCH_SIMD_ARM
+    case STRETCH_SIMD_NEON:
+        SampleRowSpanNeon(sampler, sample_x, offset_x, count, out);
+        return;
+#endif
+    default:
+        SampleRowSpanScalar(sampler, sample_x, offset_x, count, out);
+        return;
+    }
+}
+
+template void StretchSampleRowSpan(const FastRowSampler<StretchPixel8>&, float, float, int, StretchPixel8*);
+template void StretchSampleRowSpan(const FastRowSampler<StretchPixel16>&, float, float, int, StretchPixel16*);
+template void StretchSampleRowSpan(const FastRowSampler<StretchPixelF>&, float, float, int, StretchPixelF*);
+
+template <typename Pixel>
+void StretchBlendSpanPremultiplied(const StretchPixelF* row0, const StretchPixelF* row1,
+    float w00, float w10, float w01, float w11, int count, Pixel* out)
+{
+    switch (StretchGetSimdLevel()) {
+#if STRETCH_SIMD_X86
+    case STRETCH_SIMD_AVX2:
+        BlendSpanPremultipliedAvx2(row0, row1, w00, w10, w01, w11, count, out);
+        return;
+#endif
+#if STRETCH_SIMD_ARM
+    case STRETCH_SIMD_NEON:
+        BlendSpanPremultipliedNeon(row0, row1, w00, w10, w01, w11, count, out);
+        return;
+#endif
+    default:
+        BlendSpanPremultipliedScalar(row0, row1, w00, w10, w01, w11, count, out);
+        return;
+    }
+}
+
+template void StretchBlendSpanPremultiplied(const StretchPixelF*, const StretchPixelF*, float, float, float, float, int, StretchPixel8*);
+template void StretchBlendSpanPremultiplied(const StretchPixelF*, const StretchPixelF*, float, float, float, float, int, StretchPixel16*);
+template void StretchBlendSpanPremultiplied(const StretchPixelF*, const StretchPixelF*, float, float, float, float, int, StretchPixelF*);
+
+template <typename Pixel>
+void StretchSampleKernelSpan(const StretchKernel& kernel, const std::uint8_t* base_ptr, std::ptrdiff_t rowbytes,
+    int width, int height, float sample_x, float offset_x, float sample_y, int count, Pixel* out)
+{
+    const int y0 = static_cast<int>(floorf(sample_y));
+    const float* wy = kernel.Weights(sample_y - static_cast<float>(y0));
+    KernelRows<Pixel> rows;
+    rows.count = 0;
+    for (int j = 0; j < kernel.taps; ++j) {
+        const int y = y0 + kernel.first + j;
+        if (wy[j] != 0.0f && y >= 0 && y < height) {
+            rows.rows[rows.count] = reinterpret_cast<const Pixel*>(base_ptr + static_cast<std::ptrdiff_t>(y) * rowbytes);
+            rows.weights[rows.count] = wy[j];
+            ++rows.count;
+        }
+    }
+    if (rows.count == 0) {
+        std::memset(out, 0, sizeof(Pixel) * static_cast<size_t>(count));
+        return;
+    }
+
+    const StretchSimdLevel level = StretchGetSimdLevel();
+    KernelChunk chunk;
+    StretchPixelF columns[KERNEL_CHUNK_COLUMNS];
+
+    for (int start = 0; start < count; start += KERNEL_CHUNK) {
+        const int n = std::min(KERNEL_CHUNK, count - start);
+        switch (level) {
+#if STRETCH_SIMD_X86
+        case STRETCH_SIMD_AVX2:
+            KernelPositionsAvx2(sample_x, offset_x, start, n, chunk);
+            break;
+#endif
+#if STRETCH_SIMD_ARM
+        case STRETCH_SIMD_NEON:
+            KernelPositionsNeon(sample_x, offset_x, start, n, chunk);
+            break;
+#endif
+        default:
+            KernelPositionsScalar(sample_x, offset_x, start, 0, n, chunk);
+            break;
+        }
+
+        // Float steps coarser than a pixel (far outside the input) can spread
+        // a chunk over more columns than it has room for
+        const int column_count = chunk.column[n - 1] - chunk.column[0] + kernel.taps;
+        if (column_count < kernel.taps || column_count > KERNEL_CHUNK_COLUMNS) {
+            for (int i = 0; i < n; ++i) {
+                out[start + i] = SampleKernel<Pixel>(kernel, base_ptr, rowbytes,
+                    (sample_x + static_cast<float>(start + i)) + offset_x, sample_y, width, height);
+            }
+            continue;
+        }
+
+        const int column_x = chunk.column[0] + kernel.first;
+        switch (level) {
+#if STRETCH_SIMD_X86
+        case STRETCH_SIMD_AVX2:
+            KernelColumnsAvx2(rows, width, column_x, column_count, columns);
+            KernelFilterAvx2(kernel, columns, chunk, n, out + start);
+            break;
+#endif
+#if STRETCH_SIMD_ARM
+        case STRETCH_SIMD_NEON:
+            KernelColumnsNeon(rows, width, column_x, column_count, columns);
+            KernelFilterNeon(kernel, columns, chunk, n, out + start);
+            break;
+#endif
+        default:
+            KernelColumnsScalar(rows, width, column_x, column_count, columns);
+            KernelFilterScalar(kernel, columns, chunk, 0, n, out + start);
+            break;
+        }
+    }
+}
+
+template void StretchSampleKernelSpan(const StretchKernel&, const std::uint8_t*, std::ptrdiff_t, int, int, float, float, float, int, StretchPixel8*);
+template void StretchSampleKernelSpan(const StretchKernel&, const std::uint8_t*, std::ptrdiff_t, int, int, float, float, float, int, StretchPixel16*);
+template void StretchSampleKernelSpan(const StretchKernel&, const std::uint8_t*, std::ptrdiff_t, int, int, float, float, float, int, StretchPixelF*);
+
+template <typename Pixel>
+int StretchSampleLineCacheSpan(const StretchLineCache<Pixel>& cache, float u0, float step, int begin, int count, Pixel* out)
+{
+    // Locals, so stores to out (which may alias anything for 8 bpc) do not
+    // reload the cache's fields
+    const Pixel* grid = cache.grid;
+    const std::uint8_t* plain = cache.plain;
+    const int last = cache.size - 1;
+    for (int i = begin; i < count; ++i) {
+        const float u = u0 + step * static_cast<float>(i);
+        if (!(u > 0.0f)) {
+            out[i] = grid[0];
+            continue;
+        }
+        const int index = static_cast<int>(u);
+        if (index >= last) {
+            out[i] = grid[last];
+        } else if (plain[index]) {
+            out[i] = LerpAlphaWeighted(grid[index], grid[index + 1], u - static_cast<float>(index));
+        } else {
+            int k = 0;
+            const float f = StretchLineCacheSegment(cache.knots, cache.cells, u, k);
+            if (cache.direct[k]) {
+                return i;
+            }
+            out[i] = LerpAlphaWeighted(cache.samples[k], cache.samples[k + 1], f);
+        }
+    }
+    return count;
+}
+
+template int StretchSampleLineCacheSpan(const StretchLineCache<StretchPixel8>&, float, float, int, int, StretchPixel8*);
+template int StretchSampleLineCacheSpan(const StretchLineCache<StretchPixel16>&, float, float, int, int, StretchPixel16*);
+template int StretchSampleLineCacheSpan(const StretchLineCache<StretchPixelF>&, float, float, int, int, StretchPixelF*);
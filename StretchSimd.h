@@ -0,0 +1,33 @@
+#pragma once
+#ifndef STRETCH_SIMD_H
+#define STRETCH_SIMD_H
+
+// -----------------------------------------------------------------------------
+// SIMD dispatch
+// -----------------------------------------------------------------------------
+//
+// The vectorized kernels live in StretchSimd.cpp and are selected at runtime:
+// AVX2 on x86-64 CPUs that support it, NEON on ARM64, scalar otherwise.
+// Every level produces the same output as the scalar samplers.
+
+enum StretchSimdLevel
+{
+    STRETCH_SIMD_SCALAR = 0,
+    STRETCH_SIMD_AVX2,
+    STRETCH_SIMD_NEON
+};
+
+// Best level supported by this CPU and build (detected once)
+StretchSimdLevel StretchDetectSimdLevel();
+
+// Level used by the kernels. Defaults to the detected level; the STRETCH_SIMD
+// environment variable ("scalar", "avx2", "neon") can lower it.
+StretchSimdLevel StretchGetSimdLevel();
+
+// Overrides the active level (clamped to what the CPU supports).
+// Intended for benchmarks and differential checks.
+void StretchSetSimdLevel(StretchSimdLevel level);
+
+const char* StretchSimdLevelName(StretchSimdLevel level);
+
+#endif // STRETCH_SIMD_H
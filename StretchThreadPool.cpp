@@ -0,0 +1,238 @@
+#include "StretchThreadPool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+// A job is shared between the caller and the workers that picked up one of its
+// tickets. Each slot holds a packed [front | back) range of chunk indices:
+// the owner pops from the front, thieves pop from the back.
+struct StretchThreadPool::Job
+{
+    const RangeFunc* func = nullptr;
+    int begin = 0;
+    int end = 0;
+    int grain = 1;
+    int num_chunks = 0;
+    int num_slots = 0;
+
+    std::unique_ptr<std::atomic<std::uint64_t>[]> slots;
+    std::atomic<int> next_slot{1}; // slot 0 belongs to the caller
+    std::atomic<int> remaining{0};
+    std::atomic<bool> failed{false};
+
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+};
+
+// Set once by each worker thread
+static thread_local int t_thread_index = 0;
+
+static inline std::uint64_t PackRange(std::uint32_t front, std::uint32_t back)
+{
+    return (static_cast<std::uint64_t>(front) << 32) | back;
+}
+
+static bool PopFront(std::atomic<std::uint64_t>& slot, int& chunk)
+{
+    std::uint64_t v = slot.load(std::memory_order_acquire);
+    for (;;) {
+        const std::uint32_t front = static_cast<std::uint32_t>(v >> 32);
+        const std::uint32_t back = static_cast<std::uint32_t>(v);
+        if (front >= back) {
+            return false;
+        }
+        if (slot.compare_exchange_weak(v, PackRange(front + 1, back), std::memory_order_acq_rel)) {
+            chunk = static_cast<int>(front);
+            return true;
+        }
+    }
+}
+
+static bool PopBack(std::atomic<std::uint64_t>& slot, int& chunk)
+{
+    std::uint64_t v = slot.load(std::memory_order_acquire);
+    for (;;) {
+        const std::uint32_t front = static_cast<std::uint32_t>(v >> 32);
+        const std::uint32_t back = static_cast<std::uint32_t>(v);
+        if (front >= back) {
+            return false;
+        }
+        if (slot.compare_exchange_weak(v, PackRange(front, back - 1), std::memory_order_acq_rel)) {
+            chunk = static_cast<int>(back - 1);
+            return true;
+        }
+    }
+}
+
+StretchThreadPool& StretchThreadPool::Instance()
+{
+    // Intentionally leaked: joining threads from a static destructor can
+    // deadlock under the loader lock when the host unloads the plugin.
+    static StretchThreadPool* pool = new StretchThreadPool();
+    return *pool;
+}
+
+StretchThreadPool::StretchThreadPool()
+{
+    const int hw = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    const int num_workers = std::min(MAX_THREADS, hw) - 1;
+
+    workers_.reserve(num_workers);
+    for (int i = 0; i < num_workers; ++i) {
+        workers_.emplace_back([this, i]() { WorkerLoop(i + 1); });
+    }
+
+    int limit = num_workers + 1;
+    if (const char* env = std::getenv("STRETCH_MAX_THREADS")) {
+        const int requested = std::atoi(env);
+        if (requested > 0) {
+            limit = requested;
+        }
+    }
+    SetConcurrencyLimit(limit);
+}
+
+void StretchThreadPool::SetConcurrencyLimit(int limit)
+{
+    concurrency_limit_.store(std::clamp(limit, 1, WorkerCount() + 1), std::memory_order_relaxed);
+}
+
+int StretchThreadPool::ConcurrencyLimit() const
+{
+    return concurrency_limit_.load(std::memory_order_relaxed);
+}
+
+StretchThreadPool::FrameScope::FrameScope(StretchThreadPool& pool)
+    : pool_(pool)
+{
+    const int active = pool.active_frames_.fetch_add(1, std::memory_order_relaxed) + 1;
+    const int limit = pool.ConcurrencyLimit();
+    parallelism_ = std::max(1, (limit + active - 1) / active);
+}
+
+StretchThreadPool::FrameScope::~FrameScope()
+{
+    pool_.active_frames_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+int StretchThreadPool::CurrentThreadIndex()
+{
+    return t_thread_index;
+}
+
+void StretchThreadPool::WorkerLoop(int index)
+{
+    t_thread_index = index;
+    for (;;) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return !tickets_.empty(); });
+            job = std::move(tickets_.front());
+            tickets_.pop_front();
+        }
+
+        const int slot = job->next_slot.fetch_add(1, std::memory_order_relaxed);
+        if (slot < job->num_slots) {
+            RunParticipant(*job, slot);
+        }
+    }
+}
+
+void StretchThreadPool::RunParticipant(Job& job, int slot)
+{
+    for (;;) {
+        int chunk = -1;
+        if (!PopFront(job.slots[slot], chunk)) {
+            // Own run exhausted: steal from the other participants
+            for (int i = 1; i < job.num_slots; ++i) {
+                if (PopBack(job.slots[(slot + i) % job.num_slots], chunk)) {
+                    break;
+                }
+            }
+            if (chunk < 0) {
+                return;
+            }
+        }
+
+        const int chunk_begin = job.begin + chunk * job.grain;
+        const int chunk_end = std::min(chunk_begin + job.grain, job.end);
+        try {
+            (*job.func)(chunk_begin, chunk_end);
+        }
+        catch (...) {
+            job.failed.store(true, std::memory_order_release);
+        }
+
+        if (job.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(job.done_mutex);
+            job.done_cv.notify_all();
+        }
+    }
+}
+
+bool StretchThreadPool::ParallelFor(int begin, int end, int grain, const RangeFunc& func, int max_parallelism)
+{
+    if (end <= begin) {
+        return true;
+    }
+    grain = std::max(1, grain);
+
+    const int num_chunks = (end - begin + grain - 1) / grain;
+    const int limit = (max_parallelism > 0) ? std::min(max_parallelism, ConcurrencyLimit()) : ConcurrencyLimit();
+    const int num_slots = std::max(1, std::min({ num_chunks, limit, WorkerCount() + 1 }));
+
+    // Single participant: run inline without touching the pool
+    if (num_slots == 1) {
+        try {
+            func(begin, end);
+        }
+        catch (...) {
+            return false;
+        }
+        return true;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->func = &func;
+    job->begin = begin;
+    job->end = end;
+    job->grain = grain;
+    job->num_chunks = num_chunks;
+    job->num_slots = num_slots;
+    job->remaining.store(num_chunks, std::memory_order_relaxed);
+    job->slots.reset(new std::atomic<std::uint64_t>[num_slots]);
+
+    // Contiguous chunk runs per participant keep neighbouring rows on one core
+    const int chunks_per_slot = num_chunks / num_slots;
+    const int extra = num_chunks % num_slots;
+    int front = 0;
+    for (int s = 0; s < num_slots; ++s) {
+        const int count = chunks_per_slot + (s < extra ? 1 : 0);
+        job->slots[s].store(PackRange(static_cast<std::uint32_t>(front), static_cast<std::uint32_t>(front + count)),
+                            std::memory_order_relaxed);
+        front += count;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int s = 1; s < num_slots; ++s) {
+            tickets_.push_back(job);
+        }
+    }
+    if (num_slots == 2) {
+        cv_.notify_one();
+    } else {
+        cv_.notify_all();
+    }
+
+    RunParticipant(*job, 0);
+
+    {
+        std::unique_lock<std::mutex> lock(job->done_mutex);
+        job->done_cv.wait(lock, [&job]() { return job->remaining.load(std::memory_order_acquire) == 0; });
+    }
+
+    return !job->failed.load(std::memory_order_acquire);
+}
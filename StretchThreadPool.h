@@ -0,0 +1,98 @@
+#pragma once
+#ifndef STRETCH_THREAD_POOL_H
+#define STRETCH_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Process-wide worker pool
+// -----------------------------------------------------------------------------
+//
+// Created lazily on first use and shared by every render call, so frames no
+// longer pay for thread creation. A ParallelFor call splits its range into
+// chunks and hands each participant a contiguous run of them; a participant
+// that runs dry steals chunks from the back of another participant's run.
+// The calling thread always participates, so a call completes even when all
+// workers are busy with other frames (AE multi-frame rendering).
+//
+// Thread-safe: any number of threads may call ParallelFor concurrently.
+// Concurrent frames share the pool through FrameScope: each frame's calls
+// use its share of the concurrency limit, so N frames in flight do not put
+// N times the limit on the cores.
+
+class StretchThreadPool
+{
+public:
+    using RangeFunc = std::function<void(int begin, int end)>;
+
+    // Upper bound on threads per call (workers + caller)
+    static constexpr int MAX_THREADS = 16;
+
+    static StretchThreadPool& Instance();
+
+    // Runs func over [begin, end) in chunks of `grain` items.
+    // max_parallelism caps the threads (including the caller) working on this
+    // call; 0 uses the pool-wide concurrency limit.
+    // Returns false if any chunk threw.
+    bool ParallelFor(int begin, int end, int grain, const RangeFunc& func, int max_parallelism = 0);
+
+    // Pool-wide cap on threads per call, clamped to [1, WorkerCount() + 1].
+    // Defaults to the STRETCH_MAX_THREADS environment variable when set.
+    void SetConcurrencyLimit(int limit);
+    int ConcurrencyLimit() const;
+
+    int WorkerCount() const { return static_cast<int>(workers_.size()); }
+
+    // Marks one frame as rendering for its lifetime. Parallelism() is the
+    // frame's share of the concurrency limit, given the frames in flight
+    // when it started (rounded up, at least 1); pass it as max_parallelism
+    class FrameScope
+    {
+    public:
+        explicit FrameScope(StretchThreadPool& pool);
+        ~FrameScope();
+
+        int Parallelism() const { return parallelism_; }
+
+        FrameScope(const FrameScope&) = delete;
+        FrameScope& operator=(const FrameScope&) = delete;
+
+    private:
+        StretchThreadPool& pool_;
+        int parallelism_;
+    };
+
+    // Frames currently inside a FrameScope, process-wide
+    int ActiveFrames() const { return active_frames_.load(std::memory_order_relaxed); }
+
+    // 1..WorkerCount() on pool workers, 0 on any other thread. Stable for the
+    // thread's lifetime, so callers can index per-thread scratch with it
+    static int CurrentThreadIndex();
+
+    StretchThreadPool(const StretchThreadPool&) = delete;
+    StretchThreadPool& operator=(const StretchThreadPool&) = delete;
+
+private:
+    struct Job;
+
+    StretchThreadPool();
+
+    void WorkerLoop(int index);
+    static void RunParticipant(Job& job, int slot);
+
+    std::vector<std::thread> workers_;
+    std::deque<std::shared_ptr<Job>> tickets_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<int> concurrency_limit_{1};
+    std::atomic<int> active_frames_{0};
+};
+
+#endif // STRETCH_THREAD_POOL_H
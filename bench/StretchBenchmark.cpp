@@ -0,0 +1,809 @@
+// Micro and macro benchmarks for the StretchCore kernels. The differential
+// checks that gate changes to them are tests/StretchCheck.cpp.
+//
+//   StretchBenchmark --benchmark_filter=RenderFrame
+//   StretchBenchmark --benchmark_out=results.json --benchmark_out_format=json
+//
+// Throughput is reported as the "MP/s" counter (output megapixels per second).
+
+#include "StretchArena.h"
+#include "StretchCore.h"
+#include "StretchResultCache.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Synthetic input
+// -----------------------------------------------------------------------------
+
+// Gradient plate with a soft-edged transparent hole so the alpha-weighted
+// paths see opaque, partially transparent and fully transparent taps.
+template <typename Pixel>
+static std::vector<Pixel> MakeInput(int width, int height)
+{
+    using Traits = PixelTraits<Pixel>;
+    const float max_val = Traits::MAX_VAL;
+
+    std::vector<Pixel> pixels(static_cast<size_t>(width) * height);
+    const float cx = width * 0.5f;
+    const float cy = height * 0.5f;
+    const float radius = 0.25f * static_cast<float>(std::min(width, height));
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const float dx = static_cast<float>(x) - cx;
+            const float dy = static_cast<float>(y) - cy;
+            const float d = std::sqrt(dx * dx + dy * dy);
+            const float alpha = ClampScalar((d - radius) / 8.0f, 0.0f, 1.0f);
+
+            Pixel& p = pixels[static_cast<size_t>(y) * width + x];
+            p.alpha = Traits::FromFloat(alpha * max_val);
+            p.red = Traits::FromFloat(max_val * static_cast<float>(x) / width);
+            p.green = Traits::FromFloat(max_val * static_cast<float>(y) / height);
+            p.blue = Traits::FromFloat(max_val * static_cast<float>((x ^ y) & 0xff) / 255.0f);
+        }
+    }
+    return pixels;
+}
+
+static void SetThroughput(benchmark::State& state, double pixels_per_iteration)
+{
+    state.counters["MP/s"] = benchmark::Counter(pixels_per_iteration / 1.0e6,
+        benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// -----------------------------------------------------------------------------
+// Sampler micro benchmarks (one 1920x1080 frame of samples per iteration)
+// -----------------------------------------------------------------------------
+
+constexpr int SAMPLER_WIDTH = 1920;
+constexpr int SAMPLER_HEIGHT = 1080;
+constexpr float SAMPLER_OFFSET_X = 0.37f;
+constexpr float SAMPLER_OFFSET_Y = 0.61f;
+
+template <typename Pixel>
+static void BM_SampleBilinear(benchmark::State& state)
+{
+    const std::vector<Pixel> input = MakeInput<Pixel>(SAMPLER_WIDTH, SAMPLER_HEIGHT);
+    const auto* base = reinterpret_cast<const std::uint8_t*>(input.data());
+    const std::ptrdiff_t rowbytes = SAMPLER_WIDTH * static_cast<std::ptrdiff_t>(sizeof(Pixel));
+
+    std::vector<Pixel> row(SAMPLER_WIDTH);
+    for (auto _ : state) {
+        for (int y = 0; y < SAMPLER_HEIGHT; ++y) {
+            const float sy = static_cast<float>(y) + SAMPLER_OFFSET_Y;
+            for (int x = 0; x < SAMPLER_WIDTH; ++x) {
+                row[x] = SampleBilinear<Pixel>(base, rowbytes, static_cast<float>(x) + SAMPLER_OFFSET_X, sy,
+                    SAMPLER_WIDTH, SAMPLER_HEIGHT);
+            }
+            benchmark::DoNotOptimize(row.data());
+        }
+    }
+    SetThroughput(state, static_cast<double>(SAMPLER_WIDTH) * SAMPLER_HEIGHT);
+}
+
+template <typename Pixel>
+static void BM_FastRowSampler(benchmark::State& state)
+{
+    const std::vector<Pixel> input = MakeInput<Pixel>(SAMPLER_WIDTH, SAMPLER_HEIGHT);
+    const auto* base = reinterpret_cast<const std::uint8_t*>(input.data());
+    const std::ptrdiff_t rowbytes = SAMPLER_WIDTH * static_cast<std::ptrdiff_t>(sizeof(Pixel));
+
+    std::vector<Pixel> row(SAMPLER_WIDTH);
+    for (auto _ : state) {
+        for (int y = 0; y < SAMPLER_HEIGHT; ++y) {
+            FastRowSampler<Pixel> sampler;
+            sampler.Setup(base, rowbytes, SAMPLER_WIDTH, SAMPLER_HEIGHT, static_cast<float>(y) + SAMPLER_OFFSET_Y);
+            for (int x = 0; x < SAMPLER_WIDTH; ++x) {
+                row[x] = sampler.Sample(static_cast<float>(x) + SAMPLER_OFFSET_X);
+            }
+            benchmark::DoNotOptimize(row.data());
+        }
+    }
+    SetThroughput(state, static_cast<double>(SAMPLER_WIDTH) * SAMPLER_HEIGHT);
+}
+
+// Arg: StretchSimdLevel (levels the CPU lacks fall back to the detected one)
+template <typename Pixel>
+static void BM_SampleRowSpan(benchmark::State& state)
+{
+    const std::vector<Pixel> input = MakeInput<Pixel>(SAMPLER_WIDTH, SAMPLER_HEIGHT);
+    const auto* base = reinterpret_cast<const std::uint8_t*>(input.data());
+    const std::ptrdiff_t rowbytes = SAMPLER_WIDTH * static_cast<std::ptrdiff_t>(sizeof(Pixel));
+
+    const StretchSimdLevel previous = StretchGetSimdLevel();
+    StretchSetSimdLevel(static_cast<StretchSimdLevel>(state.range(0)));
+    state.SetLabel(StretchSimdLevelName(StretchGetSimdLevel()));
+
+    std::vector<Pixel> row(SAMPLER_WIDTH);
+    for (auto _ : state) {
+        for (int y = 0; y < SAMPLER_HEIGHT; ++y) {
+            FastRowSampler<Pixel> sampler;
+            sampler.Setup(base, rowbytes, SAMPLER_WIDTH, SAMPLER_HEIGHT, static_cast<float>(y) + SAMPLER_OFFSET_Y);
+            StretchSampleRowSpan(sampler, 0.0f, SAMPLER_OFFSET_X, SAMPLER_WIDTH, row.data());
+            benchmark::DoNotOptimize(row.data());
+        }
+    }
+    SetThroughput(state, static_cast<double>(SAMPLER_WIDTH) * SAMPLER_HEIGHT);
+    StretchSetSimdLevel(previous);
+}
+
+template <typename Pixel>
+static void BM_SampleNearestNeighbor(benchmark::State& state)
+{
+    const std::vector<Pixel> input = MakeInput<Pixel>(SAMPLER_WIDTH, SAMPLER_HEIGHT);
+    const auto* base = reinterpret_cast<const std::uint8_t*>(input.data());
+    const std::ptrdiff_t rowbytes = SAMPLER_WIDTH * static_cast<std::ptrdiff_t>(sizeof(Pixel));
+
+    std::vector<Pixel> row(SAMPLER_WIDTH);
+    for (auto _ : state) {
+        for (int y = 0; y < SAMPLER_HEIGHT; ++y) {
+            const float sy = static_cast<float>(y) + SAMPLER_OFFSET_Y;
+            for (int x = 0; x < SAMPLER_WIDTH; ++x) {
+                row[x] = SampleNearestNeighbor<Pixel>(base, rowbytes, static_cast<float>(x) + SAMPLER_OFFSET_X, sy,
+                    SAMPLER_WIDTH, SAMPLER_HEIGHT);
+            }
+            benchmark::DoNotOptimize(row.data());
+        }
+    }
+    SetThroughput(state, static_cast<double>(SAMPLER_WIDTH) * SAMPLER_HEIGHT);
+}
+
+BENCHMARK_TEMPLATE(BM_SampleBilinear, StretchPixel8);
+BENCHMARK_TEMPLATE(BM_SampleBilinear, StretchPixel16);
+BENCHMARK_TEMPLATE(BM_SampleBilinear, StretchPixelF);
+BENCHMARK_TEMPLATE(BM_FastRowSampler, StretchPixel8);
+BENCHMARK_TEMPLATE(BM_FastRowSampler, StretchPixel16);
+BENCHMARK_TEMPLATE(BM_FastRowSampler, StretchPixelF);
+BENCHMARK_TEMPLATE(BM_SampleRowSpan, StretchPixel8)->ArgName("simd")->Arg(STRETCH_SIMD_SCALAR)->Arg(StretchDetectSimdLevel());
+BENCHMARK_TEMPLATE(BM_SampleRowSpan, StretchPixel16)->ArgName("simd")->Arg(STRETCH_SIMD_SCALAR)->Arg(StretchDetectSimdLevel());
+BENCHMARK_TEMPLATE(BM_SampleRowSpan, StretchPixelF)->ArgName("simd")->Arg(STRETCH_SIMD_SCALAR)->Arg(StretchDetectSimdLevel());
+BENCHMARK_TEMPLATE(BM_SampleNearestNeighbor, StretchPixel8);
+BENCHMARK_TEMPLATE(BM_SampleNearestNeighbor, StretchPixel16);
+BENCHMARK_TEMPLATE(BM_SampleNearestNeighbor, StretchPixelF);
+
+// -----------------------------------------------------------------------------
+// Whole-frame renders
+// -----------------------------------------------------------------------------
+
+// Shift Amount used for whole-frame renders (full-resolution pixels)
+constexpr int FRAME_SHIFT = 200;
+
+// Shift Amount for gap-dominated renders, where the stretched gap covers most
+// of the output
+constexpr int GAP_FRAME_SHIFT = 5000;
+
+// Args: input width, input height, angle (degrees), direction, shift amount,
+// StretchSchedule, premultiplied mode (0/1), StretchQuality
+template <typename Pixel>
+static void BM_RenderFrame(benchmark::State& state)
+{
+    const int input_width = static_cast<int>(state.range(0));
+    const int input_height = static_cast<int>(state.range(1));
+
+    StretchParams params;
+    params.shift_amount = static_cast<float>(state.range(4));
+    params.angle_deg = static_cast<float>(state.range(2));
+    params.direction = static_cast<int>(state.range(3));
+    params.quality = static_cast<int>(state.range(7));
+    params.anchor_x = static_cast<float>(input_width / 2);
+    params.anchor_y = static_cast<float>(input_height / 2);
+
+    const StretchGeometry geometry = StretchComputeGeometry(params);
+    const StretchExpansion expansion = StretchComputeExpansion(geometry, input_width, input_height);
+    const int width = input_width + expansion.left + expansion.right;
+    const int height = input_height + expansion.top + expansion.bottom;
+
+    const std::vector<Pixel> input = MakeInput<Pixel>(input_width, input_height);
+    std::vector<Pixel> output(static_cast<size_t>(width) * height);
+
+    const StretchRenderContext<Pixel> ctx = StretchMakeContext<Pixel>(geometry,
+        input.data(), input_width * static_cast<std::ptrdiff_t>(sizeof(Pixel)), input_width, input_height,
+        output.data(), width * static_cast<std::ptrdiff_t>(sizeof(Pixel)), width, height,
+        static_cast<float>(expansion.left), static_cast<float>(expansion.top));
+
+    StretchRenderOptions options;
+    options.schedule = static_cast<StretchSchedule>(state.range(5));
+    options.premultiplied = state.range(6) != 0;
+
+    for (auto _ : state) {
+        if (!StretchRenderFrame(ctx, geometry.direction, options)) {
+            state.SkipWithError("render failed");
+            break;
+        }
+        benchmark::ClobberMemory();
+    }
+    SetThroughput(state, static_cast<double>(width) * height);
+}
+
+// Resolutions from 720p up to the host's 16384 single-pass limit (larger
+// frames render in strips, see BM_StripFrame). The widest case is a strip
+// sized so the expanded output stays under that limit and the 32-bit
+// buffers stay within a few GB.
+static const int FRAME_SIZES[][2] = {
+    {1280, 720},
+    {1920, 1080},
+    {3840, 2160},
+    {7680, 4320},
+    {16000, 2048},
+};
+
+// Axis-aligned, diagonal and an arbitrary angle
+static const int FRAME_ANGLES[] = {0, 45, 90, 37};
+
+static void FrameArgs(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"w", "h", "angle", "dir", "shift", "sched", "premul", "quality"});
+    for (const auto& size : FRAME_SIZES) {
+        for (int angle : FRAME_ANGLES) {
+            for (int direction = STRETCH_DIRECTION_BOTH; direction <= STRETCH_DIRECTION_BACKWARD; ++direction) {
+                b->Args({size[0], size[1], angle, direction, FRAME_SHIFT, STRETCH_SCHEDULE_TILES, 0, STRETCH_QUALITY_BILINEAR});
+            }
+        }
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+// 720p input stretched by GAP_FRAME_SHIFT in both directions
+static void GapFrameArgs(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"w", "h", "angle", "dir", "shift", "sched", "premul", "quality"});
+    for (int angle : FRAME_ANGLES) {
+        b->Args({1280, 720, angle, STRETCH_DIRECTION_BOTH, GAP_FRAME_SHIFT, STRETCH_SCHEDULE_TILES, 0, STRETCH_QUALITY_BILINEAR});
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+// Tiles vs full-width row bands at steep and arbitrary angles, on frames whose
+// rows outgrow L2
+static void ScheduleFrameArgs(benchmark::internal::Benchmark* b)
+{
+    static const int sizes[][2] = { {3840, 2160}, {16000, 2048} };
+    b->ArgNames({"w", "h", "angle", "dir", "shift", "sched", "premul", "quality"});
+    for (const auto& size : sizes) {
+        for (int angle : {45, 37, 80}) {
+            for (int schedule : {STRETCH_SCHEDULE_ROWS, STRETCH_SCHEDULE_TILES}) {
+                b->Args({size[0], size[1], angle, STRETCH_DIRECTION_BOTH, FRAME_SHIFT, schedule, 0, STRETCH_QUALITY_BILINEAR});
+            }
+        }
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixel8)->Apply(FrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixel16)->Apply(FrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixelF)->Apply(FrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixel8)->Apply(GapFrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixel16)->Apply(GapFrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixelF)->Apply(GapFrameArgs);
+// Straight-alpha vs premultiplied sampling at arbitrary angles
+static void PremultipliedFrameArgs(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"w", "h", "angle", "dir", "shift", "sched", "premul", "quality"});
+    for (int angle : {37, 45}) {
+        for (int premultiplied : {0, 1}) {
+            b->Args({1920, 1080, angle, STRETCH_DIRECTION_BOTH, FRAME_SHIFT, STRETCH_SCHEDULE_TILES, premultiplied, STRETCH_QUALITY_BILINEAR});
+            b->Args({1280, 720, angle, STRETCH_DIRECTION_BOTH, GAP_FRAME_SHIFT, STRETCH_SCHEDULE_TILES, premultiplied, STRETCH_QUALITY_BILINEAR});
+        }
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixel8)->Apply(ScheduleFrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixelF)->Apply(ScheduleFrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixel8)->Apply(PremultipliedFrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixel16)->Apply(PremultipliedFrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixelF)->Apply(PremultipliedFrameArgs);
+
+// Axis-aligned cuts at an odd shift: each side moves by a half pixel, so the
+// frame samples through the separable 1D spans instead of copying
+static void SeparableFrameArgs(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"w", "h", "angle", "dir", "shift", "sched", "premul", "quality"});
+    for (int angle : {0, 90}) {
+        b->Args({1920, 1080, angle, STRETCH_DIRECTION_BOTH, FRAME_SHIFT + 1, STRETCH_SCHEDULE_TILES, 0, STRETCH_QUALITY_BILINEAR});
+        b->Args({3840, 2160, angle, STRETCH_DIRECTION_BOTH, FRAME_SHIFT + 1, STRETCH_SCHEDULE_TILES, 0, STRETCH_QUALITY_BILINEAR});
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixel8)->Apply(SeparableFrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixel16)->Apply(SeparableFrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixelF)->Apply(SeparableFrameArgs);
+
+// Each sampling quality at an arbitrary angle and an odd quarter turn
+static void QualityFrameArgs(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"w", "h", "angle", "dir", "shift", "sched", "premul", "quality"});
+    for (int angle : {37, 90}) {
+        for (int quality = STRETCH_QUALITY_NEAREST; quality <= STRETCH_QUALITY_LANCZOS3; ++quality) {
+            b->Args({1920, 1080, angle, STRETCH_DIRECTION_BOTH, FRAME_SHIFT + 1, STRETCH_SCHEDULE_TILES, 0, quality});
+        }
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixel8)->Apply(QualityFrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixel16)->Apply(QualityFrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrame, StretchPixelF)->Apply(QualityFrameArgs);
+
+// Preview of a UHD comp at 1/4 resolution, at full and at draft (host quality
+// Low) quality. Args: angle (degrees), draft (0/1)
+template <typename Pixel>
+static void BM_PreviewFrame(benchmark::State& state)
+{
+    constexpr int DOWNSAMPLE = 4;
+    const int input_width = 3840 / DOWNSAMPLE;
+    const int input_height = 2160 / DOWNSAMPLE;
+
+    StretchParams params;
+    params.shift_amount = static_cast<float>(FRAME_SHIFT);
+    params.angle_deg = static_cast<float>(state.range(0));
+    params.draft = state.range(1) != 0;
+    params.downsample_x = static_cast<float>(DOWNSAMPLE);
+    params.downsample_y = static_cast<float>(DOWNSAMPLE);
+    params.anchor_x = static_cast<float>(input_width / 2);
+    params.anchor_y = static_cast<float>(input_height / 2);
+
+    const StretchGeometry geometry = StretchComputeGeometry(params);
+    const StretchExpansion expansion = StretchComputeExpansion(geometry, input_width, input_height);
+    const int width = input_width + expansion.left + expansion.right;
+    const int height = input_height + expansion.top + expansion.bottom;
+
+    const std::vector<Pixel> input = MakeInput<Pixel>(input_width, input_height);
+    std::vector<Pixel> output(static_cast<size_t>(width) * height);
+
+    const StretchRenderContext<Pixel> ctx = StretchMakeContext<Pixel>(geometry,
+        input.data(), input_width * static_cast<std::ptrdiff_t>(sizeof(Pixel)), input_width, input_height,
+        output.data(), width * static_cast<std::ptrdiff_t>(sizeof(Pixel)), width, height,
+        static_cast<float>(expansion.left), static_cast<float>(expansion.top));
+
+    StretchRenderOptions options;
+    for (auto _ : state) {
+        if (!StretchRenderFrame(ctx, geometry.direction, options)) {
+            state.SkipWithError("render failed");
+            break;
+        }
+        benchmark::ClobberMemory();
+    }
+    SetThroughput(state, static_cast<double>(width) * height);
+}
+
+static void PreviewFrameArgs(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"angle", "draft"});
+    for (int angle : {0, 37}) {
+        for (int draft : {0, 1}) {
+            b->Args({angle, draft});
+        }
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_PreviewFrame, StretchPixel8)->Apply(PreviewFrameArgs);
+BENCHMARK_TEMPLATE(BM_PreviewFrame, StretchPixel16)->Apply(PreviewFrameArgs);
+BENCHMARK_TEMPLATE(BM_PreviewFrame, StretchPixelF)->Apply(PreviewFrameArgs);
+
+// Cost of render statistics (StretchRenderOptions::stats) on a 1080p frame;
+// the counters report the last render's time split and feather share.
+// Args: angle (degrees), stats (0/1)
+template <typename Pixel>
+static void BM_RenderStats(benchmark::State& state)
+{
+    const int input_width = 1920;
+    const int input_height = 1080;
+
+    StretchParams params;
+    params.shift_amount = static_cast<float>(FRAME_SHIFT);
+    params.angle_deg = static_cast<float>(state.range(0));
+    params.anchor_x = static_cast<float>(input_width / 2);
+    params.anchor_y = static_cast<float>(input_height / 2);
+
+    const StretchGeometry geometry = StretchComputeGeometry(params);
+    const StretchExpansion expansion = StretchComputeExpansion(geometry, input_width, input_height);
+    const int width = input_width + expansion.left + expansion.right;
+    const int height = input_height + expansion.top + expansion.bottom;
+
+    const std::vector<Pixel> input = MakeInput<Pixel>(input_width, input_height);
+    std::vector<Pixel> output(static_cast<size_t>(width) * height);
+
+    const StretchRenderContext<Pixel> ctx = StretchMakeContext<Pixel>(geometry,
+        input.data(), input_width * static_cast<std::ptrdiff_t>(sizeof(Pixel)), input_width, input_height,
+        output.data(), width * static_cast<std::ptrdiff_t>(sizeof(Pixel)), width, height,
+        static_cast<float>(expansion.left), static_cast<float>(expansion.top));
+
+    StretchRenderStats stats;
+    StretchRenderOptions options;
+    options.stats = state.range(1) ? &stats : nullptr;
+    for (auto _ : state) {
+        if (!StretchRenderFrame(ctx, geometry.direction, options)) {
+            state.SkipWithError("render failed");
+            break;
+        }
+        benchmark::ClobberMemory();
+    }
+    SetThroughput(state, static_cast<double>(width) * height);
+    if (options.stats) {
+        state.counters["setup_us"] = static_cast<double>(stats.setup_ns) / 1000.0;
+        state.counters["join_us"] = static_cast<double>(stats.join_ns) / 1000.0;
+        state.counters["tasks"] = stats.tasks;
+        state.counters["feather_%"] = 100.0 * static_cast<double>(stats.pixels[STRETCH_SPAN_FEATHER])
+            / (static_cast<double>(width) * height);
+    }
+}
+
+static void RenderStatsArgs(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"angle", "stats"});
+    for (int angle : {0, 37}) {
+        for (int stats : {0, 1}) {
+            b->Args({angle, stats});
+        }
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_RenderStats, StretchPixel8)->Apply(RenderStatsArgs);
+
+// -----------------------------------------------------------------------------
+// Incremental re-render
+// -----------------------------------------------------------------------------
+
+// Shift Amount step between the cached and the rendered frame
+constexpr int SCRUB_STEP = 10;
+
+// One step of scrubbing Shift Amount: renders at FRAME_SHIFT + SCRUB_STEP
+// reusing a finished frame at FRAME_SHIFT. Compare with BM_RenderFrame.
+// Args: input width, input height, angle (degrees), direction
+template <typename Pixel>
+static void BM_RenderFrameIncremental(benchmark::State& state)
+{
+    const int input_width = static_cast<int>(state.range(0));
+    const int input_height = static_cast<int>(state.range(1));
+    const std::vector<Pixel> input = MakeInput<Pixel>(input_width, input_height);
+    const std::ptrdiff_t input_rowbytes = input_width * static_cast<std::ptrdiff_t>(sizeof(Pixel));
+
+    StretchParams params;
+    params.angle_deg = static_cast<float>(state.range(2));
+    params.direction = static_cast<int>(state.range(3));
+    params.anchor_x = static_cast<float>(input_width / 2);
+    params.anchor_y = static_cast<float>(input_height / 2);
+
+    // Previous frame
+    params.shift_amount = static_cast<float>(FRAME_SHIFT);
+    const StretchGeometry previous = StretchComputeGeometry(params);
+    const StretchExpansion previous_expansion = StretchComputeExpansion(previous, input_width, input_height);
+    const int previous_width = input_width + previous_expansion.left + previous_expansion.right;
+    const int previous_height = input_height + previous_expansion.top + previous_expansion.bottom;
+    std::vector<Pixel> previous_output(static_cast<size_t>(previous_width) * previous_height);
+    const StretchRenderContext<Pixel> previous_ctx = StretchMakeContext<Pixel>(previous,
+        input.data(), input_rowbytes, input_width, input_height,
+        previous_output.data(), previous_width * static_cast<std::ptrdiff_t>(sizeof(Pixel)), previous_width, previous_height,
+        static_cast<float>(previous_expansion.left), static_cast<float>(previous_expansion.top));
+    StretchRenderFrame(previous_ctx, previous.direction);
+
+    StretchReuseFrame reuse;
+    reuse.geometry = previous;
+    reuse.data = previous_output.data();
+    reuse.rowbytes = previous_width * static_cast<std::ptrdiff_t>(sizeof(Pixel));
+    reuse.width = previous_width;
+    reuse.height = previous_height;
+    reuse.output_origin_x = static_cast<float>(previous_expansion.left);
+    reuse.output_origin_y = static_cast<float>(previous_expansion.top);
+
+    params.shift_amount = static_cast<float>(FRAME_SHIFT + SCRUB_STEP);
+    const StretchGeometry geometry = StretchComputeGeometry(params);
+    const StretchExpansion expansion = StretchComputeExpansion(geometry, input_width, input_height);
+    const int width = input_width + expansion.left + expansion.right;
+    const int height = input_height + expansion.top + expansion.bottom;
+    std::vector<Pixel> output(static_cast<size_t>(width) * height);
+    const StretchRenderContext<Pixel> ctx = StretchMakeContext<Pixel>(geometry,
+        input.data(), input_rowbytes, input_width, input_height,
+        output.data(), width * static_cast<std::ptrdiff_t>(sizeof(Pixel)), width, height,
+        static_cast<float>(expansion.left), static_cast<float>(expansion.top));
+
+    StretchRenderOptions options;
+    options.reuse = &reuse;
+
+    for (auto _ : state) {
+        if (!StretchRenderFrame(ctx, geometry.direction, options)) {
+            state.SkipWithError("render failed");
+            break;
+        }
+        benchmark::ClobberMemory();
+    }
+    SetThroughput(state, static_cast<double>(width) * height);
+}
+
+static void IncrementalFrameArgs(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"w", "h", "angle", "dir"});
+    for (const auto& size : { std::make_pair(3840, 2160), std::make_pair(7680, 4320) }) {
+        for (int angle : {0, 37}) {
+            for (int direction = STRETCH_DIRECTION_BOTH; direction <= STRETCH_DIRECTION_BACKWARD; ++direction) {
+                b->Args({size.first, size.second, angle, direction});
+            }
+        }
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_RenderFrameIncremental, StretchPixel8)->Apply(IncrementalFrameArgs);
+BENCHMARK_TEMPLATE(BM_RenderFrameIncremental, StretchPixelF)->Apply(IncrementalFrameArgs);
+
+// -----------------------------------------------------------------------------
+// Result cache
+// -----------------------------------------------------------------------------
+
+// A held frame served from StretchResultCache: input checksum plus output
+// copy. Compare with BM_RenderFrame at the same args.
+// Args: input width, input height, angle (degrees)
+template <typename Pixel>
+static void BM_ResultCacheHit(benchmark::State& state)
+{
+    const int input_width = static_cast<int>(state.range(0));
+    const int input_height = static_cast<int>(state.range(1));
+
+    StretchParams params;
+    params.shift_amount = static_cast<float>(FRAME_SHIFT);
+    params.angle_deg = static_cast<float>(state.range(2));
+    params.anchor_x = static_cast<float>(input_width / 2);
+    params.anchor_y = static_cast<float>(input_height / 2);
+
+    const StretchGeometry geometry = StretchComputeGeometry(params);
+    const StretchExpansion expansion = StretchComputeExpansion(geometry, input_width, input_height);
+    const int width = input_width + expansion.left + expansion.right;
+    const int height = input_height + expansion.top + expansion.bottom;
+    const std::ptrdiff_t input_rowbytes = input_width * static_cast<std::ptrdiff_t>(sizeof(Pixel));
+    const std::ptrdiff_t output_rowbytes = width * static_cast<std::ptrdiff_t>(sizeof(Pixel));
+
+    const std::vector<Pixel> input = MakeInput<Pixel>(input_width, input_height);
+    std::vector<Pixel> output(static_cast<size_t>(width) * height);
+
+    StretchResultCache cache;
+    const auto make_key = [&]() {
+        return StretchMakeCacheKey(geometry, input.data(), input_rowbytes, input_width, input_height,
+                                   width, height, static_cast<float>(expansion.left), static_cast<float>(expansion.top),
+                                   static_cast<int>(sizeof(Pixel)));
+    };
+    cache.Store(make_key(), output.data(), output_rowbytes);
+
+    for (auto _ : state) {
+        if (!cache.Fetch(make_key(), output.data(), output_rowbytes)) {
+            state.SkipWithError("cache miss");
+            break;
+        }
+        benchmark::ClobberMemory();
+    }
+    SetThroughput(state, static_cast<double>(width) * height);
+}
+
+static void ResultCacheArgs(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"w", "h", "angle"});
+    b->Args({1920, 1080, 37});
+    b->Args({3840, 2160, 37});
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_ResultCacheHit, StretchPixel8)->Apply(ResultCacheArgs);
+BENCHMARK_TEMPLATE(BM_ResultCacheHit, StretchPixelF)->Apply(ResultCacheArgs);
+
+// -----------------------------------------------------------------------------
+// Multi-frame rendering
+// -----------------------------------------------------------------------------
+
+// One frame of a concurrent batch: its own shift and output buffer
+template <typename Pixel>
+struct ConcurrentFrame
+{
+    StretchGeometry geometry;
+    StretchExpansion expansion;
+    int width = 0;
+    int height = 0;
+    std::vector<Pixel> output;
+    std::vector<Pixel> reference;
+
+    bool Render(const std::vector<Pixel>& input, int input_width, int input_height)
+    {
+        const StretchRenderContext<Pixel> ctx = StretchMakeContext<Pixel>(geometry,
+            input.data(), input_width * static_cast<std::ptrdiff_t>(sizeof(Pixel)), input_width, input_height,
+            output.data(), width * static_cast<std::ptrdiff_t>(sizeof(Pixel)), width, height,
+            static_cast<float>(expansion.left), static_cast<float>(expansion.top));
+        return StretchRenderFrame(ctx, geometry.direction, StretchRenderOptions());
+    }
+};
+
+// Stress test for host multi-frame rendering: `frames` threads render
+// neighbouring frames of one shot at once, as AE MFR does, sharing the
+// worker pool. Each output must equal the same frame rendered alone, so a
+// race or scheduling-dependent result fails the run. StretchCheck Concurrent
+// (run by ctest) checks the same through the result cache and arena pool.
+// Args: frames in flight, angle (degrees)
+template <typename Pixel>
+static void BM_ConcurrentFrames(benchmark::State& state)
+{
+    const int frames = static_cast<int>(state.range(0));
+    const int input_width = 1920;
+    const int input_height = 1080;
+    const std::vector<Pixel> input = MakeInput<Pixel>(input_width, input_height);
+
+    std::vector<ConcurrentFrame<Pixel>> batch(static_cast<size_t>(frames));
+    double pixels = 0.0;
+    for (int i = 0; i < frames; ++i) {
+        StretchParams params;
+        params.shift_amount = static_cast<float>(FRAME_SHIFT + i * SCRUB_STEP);
+        params.angle_deg = static_cast<float>(state.range(1));
+        params.anchor_x = static_cast<float>(input_width / 2);
+        params.anchor_y = static_cast<float>(input_height / 2);
+
+        ConcurrentFrame<Pixel>& frame = batch[static_cast<size_t>(i)];
+        frame.geometry = StretchComputeGeometry(params);
+        frame.expansion = StretchComputeExpansion(frame.geometry, input_width, input_height);
+        frame.width = input_width + frame.expansion.left + frame.expansion.right;
+        frame.height = input_height + frame.expansion.top + frame.expansion.bottom;
+        frame.output.resize(static_cast<size_t>(frame.width) * frame.height);
+        if (!frame.Render(input, input_width, input_height)) {
+            state.SkipWithError("render failed");
+            return;
+        }
+        frame.reference = frame.output;
+        pixels += static_cast<double>(frame.width) * frame.height;
+    }
+
+    for (auto _ : state) {
+        std::atomic<bool> failed{false};
+        std::vector<std::thread> threads;
+        threads.reserve(static_cast<size_t>(frames));
+        for (ConcurrentFrame<Pixel>& frame : batch) {
+            threads.emplace_back([&frame, &input, &failed]() {
+                if (!frame.Render(input, input_width, input_height)) {
+                    failed.store(true, std::memory_order_relaxed);
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        if (failed.load(std::memory_order_relaxed)) {
+            state.SkipWithError("render failed");
+            break;
+        }
+
+        bool deterministic = true;
+        for (const ConcurrentFrame<Pixel>& frame : batch) {
+            deterministic = deterministic
+                && std::memcmp(frame.output.data(), frame.reference.data(), frame.output.size() * sizeof(Pixel)) == 0;
+        }
+        if (!deterministic) {
+            state.SkipWithError("concurrent render differs from a solo render");
+            break;
+        }
+    }
+    SetThroughput(state, pixels);
+}
+
+static void ConcurrentFrameArgs(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"frames", "angle"});
+    for (int frames : {1, 2, 4, 8}) {
+        for (int angle : {0, 37}) {
+            b->Args({frames, angle});
+        }
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_ConcurrentFrames, StretchPixel8)->Apply(ConcurrentFrameArgs);
+BENCHMARK_TEMPLATE(BM_ConcurrentFrames, StretchPixelF)->Apply(ConcurrentFrameArgs);
+
+
+// -----------------------------------------------------------------------------
+// Strip streaming
+// -----------------------------------------------------------------------------
+
+// A 12K-class plate with a shift that expands it past the single-pass limit
+constexpr int STRIP_INPUT_WIDTH = 12288;
+constexpr int STRIP_INPUT_HEIGHT = 1024;
+constexpr int STRIP_SHIFT = 6000;
+
+// Renders the frame as strips within a budget into one output buffer, as the
+// host path does, and fails if the result differs from a whole-frame render.
+// Reports the strip count and the scratch arena's peak size. Strips render in
+// straight alpha, so the reference does too.
+// Args: strip budget in MB (0 renders the whole frame), angle (degrees)
+template <typename Pixel>
+static void BM_StripFrame(benchmark::State& state)
+{
+    const std::size_t budget = static_cast<std::size_t>(state.range(0)) << 20;
+
+    StretchParams params;
+    params.shift_amount = static_cast<float>(STRIP_SHIFT);
+    params.angle_deg = static_cast<float>(state.range(1));
+    params.anchor_x = static_cast<float>(STRIP_INPUT_WIDTH / 2);
+    params.anchor_y = static_cast<float>(STRIP_INPUT_HEIGHT / 2);
+
+    const StretchGeometry geometry = StretchComputeGeometry(params);
+    const StretchExpansion expansion = StretchComputeExpansion(geometry, STRIP_INPUT_WIDTH, STRIP_INPUT_HEIGHT);
+    const int width = STRIP_INPUT_WIDTH + expansion.left + expansion.right;
+    const int height = STRIP_INPUT_HEIGHT + expansion.top + expansion.bottom;
+    const std::ptrdiff_t rowbytes = width * static_cast<std::ptrdiff_t>(sizeof(Pixel));
+
+    const std::vector<Pixel> input = MakeInput<Pixel>(STRIP_INPUT_WIDTH, STRIP_INPUT_HEIGHT);
+    std::vector<Pixel> output(static_cast<size_t>(width) * height);
+    std::vector<Pixel> reference(output.size());
+
+    StretchRenderOptions options;
+    options.premultiplied = false;
+
+    const auto make_context = [&](std::vector<Pixel>& target) {
+        return StretchMakeContext<Pixel>(geometry,
+            input.data(), STRIP_INPUT_WIDTH * static_cast<std::ptrdiff_t>(sizeof(Pixel)), STRIP_INPUT_WIDTH, STRIP_INPUT_HEIGHT,
+            target.data(), rowbytes, width, height,
+            static_cast<float>(expansion.left), static_cast<float>(expansion.top));
+    };
+    if (!StretchRenderFrame(make_context(reference), geometry.direction, options)) {
+        state.SkipWithError("render failed");
+        return;
+    }
+
+    // Only the timed renders count towards the scratch peak
+    StretchFrameArena arena;
+    options.arena = &arena;
+
+    const std::vector<StretchStrip> strips = (budget > 0)
+        ? StretchPlanStrips(geometry, STRIP_INPUT_WIDTH, STRIP_INPUT_HEIGHT, width, height,
+              static_cast<float>(expansion.left), static_cast<float>(expansion.top), static_cast<int>(sizeof(Pixel)),
+              static_cast<int>(sizeof(Pixel)), budget)
+        : std::vector<StretchStrip>();
+    StretchStripSink sink;
+    sink.begin = [&output, rowbytes](const StretchStrip& strip, void*& data, std::ptrdiff_t& strip_rowbytes) {
+        data = reinterpret_cast<std::uint8_t*>(output.data()) + strip.start_y * rowbytes;
+        strip_rowbytes = rowbytes;
+        return true;
+    };
+    sink.end = [](const StretchStrip&) { return true; };
+
+    const StretchRenderContext<Pixel> ctx = make_context(output);
+    std::size_t scratch = 0;
+    for (auto _ : state) {
+        const bool ok = strips.empty()
+            ? StretchRenderFrame(ctx, geometry.direction, options)
+            : StretchRenderStrips(ctx, geometry.direction, strips, sink, options);
+        if (!ok) {
+            state.SkipWithError("render failed");
+            break;
+        }
+        scratch = arena.BytesReserved();
+        benchmark::ClobberMemory();
+    }
+    if (std::memcmp(output.data(), reference.data(), output.size() * sizeof(Pixel)) != 0) {
+        state.SkipWithError("strips differ from the whole-frame render");
+    }
+    SetThroughput(state, static_cast<double>(width) * height);
+    state.counters["strips"] = static_cast<double>(strips.empty() ? 1 : strips.size());
+    state.counters["scratch_MB"] = static_cast<double>(scratch) / (1 << 20);
+}
+
+static void StripFrameArgs(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"strip_mb", "angle"});
+    for (int budget : {0, 256, 64}) {
+        b->Args({budget, 80});
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(BM_StripFrame, StretchPixel8)->Apply(StripFrameArgs);
+BENCHMARK_TEMPLATE(BM_StripFrame, StretchPixelF)->Apply(StripFrameArgs);
+
+BENCHMARK_MAIN();
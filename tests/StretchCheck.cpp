@@ -0,0 +1,882 @@
+// Differential checks for the StretchCore render paths, run by ctest.
+//
+//   StretchCheck                 every check
+//   StretchCheck Reference Simd  checks whose name starts with Reference or Simd
+//
+// Not timings: each check renders a fixed matrix of small synthetic frames
+// (every direction; axis-aligned, diagonal and arbitrary angles; shifts that
+// are whole, fractional, narrower than the feather or wider than the input;
+// centered and off-frame anchors) through one render path at each depth and
+// quality, and fails when it strays from its reference by more than the
+// check's tolerance. A faster kernel joins these checks before it replaces
+// the path it speeds up.
+//
+// Errors are measured on premultiplied channels in 8-bit steps (1/255 of full
+// scale), so color under zero alpha, which never shows, does not count. Each
+// run prints its largest error; a failure names the worst case, and the exit
+// status is non-zero if any run failed.
+
+#include "StretchArena.h"
+#include "StretchCore.h"
+#include "StretchResultCache.h"
+#include "StretchThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Case matrix
+// -----------------------------------------------------------------------------
+
+constexpr int CHECK_INPUT_WIDTH = 61;
+constexpr int CHECK_INPUT_HEIGHT = 43;
+
+// Noise and gradients with the alpha cases the samplers special-case: an
+// opaque area, a hard alpha edge, a soft alpha ramp, and a fully transparent
+// block, which carries color unless colored_transparency is false. Channels
+// are whole 8-bit steps, so every depth renders the same picture
+template <typename Pixel>
+static std::vector<Pixel> MakeCheckInput(bool colored_transparency = true)
+{
+    using Traits = PixelTraits<Pixel>;
+    const float step = Traits::MAX_VAL / 255.0f;
+
+    std::vector<Pixel> pixels(static_cast<size_t>(CHECK_INPUT_WIDTH) * CHECK_INPUT_HEIGHT);
+    for (int y = 0; y < CHECK_INPUT_HEIGHT; ++y) {
+        for (int x = 0; x < CHECK_INPUT_WIDTH; ++x) {
+            const unsigned noise = (static_cast<unsigned>(x) * 73u + static_cast<unsigned>(y) * 151u) ^ static_cast<unsigned>(x * y);
+            unsigned alpha = 255;
+            if (x >= 40) {
+                alpha = (y < 20) ? 0 : 255;                             // hard edge
+            }
+            else if (y >= 30) {
+                alpha = static_cast<unsigned>(x * 255 / 39);            // soft ramp
+            }
+            const bool hole = x >= 20 && x < 30 && y >= 8 && y < 18;    // transparent
+            const unsigned hole_color = colored_transparency ? 255 : 0;
+
+            Pixel& p = pixels[static_cast<size_t>(y) * CHECK_INPUT_WIDTH + x];
+            p.alpha = Traits::FromFloat(static_cast<float>(hole ? 0 : alpha) * step);
+            p.red = Traits::FromFloat(static_cast<float>(hole ? hole_color : noise & 0xff) * step);
+            p.green = Traits::FromFloat(static_cast<float>(hole ? hole_color : x * 255 / (CHECK_INPUT_WIDTH - 1)) * step);
+            p.blue = Traits::FromFloat(static_cast<float>(hole ? hole_color : (noise >> 3) & 0xff) * step);
+        }
+    }
+    return pixels;
+}
+
+static const std::vector<StretchParams>& CheckCases()
+{
+    static const std::vector<StretchParams> cases = []() {
+        const float anchors[][2] = {
+            { CHECK_INPUT_WIDTH * 0.5f, CHECK_INPUT_HEIGHT * 0.5f },
+            { -17.5f, CHECK_INPUT_HEIGHT + 23.0f }                       // off-frame
+        };
+        std::vector<StretchParams> list;
+        for (int direction = STRETCH_DIRECTION_BOTH; direction <= STRETCH_DIRECTION_BACKWARD; ++direction) {
+            for (float angle : { 0.0f, 90.0f, 45.0f, 37.0f, 243.0f }) {
+                for (float shift : { 0.75f, 8.0f, 13.5f, 150.0f }) {
+                    for (const auto& anchor : anchors) {
+                        StretchParams params;
+                        params.direction = direction;
+                        params.angle_deg = angle;
+                        params.shift_amount = shift;
+                        params.anchor_x = anchor[0];
+                        params.anchor_y = anchor[1];
+                        list.push_back(params);
+                    }
+                }
+            }
+        }
+        return list;
+    }();
+    return cases;
+}
+
+// One case rendered into its expanded output
+template <typename Pixel>
+struct CheckFrame
+{
+    StretchGeometry geometry;
+    StretchExpansion expansion;
+    int width = 0;
+    int height = 0;
+    std::vector<Pixel> output;
+
+    CheckFrame(const StretchParams& params)
+        : geometry(StretchComputeGeometry(params)),
+          expansion(StretchComputeExpansion(geometry, CHECK_INPUT_WIDTH, CHECK_INPUT_HEIGHT)),
+          width(CHECK_INPUT_WIDTH + expansion.left + expansion.right),
+          height(CHECK_INPUT_HEIGHT + expansion.top + expansion.bottom),
+          output(static_cast<size_t>(width) * height)
+    {
+    }
+
+    StretchRenderContext<Pixel> Context(const std::vector<Pixel>& input)
+    {
+        return StretchMakeContext<Pixel>(geometry,
+            input.data(), CHECK_INPUT_WIDTH * static_cast<std::ptrdiff_t>(sizeof(Pixel)), CHECK_INPUT_WIDTH, CHECK_INPUT_HEIGHT,
+            output.data(), width * static_cast<std::ptrdiff_t>(sizeof(Pixel)), width, height,
+            static_cast<float>(expansion.left), static_cast<float>(expansion.top));
+    }
+
+    bool Render(const std::vector<Pixel>& input, const StretchRenderOptions& options = StretchRenderOptions())
+    {
+        return StretchRenderFrame(Context(input), geometry.direction, options);
+    }
+};
+
+// Largest premultiplied channel difference, in 8-bit steps
+template <typename PixelA, typename PixelB>
+static float PixelError(const PixelA& a, const PixelB& b)
+{
+    using TraitsA = PixelTraits<PixelA>;
+    using TraitsB = PixelTraits<PixelB>;
+    const float alpha_a = TraitsA::ToFloat(a.alpha) / TraitsA::MAX_VAL;
+    const float alpha_b = TraitsB::ToFloat(b.alpha) / TraitsB::MAX_VAL;
+    const auto premultiplied = [](float channel, float max_val, float alpha) { return channel / max_val * alpha; };
+
+    float error = std::fabs(alpha_a - alpha_b);
+    error = (std::max)(error, std::fabs(premultiplied(TraitsA::ToFloat(a.red), TraitsA::MAX_VAL, alpha_a)
+        - premultiplied(TraitsB::ToFloat(b.red), TraitsB::MAX_VAL, alpha_b)));
+    error = (std::max)(error, std::fabs(premultiplied(TraitsA::ToFloat(a.green), TraitsA::MAX_VAL, alpha_a)
+        - premultiplied(TraitsB::ToFloat(b.green), TraitsB::MAX_VAL, alpha_b)));
+    error = (std::max)(error, std::fabs(premultiplied(TraitsA::ToFloat(a.blue), TraitsA::MAX_VAL, alpha_a)
+        - premultiplied(TraitsB::ToFloat(b.blue), TraitsB::MAX_VAL, alpha_b)));
+    return error * 255.0f;
+}
+
+template <typename PixelA, typename PixelB>
+static float FrameError(const std::vector<PixelA>& a, const std::vector<PixelB>& b)
+{
+    float error = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i) {
+        error = (std::max)(error, PixelError(a[i], b[i]));
+    }
+    return error;
+}
+
+// One 8-bit step per channel. Premultiplied, a step in both alpha and color
+// can reach two
+constexpr float CHECK_LSB_TOLERANCE = 2.0f;
+
+// One run of a check: the quality and draft flag it renders at, and what it
+// found
+struct CheckRun
+{
+    int quality = STRETCH_QUALITY_BILINEAR;
+    bool draft = false;
+    float max_error = 0.0f;
+    size_t cases = CheckCases().size();  // checks off the case matrix set their own
+    std::string label;     // printed with the result
+    std::string failure;   // empty if the run passed
+};
+
+// Runs check(params, input) on every case at the run's quality and draft
+// flag. check returns the case's largest error, or a negative value when a
+// render failed. Fails the run past tolerance (8-bit steps)
+template <typename Pixel, typename Check>
+static void RunCheck(CheckRun& run, float tolerance, const std::vector<Pixel>& input, Check check)
+{
+    float worst = 0.0f;
+    StretchParams worst_case;
+    for (StretchParams params : CheckCases()) {
+        params.quality = run.quality;
+        params.draft = run.draft;
+        const float error = check(params, input);
+        if (error < 0.0f) {
+            run.failure = "render failed";
+            return;
+        }
+        if (error > worst) {
+            worst = error;
+            worst_case = params;
+        }
+    }
+    run.max_error = worst;
+    if (worst > tolerance) {
+        char message[160];
+        std::snprintf(message, sizeof(message), "error %.3g > %.3g at dir=%d angle=%g shift=%g anchor=%g,%g",
+            worst, tolerance, worst_case.direction, worst_case.angle_deg, worst_case.shift_amount,
+            worst_case.anchor_x, worst_case.anchor_y);
+        run.failure = message;
+    }
+}
+
+// Storage for a gap line cache attached to a context
+template <typename Pixel>
+struct LineCacheStorage
+{
+    std::vector<Pixel> samples;
+    std::vector<float> knots;
+    std::vector<int> cells;
+    std::vector<std::uint8_t> direct;
+    std::vector<Pixel> grid;
+    std::vector<std::uint8_t> plain;
+};
+
+// The gap line cache StretchRenderFrame would build for ctx, filled as
+// documented on StretchLineCache and attached to ctx. The axis-aligned
+// kernels and Nearest take none
+template <typename Pixel>
+static void AttachLineCache(StretchRenderContext<Pixel>& ctx, LineCacheStorage<Pixel>& cache)
+{
+    float t0 = 0.0f;
+    const int size = (StretchIsAxisAligned(ctx) || !StretchUsesLineCache(ctx.quality)) ? 0 : StretchLineCacheRange(ctx, t0);
+    if (size < 2) {
+        return;
+    }
+    cache.knots.resize(static_cast<size_t>(StretchLineCacheKnotCapacity(ctx, size)));
+    cache.cells.resize(static_cast<size_t>(size));
+    const int count = StretchLineCacheKnots(ctx, t0, size, cache.knots.data(), cache.cells.data());
+    cache.samples.resize(static_cast<size_t>(count));
+    for (int k = 0; k < count; ++k) {
+        const float t = t0 + cache.knots[static_cast<size_t>(k)] / static_cast<float>(LINE_CACHE_OVERSAMPLE);
+        cache.samples[static_cast<size_t>(k)] = SampleBorderDirect(ctx, t);
+    }
+    cache.direct.assign(static_cast<size_t>(count), 0);
+    for (int k = 0; k + 1 < count; ++k) {
+        const size_t i = static_cast<size_t>(k);
+        const float scale = 1.0f / static_cast<float>(LINE_CACHE_OVERSAMPLE);
+        const auto transparent = [](const Pixel& p) { return PixelTraits<Pixel>::ToFloat(p.alpha) <= ALPHA_THRESHOLD; };
+        bool sampled = StretchLineCacheDirect(cache.samples[i], cache.samples[i + 1]);
+        if (sampled && transparent(cache.samples[i]) && transparent(cache.samples[i + 1])) {
+            sampled = !StretchLineCacheClear(ctx, t0 + cache.knots[i] * scale, t0 + cache.knots[i + 1] * scale);
+        }
+        cache.direct[i] = sampled ? 1 : 0;
+    }
+    cache.grid.resize(static_cast<size_t>(size));
+    cache.plain.resize(static_cast<size_t>(size));
+    StretchLineCacheFillGrid(cache.samples.data(), cache.cells.data(), cache.direct.data(), size, cache.grid.data(),
+        cache.plain.data());
+    ctx.line_cache = {cache.samples.data(), cache.knots.data(), cache.cells.data(), cache.direct.data(), cache.grid.data(),
+        cache.plain.data(), size, t0};
+}
+
+// Every output pixel of ctx's frame against StretchReferencePixel
+template <typename Pixel>
+static float ReferenceError(const CheckFrame<Pixel>& frame, const StretchRenderContext<Pixel>& ctx)
+{
+    float error = 0.0f;
+    for (int y = 0; y < frame.height; ++y) {
+        for (int x = 0; x < frame.width; ++x) {
+            const Pixel reference = frame.geometry.active
+                ? StretchReferencePixel(ctx, frame.geometry.direction, x, y)
+                : ReadInputPixel(ctx, x - frame.expansion.left, y - frame.expansion.top);
+            error = (std::max)(error, PixelError(frame.output[static_cast<size_t>(y) * frame.width + x], reference));
+        }
+    }
+    return error;
+}
+
+// -----------------------------------------------------------------------------
+// Checks
+// -----------------------------------------------------------------------------
+
+// Kernels vs StretchReferencePixel, both reading the gap from the same line
+// cache: any difference is the kernels' own (fixed-point blends, separable
+// spans, staging)
+template <typename Pixel>
+static void CheckReference(CheckRun& run)
+{
+    RunCheck<Pixel>(run, CHECK_LSB_TOLERANCE, MakeCheckInput<Pixel>(), [](const StretchParams& params, const std::vector<Pixel>& input) {
+        CheckFrame<Pixel> frame(params);
+        StretchRenderContext<Pixel> ctx = frame.Context(input);
+        LineCacheStorage<Pixel> cache;
+        AttachLineCache(ctx, cache);
+        if (!StretchRenderFrame(ctx, frame.geometry.direction)) {
+            return -1.0f;
+        }
+        return ReferenceError(frame, ctx);
+    });
+}
+
+// The line cache vs sampling the anchor line at every gap pixel, on the
+// reference. Nearest and drafts sample directly (StretchUsesLineCache), so
+// they must match exactly. Without the knots at pixel crossings and the
+// direct segments around clamps, this high-contrast input drifts by up to
+// about 9 steps at 45 degrees
+template <typename Pixel>
+static void CheckLineCache(CheckRun& run)
+{
+    RunCheck<Pixel>(run, CHECK_LSB_TOLERANCE, MakeCheckInput<Pixel>(), [](const StretchParams& params, const std::vector<Pixel>& input) {
+        CheckFrame<Pixel> frame(params);
+        StretchRenderContext<Pixel> ctx = frame.Context(input);
+        LineCacheStorage<Pixel> cache;
+        AttachLineCache(ctx, cache);
+        for (int y = 0; y < frame.height; ++y) {
+            for (int x = 0; x < frame.width; ++x) {
+                frame.output[static_cast<size_t>(y) * frame.width + x] = frame.geometry.active
+                    ? StretchReferencePixel(ctx, frame.geometry.direction, x, y)
+                    : ReadInputPixel(ctx, x - frame.expansion.left, y - frame.expansion.top);
+            }
+        }
+        return ReferenceError(frame, frame.Context(input));
+    });
+}
+
+// SIMD kernels vs the scalar ones: bit-identical
+template <typename Pixel>
+static void CheckSimd(CheckRun& run)
+{
+    const StretchSimdLevel previous = StretchGetSimdLevel();
+    RunCheck<Pixel>(run, 0.0f, MakeCheckInput<Pixel>(), [](const StretchParams& params, const std::vector<Pixel>& input) {
+        CheckFrame<Pixel> scalar(params);
+        CheckFrame<Pixel> simd(params);
+        StretchSetSimdLevel(STRETCH_SIMD_SCALAR);
+        const bool scalar_ok = scalar.Render(input);
+        StretchSetSimdLevel(StretchDetectSimdLevel());
+        const bool simd_ok = simd.Render(input);
+        if (!scalar_ok || !simd_ok) {
+            return -1.0f;
+        }
+        return std::memcmp(scalar.output.data(), simd.output.data(), scalar.output.size() * sizeof(Pixel)) == 0
+            ? 0.0f
+            : (std::max)(FrameError(scalar.output, simd.output), 1.0e-3f);
+    });
+    StretchSetSimdLevel(previous);
+    run.label = StretchSimdLevelName(StretchDetectSimdLevel());
+}
+
+// Row bands and strips vs tiles: bit-identical
+template <typename Pixel>
+static void CheckSchedule(CheckRun& run)
+{
+    RunCheck<Pixel>(run, 0.0f, MakeCheckInput<Pixel>(), [](const StretchParams& params, const std::vector<Pixel>& input) {
+        CheckFrame<Pixel> tiles(params);
+        CheckFrame<Pixel> rows(params);
+        CheckFrame<Pixel> strips(params);
+        StretchRenderOptions row_options;
+        row_options.schedule = STRETCH_SCHEDULE_ROWS;
+        if (!tiles.Render(input) || !rows.Render(input, row_options)) {
+            return -1.0f;
+        }
+
+        // Strips of a tile or two, so most frames take several
+        const std::vector<StretchStrip> plan = StretchPlanStrips(strips.geometry, CHECK_INPUT_WIDTH, CHECK_INPUT_HEIGHT,
+            strips.width, strips.height, static_cast<float>(strips.expansion.left), static_cast<float>(strips.expansion.top),
+            static_cast<int>(sizeof(Pixel)), static_cast<int>(sizeof(Pixel)), 16 * 1024);
+        StretchStripSink sink;
+        sink.begin = [&strips](const StretchStrip& strip, void*& data, std::ptrdiff_t& rowbytes) {
+            data = strips.output.data() + static_cast<size_t>(strip.start_y) * strips.width;
+            rowbytes = strips.width * static_cast<std::ptrdiff_t>(sizeof(Pixel));
+            return true;
+        };
+        sink.end = [](const StretchStrip&) { return true; };
+        if (strips.geometry.active
+            ? !StretchRenderStrips(strips.Context(input), strips.geometry.direction, plan, sink)
+            : !strips.Render(input)) {
+            return -1.0f;
+        }
+
+        const size_t bytes = tiles.output.size() * sizeof(Pixel);
+        const bool same = std::memcmp(tiles.output.data(), rows.output.data(), bytes) == 0
+            && std::memcmp(tiles.output.data(), strips.output.data(), bytes) == 0;
+        return same ? 0.0f : (std::max)((std::max)(FrameError(tiles.output, rows.output), FrameError(tiles.output, strips.output)), 1.0e-3f);
+    });
+}
+
+// Premultiplied mode vs straight alpha (bilinear only). Straight alpha lets
+// the color of fully transparent pixels into feather blends and the
+// premultiplied copy does not, so the input's transparent block is colorless
+template <typename Pixel>
+static void CheckPremultiplied(CheckRun& run)
+{
+    RunCheck<Pixel>(run, CHECK_LSB_TOLERANCE, MakeCheckInput<Pixel>(false), [](const StretchParams& params, const std::vector<Pixel>& input) {
+        CheckFrame<Pixel> straight(params);
+        CheckFrame<Pixel> premultiplied(params);
+        StretchRenderOptions options;
+        options.premultiplied = true;
+        if (!straight.Render(input) || !premultiplied.Render(input, options)) {
+            return -1.0f;
+        }
+        return FrameError(straight.output, premultiplied.output);
+    });
+}
+
+// Incremental re-render over the frame one Shift Amount step back vs a full
+// render
+template <typename Pixel>
+static void CheckReuse(CheckRun& run)
+{
+    RunCheck<Pixel>(run, CHECK_LSB_TOLERANCE, MakeCheckInput<Pixel>(), [](const StretchParams& params, const std::vector<Pixel>& input) {
+        StretchParams previous_params = params;
+        previous_params.shift_amount += 3.0f;
+        CheckFrame<Pixel> previous(previous_params);
+        CheckFrame<Pixel> full(params);
+        CheckFrame<Pixel> reused(params);
+        if (!previous.Render(input) || !full.Render(input)) {
+            return -1.0f;
+        }
+
+        StretchReuseFrame reuse;
+        reuse.geometry = previous.geometry;
+        reuse.data = previous.output.data();
+        reuse.rowbytes = previous.width * static_cast<std::ptrdiff_t>(sizeof(Pixel));
+        reuse.width = previous.width;
+        reuse.height = previous.height;
+        reuse.output_origin_x = static_cast<float>(previous.expansion.left);
+        reuse.output_origin_y = static_cast<float>(previous.expansion.top);
+        StretchRenderOptions options;
+        options.reuse = &reuse;
+        if (!reused.Render(input, options)) {
+            return -1.0f;
+        }
+        return FrameError(full.output, reused.output);
+    });
+}
+
+// 8/16 bpc (fixed-point blends, line cache at that depth) vs 32 bpc float.
+// Float keeps the overshoot of the bicubic and Lanczos3 lobes, which the
+// integer depths clamp at every sample, before the line cache and feather
+// blends, so those qualities differ by more than rounding
+template <typename Pixel>
+static void CheckDepth(CheckRun& run)
+{
+    const std::vector<StretchPixelF> float_input = MakeCheckInput<StretchPixelF>();
+    const float tolerance = (run.quality <= STRETCH_QUALITY_BILINEAR) ? CHECK_LSB_TOLERANCE : 8.0f;
+    RunCheck<Pixel>(run, tolerance, MakeCheckInput<Pixel>(), [&float_input](const StretchParams& params, const std::vector<Pixel>& input) {
+        CheckFrame<Pixel> frame(params);
+        CheckFrame<StretchPixelF> reference(params);
+        if (!frame.Render(input) || !reference.Render(float_input)) {
+            return -1.0f;
+        }
+        for (StretchPixelF& p : reference.output) {
+            p.alpha = ClampScalar(p.alpha, 0.0f, 1.0f);
+            p.red = ClampScalar(p.red, 0.0f, 1.0f);
+            p.green = ClampScalar(p.green, 0.0f, 1.0f);
+            p.blue = ClampScalar(p.blue, 0.0f, 1.0f);
+        }
+        return FrameError(frame.output, reference.output);
+    });
+}
+
+// Tap sets CheckBlend draws for each blend
+constexpr int CHECK_BLEND_TAP_SETS = 100000;
+
+// The float blend the bilinear samplers fall back to: taps weighted by
+// weight times alpha, color normalized by the total
+template <typename Pixel>
+static Pixel FloatBlend(const Pixel* taps, const float* weights, int count)
+{
+    using Traits = PixelTraits<Pixel>;
+    float total_weight = 0.0f;
+    float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+    for (int i = 0; i < count; ++i) {
+        const float alpha = Traits::ToFloat(taps[i].alpha);
+        if (alpha > ALPHA_THRESHOLD) {
+            const float weight = weights[i] * alpha;
+            total_weight += weight;
+            r += Traits::ToFloat(taps[i].red) * weight;
+            g += Traits::ToFloat(taps[i].green) * weight;
+            b += Traits::ToFloat(taps[i].blue) * weight;
+            a += alpha * weights[i];
+        }
+    }
+    Pixel result;
+    std::memset(&result, 0, sizeof(Pixel));
+    if (total_weight > ALPHA_THRESHOLD) {
+        const float inv_weight = 1.0f / total_weight;
+        result.red = Traits::FromFloat(r * inv_weight);
+        result.green = Traits::FromFloat(g * inv_weight);
+        result.blue = Traits::FromFloat(b * inv_weight);
+        result.alpha = Traits::FromFloat(a);
+    }
+    return result;
+}
+
+// Largest straight-alpha channel difference in LSB of the depth; alpha must
+// match exactly
+template <typename Pixel>
+static float BlendError(const Pixel& fixed, const Pixel& reference)
+{
+    if (fixed.alpha != reference.alpha) {
+        return static_cast<float>(PixelTraits<Pixel>::MAX_VAL);
+    }
+    const auto diff = [](int a, int b) { return static_cast<float>(std::abs(a - b)); };
+    return (std::max)({ diff(fixed.red, reference.red), diff(fixed.green, reference.green), diff(fixed.blue, reference.blue) });
+}
+
+// BlendUniformAlphaFixed and BlendUniformAlphaFixed1D vs the float blend of
+// the same taps, within 1 LSB on straight-alpha channels, over random tap
+// sets sharing one alpha (zero and opaque included) and random weights (zero
+// and near one included). A tap set with one alpha off must be refused
+template <typename Pixel>
+static void CheckBlend(CheckRun& run)
+{
+    using Traits = PixelTraits<Pixel>;
+    using ChannelType = typename Traits::ChannelType;
+    const std::uint32_t max_val = static_cast<std::uint32_t>(Traits::MAX_VAL);
+
+    std::mt19937 random(20240611u);
+    const auto channel = [&]() { return static_cast<ChannelType>(random() % (max_val + 1)); };
+    const auto weight = [&]() {
+        const std::uint32_t pick = random() % 16;
+        return (pick == 0) ? 0.0f : (pick == 1) ? 0.5f : (pick == 2) ? 1.0f - 1.0f / 65536.0f
+            : static_cast<float>(random() >> 8) / static_cast<float>(1u << 24);
+    };
+
+    float worst = 0.0f;
+    char worst_case[160] = "";
+    for (int set = 0; set < CHECK_BLEND_TAP_SETS; ++set) {
+        const std::uint32_t pick = random() % 8;
+        const ChannelType alpha = (pick == 0) ? 0 : (pick == 1) ? static_cast<ChannelType>(max_val)
+            : static_cast<ChannelType>(1 + random() % max_val);
+        Pixel taps[4];
+        for (Pixel& tap : taps) {
+            tap.alpha = alpha;
+            tap.red = channel();
+            tap.green = channel();
+            tap.blue = channel();
+        }
+        const float fx = weight();
+        const float fy = weight();
+
+        Pixel fixed2d;
+        Pixel fixed1d;
+        if (!BlendUniformAlphaFixed(taps[0], taps[1], taps[2], taps[3], fx, fy, fixed2d)
+            || !BlendUniformAlphaFixed1D(taps[0], taps[1], fx, fixed1d)) {
+            run.failure = "uniform-alpha taps refused";
+            return;
+        }
+        const float weights2d[4] = { (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy };
+        const float weights1d[2] = { 1.0f - fx, fx };
+        const float error2d = BlendError(fixed2d, FloatBlend(taps, weights2d, 4));
+        const float error1d = BlendError(fixed1d, FloatBlend(taps, weights1d, 2));
+        if ((std::max)(error2d, error1d) > worst) {
+            worst = (std::max)(error2d, error1d);
+            std::snprintf(worst_case, sizeof(worst_case), "%s tap set %d: alpha=%d fx=%.9g fy=%.9g",
+                error2d >= error1d ? "2D" : "1D", set, static_cast<int>(alpha), fx, fy);
+        }
+
+        Pixel refused;
+        taps[1 + set % 3].alpha = static_cast<ChannelType>(alpha ^ 1);
+        if (BlendUniformAlphaFixed(taps[0], taps[1], taps[2], taps[3], fx, fy, refused)
+            || (set % 3 == 0 && BlendUniformAlphaFixed1D(taps[0], taps[1], fx, refused))) {
+            run.failure = "taps with different alpha blended as uniform";
+            return;
+        }
+    }
+
+    run.max_error = worst;
+    run.cases = CHECK_BLEND_TAP_SETS;
+    run.label = "LSB, straight alpha";
+    if (worst > 1.0f) {
+        char message[224];
+        std::snprintf(message, sizeof(message), "error %.3g LSB > 1 at %s", worst, worst_case);
+        run.failure = message;
+    }
+}
+
+// Frames CheckConcurrent renders at once, and the result cache's entry budget
+// there: under the case count, so frames are evicted while other threads
+// fetch or reuse them
+constexpr int CHECK_CONCURRENT_FRAMES = 8;
+constexpr std::size_t CHECK_CONCURRENT_CACHE_ENTRIES = 32;
+
+// Multi-frame rendering: CHECK_CONCURRENT_FRAMES threads each render the
+// whole case matrix at once, as render clones of two effect instances. They
+// share what concurrent host renders share: the worker pool (each frame
+// takes its FrameScope share), a pool of frame arenas, and one result
+// cache, which they fetch from, reseed re-renders
+// from (FindReusable) and store to through StretchRenderCached, while each
+// thread attaches and detaches its instance. Every output is compared with
+// the case rendered alone; hits are copies and re-renders differ by rounding
+// (see CheckReuse). Build with -DSTRETCH_SANITIZE=thread to have
+// ThreadSanitizer check the shared state
+template <typename Pixel>
+static void CheckConcurrent(CheckRun& run)
+{
+    const std::vector<Pixel> input = MakeCheckInput<Pixel>();
+    std::vector<StretchParams> cases = CheckCases();
+    std::vector<CheckFrame<Pixel>> solo;
+    solo.reserve(cases.size());
+    for (StretchParams& params : cases) {
+        params.quality = run.quality;
+        params.draft = run.draft;
+        solo.emplace_back(params);
+        if (!solo.back().Render(input)) {
+            run.failure = "render failed";
+            return;
+        }
+    }
+
+    StretchResultCache cache(STRETCH_RESULT_CACHE_BYTES, CHECK_CONCURRENT_CACHE_ENTRIES);
+    StretchFrameArenaPool arenas;
+    const std::uint64_t owners[2] = { 1, 2 };
+    for (std::uint64_t owner : owners) {
+        cache.Attach(owner, 0, 0);
+    }
+
+    // Per thread: largest error and its case, or a failed render
+    struct Result
+    {
+        float error = 0.0f;
+        size_t worst = 0;
+        bool failed = false;
+    };
+    std::vector<Result> results(CHECK_CONCURRENT_FRAMES);
+    std::atomic<int> ready{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < CHECK_CONCURRENT_FRAMES; ++t) {
+        threads.emplace_back([&, t]() {
+            Result& result = results[static_cast<size_t>(t)];
+            const std::uint64_t owner = owners[(t / 2) % 2];
+            cache.Attach(owner, 0, 0);
+            ready.fetch_add(1);
+            while (ready.load() < CHECK_CONCURRENT_FRAMES) {
+                std::this_thread::yield();
+            }
+
+            // Odd threads walk the matrix backwards. Threads of one instance
+            // and direction start a case apart, so they fetch each other's
+            // frames and reuse them at neighbouring shifts
+            const size_t count = cases.size();
+            for (size_t n = 0; n < count && !result.failed; ++n) {
+                const size_t step = (n + static_cast<size_t>(t / 4)) % count;
+                const size_t i = (t % 2) ? count - 1 - step : step;
+                CheckFrame<Pixel> frame(cases[i]);
+                const StretchCacheKey key = StretchMakeCacheKey(frame.geometry,
+                    input.data(), CHECK_INPUT_WIDTH * static_cast<std::ptrdiff_t>(sizeof(Pixel)), CHECK_INPUT_WIDTH, CHECK_INPUT_HEIGHT,
+                    frame.width, frame.height, static_cast<float>(frame.expansion.left), static_cast<float>(frame.expansion.top),
+                    static_cast<int>(sizeof(Pixel)), owner);
+                StretchFrameArenaPool::Lease lease(arenas, StretchMallocArenaAllocator());
+                StretchRenderOptions options;
+                options.arena = &lease.Arena();
+                if (!StretchRenderCached(&cache, key, frame.Context(input), frame.geometry.direction, options)) {
+                    result.failed = true;
+                    break;
+                }
+                const float error = FrameError(solo[i].output, frame.output);
+                if (error > result.error) {
+                    result.error = error;
+                    result.worst = i;
+                }
+            }
+            cache.Detach(owner);
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (std::uint64_t owner : owners) {
+        cache.Detach(owner);
+    }
+
+    const StretchResultCache::Stats stats = cache.GetStats();
+    char message[160];
+    std::snprintf(message, sizeof(message), "hits=%llu misses=%llu",
+        static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.misses));
+    run.label = message;
+
+    size_t worst = 0;
+    for (const Result& result : results) {
+        if (result.failed) {
+            run.failure = "render failed";
+            return;
+        }
+        if (result.error > run.max_error) {
+            run.max_error = result.error;
+            worst = result.worst;
+        }
+    }
+    if (run.max_error > CHECK_LSB_TOLERANCE) {
+        const StretchParams& params = cases[worst];
+        std::snprintf(message, sizeof(message), "error %.3g > %.3g at dir=%d angle=%g shift=%g anchor=%g,%g",
+            run.max_error, CHECK_LSB_TOLERANCE, params.direction, params.angle_deg, params.shift_amount,
+            params.anchor_x, params.anchor_y);
+        run.failure = message;
+    }
+    else if (stats.entries != 0 || StretchThreadPool::Instance().ActiveFrames() != 0) {
+        run.failure = "frames left behind: cache entries or frames in flight after every render finished";
+    }
+}
+
+// Output of the whole case matrix, hashed (FNV-1a over the pixels of every
+// case) and compared with the hash recorded when the output last changed on
+// purpose. Catches any change, including ones within the tolerances above.
+// A commit that re-records hashes names the runs that changed and why, so
+// the history shows every intended change.
+// sin/cos and float contraction differ between compilers and math
+// libraries, so hashes are only recorded for Linux x86-64 builds; other
+// platforms report theirs as the label
+struct GoldenHash
+{
+    int depth;  // bits per channel
+    int quality;
+    int draft;
+    std::uint64_t hash;
+};
+
+static const GoldenHash GOLDEN_HASHES[] = {
+    { 8, 1, 0, 0xbd0698c5e3393498ull },
+    { 8, 2, 0, 0xd611e1ddaa16d26full },
+    { 8, 3, 0, 0xc766f81469c2e456ull },
+    { 8, 4, 0, 0x406ab413640f3a7bull },
+    { 8, 2, 1, 0xd14a47f3fd775010ull },
+    { 16, 1, 0, 0x90c20b873a70b077ull },
+    { 16, 2, 0, 0xed3c92d880890d9dull },
+    { 16, 3, 0, 0x1fcbe882aa7aa995ull },
+    { 16, 4, 0, 0xb7e782de407cfb80ull },
+    { 16, 2, 1, 0x487a172b252653f8ull },
+    { 32, 1, 0, 0x6d87cd65548a470dull },
+    { 32, 2, 0, 0x2ddba52d38c0843aull },
+    { 32, 3, 0, 0x2fd1e9a0bd83ad1cull },
+    { 32, 4, 0, 0x550d355488955f3full },
+    { 32, 2, 1, 0x4155de3051226dc1ull },
+};
+
+template <typename Pixel>
+static void CheckGolden(CheckRun& run)
+{
+    const std::vector<Pixel> input = MakeCheckInput<Pixel>();
+    const int depth = static_cast<int>(sizeof(Pixel)) * 2;
+
+    std::uint64_t hash = 14695981039346656037ull;
+    for (StretchParams params : CheckCases()) {
+        params.quality = run.quality;
+        params.draft = run.draft;
+        CheckFrame<Pixel> frame(params);
+        if (!frame.Render(input)) {
+            run.failure = "render failed";
+            return;
+        }
+        const auto* bytes = reinterpret_cast<const std::uint8_t*>(frame.output.data());
+        for (size_t i = 0; i < frame.output.size() * sizeof(Pixel); ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+
+    char message[128];
+    std::snprintf(message, sizeof(message), "%016llx", static_cast<unsigned long long>(hash));
+    run.label = message;
+#if defined(__linux__) && (defined(__x86_64__) || defined(_M_X64))
+    for (const GoldenHash& golden : GOLDEN_HASHES) {
+        if (golden.depth == depth && golden.quality == run.quality && golden.draft == (run.draft ? 1 : 0) && golden.hash != hash) {
+            std::snprintf(message, sizeof(message), "output hash %016llx, recorded %016llx",
+                static_cast<unsigned long long>(hash), static_cast<unsigned long long>(golden.hash));
+            run.failure = message;
+            return;
+        }
+    }
+#else
+    (void)depth;
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// Runner
+// -----------------------------------------------------------------------------
+
+// Quality/draft pairs a check runs at
+enum CheckArgs
+{
+    CHECK_ALL_QUALITIES,      // each quality, plus Bilinear draft
+    CHECK_BILINEAR            // Bilinear only
+};
+
+struct CheckEntry
+{
+    const char* name;
+    void (*run)(CheckRun&);
+    CheckArgs args;
+};
+
+static const CheckEntry CHECKS[] = {
+    { "Reference<StretchPixel8>", CheckReference<StretchPixel8>, CHECK_ALL_QUALITIES },
+    { "Reference<StretchPixel16>", CheckReference<StretchPixel16>, CHECK_ALL_QUALITIES },
+    { "Reference<StretchPixelF>", CheckReference<StretchPixelF>, CHECK_ALL_QUALITIES },
+    { "LineCache<StretchPixel8>", CheckLineCache<StretchPixel8>, CHECK_ALL_QUALITIES },
+    { "LineCache<StretchPixel16>", CheckLineCache<StretchPixel16>, CHECK_ALL_QUALITIES },
+    { "LineCache<StretchPixelF>", CheckLineCache<StretchPixelF>, CHECK_ALL_QUALITIES },
+    { "Simd<StretchPixel8>", CheckSimd<StretchPixel8>, CHECK_ALL_QUALITIES },
+    { "Simd<StretchPixel16>", CheckSimd<StretchPixel16>, CHECK_ALL_QUALITIES },
+    { "Simd<StretchPixelF>", CheckSimd<StretchPixelF>, CHECK_ALL_QUALITIES },
+    { "Schedule<StretchPixel8>", CheckSchedule<StretchPixel8>, CHECK_ALL_QUALITIES },
+    { "Schedule<StretchPixel16>", CheckSchedule<StretchPixel16>, CHECK_ALL_QUALITIES },
+    { "Schedule<StretchPixelF>", CheckSchedule<StretchPixelF>, CHECK_ALL_QUALITIES },
+    { "Premultiplied<StretchPixel8>", CheckPremultiplied<StretchPixel8>, CHECK_BILINEAR },
+    { "Premultiplied<StretchPixel16>", CheckPremultiplied<StretchPixel16>, CHECK_BILINEAR },
+    { "Premultiplied<StretchPixelF>", CheckPremultiplied<StretchPixelF>, CHECK_BILINEAR },
+    { "Reuse<StretchPixel8>", CheckReuse<StretchPixel8>, CHECK_ALL_QUALITIES },
+    { "Reuse<StretchPixel16>", CheckReuse<StretchPixel16>, CHECK_ALL_QUALITIES },
+    { "Reuse<StretchPixelF>", CheckReuse<StretchPixelF>, CHECK_ALL_QUALITIES },
+    { "Depth<StretchPixel8>", CheckDepth<StretchPixel8>, CHECK_ALL_QUALITIES },
+    { "Depth<StretchPixel16>", CheckDepth<StretchPixel16>, CHECK_ALL_QUALITIES },
+    { "Blend<StretchPixel8>", CheckBlend<StretchPixel8>, CHECK_BILINEAR },
+    { "Blend<StretchPixel16>", CheckBlend<StretchPixel16>, CHECK_BILINEAR },
+    { "Concurrent<StretchPixel8>", CheckConcurrent<StretchPixel8>, CHECK_BILINEAR },
+    { "Concurrent<StretchPixel16>", CheckConcurrent<StretchPixel16>, CHECK_BILINEAR },
+    { "Concurrent<StretchPixelF>", CheckConcurrent<StretchPixelF>, CHECK_BILINEAR },
+    { "Golden<StretchPixel8>", CheckGolden<StretchPixel8>, CHECK_ALL_QUALITIES },
+    { "Golden<StretchPixel16>", CheckGolden<StretchPixel16>, CHECK_ALL_QUALITIES },
+    { "Golden<StretchPixelF>", CheckGolden<StretchPixelF>, CHECK_ALL_QUALITIES },
+};
+
+static std::vector<CheckRun> MakeRuns(CheckArgs args)
+{
+    std::vector<CheckRun> runs;
+    const auto add = [&runs](int quality, bool draft) {
+        CheckRun run;
+        run.quality = quality;
+        run.draft = draft;
+        runs.push_back(run);
+    };
+    switch (args) {
+    case CHECK_BILINEAR:
+        add(STRETCH_QUALITY_BILINEAR, false);
+        break;
+    default:
+        for (int quality = STRETCH_QUALITY_NEAREST; quality <= STRETCH_QUALITY_LANCZOS3; ++quality) {
+            add(quality, false);
+        }
+        add(STRETCH_QUALITY_BILINEAR, true);
+        break;
+    }
+    return runs;
+}
+
+int main(int argc, char** argv)
+{
+    int selected = 0;
+    int failed = 0;
+    for (const CheckEntry& check : CHECKS) {
+        bool match = argc < 2;
+        for (int i = 1; i < argc && !match; ++i) {
+            match = std::strncmp(check.name, argv[i], std::strlen(argv[i])) == 0;
+        }
+        if (!match) {
+            continue;
+        }
+
+        for (CheckRun& run : MakeRuns(check.args)) {
+            check.run(run);
+            ++selected;
+            std::printf("%-30s quality:%d draft:%d  max_error=%-6.3g cases=%zu  ",
+                check.name, run.quality, run.draft ? 1 : 0, run.max_error, run.cases);
+            if (run.failure.empty()) {
+                std::printf("ok%s%s\n", run.label.empty() ? "" : "  ", run.label.c_str());
+            }
+            else {
+                std::printf("FAILED: %s\n", run.failure.c_str());
+                ++failed;
+            }
+        }
+    }
+
+    if (selected == 0) {
+        std::fprintf(stderr, "StretchCheck: no check matches\n");
+        return 1;
+    }
+    std::printf("%d of %d runs failed\n", failed, selected);
+    return failed ? 1 : 0;
+}
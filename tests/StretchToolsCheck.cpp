@@ -0,0 +1,410 @@
+// Input checks for the StretchRender tools, run by ctest.
+//
+//   StretchToolsCheck           every check
+//   StretchToolsCheck Keyframes checks whose name starts with Keyframes
+//
+// Each check feeds one parser well-formed input, whose result it compares
+// with the expected one, and a list of malformed inputs, each of which must be
+// rejected with an error message. A failure names the case; the exit status
+// is non-zero if any check failed.
+
+#include "StretchImageIO.h"
+#include "StretchKeyframes.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct ToolsCheckRun
+{
+    int cases = 0;
+    std::string failure;
+
+    void Fail(const std::string& what)
+    {
+        if (failure.empty()) {
+            failure = what;
+        }
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Keyframes
+// -----------------------------------------------------------------------------
+
+enum KeyframeSyntax
+{
+    KEYFRAMES_CSV,
+    KEYFRAMES_JSON
+};
+
+static bool ParseKeyframes(KeyframeSyntax syntax, const std::string& text, StretchKeyframes& keys, std::string& error)
+{
+    return (syntax == KEYFRAMES_CSV) ? keys.ParseCsv(text, error) : keys.ParseJson(text, error);
+}
+
+static void ExpectKeyframes(ToolsCheckRun& run, KeyframeSyntax syntax, const std::string& text, int frame, const StretchParams& expected)
+{
+    ++run.cases;
+    StretchKeyframes keys;
+    std::string error;
+    if (!ParseKeyframes(syntax, text, keys, error)) {
+        run.Fail("rejected " + text + " (" + error + ")");
+        return;
+    }
+    const StretchParams params = keys.At(frame, 1920, 1080);
+    if (params.anchor_x != expected.anchor_x || params.anchor_y != expected.anchor_y
+        || params.angle_deg != expected.angle_deg || params.shift_amount != expected.shift_amount
+        || params.direction != expected.direction) {
+        run.Fail("wrong parameters at frame " + std::to_string(frame) + " of " + text);
+    }
+}
+
+static void ExpectKeyframesRejected(ToolsCheckRun& run, KeyframeSyntax syntax, const std::string& text)
+{
+    ++run.cases;
+    StretchKeyframes keys;
+    std::string error;
+    if (ParseKeyframes(syntax, text, keys, error)) {
+        run.Fail("accepted " + text);
+    }
+    else if (error.empty()) {
+        run.Fail("no error message for " + text);
+    }
+}
+
+static StretchParams KeyParams(float anchor_x, float anchor_y, float angle, float shift, int direction)
+{
+    StretchParams params;
+    params.anchor_x = anchor_x;
+    params.anchor_y = anchor_y;
+    params.angle_deg = angle;
+    params.shift_amount = shift;
+    params.direction = direction;
+    return params;
+}
+
+static void CheckKeyframesCsv(ToolsCheckRun& run)
+{
+    const std::string keys =
+        "# two keys\n"
+        "frame,anchor_x,anchor_y,angle,shift,direction\n"
+        "0,960,540,0,0,both\n"
+        "\n"
+        "48,100,540,30,400,forward\n";
+    ExpectKeyframes(run, KEYFRAMES_CSV, keys, 24, KeyParams(530.0f, 540.0f, 15.0f, 200.0f, STRETCH_DIRECTION_BOTH));
+    ExpectKeyframes(run, KEYFRAMES_CSV, keys, 60, KeyParams(100.0f, 540.0f, 30.0f, 400.0f, STRETCH_DIRECTION_FORWARD));
+
+    // Blank cells and short rows set only what they name; the anchor falls
+    // back to the frame center
+    ExpectKeyframes(run, KEYFRAMES_CSV, "frame,shift,angle\n0,,10\n10,100\n", 5, KeyParams(960.0f, 540.0f, 10.0f, 100.0f, STRETCH_DIRECTION_BOTH));
+    ExpectKeyframes(run, KEYFRAMES_CSV, "shift,frame\n10,-1000000000\n", 0, KeyParams(960.0f, 540.0f, 0.0f, 10.0f, STRETCH_DIRECTION_BOTH));
+    ExpectKeyframes(run, KEYFRAMES_CSV, "frame,direction\n0,3\n", 0, KeyParams(960.0f, 540.0f, 0.0f, 0.0f, STRETCH_DIRECTION_BACKWARD));
+    ExpectKeyframes(run, KEYFRAMES_CSV, "frame,shift,angle\n0,10000,-720\n", 0, KeyParams(960.0f, 540.0f, -720.0f, 10000.0f, STRETCH_DIRECTION_BOTH));
+
+    static const char* const MALFORMED[] = {
+        "frame,shift,speed\n0,1,2\n",   // unknown column
+        "shift,angle\n1,2\n",           // no frame column
+        "frame,shift\n0,1,2\n",         // more cells than columns
+        "shift,frame\n10\n",            // row ends before its frame
+        "frame,shift\n,10\n",           // empty frame
+        "frame,shift\nten,10\n",
+        "frame,shift\n2.5,10\n",        // fractional frame
+        "frame,shift\n1e300,10\n",      // frame past int
+        "frame,shift\n1000000001,10\n",
+        "frame,shift\n-1000000001,10\n",
+        "frame,shift\nnan,10\n",
+        "frame,shift\ninf,10\n",
+        "frame,shift\n0,1e999\n",
+        "frame,shift\n0,-1\n",          // shift outside the slider
+        "frame,shift\n0,10001\n",
+        "frame,shift\n0,nan\n",
+        "frame,angle\n0,1e300\n",       // finite, but not as a float
+        "frame,anchor_x\n0,-1e39\n",
+        "frame,shift\n0,abc\n",
+        "frame,direction\n0,sideways\n",
+        "frame,direction\n0,4\n",
+        "frame,direction\n0,1.5\n",
+    };
+    for (const char* text : MALFORMED) {
+        ExpectKeyframesRejected(run, KEYFRAMES_CSV, text);
+    }
+}
+
+static void CheckKeyframesJson(ToolsCheckRun& run)
+{
+    const std::string keys =
+        "[{\"frame\": 0, \"anchor\": [960, 540], \"shift\": 0},\n"
+        " {\"frame\": 48, \"angle\": 30, \"shift\": 400, \"direction\": \"forward\"}]";
+    // Angle and direction have one key each, held on both sides
+    ExpectKeyframes(run, KEYFRAMES_JSON, keys, 24, KeyParams(960.0f, 540.0f, 30.0f, 200.0f, STRETCH_DIRECTION_FORWARD));
+    ExpectKeyframes(run, KEYFRAMES_JSON, keys, 48, KeyParams(960.0f, 540.0f, 30.0f, 400.0f, STRETCH_DIRECTION_FORWARD));
+    ExpectKeyframes(run, KEYFRAMES_JSON, "{\"keyframes\": [{\"frame\": 2, \"anchor_x\": 10, \"direction\": 3}]}", 0,
+        KeyParams(10.0f, 540.0f, 0.0f, 0.0f, STRETCH_DIRECTION_BACKWARD));
+
+    static const char* const MALFORMED[] = {
+        "{\"frame\": 0}",                             // not an array
+        "{\"keys\": []}",
+        "[{\"shift\": 1}]",                           // no frame
+        "[{\"frame\": \"0\"}]",
+        "[0]",
+        "[{\"frame\": 0.5}]",
+        "[{\"frame\": 1e300}]",
+        "[{\"frame\": 1e999}]",                       // inf
+        "[{\"frame\": 2000000000}]",
+        "[{\"frame\": 0, \"speed\": 1}]",             // unknown key
+        "[{\"frame\": 0, \"shift\": \"1\"}]",
+        "[{\"frame\": 0, \"shift\": 1e999}]",
+        "[{\"frame\": 0, \"anchor\": [1]}]",
+        "[{\"frame\": 0, \"anchor\": [1e999, 0]}]",
+        "[{\"frame\": 0, \"anchor\": [0, 1e300]}]",
+        "[{\"frame\": 0, \"shift\": -0.5}]",
+        "[{\"frame\": 0, \"shift\": 10000.5}]",
+        "[{\"frame\": 0, \"angle\": 1e300}]",
+        "[{\"frame\": 0, \"direction\": 4}]",
+        "[{\"frame\": 0, \"direction\": 2.5}]",
+        "[{\"frame\": 0, \"direction\": 1e300}]",
+        "[{\"frame\": 0, \"direction\": \"up\"}]",
+        "[{\"frame\": 0,}]",                          // syntax
+        "[{\"frame\": 0}",
+        "[{\"frame: 0}]",
+        "[{\"frame\": 0}] x",
+        "",
+    };
+    for (const char* text : MALFORMED) {
+        ExpectKeyframesRejected(run, KEYFRAMES_JSON, text);
+    }
+    ExpectKeyframesRejected(run, KEYFRAMES_JSON, std::string(100, '[') + std::string(100, ']'));  // too deep
+}
+
+// -----------------------------------------------------------------------------
+// Path patterns
+// -----------------------------------------------------------------------------
+
+static void CheckPatterns(ToolsCheckRun& run)
+{
+    struct Sequence
+    {
+        const char* pattern;
+        bool sequence;
+        const char* path;  // of frame 12
+    };
+    static const Sequence VALID[] = {
+        { "plate.png", false, "plate.png" },
+        { "plate.%04d.png", true, "plate.0012.png" },
+        { "%d.raw", true, "12.raw" },
+        { "100%%.raw", false, "100%.raw" },
+        { "a%%%d.raw", true, "a%12.raw" },
+        { "shot%3d.raw", true, "shot 12.raw" },
+    };
+    for (const Sequence& valid : VALID) {
+        ++run.cases;
+        bool sequence = !valid.sequence;
+        if (!StretchIsValidPathPattern(valid.pattern, sequence)) {
+            run.Fail(std::string("rejected ") + valid.pattern);
+            continue;
+        }
+        const std::string path = StretchFramePath(valid.pattern, 12);
+        if (sequence != valid.sequence || path != valid.path) {
+            run.Fail(std::string(valid.pattern) + " gave " + path);
+        }
+    }
+
+    // The widest field is formatted whole
+    ++run.cases;
+    bool sequence = false;
+    if (!StretchIsValidPathPattern("%999d.raw", sequence) || StretchFramePath("%999d.raw", 7).size() != 999 + 4) {
+        run.Fail("%999d.raw");
+    }
+
+    static const char* const MALFORMED[] = {
+        "%s.raw",
+        "%n.raw",
+        "%x.raw",
+        "%-4d.raw",
+        "%+d.raw",
+        "%ld.raw",
+        "%1000d.raw",
+        "%04d.%04d.raw",  // two frame numbers
+        "plate.raw%",
+        "%",
+    };
+    for (const char* pattern : MALFORMED) {
+        ++run.cases;
+        if (StretchIsValidPathPattern(pattern, sequence)) {
+            run.Fail(std::string("accepted ") + pattern);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// StretchRaw headers
+// -----------------------------------------------------------------------------
+
+static void StoreCheckU32(std::vector<std::uint8_t>& file, std::size_t offset, std::uint32_t v)
+{
+    for (int i = 0; i < 4; ++i) {
+        file[offset + i] = static_cast<std::uint8_t>(v >> (8 * i));
+    }
+}
+
+// Header and pixels of a StretchRaw file; the pixel bytes cover height rows
+// of rowbytes
+static std::vector<std::uint8_t> MakeRawFile(std::uint32_t width, std::uint32_t height, std::uint32_t depth, std::uint64_t rowbytes,
+                                             std::size_t pixel_bytes)
+{
+    std::vector<std::uint8_t> file(STRETCH_RAW_HEADER_BYTES + pixel_bytes);
+    std::memcpy(file.data(), STRETCH_RAW_MAGIC, sizeof(STRETCH_RAW_MAGIC));
+    StoreCheckU32(file, 8, width);
+    StoreCheckU32(file, 12, height);
+    StoreCheckU32(file, 16, depth);
+    StoreCheckU32(file, 24, static_cast<std::uint32_t>(rowbytes));
+    StoreCheckU32(file, 28, static_cast<std::uint32_t>(rowbytes >> 32));
+    for (std::size_t i = STRETCH_RAW_HEADER_BYTES; i < file.size(); ++i) {
+        file[i] = static_cast<std::uint8_t>(i * 7);
+    }
+    return file;
+}
+
+// Files go to the working directory, which ctest sets to the build tree
+static bool ReadRawFile(const std::vector<std::uint8_t>& file, StretchImage& image, std::string& error)
+{
+    const std::string path = "StretchToolsCheck.raw";
+    std::FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out) {
+        error = "cannot write " + path;
+        return false;
+    }
+    const bool written = file.empty() || std::fwrite(file.data(), 1, file.size(), out) == file.size();
+    std::fclose(out);
+    const bool read = written && StretchReadImage(path, image, error);
+    std::remove(path.c_str());
+    return read;
+}
+
+static void CheckRawHeaders(ToolsCheckRun& run)
+{
+    // Packed and padded rows read back with the file's own stride
+    struct Valid
+    {
+        int width;
+        int height;
+        int depth;
+        std::uint64_t rowbytes;
+    };
+    static const Valid VALID[] = {
+        { 5, 3, 8, 20 },
+        { 5, 3, 16, 48 },
+        { 5, 3, 32, 96 },
+        { 1, 1, 32, 16 },
+    };
+    for (const Valid& valid : VALID) {
+        ++run.cases;
+        const std::size_t packed = static_cast<std::size_t>(valid.width) * 4 * (valid.depth / 8);
+        const std::vector<std::uint8_t> file = MakeRawFile(valid.width, valid.height, valid.depth, valid.rowbytes,
+            static_cast<std::size_t>(valid.rowbytes) * (valid.height - 1) + packed);
+        StretchImage image;
+        std::string error;
+        const std::string what = std::to_string(valid.width) + "x" + std::to_string(valid.height) + " depth " + std::to_string(valid.depth);
+        if (!ReadRawFile(file, image, error)) {
+            run.Fail("rejected " + what + " (" + error + ")");
+            continue;
+        }
+        bool same = image.width == valid.width && image.height == valid.height && image.depth == valid.depth;
+        for (int y = 0; same && y < valid.height; ++y) {
+            same = std::memcmp(image.Row(y), file.data() + STRETCH_RAW_HEADER_BYTES + y * valid.rowbytes, packed) == 0;
+        }
+        if (!same) {
+            run.Fail("wrong pixels from " + what);
+        }
+    }
+
+    struct Malformed
+    {
+        const char* what;
+        std::vector<std::uint8_t> file;
+    };
+    std::vector<Malformed> malformed = {
+        { "empty file", {} },
+        { "zero width", MakeRawFile(0, 3, 8, 20, 60) },
+        { "zero height", MakeRawFile(5, 0, 8, 20, 60) },
+        { "width past int", MakeRawFile(0x80000000u, 1, 8, 0x200000000ull, 64) },
+        { "height past int", MakeRawFile(1, 0x80000000u, 8, 4, 64) },
+        { "depth 12", MakeRawFile(5, 3, 12, 30, 90) },
+        { "depth 0", MakeRawFile(5, 3, 0, 20, 60) },
+        { "rowbytes under width", MakeRawFile(5, 3, 8, 16, 60) },
+        { "rowbytes between pixels", MakeRawFile(5, 3, 16, 42, 126) },
+        { "rowbytes past memory", MakeRawFile(5, 3, 8, 0x7fffffffffffffffull, 60) },
+        { "truncated pixels", MakeRawFile(5, 3, 8, 20, 59) },
+    };
+    malformed.push_back({ "bad magic", MakeRawFile(5, 3, 8, 20, 60) });
+    malformed.back().file[7] = '2';
+    malformed.push_back({ "short header", MakeRawFile(5, 3, 8, 20, 60) });
+    malformed.back().file.resize(STRETCH_RAW_HEADER_BYTES / 2);
+
+    for (const Malformed& bad : malformed) {
+        ++run.cases;
+        StretchImage image;
+        std::string error;
+        if (ReadRawFile(bad.file, image, error)) {
+            run.Fail(std::string("accepted ") + bad.what);
+        }
+        else if (error.empty()) {
+            run.Fail(std::string("no error message for ") + bad.what);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Driver
+// -----------------------------------------------------------------------------
+
+struct ToolsCheckEntry
+{
+    const char* name;
+    void (*run)(ToolsCheckRun&);
+};
+
+static const ToolsCheckEntry CHECKS[] = {
+    { "Keyframes.Csv", CheckKeyframesCsv },
+    { "Keyframes.Json", CheckKeyframesJson },
+    { "Patterns", CheckPatterns },
+    { "RawHeaders", CheckRawHeaders },
+};
+
+int main(int argc, char** argv)
+{
+    int selected = 0;
+    int failed = 0;
+    for (const ToolsCheckEntry& check : CHECKS) {
+        bool match = argc < 2;
+        for (int i = 1; i < argc && !match; ++i) {
+            match = std::strncmp(check.name, argv[i], std::strlen(argv[i])) == 0;
+        }
+        if (!match) {
+            continue;
+        }
+
+        ToolsCheckRun run;
+        check.run(run);
+        ++selected;
+        std::printf("%-30s cases=%-4d ", check.name, run.cases);
+        if (run.failure.empty()) {
+            std::printf("ok\n");
+        }
+        else {
+            std::printf("FAILED: %s\n", run.failure.c_str());
+            ++failed;
+        }
+    }
+
+    if (selected == 0) {
+        std::fprintf(stderr, "StretchToolsCheck: no check matches\n");
+        return 1;
+    }
+    std::printf("%d of %d checks failed\n", failed, selected);
+    return failed ? 1 : 0;
+}
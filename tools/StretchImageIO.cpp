@@ -0,0 +1,825 @@
+#include "StretchImageIO.h"
+
+#include "StretchCore.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#ifdef STRETCH_HAVE_PNG
+#include <png.h>
+#include <csetjmp>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define STRETCH_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool StretchImage::Allocate(int new_width, int new_height, int new_depth)
+{
+    if (new_width <= 0 || new_height <= 0 || (new_depth != 8 && new_depth != 16 && new_depth != 32)) {
+        return false;
+    }
+    const std::size_t row = static_cast<std::size_t>(new_width) * 4 * (new_depth / 8);
+    if (row > PTRDIFF_MAX / static_cast<std::size_t>(new_height)) {
+        return false;
+    }
+    mapping.reset();
+    storage.assign(row * static_cast<std::size_t>(new_height), 0);
+    width = new_width;
+    height = new_height;
+    depth = new_depth;
+    rowbytes = static_cast<std::ptrdiff_t>(row);
+    data = storage.data();
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// StretchFileMapping
+// -----------------------------------------------------------------------------
+
+bool StretchHasFileMapping()
+{
+#ifdef STRETCH_HAVE_MMAP
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef STRETCH_HAVE_MMAP
+
+bool StretchGetFileId(const std::string& path, StretchFileId& id)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    id.device = static_cast<std::uint64_t>(st.st_dev);
+    id.inode = static_cast<std::uint64_t>(st.st_ino);
+    return true;
+}
+
+std::shared_ptr<StretchFileMapping> StretchFileMapping::Open(const std::string& path, std::string& error)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = path + ": " + std::strerror(errno);
+        return nullptr;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+        error = path + ": " + (st.st_size <= 0 ? std::string("empty file") : std::strerror(errno));
+        ::close(fd);
+        return nullptr;
+    }
+    const std::size_t size = static_cast<std::size_t>(st.st_size);
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    const int map_errno = errno;
+    ::close(fd);  // the mapping keeps the file
+    if (data == MAP_FAILED) {
+        error = path + ": " + std::strerror(map_errno);
+        return nullptr;
+    }
+    return std::shared_ptr<StretchFileMapping>(new StretchFileMapping(static_cast<std::uint8_t*>(data), size, false));
+}
+
+std::shared_ptr<StretchFileMapping> StretchFileMapping::Create(const std::string& path, std::size_t bytes, std::string& error)
+{
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        error = path + ": " + std::strerror(errno);
+        return nullptr;
+    }
+
+    // Allocate the blocks now: a full disk then fails here instead of
+    // raising SIGBUS when a kernel writes a page. Filesystems without
+    // fallocate get a sparse file
+    int err = (bytes <= static_cast<std::size_t>(PTRDIFF_MAX)) ? 0 : EFBIG;
+#if defined(__linux__)
+    if (err == 0) {
+        err = ::posix_fallocate(fd, 0, static_cast<off_t>(bytes));
+        if (err == EOPNOTSUPP || err == EINVAL) {
+            err = 0;
+        }
+    }
+#endif
+    if (err == 0 && ::ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        err = errno;
+    }
+    void* data = MAP_FAILED;
+    if (err == 0) {
+        data = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            err = errno;
+        }
+    }
+    ::close(fd);
+    if (err != 0) {
+        error = path + ": " + std::strerror(err);
+        ::unlink(path.c_str());
+        return nullptr;
+    }
+    return std::shared_ptr<StretchFileMapping>(new StretchFileMapping(static_cast<std::uint8_t*>(data), bytes, true));
+}
+
+StretchFileMapping::~StretchFileMapping()
+{
+    // Dirty pages of a writable mapping stay in the page cache and reach the
+    // file through normal writeback
+    ::munmap(data_, size_);
+}
+
+void StretchFileMapping::Prefetch(std::size_t offset, std::size_t bytes) const
+{
+    if (offset >= size_) {
+        return;
+    }
+    const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    const std::size_t begin = offset & ~(page - 1);
+    const std::size_t end = std::min(size_, offset + bytes);
+    ::madvise(data_ + begin, end - begin, MADV_WILLNEED);
+}
+
+void StretchFileMapping::Release(std::size_t offset, std::size_t bytes) const
+{
+    if (offset >= size_) {
+        return;
+    }
+    const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    const std::size_t begin = (offset + page - 1) & ~(page - 1);
+    std::size_t end = (bytes < size_ - offset) ? offset + bytes : size_;
+    if (end < size_) {
+        end &= ~(page - 1);
+    }
+
+    // Shared file pages: on Linux dropping a dirty page hands it to the page
+    // cache for writeback, it is not discarded
+    if (begin < end) {
+        ::madvise(data_ + begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+#else
+
+// Without mappings inputs are read whole into memory, so an output written
+// over one cannot fault
+bool StretchGetFileId(const std::string&, StretchFileId&)
+{
+    return false;
+}
+
+std::shared_ptr<StretchFileMapping> StretchFileMapping::Open(const std::string& path, std::string& error)
+{
+    error = path + ": file mapping is not supported on this platform";
+    return nullptr;
+}
+
+std::shared_ptr<StretchFileMapping> StretchFileMapping::Create(const std::string& path, std::size_t, std::string& error)
+{
+    error = path + ": file mapping is not supported on this platform";
+    return nullptr;
+}
+
+StretchFileMapping::~StretchFileMapping()
+{
+}
+
+void StretchFileMapping::Prefetch(std::size_t, std::size_t) const
+{
+}
+
+void StretchFileMapping::Release(std::size_t, std::size_t) const
+{
+}
+
+#endif // STRETCH_HAVE_MMAP
+
+StretchImageFormat StretchImageFormatForPath(const std::string& path)
+{
+    const std::size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) {
+        return STRETCH_IMAGE_UNKNOWN;
+    }
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (ext == "png") {
+        return STRETCH_IMAGE_PNG;
+    }
+    if (ext == "raw") {
+        return STRETCH_IMAGE_RAW;
+    }
+    return STRETCH_IMAGE_UNKNOWN;
+}
+
+bool StretchIsValidPathPattern(const std::string& pattern, bool& sequence)
+{
+    sequence = false;
+    for (std::size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] != '%') {
+            continue;
+        }
+        if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+            ++i;
+            continue;
+        }
+        std::size_t j = i + 1;
+        while (j < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[j]))) {
+            ++j;
+        }
+        if (sequence || j >= pattern.size() || pattern[j] != 'd' || j - i > 4) {
+            return false;
+        }
+        sequence = true;
+        i = j;
+    }
+    return true;
+}
+
+// The buffer is sized from the formatted length, so a wide field (%999d) is
+// not truncated
+std::string StretchFramePath(const std::string& pattern, int frame)
+{
+    const int length = std::snprintf(nullptr, 0, pattern.c_str(), frame);
+    if (length < 0) {
+        return pattern;
+    }
+    std::vector<char> path(static_cast<std::size_t>(length) + 1);
+    std::snprintf(path.data(), path.size(), pattern.c_str(), frame);
+    return path.data();
+}
+
+namespace {
+
+struct FileCloser
+{
+    void operator()(std::FILE* file) const { std::fclose(file); }
+};
+
+using FilePtr = std::unique_ptr<std::FILE, FileCloser>;
+
+FilePtr OpenFile(const std::string& path, const char* mode, std::string& error)
+{
+    FilePtr file(std::fopen(path.c_str(), mode));
+    if (!file) {
+        error = path + ": " + std::strerror(errno);
+    }
+    return file;
+}
+
+std::uint32_t LoadU32(const std::uint8_t* p)
+{
+    return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8)
+        | (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+}
+
+void StoreU32(std::uint8_t* p, std::uint32_t v)
+{
+    for (int i = 0; i < 4; ++i) {
+        p[i] = static_cast<std::uint8_t>(v >> (8 * i));
+    }
+}
+
+// -----------------------------------------------------------------------------
+// StretchRaw
+// -----------------------------------------------------------------------------
+
+struct RawHeader
+{
+    int width = 0;
+    int height = 0;
+    int depth = 0;
+    std::uint64_t rowbytes = 0;
+};
+
+void StoreRawHeader(std::uint8_t* header, int width, int height, int depth, std::uint64_t rowbytes)
+{
+    std::memset(header, 0, STRETCH_RAW_HEADER_BYTES);
+    std::memcpy(header, STRETCH_RAW_MAGIC, sizeof(STRETCH_RAW_MAGIC));
+    StoreU32(header + 8, static_cast<std::uint32_t>(width));
+    StoreU32(header + 12, static_cast<std::uint32_t>(height));
+    StoreU32(header + 16, static_cast<std::uint32_t>(depth));
+    StoreU32(header + 24, static_cast<std::uint32_t>(rowbytes));
+    StoreU32(header + 28, static_cast<std::uint32_t>(rowbytes >> 32));
+}
+
+// Validates a header; false for anything the kernels cannot take
+bool LoadRawHeader(const std::uint8_t* header, RawHeader& raw)
+{
+    if (std::memcmp(header, STRETCH_RAW_MAGIC, sizeof(STRETCH_RAW_MAGIC)) != 0) {
+        return false;
+    }
+    const std::uint32_t width = LoadU32(header + 8);
+    const std::uint32_t height = LoadU32(header + 12);
+    const std::uint32_t depth = LoadU32(header + 16);
+    raw.rowbytes = static_cast<std::uint64_t>(LoadU32(header + 24))
+        | (static_cast<std::uint64_t>(LoadU32(header + 28)) << 32);
+    if (width == 0 || height == 0 || width > INT_MAX || height > INT_MAX
+        || (depth != 8 && depth != 16 && depth != 32)) {
+        return false;
+    }
+    raw.width = static_cast<int>(width);
+    raw.height = static_cast<int>(height);
+    raw.depth = static_cast<int>(depth);
+    const std::uint64_t pixel_bytes = 4 * (depth / 8);
+    const std::uint64_t packed = static_cast<std::uint64_t>(width) * pixel_bytes;
+    return raw.rowbytes >= packed && raw.rowbytes % pixel_bytes == 0
+        && raw.rowbytes <= static_cast<std::uint64_t>(PTRDIFF_MAX) / height;
+}
+
+// Bytes of a frame's pixels in the file (the last row needs no padding)
+std::uint64_t RawPixelBytes(const RawHeader& raw)
+{
+    return raw.rowbytes * static_cast<std::uint64_t>(raw.height - 1)
+        + static_cast<std::uint64_t>(raw.width) * 4 * static_cast<std::uint64_t>(raw.depth / 8);
+}
+
+#ifdef STRETCH_HAVE_MMAP
+
+// Zero copy: the image points into a read-only mapping of the file, rows at
+// the file's own rowbytes
+bool ReadRaw(const std::string& path, StretchImage& image, std::string& error)
+{
+    std::shared_ptr<StretchFileMapping> mapping = StretchFileMapping::Open(path, error);
+    if (!mapping) {
+        return false;
+    }
+    RawHeader raw;
+    if (mapping->Size() < STRETCH_RAW_HEADER_BYTES || !LoadRawHeader(mapping->Data(), raw)) {
+        error = path + ": not a StretchRaw frame";
+        return false;
+    }
+    if (mapping->Size() - STRETCH_RAW_HEADER_BYTES < RawPixelBytes(raw)) {
+        error = path + ": truncated StretchRaw frame";
+        return false;
+    }
+
+    // Start reading the pixels in while earlier frames render
+    mapping->Prefetch(STRETCH_RAW_HEADER_BYTES, static_cast<std::size_t>(RawPixelBytes(raw)));
+
+    image.storage.clear();
+    image.width = raw.width;
+    image.height = raw.height;
+    image.depth = raw.depth;
+    image.rowbytes = static_cast<std::ptrdiff_t>(raw.rowbytes);
+    image.data = mapping->Data() + STRETCH_RAW_HEADER_BYTES;
+    image.mapping = std::move(mapping);
+    return true;
+}
+
+#else
+
+bool ReadRaw(const std::string& path, StretchImage& image, std::string& error)
+{
+    FilePtr file = OpenFile(path, "rb", error);
+    if (!file) {
+        return false;
+    }
+
+    std::uint8_t header[STRETCH_RAW_HEADER_BYTES];
+    RawHeader raw;
+    if (std::fread(header, 1, sizeof(header), file.get()) != sizeof(header) || !LoadRawHeader(header, raw)) {
+        error = path + ": not a StretchRaw frame";
+        return false;
+    }
+    if (!image.Allocate(raw.width, raw.height, raw.depth)) {
+        error = path + ": frame too large";
+        return false;
+    }
+
+    // Rows are stored packed in memory; skip any padding in the file
+    const std::size_t padding = static_cast<std::size_t>(raw.rowbytes - static_cast<std::uint64_t>(image.rowbytes));
+    for (int y = 0; y < image.height; ++y) {
+        if (std::fread(image.Row(y), 1, static_cast<std::size_t>(image.rowbytes), file.get()) != static_cast<std::size_t>(image.rowbytes)
+            || (padding && y + 1 < image.height && std::fseek(file.get(), static_cast<long>(padding), SEEK_CUR) != 0)) {
+            error = path + ": truncated StretchRaw frame";
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif // STRETCH_HAVE_MMAP
+
+#ifdef STRETCH_HAVE_MMAP
+
+// Output frame mapped at its final size: the kernels write the file directly
+bool CreateRaw(const std::string& path, int width, int height, int depth, StretchImage& image, std::string& error)
+{
+    if (width <= 0 || height <= 0 || (depth != 8 && depth != 16 && depth != 32)) {
+        error = path + ": bad frame size";
+        return false;
+    }
+    const std::uint64_t rowbytes = static_cast<std::uint64_t>(width) * 4 * static_cast<std::uint64_t>(depth / 8);
+    const std::uint64_t bytes = STRETCH_RAW_HEADER_BYTES + rowbytes * static_cast<std::uint64_t>(height);
+    if (bytes / static_cast<std::uint64_t>(height) < rowbytes || bytes > static_cast<std::uint64_t>(PTRDIFF_MAX)) {
+        error = path + ": frame too large";
+        return false;
+    }
+
+    std::shared_ptr<StretchFileMapping> mapping = StretchFileMapping::Create(path, static_cast<std::size_t>(bytes), error);
+    if (!mapping) {
+        return false;
+    }
+    StoreRawHeader(mapping->Data(), width, height, depth, rowbytes);
+
+    image.storage.clear();
+    image.width = width;
+    image.height = height;
+    image.depth = depth;
+    image.rowbytes = static_cast<std::ptrdiff_t>(rowbytes);
+    image.data = mapping->Data() + STRETCH_RAW_HEADER_BYTES;
+    image.mapping = std::move(mapping);
+    return true;
+}
+
+#endif // STRETCH_HAVE_MMAP
+
+// -----------------------------------------------------------------------------
+// PNG
+// -----------------------------------------------------------------------------
+
+#ifdef STRETCH_HAVE_PNG
+
+// 16-bit PNG (0..65535) <-> After Effects 16-bit (0..32768), rounded
+inline std::uint16_t PngToAe16(std::uint32_t v)
+{
+    return static_cast<std::uint16_t>((v * 32768u + 32767u) / 65535u);
+}
+
+inline std::uint16_t Ae16ToPng(std::uint32_t v)
+{
+    return static_cast<std::uint16_t>((std::min(v, 32768u) * 65535u + 16384u) / 32768u);
+}
+
+inline std::uint16_t FloatToPng16(float v)
+{
+    return static_cast<std::uint16_t>(ClampScalar(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+void PngError(png_structp png, png_const_charp message)
+{
+    auto* error = static_cast<std::string*>(png_get_error_ptr(png));
+    *error = message;
+    png_longjmp(png, 1);
+}
+
+void PngWarning(png_structp, png_const_charp)
+{
+}
+
+bool ReadPng(const std::string& path, StretchImage& image, std::string& error)
+{
+    FilePtr file = OpenFile(path, "rb", error);
+    if (!file) {
+        return false;
+    }
+
+    std::string png_error;
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, &png_error, PngError, PngWarning);
+    png_infop info = png ? png_create_info_struct(png) : nullptr;
+    if (!info) {
+        png_destroy_read_struct(&png, nullptr, nullptr);
+        error = path + ": out of memory";
+        return false;
+    }
+
+    std::vector<png_bytep> rows;
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, nullptr);
+        error = path + ": " + png_error;
+        return false;
+    }
+
+    png_init_io(png, file.get());
+    png_read_info(png, info);
+
+    // Expand everything to 8- or 16-bit RGBA, 16-bit samples in host order
+    const int bit_depth = png_get_bit_depth(png, info);
+    const int color_type = png_get_color_type(png, info);
+    png_set_expand(png);
+    if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+        png_set_gray_to_rgb(png);
+    }
+    const int depth = (bit_depth == 16) ? 16 : 8;
+    png_set_add_alpha(png, depth == 16 ? 0xffff : 0xff, PNG_FILLER_AFTER);
+    if (depth == 16) {
+        png_set_swap(png);
+    }
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    const int width = static_cast<int>(png_get_image_width(png, info));
+    const int height = static_cast<int>(png_get_image_height(png, info));
+    if (!image.Allocate(width, height, depth)) {
+        png_destroy_read_struct(&png, &info, nullptr);
+        error = path + ": unsupported PNG size";
+        return false;
+    }
+
+    // RGBA rows share the image size; read them into the image and reorder
+    // to ARGB in place
+    rows.resize(static_cast<std::size_t>(height));
+    for (int y = 0; y < height; ++y) {
+        rows[static_cast<std::size_t>(y)] = image.Row(y);
+    }
+    png_read_image(png, rows.data());
+    png_read_end(png, nullptr);
+    png_destroy_read_struct(&png, &info, nullptr);
+
+    for (int y = 0; y < height; ++y) {
+        if (depth == 8) {
+            std::uint8_t* p = image.Row(y);
+            for (int x = 0; x < width; ++x, p += 4) {
+                const std::uint8_t a = p[3];
+                p[3] = p[2];
+                p[2] = p[1];
+                p[1] = p[0];
+                p[0] = a;
+            }
+        } else {
+            auto* p = reinterpret_cast<std::uint16_t*>(image.Row(y));
+            for (int x = 0; x < width; ++x, p += 4) {
+                const std::uint16_t a = PngToAe16(p[3]);
+                p[3] = PngToAe16(p[2]);
+                p[2] = PngToAe16(p[1]);
+                p[1] = PngToAe16(p[0]);
+                p[0] = a;
+            }
+        }
+    }
+    return true;
+}
+
+#endif // STRETCH_HAVE_PNG
+
+} // namespace
+
+bool StretchHasPng()
+{
+#ifdef STRETCH_HAVE_PNG
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool StretchReadImage(const std::string& path, StretchImage& image, std::string& error)
+{
+    switch (StretchImageFormatForPath(path)) {
+    case STRETCH_IMAGE_RAW:
+        return ReadRaw(path, image, error);
+#ifdef STRETCH_HAVE_PNG
+    case STRETCH_IMAGE_PNG:
+        return ReadPng(path, image, error);
+#endif
+    default:
+        error = path + ": unsupported format" + (StretchHasPng() ? "" : " (built without libpng)");
+        return false;
+    }
+}
+
+bool StretchCreateImage(const std::string& path, int width, int height, int depth,
+                        StretchImage& image, std::string& error)
+{
+#ifdef STRETCH_HAVE_MMAP
+    if (StretchImageFormatForPath(path) == STRETCH_IMAGE_RAW) {
+        return CreateRaw(path, width, height, depth, image, error);
+    }
+#endif
+    if (!image.Allocate(width, height, depth)) {
+        error = path + ": bad frame size";
+        return false;
+    }
+    return true;
+}
+
+bool StretchWriteImage(const std::string& path, const StretchImage& image, std::string& error)
+{
+    StretchImageWriter writer;
+    return writer.Open(path, image.width, image.height, image.depth, error)
+        && writer.WriteRows(image.data, image.rowbytes, image.height, error)
+        && writer.Close(error);
+}
+
+// -----------------------------------------------------------------------------
+// StretchImageWriter
+// -----------------------------------------------------------------------------
+
+struct StretchImageWriterState
+{
+    std::string path;
+    StretchImageFormat format = STRETCH_IMAGE_UNKNOWN;
+    FilePtr file;
+    int width = 0;
+    int height = 0;
+    int depth = 8;
+    int rows_written = 0;
+
+#ifdef STRETCH_HAVE_PNG
+    png_structp png = nullptr;
+    png_infop info = nullptr;
+    std::string png_error;
+    std::vector<std::uint8_t> row;  // one RGBA row in PNG order
+
+    ~StretchImageWriterState()
+    {
+        if (png) {
+            png_destroy_write_struct(&png, &info);
+        }
+    }
+#endif
+};
+
+namespace {
+
+// StretchRaw output: packed rows after the header
+
+bool OpenRaw(StretchImageWriterState& state, std::string& error)
+{
+    std::uint8_t header[STRETCH_RAW_HEADER_BYTES];
+    StoreRawHeader(header, state.width, state.height, state.depth,
+                   static_cast<std::uint64_t>(state.width) * 4 * static_cast<std::uint64_t>(state.depth / 8));
+    if (std::fwrite(header, 1, sizeof(header), state.file.get()) != sizeof(header)) {
+        error = state.path + ": write failed";
+        return false;
+    }
+    return true;
+}
+
+bool WriteRawRows(StretchImageWriterState& state, const std::uint8_t* rows, std::ptrdiff_t rowbytes, int count, std::string& error)
+{
+    const std::size_t bytes = static_cast<std::size_t>(state.width) * 4 * static_cast<std::size_t>(state.depth / 8);
+    for (int y = 0; y < count; ++y) {
+        if (std::fwrite(rows + static_cast<std::ptrdiff_t>(y) * rowbytes, 1, bytes, state.file.get()) != bytes) {
+            error = state.path + ": write failed";
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef STRETCH_HAVE_PNG
+
+// PNG output: libpng reports errors by longjmp, so every call into it sits
+// behind its own setjmp
+
+bool OpenPng(StretchImageWriterState& state, std::string& error)
+{
+    const int depth = (state.depth == 8) ? 8 : 16;
+    state.row.resize(static_cast<std::size_t>(state.width) * 4 * (depth / 8));
+
+    state.png = png_create_write_struct(PNG_LIBPNG_VER_STRING, &state.png_error, PngError, PngWarning);
+    state.info = state.png ? png_create_info_struct(state.png) : nullptr;
+    if (!state.info) {
+        error = state.path + ": out of memory";
+        return false;
+    }
+    if (setjmp(png_jmpbuf(state.png))) {
+        error = state.path + ": " + state.png_error;
+        return false;
+    }
+
+    png_init_io(state.png, state.file.get());
+    png_set_IHDR(state.png, state.info, static_cast<png_uint_32>(state.width), static_cast<png_uint_32>(state.height), depth,
+                 PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    // Favour speed: farm output is usually an intermediate
+    png_set_compression_level(state.png, 1);
+    png_write_info(state.png, state.info);
+    if (depth == 16) {
+        png_set_swap(state.png);
+    }
+    return true;
+}
+
+bool WritePngRows(StretchImageWriterState& state, const std::uint8_t* rows, std::ptrdiff_t rowbytes, int count, std::string& error)
+{
+    if (setjmp(png_jmpbuf(state.png))) {
+        error = state.path + ": " + state.png_error;
+        return false;
+    }
+
+    for (int y = 0; y < count; ++y) {
+        const std::uint8_t* source = rows + static_cast<std::ptrdiff_t>(y) * rowbytes;
+        if (state.depth == 8) {
+            const std::uint8_t* p = source;
+            for (int x = 0; x < state.width; ++x, p += 4) {
+                std::uint8_t* q = state.row.data() + 4 * x;
+                q[0] = p[1];
+                q[1] = p[2];
+                q[2] = p[3];
+                q[3] = p[0];
+            }
+        } else if (state.depth == 16) {
+            const auto* p = reinterpret_cast<const std::uint16_t*>(source);
+            auto* q = reinterpret_cast<std::uint16_t*>(state.row.data());
+            for (int x = 0; x < state.width; ++x, p += 4, q += 4) {
+                q[0] = Ae16ToPng(p[1]);
+                q[1] = Ae16ToPng(p[2]);
+                q[2] = Ae16ToPng(p[3]);
+                q[3] = Ae16ToPng(p[0]);
+            }
+        } else {
+            const auto* p = reinterpret_cast<const float*>(source);
+            auto* q = reinterpret_cast<std::uint16_t*>(state.row.data());
+            for (int x = 0; x < state.width; ++x, p += 4, q += 4) {
+                q[0] = FloatToPng16(p[1]);
+                q[1] = FloatToPng16(p[2]);
+                q[2] = FloatToPng16(p[3]);
+                q[3] = FloatToPng16(p[0]);
+            }
+        }
+        png_write_row(state.png, state.row.data());
+    }
+    return true;
+}
+
+bool ClosePng(StretchImageWriterState& state, std::string& error)
+{
+    if (setjmp(png_jmpbuf(state.png))) {
+        error = state.path + ": " + state.png_error;
+        return false;
+    }
+    png_write_end(state.png, nullptr);
+    png_destroy_write_struct(&state.png, &state.info);
+    return true;
+}
+
+#endif // STRETCH_HAVE_PNG
+
+} // namespace
+
+StretchImageWriter::StretchImageWriter() = default;
+
+StretchImageWriter::~StretchImageWriter() = default;
+
+bool StretchImageWriter::Open(const std::string& path, int width, int height, int depth, std::string& error)
+{
+    state_.reset(new StretchImageWriterState());
+    state_->path = path;
+    state_->format = StretchImageFormatForPath(path);
+    state_->width = width;
+    state_->height = height;
+    state_->depth = depth;
+
+    if (width <= 0 || height <= 0 || (depth != 8 && depth != 16 && depth != 32)) {
+        error = path + ": bad frame size";
+        return false;
+    }
+    switch (state_->format) {
+    case STRETCH_IMAGE_RAW:
+        state_->file = OpenFile(path, "wb", error);
+        return state_->file && OpenRaw(*state_, error);
+#ifdef STRETCH_HAVE_PNG
+    case STRETCH_IMAGE_PNG:
+        state_->file = OpenFile(path, "wb", error);
+        return state_->file && OpenPng(*state_, error);
+#endif
+    default:
+        error = path + ": unsupported format" + (StretchHasPng() ? "" : " (built without libpng)");
+        return false;
+    }
+}
+
+bool StretchImageWriter::WriteRows(const std::uint8_t* rows, std::ptrdiff_t rowbytes, int count, std::string& error)
+{
+    if (!state_ || !state_->file || count < 0 || count > state_->height - state_->rows_written) {
+        error = (state_ ? state_->path : std::string("StretchImageWriter")) + ": rows past the end of the frame";
+        return false;
+    }
+    state_->rows_written += count;
+#ifdef STRETCH_HAVE_PNG
+    if (state_->format == STRETCH_IMAGE_PNG) {
+        return WritePngRows(*state_, rows, rowbytes, count, error);
+    }
+#endif
+    return WriteRawRows(*state_, rows, rowbytes, count, error);
+}
+
+bool StretchImageWriter::Close(std::string& error)
+{
+    if (!state_ || !state_->file || state_->rows_written != state_->height) {
+        error = (state_ ? state_->path : std::string("StretchImageWriter")) + ": frame closed before all rows were written";
+        return false;
+    }
+    bool ok = true;
+#ifdef STRETCH_HAVE_PNG
+    if (state_->format == STRETCH_IMAGE_PNG) {
+        ok = ClosePng(*state_, error);
+    }
+#endif
+    if (std::fclose(state_->file.release()) != 0 && ok) {
+        error = state_->path + ": write failed";
+        ok = false;
+    }
+    state_.reset();
+    return ok;
+}
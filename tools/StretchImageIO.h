@@ -0,0 +1,191 @@
+#pragma once
+#ifndef STRETCH_IMAGE_IO_H
+#define STRETCH_IMAGE_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Frame images for the command-line renderer
+// -----------------------------------------------------------------------------
+//
+// Frames are held in the plugin's pixel layout (StretchPixel8/16/F: alpha,
+// red, green, blue per pixel) so they go to the kernels unconverted. 16-bit
+// frames use After Effects' 0..32768 range.
+//
+// Formats, chosen by file extension:
+//   .png  8/16-bit (needs libpng; any PNG color type is read, RGBA is written)
+//   .raw  StretchRaw container below, any depth including 32-bit float.
+//         Where the OS supports it, .raw frames are memory-mapped: inputs are
+//         rendered straight from the page cache and outputs created with
+//         StretchCreateImage are rendered straight into the file
+
+// A file mapped into memory, unmapped when the last reference goes away
+class StretchFileMapping
+{
+public:
+    // Maps an existing file read-only
+    static std::shared_ptr<StretchFileMapping> Open(const std::string& path, std::string& error);
+
+    // Creates (or truncates) a file of `bytes` bytes, with its blocks
+    // allocated up front, and maps it read-write
+    static std::shared_ptr<StretchFileMapping> Create(const std::string& path, std::size_t bytes, std::string& error);
+
+    ~StretchFileMapping();
+
+    std::uint8_t* Data() const { return data_; }
+    std::size_t Size() const { return size_; }
+    bool Writable() const { return writable_; }
+
+    // Starts reading [offset, offset + bytes) into the page cache ahead of use
+    void Prefetch(std::size_t offset, std::size_t bytes) const;
+
+    // Drops the pages wholly inside [offset, offset + bytes) from this
+    // process. Data is kept: the next access reads it back from the page
+    // cache or the file, and dirty pages of a writable mapping go to writeback
+    void Release(std::size_t offset, std::size_t bytes) const;
+
+    StretchFileMapping(const StretchFileMapping&) = delete;
+    StretchFileMapping& operator=(const StretchFileMapping&) = delete;
+
+private:
+    StretchFileMapping(std::uint8_t* data, std::size_t size, bool writable)
+        : data_(data), size_(size), writable_(writable) {}
+
+    std::uint8_t* data_;
+    std::size_t size_;
+    bool writable_;
+};
+
+// True when this build maps .raw frames instead of reading them (POSIX)
+bool StretchHasFileMapping();
+
+// Device and inode of an existing file, equal for every path that reaches it
+// (hard links, symlinks, "./a" and "a"). False if the file does not exist or
+// the OS has no such identity
+struct StretchFileId
+{
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+
+    bool operator<(const StretchFileId& other) const
+    {
+        return device != other.device ? device < other.device : inode < other.inode;
+    }
+};
+
+bool StretchGetFileId(const std::string& path, StretchFileId& id);
+
+struct StretchImage
+{
+    int width = 0;
+    int height = 0;
+    int depth = 8;                 // bits per channel: 8, 16 or 32 (float)
+    std::ptrdiff_t rowbytes = 0;   // at least width * PixelBytes()
+    std::uint8_t* data = nullptr;  // row 0, in storage or in mapping
+
+    // Owner of the pixels: heap storage, or a mapped .raw file. A read-only
+    // mapping must not be written through data
+    std::vector<std::uint8_t> storage;
+    std::shared_ptr<StretchFileMapping> mapping;
+
+    StretchImage() = default;
+    StretchImage(StretchImage&&) = default;
+    StretchImage& operator=(StretchImage&&) = default;
+    StretchImage(const StretchImage&) = delete;
+    StretchImage& operator=(const StretchImage&) = delete;
+
+    int PixelBytes() const { return 4 * depth / 8; }
+
+    // Sizes heap storage for width x height at depth with packed rows. False
+    // if the depth is unsupported or the size overflows
+    bool Allocate(int width, int height, int depth);
+
+    // Pixels live in a writable file mapping: they are already in the file
+    bool WrittenInPlace() const { return mapping && mapping->Writable(); }
+
+    std::uint8_t* Row(int y) { return data + static_cast<std::ptrdiff_t>(y) * rowbytes; }
+    const std::uint8_t* Row(int y) const { return data + static_cast<std::ptrdiff_t>(y) * rowbytes; }
+};
+
+// StretchRaw: a 64-byte little-endian header followed by height rows of
+// rowbytes bytes each, pixels in the StretchImage layout.
+//
+//   offset  size  field
+//        0     8  magic "STRRAW01"
+//        8     4  width
+//       12     4  height
+//       16     4  depth (8, 16 or 32)
+//       20     4  reserved, 0
+//       24     8  rowbytes (at least width * 4 * depth / 8)
+//       32    32  reserved, 0
+constexpr char STRETCH_RAW_MAGIC[8] = { 'S', 'T', 'R', 'R', 'A', 'W', '0', '1' };
+constexpr std::size_t STRETCH_RAW_HEADER_BYTES = 64;
+
+enum StretchImageFormat
+{
+    STRETCH_IMAGE_UNKNOWN,
+    STRETCH_IMAGE_PNG,
+    STRETCH_IMAGE_RAW
+};
+
+StretchImageFormat StretchImageFormatForPath(const std::string& path);
+
+// A path pattern may hold one %d frame number with optional zero padding and
+// a width of up to 3 digits (and %% for a literal percent sign). False for
+// anything else, which must not reach snprintf; sequence tells whether the
+// pattern holds a frame number
+bool StretchIsValidPathPattern(const std::string& pattern, bool& sequence);
+
+// Path of frame in a pattern accepted by StretchIsValidPathPattern
+std::string StretchFramePath(const std::string& pattern, int frame);
+
+// True when this build can read and write PNG
+bool StretchHasPng();
+
+// Reads a frame in the format of its extension (maps .raw frames read-only,
+// with readahead started). On failure returns false and describes the
+// problem in error
+bool StretchReadImage(const std::string& path, StretchImage& image, std::string& error);
+
+// Sets up an output frame for path: a .raw frame is created at its final
+// size and mapped, so rendering writes the file in place (see
+// WrittenInPlace); other formats get heap storage for StretchWriteImage
+bool StretchCreateImage(const std::string& path, int width, int height, int depth,
+                        StretchImage& image, std::string& error);
+
+// Writes a frame in the format of its extension. PNG output keeps 8-bit
+// frames at 8 bits and writes 16-bit and float frames as 16-bit. A frame
+// written in place needs no call
+bool StretchWriteImage(const std::string& path, const StretchImage& image, std::string& error);
+
+struct StretchImageWriterState;
+
+// Writes a frame in the format of its extension a few rows at a time, so a
+// frame that is rendered in strips never has to be in memory whole. Rows are
+// in the StretchImage layout; PNG depths as for StretchWriteImage
+class StretchImageWriter
+{
+public:
+    StretchImageWriter();
+    ~StretchImageWriter();
+
+    bool Open(const std::string& path, int width, int height, int depth, std::string& error);
+
+    // Appends count rows, rowbytes apart
+    bool WriteRows(const std::uint8_t* rows, std::ptrdiff_t rowbytes, int count, std::string& error);
+
+    // Completes the file; every row must have been written
+    bool Close(std::string& error);
+
+    StretchImageWriter(const StretchImageWriter&) = delete;
+    StretchImageWriter& operator=(const StretchImageWriter&) = delete;
+
+private:
+    std::unique_ptr<StretchImageWriterState> state_;
+};
+
+#endif // STRETCH_IMAGE_IO_H
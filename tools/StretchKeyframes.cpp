@@ -0,0 +1,527 @@
+#include "StretchKeyframes.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+std::string Lower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+std::string Trim(const std::string& s)
+{
+    std::size_t begin = 0;
+    std::size_t end = s.size();
+    while (begin < end && std::isspace(static_cast<unsigned char>(s[begin]))) {
+        ++begin;
+    }
+    while (end > begin && std::isspace(static_cast<unsigned char>(s[end - 1]))) {
+        --end;
+    }
+    return s.substr(begin, end - begin);
+}
+
+bool ParseNumber(const std::string& text, double& value)
+{
+    const std::string s = Trim(text);
+    if (s.empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtod(s.c_str(), &end);
+    return errno == 0 && end == s.c_str() + s.size() && std::isfinite(value);
+}
+
+// Frames are limited like --start/--end, so the distance between two keys
+// fits an int
+constexpr double MAX_FRAME = 1000000000.0;
+
+bool ToFrame(double value, int& frame)
+{
+    if (!std::isfinite(value) || value != std::floor(value) || std::fabs(value) > MAX_FRAME) {
+        return false;
+    }
+    frame = static_cast<int>(value);
+    return true;
+}
+
+bool IsDirection(double value)
+{
+    return value >= STRETCH_DIRECTION_BOTH && value <= STRETCH_DIRECTION_BACKWARD && value == std::floor(value);
+}
+
+bool ParseDirection(const std::string& text, double& value)
+{
+    const std::string name = Lower(Trim(text));
+    if (name == "both") {
+        value = STRETCH_DIRECTION_BOTH;
+    } else if (name == "forward") {
+        value = STRETCH_DIRECTION_FORWARD;
+    } else if (name == "backward") {
+        value = STRETCH_DIRECTION_BACKWARD;
+    } else if (!ParseNumber(name, value)) {
+        return false;
+    }
+    return IsDirection(value);
+}
+
+// Column or key name -> field; -1 for "frame", -2 if unknown
+int FieldForName(const std::string& raw)
+{
+    const std::string name = Lower(Trim(raw));
+    if (name == "frame") return -1;
+    if (name == "anchor_x") return StretchKeyframes::ANCHOR_X;
+    if (name == "anchor_y") return StretchKeyframes::ANCHOR_Y;
+    if (name == "angle") return StretchKeyframes::ANGLE;
+    if (name == "shift") return StretchKeyframes::SHIFT;
+    if (name == "direction") return StretchKeyframes::DIRECTION;
+    return -2;
+}
+
+// -----------------------------------------------------------------------------
+// Minimal JSON reader: values are parsed into a small tree
+// -----------------------------------------------------------------------------
+
+struct JsonValue
+{
+    enum Kind { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT } kind = NUL;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> items;                            // ARRAY
+    std::vector<std::pair<std::string, JsonValue>> members;  // OBJECT
+
+    const JsonValue* Find(const std::string& key) const
+    {
+        for (const auto& member : members) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+class JsonParser
+{
+public:
+    explicit JsonParser(const std::string& text) : text_(text) {}
+
+    bool Parse(JsonValue& value, std::string& error)
+    {
+        if (!ParseValue(value, 0) || (SkipSpace(), pos_ != text_.size())) {
+            error = "line " + std::to_string(Line()) + ": " + (error_.empty() ? "unexpected character" : error_);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr int MAX_DEPTH = 64;
+
+    int Line() const
+    {
+        return 1 + static_cast<int>(std::count(text_.begin(), text_.begin() + static_cast<std::ptrdiff_t>(std::min(pos_, text_.size())), '\n'));
+    }
+
+    void SkipSpace()
+    {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+            ++pos_;
+        }
+    }
+
+    bool Consume(char c)
+    {
+        SkipSpace();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    bool ParseLiteral(const char* word)
+    {
+        const std::size_t n = std::strlen(word);
+        if (text_.compare(pos_, n, word) == 0) {
+            pos_ += n;
+            return true;
+        }
+        return false;
+    }
+
+    bool ParseString(std::string& out)
+    {
+        if (!Consume('"')) {
+            return false;
+        }
+        while (pos_ < text_.size()) {
+            const char c = text_[pos_++];
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos_ >= text_.size()) {
+                break;
+            }
+            const char e = text_[pos_++];
+            switch (e) {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u':
+                // Keys and direction names are ASCII; keep escapes as '?'
+                if (pos_ + 4 > text_.size()) {
+                    error_ = "bad escape";
+                    return false;
+                }
+                pos_ += 4;
+                out += '?';
+                break;
+            default: out += e; break;
+            }
+        }
+        error_ = "unterminated string";
+        return false;
+    }
+
+    bool ParseValue(JsonValue& value, int depth)
+    {
+        if (depth > MAX_DEPTH) {
+            error_ = "nesting too deep";
+            return false;
+        }
+        SkipSpace();
+        if (pos_ >= text_.size()) {
+            error_ = "unexpected end of input";
+            return false;
+        }
+
+        const char c = text_[pos_];
+        if (c == '{') {
+            ++pos_;
+            value.kind = JsonValue::OBJECT;
+            if (Consume('}')) {
+                return true;
+            }
+            do {
+                std::pair<std::string, JsonValue> member;
+                if (!ParseString(member.first) || !Consume(':') || !ParseValue(member.second, depth + 1)) {
+                    return false;
+                }
+                value.members.push_back(std::move(member));
+            } while (Consume(','));
+            return Consume('}');
+        }
+        if (c == '[') {
+            ++pos_;
+            value.kind = JsonValue::ARRAY;
+            if (Consume(']')) {
+                return true;
+            }
+            do {
+                value.items.emplace_back();
+                if (!ParseValue(value.items.back(), depth + 1)) {
+                    return false;
+                }
+            } while (Consume(','));
+            return Consume(']');
+        }
+        if (c == '"') {
+            value.kind = JsonValue::STRING;
+            return ParseString(value.string);
+        }
+        if (ParseLiteral("true") || ParseLiteral("false")) {
+            value.kind = JsonValue::BOOLEAN;
+            value.number = (text_[pos_ - 4] == 't') ? 1.0 : 0.0;
+            return true;
+        }
+        if (ParseLiteral("null")) {
+            value.kind = JsonValue::NUL;
+            return true;
+        }
+
+        const char* begin = text_.c_str() + pos_;
+        char* end = nullptr;
+        value.number = std::strtod(begin, &end);
+        if (end == begin) {
+            return false;
+        }
+        value.kind = JsonValue::NUMBER;
+        pos_ += static_cast<std::size_t>(end - begin);
+        return true;
+    }
+
+    const std::string& text_;
+    std::size_t pos_ = 0;
+    std::string error_;
+};
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// StretchKeyframes
+// -----------------------------------------------------------------------------
+
+bool StretchKeyframes::Load(const std::string& path, std::string& error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = path + ": cannot open";
+        return false;
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+
+    const std::size_t dot = path.find_last_of('.');
+    const std::string ext = (dot == std::string::npos) ? std::string() : Lower(path.substr(dot + 1));
+    bool ok = false;
+    if (ext == "json") {
+        ok = ParseJson(text.str(), error);
+    } else if (ext == "csv") {
+        ok = ParseCsv(text.str(), error);
+    } else {
+        error = "expected a .csv or .json file";
+    }
+    if (!ok) {
+        error = path + ": " + error;
+    }
+    return ok;
+}
+
+bool StretchKeyframes::ParseCsv(const std::string& text, std::string& error)
+{
+    std::istringstream lines(text);
+    std::string line;
+    std::vector<int> columns;
+    int line_number = 0;
+    while (std::getline(lines, line)) {
+        ++line_number;
+        const std::string trimmed = Trim(line);
+        if (trimmed.empty() || trimmed[0] == '#') {
+            continue;
+        }
+
+        std::vector<std::string> cells;
+        std::istringstream row(trimmed);
+        std::string cell;
+        while (std::getline(row, cell, ',')) {
+            cells.push_back(cell);
+        }
+
+        const std::string where = "line " + std::to_string(line_number) + ": ";
+        if (columns.empty()) {
+            bool has_frame = false;
+            for (const std::string& name : cells) {
+                const int field = FieldForName(name);
+                if (field == -2) {
+                    error = where + "unknown column \"" + Trim(name) + "\"";
+                    return false;
+                }
+                has_frame = has_frame || field == -1;
+                columns.push_back(field);
+            }
+            if (!has_frame) {
+                error = where + "no \"frame\" column";
+                return false;
+            }
+            continue;
+        }
+
+        if (cells.size() > columns.size()) {
+            error = where + "more cells than columns";
+            return false;
+        }
+
+        // Find the frame first, then set the keys this row names. A short
+        // row must still reach the frame column
+        const std::size_t frame_column = static_cast<std::size_t>(std::find(columns.begin(), columns.end(), -1) - columns.begin());
+        if (frame_column >= cells.size()) {
+            error = where + "no frame number";
+            return false;
+        }
+        double number = 0.0;
+        int frame = 0;
+        if (!ParseNumber(cells[frame_column], number) || !ToFrame(number, frame)) {
+            error = where + "bad frame number";
+            return false;
+        }
+        for (std::size_t i = 0; i < cells.size(); ++i) {
+            if (columns[i] < 0 || Trim(cells[i]).empty()) {
+                continue;
+            }
+            double value = 0.0;
+            const bool ok = (columns[i] == DIRECTION) ? ParseDirection(cells[i], value) : ParseNumber(cells[i], value);
+            if (!ok) {
+                error = where + "bad value \"" + Trim(cells[i]) + "\"";
+                return false;
+            }
+            if (!CheckValue(static_cast<Field>(columns[i]), value, error)) {
+                error = where + error;
+                return false;
+            }
+            SetKey(static_cast<Field>(columns[i]), frame, static_cast<float>(value));
+        }
+    }
+    return true;
+}
+
+bool StretchKeyframes::ParseJson(const std::string& text, std::string& error)
+{
+    JsonValue root;
+    if (!JsonParser(text).Parse(root, error)) {
+        return false;
+    }
+    const JsonValue* keys = &root;
+    if (root.kind == JsonValue::OBJECT) {
+        keys = root.Find("keyframes");
+    }
+    if (!keys || keys->kind != JsonValue::ARRAY) {
+        error = "expected an array of keyframes";
+        return false;
+    }
+
+    for (std::size_t k = 0; k < keys->items.size(); ++k) {
+        const JsonValue& key = keys->items[k];
+        const std::string where = "keyframe " + std::to_string(k) + ": ";
+        const JsonValue* frame = (key.kind == JsonValue::OBJECT) ? key.Find("frame") : nullptr;
+        if (!frame || frame->kind != JsonValue::NUMBER) {
+            error = where + "no \"frame\" number";
+            return false;
+        }
+        int at = 0;
+        if (!ToFrame(frame->number, at)) {
+            error = where + "bad frame number";
+            return false;
+        }
+
+        for (const auto& member : key.members) {
+            const JsonValue& value = member.second;
+            if (member.first == "anchor") {
+                if (value.kind != JsonValue::ARRAY || value.items.size() != 2
+                    || value.items[0].kind != JsonValue::NUMBER || value.items[1].kind != JsonValue::NUMBER) {
+                    error = where + "\"anchor\" must be [x, y]";
+                    return false;
+                }
+                if (!CheckValue(ANCHOR_X, value.items[0].number, error) || !CheckValue(ANCHOR_Y, value.items[1].number, error)) {
+                    error = where + error;
+                    return false;
+                }
+                SetKey(ANCHOR_X, at, static_cast<float>(value.items[0].number));
+                SetKey(ANCHOR_Y, at, static_cast<float>(value.items[1].number));
+                continue;
+            }
+
+            const int field = FieldForName(member.first);
+            if (field == -1) {
+                continue;
+            }
+            if (field == -2) {
+                error = where + "unknown key \"" + member.first + "\"";
+                return false;
+            }
+
+            double number = value.number;
+            bool ok = value.kind == JsonValue::NUMBER && std::isfinite(number);
+            if (field == DIRECTION) {
+                ok = (value.kind == JsonValue::STRING) ? ParseDirection(value.string, number)
+                    : (ok && IsDirection(number));
+            }
+            if (!ok) {
+                error = where + "bad value for \"" + member.first + "\"";
+                return false;
+            }
+            if (!CheckValue(static_cast<Field>(field), number, error)) {
+                error = where + error;
+                return false;
+            }
+            SetKey(static_cast<Field>(field), at, static_cast<float>(number));
+        }
+    }
+    return true;
+}
+
+bool StretchKeyframes::CheckValue(Field field, double value, std::string& error)
+{
+    // Finite as a float too: 1e300 passes as a double but not at SetKey
+    if (!std::isfinite(value) || std::fabs(value) > FLT_MAX) {
+        error = "value is not a finite number";
+        return false;
+    }
+    if (field == SHIFT && (value < STRETCH_SHIFT_MIN || value > STRETCH_SHIFT_MAX)) {
+        error = "shift must be within 0 to 10000";
+        return false;
+    }
+    if (field == DIRECTION && !IsDirection(value)) {
+        error = "direction must be both, forward, backward or 1-3";
+        return false;
+    }
+    return true;
+}
+
+void StretchKeyframes::SetKey(Field field, int frame, float value)
+{
+    Track& track = tracks_[field];
+    auto it = std::lower_bound(track.begin(), track.end(), frame,
+        [](const std::pair<int, float>& key, int f) { return key.first < f; });
+    if (it != track.end() && it->first == frame) {
+        it->second = value;
+    } else {
+        track.insert(it, { frame, value });
+    }
+}
+
+float StretchKeyframes::Evaluate(const Track& track, int frame, bool hold, float fallback)
+{
+    if (track.empty()) {
+        return fallback;
+    }
+    auto next = std::upper_bound(track.begin(), track.end(), frame,
+        [](int f, const std::pair<int, float>& key) { return f < key.first; });
+    if (next == track.begin()) {
+        return next->second;
+    }
+    const auto prev = next - 1;
+    if (next == track.end() || hold) {
+        return prev->second;
+    }
+    const float t = static_cast<float>(frame - prev->first) / static_cast<float>(next->first - prev->first);
+    return prev->second + (next->second - prev->second) * t;
+}
+
+StretchParams StretchKeyframes::At(int frame, int input_width, int input_height) const
+{
+    StretchParams params;
+    params.anchor_x = Evaluate(tracks_[ANCHOR_X], frame, false, static_cast<float>(input_width / 2));
+    params.anchor_y = Evaluate(tracks_[ANCHOR_Y], frame, false, static_cast<float>(input_height / 2));
+    params.angle_deg = Evaluate(tracks_[ANGLE], frame, false, 0.0f);
+    params.shift_amount = Evaluate(tracks_[SHIFT], frame, false, 0.0f);
+    params.direction = static_cast<int>(Evaluate(tracks_[DIRECTION], frame, true, static_cast<float>(STRETCH_DIRECTION_BOTH)));
+    return params;
+}
+
+bool StretchKeyframes::Empty() const
+{
+    for (const Track& track : tracks_) {
+        if (!track.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
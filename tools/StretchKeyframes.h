@@ -0,0 +1,81 @@
+#pragma once
+#ifndef STRETCH_KEYFRAMES_H
+#define STRETCH_KEYFRAMES_H
+
+#include "StretchCore.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Keyframes for the command-line renderer
+// -----------------------------------------------------------------------------
+//
+// Per-frame stretch parameters, keyed like the effect's own parameters.
+// Each parameter is its own track: a row or object sets only the parameters
+// it names. Anchor, angle and shift interpolate linearly between keys and
+// hold before the first and after the last; direction holds until its next
+// key, like a hold keyframe in After Effects.
+//
+// CSV: a header row naming the columns, then one row per key. '#' starts a
+// comment line.
+//
+//   frame,anchor_x,anchor_y,angle,shift,direction
+//   0,960,540,0,0,both
+//   48,960,540,30,400,forward
+//
+// JSON: an array of objects, or an object holding one as "keyframes".
+// "anchor" may be given as [x, y] instead of anchor_x/anchor_y.
+//
+//   [{"frame": 0, "anchor": [960, 540], "shift": 0},
+//    {"frame": 48, "angle": 30, "shift": 400, "direction": "forward"}]
+//
+// Every row or object needs a frame: a whole number of at most 10^9 either
+// way. Values must be finite, and shift within the effect's slider range
+// (0 to 10000). Direction is "both", "forward", "backward" or the popup value 1-3.
+// Without anchor keys the anchor is the frame's center.
+
+class StretchKeyframes
+{
+public:
+    // Loads a .csv or .json file. On failure returns false and describes the
+    // problem (with its line) in error
+    bool Load(const std::string& path, std::string& error);
+
+    bool ParseCsv(const std::string& text, std::string& error);
+    bool ParseJson(const std::string& text, std::string& error);
+
+    // Parameters at frame for an input of the given size. Quality and
+    // downsampling are left at their defaults
+    StretchParams At(int frame, int input_width, int input_height) const;
+
+    bool Empty() const;
+
+    enum Field
+    {
+        ANCHOR_X,
+        ANCHOR_Y,
+        ANGLE,
+        SHIFT,
+        DIRECTION,
+        FIELD_COUNT
+    };
+
+    // Adds or replaces the key of one parameter at frame
+    void SetKey(Field field, int frame, float value);
+
+    // Whether value can be a key of field (see the rules above). On failure
+    // returns false and describes the problem in error
+    static bool CheckValue(Field field, double value, std::string& error);
+
+private:
+    // (frame, value), sorted by frame
+    using Track = std::vector<std::pair<int, float>>;
+
+    static float Evaluate(const Track& track, int frame, bool hold, float fallback);
+
+    Track tracks_[FIELD_COUNT];
+};
+
+#endif // STRETCH_KEYFRAMES_H
@@ -0,0 +1,686 @@
+// Headless batch renderer: runs the Stretch kernels over an image sequence
+// outside After Effects.
+//
+//   StretchRender -i plate.%04d.png -o out.%04d.png --start 1 --end 240 --keys keys.csv
+//   StretchRender -i plate.raw -o out.raw --shift 400 --angle 30 --direction forward
+//
+// Frames are pipelined: reader threads decode upcoming frames and writer
+// threads encode finished ones while the worker pool stretches the current
+// one, so I/O overlaps the render. Output matches the effect rendered in After
+// Effects at full resolution: the buffer expands like PF_OutFlag_I_EXPAND_BUFFER
+// unless --no-expand keeps the input size.
+
+#include "StretchCore.h"
+#include "StretchImageIO.h"
+#include "StretchKeyframes.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// -----------------------------------------------------------------------------
+// Command line
+// -----------------------------------------------------------------------------
+
+struct Options
+{
+    std::string input;
+    std::string output;
+    std::string keys;
+    int start = 0;
+    int end = 0;
+    bool expand = true;
+    bool quiet = false;
+    int quality = STRETCH_QUALITY_BILINEAR;
+    int io_threads = 2;
+    int queue_depth = 4;
+
+    // Frames needing more than this for output plus input render in strips
+    std::size_t strip_bytes = std::size_t(256) << 20;
+
+    // Constant parameters when there is no keyframe file
+    StretchKeyframes constant;
+};
+
+void PrintUsage()
+{
+    std::fprintf(stderr,
+        "usage: StretchRender -i INPUT -o OUTPUT [options]\n"
+        "\n"
+        "INPUT and OUTPUT are .png or .raw paths; a printf-style frame number\n"
+        "(e.g. plate.%%04d.png) makes them sequences over --start..--end.\n"
+        "\n"
+        "  --start N, --end N     frame range (inclusive, default 0..0)\n"
+        "  --keys FILE            per-frame parameters from a .csv or .json file\n"
+        "  --anchor X,Y           constant anchor point (default: frame center)\n"
+        "  --angle DEG            constant angle\n"
+        "  --shift PX             constant shift amount (0 to 10000)\n"
+        "  --direction D          both, forward or backward\n"
+        "  --quality Q            nearest, bilinear (default), bicubic or lanczos3\n"
+        "  --no-expand            keep the input size instead of expanding the buffer\n"
+        "  --io-threads N         reader and writer threads each (default 2)\n"
+        "  --queue N              frames buffered between stages (default 4)\n"
+        "  --strip-mb N           render frames needing more than N MB (output plus\n"
+        "                         input) in strips of that size (default 256)\n"
+        "  --quiet                no per-frame log\n");
+}
+
+bool ParseInt(const char* text, int& value)
+{
+    char* end = nullptr;
+    const long v = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || v < -1000000000L || v > 1000000000L) {
+        return false;
+    }
+    value = static_cast<int>(v);
+    return true;
+}
+
+// A constant parameter, held to the same rules as a keyframe value
+bool ParseConstant(const std::string& text, StretchKeyframes::Field field, double& value, std::string& error)
+{
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    if (text.empty() || end != text.c_str() + text.size()) {
+        error = "bad number \"" + text + "\"";
+        return false;
+    }
+    return StretchKeyframes::CheckValue(field, value, error);
+}
+
+bool ParseQuality(const std::string& name, int& quality)
+{
+    static const char* const NAMES[] = { "nearest", "bilinear", "bicubic", "lanczos3" };
+    for (int i = 0; i < 4; ++i) {
+        if (name == NAMES[i]) {
+            quality = STRETCH_QUALITY_NEAREST + i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Finds an output frame that is also an input frame under any path. A
+// mapped .raw input would be truncated under its reader by StretchCreateImage
+// (SIGBUS on the next read), and readers run ahead of writers, so every frame
+// of the range is compared, not just frames with the same number
+bool FindOverlappingFile(const Options& options, bool input_sequence, bool output_sequence, std::string& overlap)
+{
+    std::set<StretchFileId> inputs;
+    StretchFileId id;
+    for (int frame = options.start; frame <= options.end; ++frame) {
+        if (StretchGetFileId(StretchFramePath(options.input, frame), id)) {
+            inputs.insert(id);
+        }
+        if (!input_sequence) {
+            break;
+        }
+    }
+    for (int frame = options.start; frame <= options.end && !inputs.empty(); ++frame) {
+        const std::string path = StretchFramePath(options.output, frame);
+        if (StretchGetFileId(path, id) && inputs.count(id)) {
+            overlap = path;
+            return true;
+        }
+        if (!output_sequence) {
+            break;
+        }
+    }
+    return false;
+}
+
+bool ParseArgs(int argc, char** argv, Options& options, std::string& error)
+{
+    bool has_constant = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        const auto need_value = [&]() {
+            if (!value) {
+                error = arg + " needs a value";
+                return false;
+            }
+            ++i;
+            return true;
+        };
+
+        if (arg == "-i" || arg == "--input") {
+            if (!need_value()) return false;
+            options.input = value;
+        } else if (arg == "-o" || arg == "--output") {
+            if (!need_value()) return false;
+            options.output = value;
+        } else if (arg == "--keys") {
+            if (!need_value()) return false;
+            options.keys = value;
+        } else if (arg == "--start" || arg == "--end") {
+            if (!need_value()) return false;
+            if (!ParseInt(value, arg == "--start" ? options.start : options.end)) {
+                error = "bad frame number for " + arg;
+                return false;
+            }
+        } else if (arg == "--anchor") {
+            if (!need_value()) return false;
+            const std::string anchor = value;
+            const std::size_t comma = anchor.find(',');
+            double x = 0.0;
+            double y = 0.0;
+            if (comma == std::string::npos) {
+                error = "--anchor expects X,Y";
+                return false;
+            }
+            if (!ParseConstant(anchor.substr(0, comma), StretchKeyframes::ANCHOR_X, x, error)
+                || !ParseConstant(anchor.substr(comma + 1), StretchKeyframes::ANCHOR_Y, y, error)) {
+                error = "--anchor: " + error;
+                return false;
+            }
+            options.constant.SetKey(StretchKeyframes::ANCHOR_X, 0, static_cast<float>(x));
+            options.constant.SetKey(StretchKeyframes::ANCHOR_Y, 0, static_cast<float>(y));
+            has_constant = true;
+        } else if (arg == "--angle" || arg == "--shift") {
+            if (!need_value()) return false;
+            const StretchKeyframes::Field field = (arg == "--angle") ? StretchKeyframes::ANGLE : StretchKeyframes::SHIFT;
+            double v = 0.0;
+            if (!ParseConstant(value, field, v, error)) {
+                error = arg + ": " + error;
+                return false;
+            }
+            options.constant.SetKey(field, 0, static_cast<float>(v));
+            has_constant = true;
+        } else if (arg == "--direction") {
+            if (!need_value()) return false;
+            if (!options.constant.ParseCsv(std::string("frame,direction\n0,") + value + "\n", error)) {
+                error = "--direction expects both, forward or backward";
+                return false;
+            }
+            has_constant = true;
+        } else if (arg == "--quality") {
+            if (!need_value()) return false;
+            if (!ParseQuality(value, options.quality)) {
+                error = "--quality expects nearest, bilinear, bicubic or lanczos3";
+                return false;
+            }
+        } else if (arg == "--io-threads" || arg == "--queue") {
+            if (!need_value()) return false;
+            int& target = (arg == "--queue") ? options.queue_depth : options.io_threads;
+            if (!ParseInt(value, target) || target < 1 || target > 64) {
+                error = "bad count for " + arg;
+                return false;
+            }
+        } else if (arg == "--strip-mb") {
+            if (!need_value()) return false;
+            int mb = 0;
+            if (!ParseInt(value, mb) || mb < 1 || mb > (1 << 20)) {
+                error = "bad size for --strip-mb";
+                return false;
+            }
+            options.strip_bytes = static_cast<std::size_t>(mb) << 20;
+        } else if (arg == "--no-expand") {
+            options.expand = false;
+        } else if (arg == "--quiet") {
+            options.quiet = true;
+        } else {
+            error = "unknown option " + arg;
+            return false;
+        }
+    }
+
+    if (options.input.empty() || options.output.empty()) {
+        error = "-i and -o are required";
+        return false;
+    }
+    if (!options.keys.empty() && has_constant) {
+        error = "--keys cannot be combined with constant parameters";
+        return false;
+    }
+    bool input_sequence = false;
+    bool output_sequence = false;
+    if (!StretchIsValidPathPattern(options.input, input_sequence) || !StretchIsValidPathPattern(options.output, output_sequence)) {
+        error = "paths may hold one %d frame number (e.g. %04d); write %% for a percent sign";
+        return false;
+    }
+    for (const std::string* path : { &options.input, &options.output }) {
+        const StretchImageFormat format = StretchImageFormatForPath(*path);
+        if (format == STRETCH_IMAGE_UNKNOWN || (format == STRETCH_IMAGE_PNG && !StretchHasPng())) {
+            error = *path + ": unsupported format" + (StretchHasPng() ? " (use .png or .raw)" : " (built without libpng; use .raw)");
+            return false;
+        }
+    }
+    if (options.end < options.start) {
+        error = "--end is before --start";
+        return false;
+    }
+    if (options.end > options.start && !output_sequence) {
+        error = "a frame range needs a %d frame number in the output path";
+        return false;
+    }
+    std::string overlap;
+    if (FindOverlappingFile(options, input_sequence, output_sequence, overlap)) {
+        error = overlap + ": output would overwrite an input frame";
+        return false;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Pipeline
+// -----------------------------------------------------------------------------
+
+struct Frame
+{
+    int number = 0;
+    StretchImage image;
+
+    // Rendered in this many strips straight into its file, with nothing left
+    // for the writers; image may then hold just the frame size
+    int strips = 0;
+};
+
+using FramePtr = std::unique_ptr<Frame>;
+
+// Bounded multi-producer/multi-consumer queue. Pop returns false once the
+// queue is closed and drained
+class FrameQueue
+{
+public:
+    explicit FrameQueue(std::size_t capacity) : capacity_(capacity) {}
+
+    bool Push(FramePtr frame)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this]() { return closed_ || frames_.size() < capacity_; });
+        if (closed_) {
+            return false;
+        }
+        frames_.push_back(std::move(frame));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    bool Pop(FramePtr& frame)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this]() { return closed_ || !frames_.empty(); });
+        if (frames_.empty()) {
+            return false;
+        }
+        frame = std::move(frames_.front());
+        frames_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    // Wakes every waiter; pending frames can still be popped
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+private:
+    const std::size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<FramePtr> frames_;
+    bool closed_ = false;
+};
+
+// First error wins; later stages stop early once one is set
+class ErrorState
+{
+public:
+    void Set(const std::string& message)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!failed_.exchange(true)) {
+            message_ = message;
+        }
+    }
+
+    bool Failed() const { return failed_.load(std::memory_order_relaxed); }
+
+    std::string Message() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return message_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::atomic<bool> failed_{false};
+    std::string message_;
+};
+
+template <typename Pixel>
+StretchRenderContext<Pixel> MakeContext(const StretchGeometry& geometry, const StretchExpansion& expansion,
+                                        const StretchImage& input, StretchImage& output)
+{
+    return StretchMakeContext<Pixel>(geometry,
+        input.data, input.rowbytes, input.width, input.height,
+        output.data, output.rowbytes, output.width, output.height,
+        static_cast<float>(expansion.left), static_cast<float>(expansion.top));
+}
+
+// Host options for frame number (STRETCH_PROFILE lines carry it)
+StretchRenderOptions FrameOptions(int number)
+{
+    StretchRenderOptions options = StretchGetDefaultRenderOptions();
+    options.profile_frame = number;
+    return options;
+}
+
+template <typename Pixel>
+bool StretchImageFrame(const StretchGeometry& geometry, const StretchExpansion& expansion,
+                       const StretchImage& input, StretchImage& output, int number)
+{
+    return StretchRenderFrame(MakeContext<Pixel>(geometry, expansion, input, output), geometry.direction,
+                              FrameOptions(number));
+}
+
+template <typename Pixel>
+bool StretchImageStrips(const StretchGeometry& geometry, const StretchExpansion& expansion, const StretchImage& input,
+                        StretchImage& output, const std::vector<StretchStrip>& strips, const StretchStripSink& sink,
+                        int number)
+{
+    return StretchRenderStrips(MakeContext<Pixel>(geometry, expansion, input, output), geometry.direction, strips, sink,
+                               FrameOptions(number));
+}
+
+// Renders a frame too large for the strip budget strip by strip. A mapped
+// .raw output takes the strips in place; other outputs get them through a
+// StretchImageWriter from one strip-sized buffer. Rows of a mapped input or
+// output leave memory once no later strip needs them
+bool RenderStrips(const std::string& path, const StretchGeometry& geometry, const StretchExpansion& expansion,
+                  const StretchImage& input, int width, int height, const std::vector<StretchStrip>& strips,
+                  Frame& out, std::string& error)
+{
+    const bool in_place = StretchHasFileMapping() && StretchImageFormatForPath(path) == STRETCH_IMAGE_RAW;
+    StretchImageWriter writer;
+    StretchImage buffer;
+    if (in_place) {
+        if (!StretchCreateImage(path, width, height, input.depth, out.image, error)) {
+            return false;
+        }
+    } else {
+        int rows = 0;
+        for (const StretchStrip& strip : strips) {
+            rows = std::max(rows, strip.end_y - strip.start_y);
+        }
+        if (!writer.Open(path, width, height, input.depth, error)) {
+            return false;
+        }
+        if (!buffer.Allocate(width, rows, input.depth)) {
+            error = path + ": out of memory for a strip";
+            return false;
+        }
+        out.image.width = width;
+        out.image.height = height;
+        out.image.depth = input.depth;
+    }
+
+    // Rows [y0, y1) of a mapped image
+    const auto release_rows = [](const StretchImage& image, int y0, int y1) {
+        if (image.mapping && y0 < y1) {
+            image.mapping->Release(static_cast<std::size_t>(image.data - image.mapping->Data())
+                + static_cast<std::size_t>(y0) * static_cast<std::size_t>(image.rowbytes),
+                static_cast<std::size_t>(y1 - y0) * static_cast<std::size_t>(image.rowbytes));
+        }
+    };
+
+    std::size_t next = 0;
+    StretchStripSink sink;
+    sink.begin = [&](const StretchStrip& strip, void*& data, std::ptrdiff_t& rowbytes) {
+        if (input.mapping && !strip.input_rect.IsEmpty()) {
+            input.mapping->Prefetch(static_cast<std::size_t>(input.Row(strip.input_rect.top) - input.mapping->Data()),
+                static_cast<std::size_t>(strip.input_rect.bottom - strip.input_rect.top) * static_cast<std::size_t>(input.rowbytes));
+        }
+        StretchImage& target = in_place ? out.image : buffer;
+        data = in_place ? target.Row(strip.start_y) : target.data;
+        rowbytes = target.rowbytes;
+        return true;
+    };
+    sink.end = [&](const StretchStrip& strip) {
+        ++next;
+        if (in_place) {
+            release_rows(out.image, strip.start_y, strip.end_y);
+        } else if (!writer.WriteRows(buffer.data, buffer.rowbytes, strip.end_y - strip.start_y, error)) {
+            return false;
+        }
+        if (next < strips.size()) {
+            const StretchRect& window = strips[next].input_rect;
+            release_rows(input, 0, window.IsEmpty() ? input.height : window.top);
+            release_rows(input, window.IsEmpty() ? input.height : window.bottom, input.height);
+        }
+        return true;
+    };
+
+    bool ok = false;
+    switch (input.depth) {
+    case 8:
+        ok = StretchImageStrips<StretchPixel8>(geometry, expansion, input, out.image, strips, sink, out.number);
+        break;
+    case 16:
+        ok = StretchImageStrips<StretchPixel16>(geometry, expansion, input, out.image, strips, sink, out.number);
+        break;
+    default:
+        ok = StretchImageStrips<StretchPixelF>(geometry, expansion, input, out.image, strips, sink, out.number);
+        break;
+    }
+    if (!ok) {
+        if (error.empty()) {
+            error = path + ": render failed";
+        }
+        return false;
+    }
+    out.strips = static_cast<int>(strips.size());
+    return in_place || writer.Close(error);
+}
+
+// Renders one frame into a new image of the input's depth
+bool RenderFrame(const Options& options, const StretchKeyframes& keys, const Frame& in, Frame& out, std::string& error)
+{
+    const StretchImage& input = in.image;
+    StretchParams params = keys.At(in.number, input.width, input.height);
+    params.quality = options.quality;
+    const StretchGeometry geometry = StretchComputeGeometry(params);
+
+    StretchExpansion expansion;
+    if (options.expand && geometry.active) {
+        expansion = StretchComputeExpansion(geometry, input.width, input.height);
+    }
+    const std::string path = StretchFramePath(options.output, in.number);
+    const int width = input.width + expansion.left + expansion.right;
+    const int height = input.height + expansion.top + expansion.bottom;
+    out.number = in.number;
+
+    // Frames over the budget stream out in strips
+    if (geometry.active) {
+        const int pixel_bytes = input.PixelBytes();
+        const std::vector<StretchStrip> strips = StretchPlanStrips(geometry, input.width, input.height, width, height,
+            static_cast<float>(expansion.left), static_cast<float>(expansion.top), pixel_bytes, pixel_bytes,
+            options.strip_bytes);
+        if (strips.size() > 1) {
+            return RenderStrips(path, geometry, expansion, input, width, height, strips, out, error);
+        }
+    }
+
+    // .raw outputs are mapped files, rendered in place
+    if (!StretchCreateImage(path, width, height, input.depth, out.image, error)) {
+        return false;
+    }
+
+    // Nothing to stretch: the input passes through (placed at the expansion
+    // origin, which is 0 for an inactive geometry)
+    if (!geometry.active) {
+        for (int y = 0; y < input.height; ++y) {
+            std::memcpy(out.image.Row(y), input.Row(y), static_cast<std::size_t>(input.width) * input.PixelBytes());
+        }
+        return true;
+    }
+
+    bool ok = false;
+    switch (input.depth) {
+    case 8:
+        ok = StretchImageFrame<StretchPixel8>(geometry, expansion, input, out.image, in.number);
+        break;
+    case 16:
+        ok = StretchImageFrame<StretchPixel16>(geometry, expansion, input, out.image, in.number);
+        break;
+    default:
+        ok = StretchImageFrame<StretchPixelF>(geometry, expansion, input, out.image, in.number);
+        break;
+    }
+    if (!ok) {
+        error = "frame " + std::to_string(in.number) + ": render failed";
+    }
+    return ok;
+}
+
+double Milliseconds(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+int Run(const Options& options, const StretchKeyframes& keys)
+{
+    const auto start_time = std::chrono::steady_clock::now();
+
+    FrameQueue decoded(static_cast<std::size_t>(options.queue_depth));
+    FrameQueue rendered(static_cast<std::size_t>(options.queue_depth));
+    ErrorState errors;
+    std::atomic<int> next_frame{options.start};
+    std::atomic<int> readers_left{options.io_threads};
+    std::mutex log_mutex;
+
+    // Decode: readers take frame numbers in order; the queue bounds how far
+    // they run ahead of the render
+    std::vector<std::thread> readers;
+    for (int t = 0; t < options.io_threads; ++t) {
+        readers.emplace_back([&]() {
+            for (;;) {
+                const int number = next_frame.fetch_add(1);
+                if (number > options.end || errors.Failed()) {
+                    break;
+                }
+                FramePtr frame(new Frame());
+                frame->number = number;
+                std::string error;
+                if (!StretchReadImage(StretchFramePath(options.input, number), frame->image, error)) {
+                    errors.Set(error);
+                    break;
+                }
+                if (!decoded.Push(std::move(frame))) {
+                    break;
+                }
+            }
+            if (readers_left.fetch_sub(1) == 1) {
+                decoded.Close();
+            }
+        });
+    }
+
+    // Encode: each finished frame goes to its own file, so order is free.
+    // Frames written in place only need unmapping, which hands their dirty
+    // pages to the kernel's writeback
+    std::vector<std::thread> writers;
+    for (int t = 0; t < options.io_threads; ++t) {
+        writers.emplace_back([&]() {
+            FramePtr frame;
+            while (rendered.Pop(frame)) {
+                std::string error;
+                if (!errors.Failed() && frame->strips == 0 && !frame->image.WrittenInPlace()
+                    && !StretchWriteImage(StretchFramePath(options.output, frame->number), frame->image, error)) {
+                    errors.Set(error);
+                }
+                frame.reset();
+            }
+        });
+    }
+
+    // Stretch on this thread; the kernels spread each frame over the pool
+    int frames = 0;
+    FramePtr input;
+    while (!errors.Failed() && decoded.Pop(input)) {
+        const auto frame_start = std::chrono::steady_clock::now();
+        FramePtr output(new Frame());
+        std::string error;
+        if (!RenderFrame(options, keys, *input, *output, error)) {
+            errors.Set(error);
+            break;
+        }
+        if (!options.quiet) {
+            std::lock_guard<std::mutex> lock(log_mutex);
+            std::fprintf(stderr, "frame %d: %dx%d -> %dx%d%s, %.1f ms\n", input->number,
+                         input->image.width, input->image.height, output->image.width, output->image.height,
+                         output->strips > 0 ? (" in " + std::to_string(output->strips) + " strips").c_str() : "",
+                         Milliseconds(frame_start));
+        }
+        input.reset();
+        ++frames;
+        if (!rendered.Push(std::move(output))) {
+            break;
+        }
+    }
+
+    // Unblock readers waiting on a full queue after an error
+    decoded.Close();
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    rendered.Close();
+    for (std::thread& writer : writers) {
+        writer.join();
+    }
+
+    if (errors.Failed()) {
+        std::fprintf(stderr, "StretchRender: %s\n", errors.Message().c_str());
+        return 1;
+    }
+    const double total_ms = Milliseconds(start_time);
+    std::fprintf(stderr, "%d frame%s in %.2f s (%.2f fps)\n", frames, frames == 1 ? "" : "s",
+                 total_ms / 1000.0, total_ms > 0.0 ? 1000.0 * frames / total_ms : 0.0);
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    std::string error;
+    if (argc < 2 || !ParseArgs(argc, argv, options, error)) {
+        if (!error.empty()) {
+            std::fprintf(stderr, "StretchRender: %s\n\n", error.c_str());
+        }
+        PrintUsage();
+        return 2;
+    }
+
+    StretchKeyframes keys;
+    if (!options.keys.empty()) {
+        if (!keys.Load(options.keys, error)) {
+            std::fprintf(stderr, "StretchRender: %s\n", error.c_str());
+            return 2;
+        }
+    } else {
+        keys = options.constant;
+    }
+
+    return Run(options, keys);
+}